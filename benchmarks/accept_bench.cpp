@@ -0,0 +1,177 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Accept-to-banner benchmark
+ *
+ * Runs an in-process server with TLS configured and opens connections to
+ * it one after another, timing connect() until the 220 banner arrives.
+ * Also times building the per-session services (user directory, PAM and
+ * the TLS context, which loads the certificate and key from disk) that
+ * each connection used to construct before its banner; the server now
+ * builds them once.
+ */
+
+#include "simple-sftpd/core/connection.hpp"
+#include "simple-sftpd/core/server.hpp"
+#include "simple-sftpd/config/server_config.hpp"
+#include "simple-sftpd/utils/logger.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+#include <openssl/ec.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#endif
+
+using namespace simple_sftpd;
+
+namespace {
+
+const char* const CERT_PATH = "/tmp/simple-sftpd-accept-bench.crt";
+const char* const KEY_PATH = "/tmp/simple-sftpd-accept-bench.key";
+const int PORT = 22990;
+
+bool writeCertificate() {
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    bool generated = key_ctx && EVP_PKEY_keygen_init(key_ctx) > 0 &&
+                     EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1) > 0 &&
+                     EVP_PKEY_keygen(key_ctx, &key) > 0;
+    EVP_PKEY_CTX_free(key_ctx);
+    if (!generated) {
+        return false;
+    }
+
+    X509* cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>("localhost"), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    bool written = X509_sign(cert, key, EVP_sha256()) > 0;
+
+    FILE* cert_file = std::fopen(CERT_PATH, "w");
+    FILE* key_file = std::fopen(KEY_PATH, "w");
+    written = written && cert_file && key_file && PEM_write_X509(cert_file, cert) &&
+              PEM_write_PrivateKey(key_file, key, nullptr, nullptr, 0, nullptr, nullptr);
+    if (cert_file) std::fclose(cert_file);
+    if (key_file) std::fclose(key_file);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return written;
+#else
+    return false;
+#endif
+}
+
+// connect() and read up to the end of the banner line
+bool fetchBanner() {
+    int client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (client < 0 || connect(client, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        if (client >= 0) {
+            close(client);
+        }
+        return false;
+    }
+
+    std::string banner;
+    char buffer[256];
+    while (banner.find("\r\n") == std::string::npos) {
+        ssize_t received = recv(client, buffer, sizeof(buffer), 0);
+        if (received <= 0) {
+            break;
+        }
+        banner.append(buffer, received);
+    }
+    // RST instead of FIN, so the run does not fill the port range with TIME_WAIT
+    struct linger hard_close = {1, 0};
+    setsockopt(client, SOL_SOCKET, SO_LINGER, &hard_close, sizeof(hard_close));
+    close(client);
+    return banner.compare(0, 3, "220") == 0;
+}
+
+void benchEngine(const std::shared_ptr<FTPServerConfig>& base, const char* engine, int connections) {
+    auto config = std::make_shared<FTPServerConfig>(*base);
+    config->connection.engine = engine;
+    FTPServer server(config);
+    if (!server.start()) {
+        std::printf("%-10s %12s\n", engine, "failed");
+        return;
+    }
+
+    int greeted = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < connections; ++i) {
+        greeted += fetchBanner() ? 1 : 0;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    server.stop();
+    std::printf("%-10s %12d %12.1f %10.0f\n", engine, greeted, seconds * 1e6 / connections, greeted / seconds);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int connections = argc > 1 ? std::atoi(argv[1]) : 2000;
+
+    auto config = std::make_shared<FTPServerConfig>();
+    config->connection.bind_address = "127.0.0.1";
+    config->connection.bind_port = PORT;
+    config->connection.max_connections = connections + 16;
+    config->logging.log_level = "ERROR";
+    config->rate_limit.enabled = false;
+    bool tls = writeCertificate();
+    if (tls) {
+        config->security.ssl_cert_file = CERT_PATH;
+        config->security.ssl_key_file = KEY_PATH;
+    }
+    std::printf("TLS configured: %s\n", tls ? "yes" : "no");
+
+    // What every connection used to pay before its banner
+    auto logger = std::make_shared<Logger>("", LogLevel::ERROR, false, false, LogFormat::STANDARD);
+    const int builds = 200;
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < builds; ++i) {
+        SessionServices::create(*config, logger);
+    }
+    double build_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / builds;
+    std::printf("per-session services build: %.1f us (now once per start/reload)\n\n", build_us);
+
+    std::printf("%-10s %12s %12s %10s\n", "engine", "banners", "us/conn", "conn/s");
+    benchEngine(config, "threads", connections);
+    benchEngine(config, "reactor", connections);
+
+    unlink(CERT_PATH);
+    unlink(KEY_PATH);
+    return 0;
+}
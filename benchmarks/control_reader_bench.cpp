@@ -0,0 +1,156 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Control-channel reader benchmark
+ *
+ * Feeds a typical login/download command mix through a socketpair and
+ * reads it back with the old byte-at-a-time loop and with LineBuffer,
+ * reporting recv() calls and wall time per command. "lockstep" writes one
+ * command at a time (interactive client), "pipelined" writes batches of 32.
+ */
+
+#include "simple-sftpd/core/line_buffer.hpp"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace simple_sftpd;
+
+namespace {
+
+const char* const COMMANDS[] = {
+    "USER anonymous\r\n",
+    "PASS guest@example.com\r\n",
+    "CWD /pub/releases\r\n",
+    "TYPE I\r\n",
+    "PASV\r\n",
+    "RETR simple-sftpd-0.1.0.tar.gz\r\n",
+    "NOOP\r\n",
+};
+const size_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+struct Counters {
+    size_t recv_calls = 0;
+    size_t lines = 0;
+};
+
+// The pre-LineBuffer FTPConnection::readLine(): one recv() per byte
+bool readLineBytewise(int fd, std::string& line, Counters& counters) {
+    line.clear();
+    char c;
+    while (true) {
+        ssize_t received = recv(fd, &c, 1, 0);
+        ++counters.recv_calls;
+        if (received <= 0) {
+            return false;
+        }
+        if (c == '\n') {
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            return true;
+        }
+        line += c;
+        if (line.length() > 1024) {
+            return true;
+        }
+    }
+}
+
+bool readLineBuffered(int fd, LineBuffer& buffer, std::string& line, Counters& counters) {
+    while (true) {
+        std::string_view view;
+        LineBuffer::Status status = buffer.nextLine(view);
+        if (status == LineBuffer::Status::LINE) {
+            line.assign(view.data(), view.length());
+            return true;
+        }
+        if (status == LineBuffer::Status::TOO_LONG) {
+            continue;
+        }
+        char* space = buffer.prepare(4096);
+        ssize_t received = recv(fd, space, 4096, 0);
+        ++counters.recv_calls;
+        if (received <= 0) {
+            return false;
+        }
+        buffer.commit(received);
+    }
+}
+
+template <typename Reader>
+void run(const char* name, const char* mode, size_t batch, size_t total, Reader reader) {
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+        std::perror("socketpair");
+        return;
+    }
+
+    Counters counters;
+    std::string line;
+    auto start = std::chrono::steady_clock::now();
+
+    for (size_t sent = 0; sent < total; sent += batch) {
+        std::string chunk;
+        for (size_t i = 0; i < batch; ++i) {
+            chunk += COMMANDS[(sent + i) % COMMAND_COUNT];
+        }
+        if (write(fds[1], chunk.data(), chunk.size()) != static_cast<ssize_t>(chunk.size())) {
+            std::perror("write");
+            break;
+        }
+        for (size_t i = 0; i < batch; ++i) {
+            if (!reader(fds[0], line, counters)) {
+                break;
+            }
+            ++counters.lines;
+        }
+    }
+
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    close(fds[0]);
+    close(fds[1]);
+
+    std::printf("%-10s %-10s %10zu %14.2f %12.0f\n", name, mode, counters.lines,
+                static_cast<double>(counters.recv_calls) / counters.lines,
+                static_cast<double>(elapsed) / counters.lines);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t total = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 200000;
+    total -= total % 32;
+
+    std::printf("%-10s %-10s %10s %14s %12s\n", "reader", "mode", "commands", "recv/command", "ns/command");
+    for (size_t batch : {static_cast<size_t>(1), static_cast<size_t>(32)}) {
+        const char* mode = batch == 1 ? "lockstep" : "pipelined";
+        run("bytewise", mode, batch, total, [](int fd, std::string& line, Counters& counters) {
+            return readLineBytewise(fd, line, counters);
+        });
+        LineBuffer buffer;
+        run("buffered", mode, batch, total, [&buffer](int fd, std::string& line, Counters& counters) {
+            return readLineBuffered(fd, buffer, line, counters);
+        });
+    }
+    return 0;
+}
@@ -0,0 +1,228 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Session footprint benchmark
+ *
+ * Runs an in-process reactor server and reports two costs of a session:
+ * heap allocations per command, counted by replacing global operator new,
+ * over a logged-in command mix; and resident memory and allocations per
+ * idle session, from the growth while a batch of logged-in sessions is
+ * held open.
+ * Client-side work uses fixed buffers, so the counts are the server's.
+ */
+
+#include "simple-sftpd/core/connection.hpp"
+#include "simple-sftpd/core/server.hpp"
+#include "simple-sftpd/config/server_config.hpp"
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <thread>
+#include <vector>
+
+namespace {
+
+std::atomic<uint64_t> g_allocations(0);
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* block = std::malloc(size ? size : 1)) {
+        return block;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* block) noexcept {
+    std::free(block);
+}
+
+void operator delete(void* block, std::size_t) noexcept {
+    std::free(block);
+}
+
+using namespace simple_sftpd;
+
+namespace {
+
+const int PORT = 22991;
+
+const char* const COMMANDS[] = {
+    "NOOP\r\n",
+    "PWD\r\n",
+    "TYPE I\r\n",
+    "SIZE simple-sftpd-session-bench.txt\r\n",  // the test user's home is /tmp
+    "CWD /\r\n",
+    "TYPE A\r\n",
+    "FEAT\r\n",
+};
+const size_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+
+int connectClient() {
+    int client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (client >= 0 && connect(client, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        close(client);
+        return -1;
+    }
+    return client;
+}
+
+// Read until a line starting with the given three-digit code and a space
+bool expectReply(int client, const char* code) {
+    char buffer[4096];
+    size_t length = 0;
+    while (length < sizeof(buffer) - 1) {
+        ssize_t received = recv(client, buffer + length, sizeof(buffer) - 1 - length, 0);
+        if (received <= 0) {
+            return false;
+        }
+        length += received;
+        buffer[length] = '\0';
+        for (char* line = buffer; line && *line; ) {
+            if (std::strncmp(line, code, 3) == 0 && line[3] == ' ' && std::strstr(line, "\r\n")) {
+                return true;
+            }
+            char* next = std::strstr(line, "\r\n");
+            line = next ? next + 2 : nullptr;
+        }
+    }
+    return false;
+}
+
+bool command(int client, const char* line, const char* code) {
+    return send(client, line, std::strlen(line), MSG_NOSIGNAL) == static_cast<ssize_t>(std::strlen(line)) &&
+           expectReply(client, code);
+}
+
+int loggedInClient() {
+    int client = connectClient();
+    if (client < 0 || !expectReply(client, "220") || !command(client, "USER test\r\n", "331") ||
+        !command(client, "PASS test\r\n", "230")) {
+        if (client >= 0) {
+            close(client);
+        }
+        return -1;
+    }
+    return client;
+}
+
+long residentKilobytes() {
+    std::ifstream statm("/proc/self/statm");
+    long pages = 0;
+    long resident = 0;
+    statm >> pages >> resident;
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+const char* replyCode(const char* line) {
+    if (std::strncmp(line, "SIZE", 4) == 0) return "213";
+    if (std::strncmp(line, "PWD", 3) == 0) return "257";
+    if (std::strncmp(line, "CWD", 3) == 0) return "250";
+    if (std::strncmp(line, "FEAT", 4) == 0) return "211";
+    return "200";
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    int rounds = argc > 1 ? std::atoi(argv[1]) : 2000;
+    int sessions = argc > 2 ? std::atoi(argv[2]) : 1000;
+
+    struct rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+    std::ofstream("/tmp/simple-sftpd-session-bench.txt") << "benchmark\n";
+
+    auto config = std::make_shared<FTPServerConfig>();
+    config->connection.engine = "reactor";
+    config->connection.bind_address = "127.0.0.1";
+    config->connection.bind_port = PORT;
+    config->connection.max_connections = sessions + 16;
+    config->logging.log_level = "ERROR";
+    config->rate_limit.enabled = false;
+    FTPServer server(config);
+    if (!server.start()) {
+        std::fprintf(stderr, "server failed to start\n");
+        return 1;
+    }
+
+    int client = loggedInClient();
+    if (client < 0) {
+        std::fprintf(stderr, "login failed\n");
+        return 1;
+    }
+    for (size_t i = 0; i < COMMAND_COUNT; ++i) {
+        command(client, COMMANDS[i], replyCode(COMMANDS[i]));  // warm up
+    }
+    uint64_t before = g_allocations.load();
+    auto start = std::chrono::steady_clock::now();
+    for (int round = 0; round < rounds; ++round) {
+        for (size_t i = 0; i < COMMAND_COUNT; ++i) {
+            if (!command(client, COMMANDS[i], replyCode(COMMANDS[i]))) {
+                std::fprintf(stderr, "%s failed\n", COMMANDS[i]);
+                return 1;
+            }
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    uint64_t commands = static_cast<uint64_t>(rounds) * COMMAND_COUNT;
+    std::printf("commands: %llu, allocations/command: %.2f, us/command: %.1f\n",
+                static_cast<unsigned long long>(commands),
+                static_cast<double>(g_allocations.load() - before) / commands, seconds * 1e6 / commands);
+    close(client);
+
+    std::vector<int> clients;
+    long rss_before = residentKilobytes();
+    uint64_t allocations_before = g_allocations.load();
+    for (int i = 0; i < sessions; ++i) {
+        int session = loggedInClient();
+        if (session < 0) {
+            break;
+        }
+        clients.push_back(session);
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    std::printf("sizeof(FTPConnection): %zu, sessions: %zu, resident KiB/session: %.1f, allocations/session: %.1f\n",
+                sizeof(FTPConnection), clients.size(),
+                static_cast<double>(residentKilobytes() - rss_before) / clients.size(),
+                static_cast<double>(g_allocations.load() - allocations_before) / clients.size());
+    for (int session : clients) {
+        close(session);
+    }
+
+    server.stop();
+    unlink("/tmp/simple-sftpd-session-bench.txt");
+    return 0;
+}
@@ -0,0 +1,174 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Data transfer engine benchmark
+ *
+ * Moves a scratch file over a loopback TCP connection with each
+ * DataTransfer path: "send" is a RETR (file -> socket, a thread drains
+ * the peer), "receive" is a STOR (a thread feeds the peer, socket -> file).
+ * Reports throughput per engine; the file stays in the page cache, so
+ * this measures copy and syscall overhead rather than the disk.
+ */
+
+#include "simple-sftpd/core/data_transfer.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace simple_sftpd;
+
+namespace {
+
+const char* const SCRATCH_PATH = "/tmp/simple-sftpd-transfer-bench.bin";
+
+// Returns {server side, client side} of a loopback TCP connection
+bool connectedPair(int& server_fd, int& client_fd) {
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(addr);
+    if (listener < 0 || bind(listener, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        listen(listener, 1) != 0 || getsockname(listener, reinterpret_cast<struct sockaddr*>(&addr), &length) != 0) {
+        std::perror("listen");
+        return false;
+    }
+
+    client_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(client_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) != 0) {
+        std::perror("connect");
+        close(listener);
+        return false;
+    }
+    server_fd = accept(listener, nullptr, nullptr);
+    close(listener);
+    return server_fd >= 0;
+}
+
+void report(const char* direction, const char* engine, const TransferResult& result, double seconds) {
+    if (result.status != TransferStatus::COMPLETE) {
+        std::printf("%-8s %-10s %12s\n", direction, engine,
+                    result.status == TransferStatus::UNSUPPORTED ? "unsupported" : "failed");
+        return;
+    }
+    std::printf("%-8s %-10s %12llu %10.1f\n", direction, engine,
+                static_cast<unsigned long long>(result.bytes), result.bytes / seconds / (1024 * 1024));
+}
+
+void benchSend(const char* engine,
+               const std::function<TransferResult(int, const std::string&, uint64_t, TransferThrottle&)>& send_file) {
+    int server_fd, client_fd;
+    if (!connectedPair(server_fd, client_fd)) {
+        return;
+    }
+
+    std::thread drain([client_fd] {
+        std::vector<char> buffer(256 * 1024);
+        while (recv(client_fd, buffer.data(), buffer.size(), 0) > 0) {
+        }
+    });
+
+    TransferThrottle throttle(0);
+    auto start = std::chrono::steady_clock::now();
+    TransferResult result = send_file(server_fd, SCRATCH_PATH, 0, throttle);
+    shutdown(server_fd, SHUT_WR);
+    drain.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    close(server_fd);
+    close(client_fd);
+    report("send", engine, result, seconds);
+}
+
+void benchReceive(const char* engine, size_t file_size,
+                  const std::function<TransferResult(int, int, uint64_t, TransferThrottle&)>& receive_file) {
+    int server_fd, client_fd;
+    if (!connectedPair(server_fd, client_fd)) {
+        return;
+    }
+    std::string target = std::string(SCRATCH_PATH) + ".recv";
+    int file_fd = open(target.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+    std::thread feed([client_fd, file_size] {
+        std::vector<char> buffer(256 * 1024, 'x');
+        size_t remaining = file_size;
+        while (remaining > 0) {
+            ssize_t sent = send(client_fd, buffer.data(), std::min(buffer.size(), remaining), 0);
+            if (sent <= 0) {
+                break;
+            }
+            remaining -= sent;
+        }
+        shutdown(client_fd, SHUT_WR);
+    });
+
+    TransferThrottle throttle(0);
+    auto start = std::chrono::steady_clock::now();
+    TransferResult result = receive_file(server_fd, file_fd, 0, throttle);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    feed.join();
+    close(file_fd);
+    unlink(target.c_str());
+    close(server_fd);
+    close(client_fd);
+    report("receive", engine, result, seconds);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    size_t megabytes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 256;
+    size_t file_size = megabytes * 1024 * 1024;
+
+    {
+        int fd = open(SCRATCH_PATH, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        std::vector<char> block(1024 * 1024, 'a');
+        for (size_t i = 0; i < megabytes && fd >= 0; ++i) {
+            if (write(fd, block.data(), block.size()) != static_cast<ssize_t>(block.size())) {
+                std::perror("write");
+                break;
+            }
+        }
+        if (fd < 0) {
+            std::perror("open");
+            return 1;
+        }
+        close(fd);
+    }
+
+    std::printf("io_uring available: %s\n", DataTransfer::isUringAvailable() ? "yes" : "no");
+    std::printf("%-8s %-10s %12s %10s\n", "path", "engine", "bytes", "MB/s");
+    benchSend("buffered", DataTransfer::sendFileBuffered);
+    benchSend("sendfile", DataTransfer::sendFileZeroCopy);
+    benchSend("io_uring", DataTransfer::sendFileUring);
+    benchReceive("buffered", file_size, DataTransfer::receiveFileBuffered);
+    benchReceive("splice", file_size, DataTransfer::receiveFileZeroCopy);
+    benchReceive("io_uring", file_size, DataTransfer::receiveFileUring);
+
+    unlink(SCRATCH_PATH);
+    return 0;
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace simple_sftpd {
+
+class FTPServerConfig;
+
+/**
+ * @brief Publishes immutable configuration snapshots
+ *
+ * A reload parses a complete new FTPServerConfig and swaps it in; a
+ * published snapshot is never modified, so readers take no lock. Sessions
+ * keep the snapshot they have and compare version() between commands, so
+ * the shared pointer is only re-read after a reload, and a transfer runs
+ * to the end on the snapshot it started with.
+ */
+class ConfigStore {
+public:
+    explicit ConfigStore(std::shared_ptr<const FTPServerConfig> initial);
+
+    ConfigStore(const ConfigStore&) = delete;
+    ConfigStore& operator=(const ConfigStore&) = delete;
+
+    std::shared_ptr<const FTPServerConfig> current() const;
+
+    /**
+     * @brief Bumped by every publish(); cheap to poll
+     */
+    uint64_t version() const { return version_.load(std::memory_order_acquire); }
+
+    void publish(std::shared_ptr<const FTPServerConfig> next);
+
+    /**
+     * @brief Parse and validate a configuration file without publishing it
+     * @param errors Set to the reasons when the file is rejected
+     * @return The new configuration, or nullptr
+     */
+    static std::shared_ptr<FTPServerConfig> load(const std::string& filename, std::vector<std::string>& errors);
+
+private:
+    // Only touched through std::atomic_load / std::atomic_store
+    std::shared_ptr<const FTPServerConfig> current_;
+    std::atomic<uint64_t> version_;
+};
+
+} // namespace simple_sftpd
@@ -27,10 +27,27 @@ struct ConnectionConfig {
     std::string bind_address = "0.0.0.0";
     int bind_port = 21;
     int max_connections = 100;
-    int timeout_seconds = 300;
+    int timeout_seconds = 300;  // Idle control connection limit
+    int login_timeout_seconds = 30;  // Time allowed to log in after connecting, 0 = no limit
+    int data_stall_timeout_seconds = 120;  // Abort a transfer making no progress for this long, 0 = never
+    int drain_timeout_seconds = 300;  // How long sessions may finish after an upgrade hands off the listeners
     bool passive_mode = true;
     int passive_port_range_start = 49152;
     int passive_port_range_end = 65535;
+    int data_connection_timeout_seconds = 10;  // Wait for the PASV connect / PORT connect to complete
+    int passive_pool_size = 0;  // Passive sockets kept bound and listening, 0 = bind per PASV
+    int listener_shards = 1;  // SO_REUSEPORT listeners, 0 = one per CPU core
+    std::string engine = "threads";  // "threads" (thread per session) or "reactor"
+    int event_loop_threads = 0;  // Reactor loop threads, 0 = one per CPU core
+    int worker_threads = 16;  // Reactor helpers for blocking file and auth work
+    int tls_worker_threads = 0;  // Reactor helpers for TLS handshake crypto, 0 = run it on the event loop
+    std::string transfer_engine = "zero_copy";  // "zero_copy" (sendfile/splice) or "io_uring"
+    int transfer_buffer_memory_mb = 256;  // Cap on pooled transfer buffers, process-wide
+    int memory_budget_mb = 1024;  // Session, listing and transfer memory together, 0 = unlimited
+    int user_memory_budget_mb = 0;  // Share one user's sessions may hold, 0 = unlimited
+    int reserved_admin_slots = 0;  // Top sessions of max_connections kept for admin users and addresses
+    int max_loop_lag_ms = 250;  // Shed new clients while event loops run this late, 0 = never
+    int max_worker_queue_depth = 256;  // Shed new clients past this many queued blocking commands, 0 = never
 };
 
 struct LoggingConfig {
@@ -48,6 +65,14 @@ struct SecurityConfig {
     std::string ssl_ca_file;
     bool require_client_cert = false;
     std::string ssl_client_ca_file;
+    bool require_ssl_reuse = false;  // PROT P data connections must resume the TLS session
+    bool ssl_kernel_offload = true;  // Let the kernel (kTLS) encrypt PROT P data where it can
+    int ssl_session_cache_size = 20000;  // Server-wide session cache entries, 0 = OpenSSL's per-context cache
+    int ssl_session_timeout_seconds = 3600;  // How long sessions and tickets stay resumable
+    int ssl_handshake_timeout_seconds = 10;  // Longest a control connection's TLS handshake may take
+    int ssl_ticket_key_rotation_seconds = 3600;  // Ticket encryption key age limit, 0 = never rotate
+    std::string ssl_ticket_key_shm;  // Shared-memory name for the ticket keys ("/name"), empty = this process only
+    int ssl_cert_check_seconds = 60;  // Reload certificates whose files changed, checked this often; 0 = on reload only
     bool allow_anonymous = false;
     std::string anonymous_user = "anonymous";
     std::string anonymous_password = "anonymous@";
@@ -57,6 +82,18 @@ struct SecurityConfig {
     std::string run_as_user = "ftp";
     std::string run_as_group = "ftp";
     bool enable_pam = false;
+    std::vector<std::string> allowed_ips;  // Addresses or CIDR ranges; empty = everyone not blocked
+    std::vector<std::string> blocked_ips;  // Checked before allowed_ips
+    std::vector<std::string> admin_users;  // May use reserved slots and log in while overloaded
+    std::vector<std::string> admin_ips;  // Addresses or CIDR ranges admitted while overloaded
+};
+
+// A name clients can ask for with SNI and the certificate it is served with;
+// CA and client-certificate settings come from [security]
+struct VirtualHostConfig {
+    std::string hostname;  // Exact name, or "*.example.com"
+    std::string ssl_cert_file;
+    std::string ssl_key_file;
 };
 
 struct RateLimitConfig {
@@ -88,6 +125,7 @@ public:
     LoggingConfig logging;
     SecurityConfig security;
     RateLimitConfig rate_limit;
+    std::vector<VirtualHostConfig> virtual_hosts;  // INI: one [virtual_host <name>] section each
 
 private:
     void clearErrors();
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+
+namespace simple_sftpd {
+
+/**
+ * @brief Decides whether a new control connection is served
+ *
+ * Load is judged from the session count, event loop lag and the depth of
+ * the worker queue that transfers and other blocking commands wait in.
+ * Past a limit, clients are told "421 ... try again in N seconds", with N
+ * growing with the overload and with how many clients were turned away
+ * recently, and jittered, so a retry storm spreads out instead of coming
+ * straight back.
+ *
+ * The top reserved_slots sessions, and every slot while overloaded, are
+ * kept for administrators: connections from admin addresses are served
+ * outright; others are let in ADMIN_ONLY, at most reserved_slots at a
+ * time, and must log in as an admin user.
+ *
+ * Thread-safe.
+ */
+class AdmissionController {
+public:
+    static constexpr int MIN_RETRY_SECONDS = 2;
+    static constexpr int MAX_RETRY_SECONDS = 120;
+    static constexpr std::chrono::seconds REJECTION_WINDOW{10};
+
+    struct Limits {
+        size_t max_sessions = 100;
+        size_t reserved_slots = 0;
+        std::chrono::milliseconds max_loop_lag{0};  // 0 = not checked
+        size_t max_queue_depth = 0;                 // 0 = not checked
+    };
+
+    struct Load {
+        size_t sessions = 0;
+        std::chrono::milliseconds loop_lag{0};
+        size_t queue_depth = 0;
+    };
+
+    enum class Verdict : uint8_t { ADMIT, ADMIN_ONLY, REJECT };
+
+    struct Decision {
+        Verdict verdict = Verdict::ADMIT;
+        int retry_seconds = 0;  // back-off hint for REJECT and refused ADMIN_ONLY sessions
+    };
+
+    struct Stats {
+        uint64_t admitted = 0;
+        uint64_t admin_only = 0;
+        uint64_t rejected = 0;
+        size_t admin_only_sessions = 0;  // ADMIN_ONLY sessions not yet released
+    };
+
+    explicit AdmissionController(const Limits& limits);
+
+    void setLimits(const Limits& limits);
+
+    /**
+     * @param privileged The client connects from an admin address
+     */
+    Decision decide(const Load& load, bool privileged);
+
+    /**
+     * @brief An ADMIN_ONLY session logged in as an admin or ended
+     */
+    void releaseAdminOnly();
+
+    Stats getStats() const;
+
+private:
+    bool isOverloaded(const Load& load) const;
+    int retryAfter(const Load& load, std::chrono::steady_clock::time_point now);
+
+    mutable std::mutex mutex_;
+    Limits limits_;
+    size_t admin_only_sessions_;
+    std::minstd_rand jitter_;
+    
+    // Rejections in the current and previous REJECTION_WINDOW
+    std::chrono::steady_clock::time_point window_start_;
+    uint64_t window_rejections_;
+    uint64_t previous_rejections_;
+
+    uint64_t admitted_;
+    uint64_t admin_only_;
+    uint64_t rejected_;
+};
+
+} // namespace simple_sftpd
@@ -0,0 +1,162 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace simple_sftpd {
+
+/**
+ * @brief Process-wide pool of data transfer buffers
+ *
+ * Buffers come in power-of-two size classes from MIN_BUFFER (64 KiB) to
+ * MAX_BUFFER (4 MiB). Memory is mapped in 2 MiB chunks, with MAP_HUGETLB
+ * when the system has hugepages reserved and otherwise advised for
+ * transparent hugepages; smaller classes are carved from a chunk. A
+ * released buffer goes to a small cache for the releasing thread's shard,
+ * then to a shared free list. Mapped memory is kept until the pool is
+ * destroyed.
+ *
+ * The memory limit caps what the pool maps. Once it is reached, acquire()
+ * settles for a smaller free buffer and then fails; callers fall back to
+ * a small buffer of their own.
+ *
+ * Thread-safe. Buffers must be returned before the pool is destroyed.
+ */
+class BufferPool {
+public:
+    static constexpr size_t MIN_BUFFER = 64 * 1024;
+    static constexpr size_t MAX_BUFFER = 4 * 1024 * 1024;
+    static constexpr size_t CHUNK_SIZE = 2 * 1024 * 1024;
+    static constexpr size_t SIZE_CLASSES = 7;  // 64 KiB ... 4 MiB
+    static constexpr size_t DEFAULT_MEMORY_LIMIT = 256 * 1024 * 1024;
+
+    /**
+     * @brief A buffer on loan from the pool; returned when destroyed
+     */
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        ~Buffer() { reset(); }
+
+        Buffer(const Buffer&) = delete;
+        Buffer& operator=(const Buffer&) = delete;
+
+        char* data() const { return data_; }
+        size_t size() const { return size_; }
+        explicit operator bool() const { return data_ != nullptr; }
+
+        /**
+         * @brief Return the memory to the pool now
+         */
+        void reset();
+
+    private:
+        friend class BufferPool;
+        Buffer(BufferPool* pool, char* data, size_t size) : pool_(pool), data_(data), size_(size) {}
+
+        BufferPool* pool_ = nullptr;
+        char* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    struct Stats {
+        uint64_t hits = 0;        // served from memory already mapped
+        uint64_t misses = 0;      // had to map memory, or could not serve
+        size_t bytes_in_use = 0;  // lent out right now
+        size_t bytes_mapped = 0;
+        size_t hugepage_bytes = 0;  // part of bytes_mapped backed by MAP_HUGETLB
+    };
+
+    explicit BufferPool(size_t memory_limit = DEFAULT_MEMORY_LIMIT);
+    ~BufferPool();
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    /**
+     * @brief The pool data transfers use; lives until the process exits
+     */
+    static std::shared_ptr<BufferPool> global();
+
+    /**
+     * @brief Borrow a buffer
+     * @param preferred Wanted size, rounded up to a size class
+     * @param minimum Smallest size worth having when memory is short
+     * @return An empty Buffer if nothing of at least minimum is available
+     */
+    Buffer acquire(size_t preferred, size_t minimum = MIN_BUFFER);
+
+    /**
+     * @brief Cap the memory the pool maps; lowering it unmaps nothing
+     */
+    void setMemoryLimit(size_t bytes) { memory_limit_.store(bytes, std::memory_order_relaxed); }
+    size_t getMemoryLimit() const { return memory_limit_.load(std::memory_order_relaxed); }
+
+    Stats getStats() const;
+
+    /**
+     * @brief Size of the class a request of this many bytes is served from
+     */
+    static size_t classSize(size_t bytes);
+
+private:
+    static constexpr size_t CACHE_SHARDS = 16;
+    static constexpr size_t CACHED_PER_CLASS = 2;
+
+    struct alignas(64) CacheShard {
+        std::mutex mutex;
+        std::array<std::array<char*, CACHED_PER_CLASS>, SIZE_CLASSES> buffers{};
+        std::array<size_t, SIZE_CLASSES> count{};
+    };
+
+    struct Mapping {
+        void* address;
+        size_t length;
+    };
+
+    static size_t classIndex(size_t bytes);
+    static CacheShard& shardFor(std::array<CacheShard, CACHE_SHARDS>& shards);
+    char* takeFree(size_t index);
+    char* mapClass(size_t index);
+    void* mapChunk(size_t length);
+    void release(char* data, size_t size);
+
+    std::atomic<size_t> memory_limit_;
+    std::array<CacheShard, CACHE_SHARDS> shards_;
+
+    mutable std::mutex mutex_;  // guards free_ and mappings_
+    std::array<std::vector<char*>, SIZE_CLASSES> free_;
+    std::vector<Mapping> mappings_;
+
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<size_t> bytes_in_use_;
+    std::atomic<size_t> bytes_mapped_;
+    std::atomic<size_t> hugepage_bytes_;
+    std::atomic<bool> hugetlb_usable_;  // cleared after the first MAP_HUGETLB failure
+};
+
+} // namespace simple_sftpd
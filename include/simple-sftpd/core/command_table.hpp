@@ -0,0 +1,168 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace simple_sftpd {
+
+/**
+ * @brief FTP verbs understood by FTPConnection (aliases share an id)
+ */
+enum class CommandId : uint8_t {
+    USER, PASS, QUIT, NOOP, SYST, FEAT, AUTH, PBSZ, PROT,
+    PWD, CWD, LIST, PASV, PORT, TYPE, SIZE, RETR, STOR,
+    DELE, MKD, RMD, REST, APPE, RNFR, RNTO
+};
+
+enum CommandFlags : uint8_t {
+    CMD_NEEDS_AUTH = 1 << 0,   // 530 until USER/PASS succeeded
+    CMD_NEEDS_DATA = 1 << 1,   // opens the data connection
+    CMD_BLOCKING = 1 << 2,     // touches the filesystem or may block; the reactor runs it on a worker
+    CMD_TLS_FEATURE = 1 << 3   // FEAT line only advertised when TLS is configured
+};
+
+struct CommandSpec {
+    std::string_view verb;
+    CommandId id;
+    uint8_t flags;
+    std::string_view feature;  // FEAT line, empty if not advertised
+};
+
+namespace command_table {
+
+constexpr CommandSpec COMMANDS[] = {
+    {"USER", CommandId::USER, 0, ""},
+    {"PASS", CommandId::PASS, 0, ""},
+    {"QUIT", CommandId::QUIT, 0, ""},
+    {"NOOP", CommandId::NOOP, 0, ""},
+    {"SYST", CommandId::SYST, 0, ""},
+    {"FEAT", CommandId::FEAT, 0, ""},
+    {"AUTH", CommandId::AUTH, CMD_TLS_FEATURE, "AUTH TLS"},  // the reactor drives the handshake itself
+    {"PBSZ", CommandId::PBSZ, CMD_TLS_FEATURE, "PBSZ"},
+    {"PROT", CommandId::PROT, CMD_TLS_FEATURE, "PROT"},
+    {"PWD", CommandId::PWD, CMD_NEEDS_AUTH, ""},
+    {"XPWD", CommandId::PWD, CMD_NEEDS_AUTH, ""},
+    {"CWD", CommandId::CWD, CMD_NEEDS_AUTH | CMD_BLOCKING, ""},
+    {"XCWD", CommandId::CWD, CMD_NEEDS_AUTH | CMD_BLOCKING, ""},
+    {"LIST", CommandId::LIST, CMD_NEEDS_AUTH | CMD_NEEDS_DATA | CMD_BLOCKING, ""},
+    {"NLST", CommandId::LIST, CMD_NEEDS_AUTH | CMD_NEEDS_DATA | CMD_BLOCKING, ""},
+    {"PASV", CommandId::PASV, CMD_NEEDS_AUTH, ""},
+    {"PORT", CommandId::PORT, CMD_NEEDS_AUTH, ""},
+    {"TYPE", CommandId::TYPE, CMD_NEEDS_AUTH, ""},
+    {"SIZE", CommandId::SIZE, CMD_NEEDS_AUTH | CMD_BLOCKING, "SIZE"},
+    {"RETR", CommandId::RETR, CMD_NEEDS_AUTH | CMD_NEEDS_DATA | CMD_BLOCKING, ""},
+    {"STOR", CommandId::STOR, CMD_NEEDS_AUTH | CMD_NEEDS_DATA | CMD_BLOCKING, ""},
+    {"DELE", CommandId::DELE, CMD_NEEDS_AUTH | CMD_BLOCKING, ""},
+    {"MKD", CommandId::MKD, CMD_NEEDS_AUTH | CMD_BLOCKING, ""},
+    {"XMKD", CommandId::MKD, CMD_NEEDS_AUTH | CMD_BLOCKING, ""},
+    {"RMD", CommandId::RMD, CMD_NEEDS_AUTH | CMD_BLOCKING, ""},
+    {"XRMD", CommandId::RMD, CMD_NEEDS_AUTH | CMD_BLOCKING, ""},
+    {"REST", CommandId::REST, CMD_NEEDS_AUTH, "REST STREAM"},
+    {"APPE", CommandId::APPE, CMD_NEEDS_AUTH | CMD_NEEDS_DATA | CMD_BLOCKING, ""},
+    {"RNFR", CommandId::RNFR, CMD_NEEDS_AUTH | CMD_BLOCKING, ""},
+    {"RNTO", CommandId::RNTO, CMD_NEEDS_AUTH | CMD_BLOCKING, ""},
+};
+
+constexpr size_t COMMAND_COUNT = sizeof(COMMANDS) / sizeof(COMMANDS[0]);
+constexpr size_t SLOT_BITS = 6;
+constexpr size_t SLOT_COUNT = size_t(1) << SLOT_BITS;
+constexpr uint8_t EMPTY_SLOT = 0xFF;
+
+// Chosen so every verb above lands in its own slot; the static_assert
+// below fails the build if a new verb collides.
+constexpr uint32_t HASH_MULTIPLIER = 0x1dd39049u;
+
+/**
+ * @brief Pack a 3-4 letter verb into a big-endian key, upper-casing it
+ * @return 0 if the verb cannot be a known command
+ */
+constexpr uint32_t packVerb(std::string_view verb) {
+    if (verb.size() < 3 || verb.size() > 4) {
+        return 0;
+    }
+    uint32_t key = 0;
+    for (size_t i = 0; i < 4; ++i) {
+        uint32_t c = 0;
+        if (i < verb.size()) {
+            c = static_cast<unsigned char>(verb[i]);
+            if (c >= 'a' && c <= 'z') {
+                c -= 'a' - 'A';
+            } else if (c < 'A' || c > 'Z') {
+                return 0;
+            }
+        }
+        key = (key << 8) | c;
+    }
+    return key;
+}
+
+constexpr size_t slotFor(uint32_t key) {
+    return static_cast<uint32_t>(key * HASH_MULTIPLIER) >> (32 - SLOT_BITS);
+}
+
+constexpr std::array<uint8_t, SLOT_COUNT> buildSlots() {
+    std::array<uint8_t, SLOT_COUNT> slots{};
+    for (size_t i = 0; i < SLOT_COUNT; ++i) {
+        slots[i] = EMPTY_SLOT;
+    }
+    for (size_t i = 0; i < COMMAND_COUNT; ++i) {
+        slots[slotFor(packVerb(COMMANDS[i].verb))] = static_cast<uint8_t>(i);
+    }
+    return slots;
+}
+
+constexpr bool isPerfect() {
+    std::array<bool, SLOT_COUNT> used{};
+    for (size_t i = 0; i < COMMAND_COUNT; ++i) {
+        size_t slot = slotFor(packVerb(COMMANDS[i].verb));
+        if (packVerb(COMMANDS[i].verb) == 0 || used[slot]) {
+            return false;
+        }
+        used[slot] = true;
+    }
+    return true;
+}
+
+static_assert(COMMAND_COUNT < EMPTY_SLOT, "command index must fit in a slot");
+static_assert(isPerfect(), "command verbs collide; pick a new HASH_MULTIPLIER");
+
+constexpr std::array<uint8_t, SLOT_COUNT> SLOTS = buildSlots();
+
+} // namespace command_table
+
+/**
+ * @brief Look up a verb (case-insensitive) without allocating
+ * @return Command spec, or nullptr for unknown verbs
+ */
+constexpr const CommandSpec* findCommand(std::string_view verb) {
+    uint32_t key = command_table::packVerb(verb);
+    if (key == 0) {
+        return nullptr;
+    }
+    uint8_t index = command_table::SLOTS[command_table::slotFor(key)];
+    if (index == command_table::EMPTY_SLOT ||
+        command_table::packVerb(command_table::COMMANDS[index].verb) != key) {
+        return nullptr;
+    }
+    return &command_table::COMMANDS[index];
+}
+
+} // namespace simple_sftpd
@@ -18,38 +18,195 @@
 
 #include <memory>
 #include <string>
+#include <string_view>
 #include <atomic>
+#include <chrono>
 #include <thread>
 #include <mutex>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+#include <sys/types.h>
+#include "simple-sftpd/core/line_buffer.hpp"
+#include "simple-sftpd/core/memory_accountant.hpp"
 
 namespace simple_sftpd {
 
 class Logger;
 class FTPServerConfig;
+class ConfigStore;
 class FTPUserManager;
 class FTPUser;
 class SSLContext;
+class TlsSessionCache;
+class TicketKeyRing;
 class FileCache;
 class PAMAuth;
+class EventLoop;
+class WorkerPool;
+class PassivePortAllocator;
+class PerformanceMonitor;
+struct TransferResult;
+enum class TlsHandshakeStatus;
 
-class FTPConnection {
+/**
+ * @brief Collaborators every session uses but none should build
+ *
+ * Loading certificates and keys costs milliseconds, far more than the rest
+ * of accepting a connection, so the server builds one set at startup and
+ * on reload and sessions share it.
+ */
+struct SessionServices {
+    std::shared_ptr<FTPUserManager> user_manager;
+    std::shared_ptr<PAMAuth> pam_auth;        // null unless PAM is enabled
+    std::shared_ptr<SSLContext> ssl_context;  // null unless TLS is configured and loaded; serves virtual hosts by SNI
+    bool certificates_loaded = true;          // false if any configured certificate failed to load
+    
+    /**
+     * @param session_cache, ticket_keys Server-wide TLS resumption state that
+     *        outlives reloads; without them each SSL context keeps its own
+     */
+    static std::shared_ptr<const SessionServices> create(const FTPServerConfig& config,
+                                                         std::shared_ptr<Logger> logger,
+                                                         std::shared_ptr<TlsSessionCache> session_cache = nullptr,
+                                                         std::shared_ptr<TicketKeyRing> ticket_keys = nullptr);
+};
+
+class FTPConnection : public std::enable_shared_from_this<FTPConnection> {
 public:
-    FTPConnection(int socket, std::shared_ptr<Logger> logger, std::shared_ptr<FTPServerConfig> config);
+    enum class TransferType : uint8_t { ASCII, BINARY };
+    enum class ProtectionLevel : uint8_t { CLEAR, SAFE, CONFIDENTIAL, PRIVATE };
+
+
+    FTPConnection(int socket, std::shared_ptr<Logger> logger, std::shared_ptr<const FTPServerConfig> config);
     ~FTPConnection();
 
     void start();
+    
+    /**
+     * @brief Run the session on an event loop instead of a dedicated thread
+     * @param event_loop Loop that owns the (non-blocking) control socket
+     * @param workers Pool for commands that block on files, data connections or auth
+     * @param tls_workers Pool for TLS handshake steps, or null to run them on the loop
+     */
+    void startReactor(std::shared_ptr<EventLoop> event_loop, std::shared_ptr<WorkerPool> workers,
+                      std::shared_ptr<WorkerPool> tls_workers = nullptr);
+    
     void stop();
+    
+    /**
+     * @brief Begin stopping without waiting for the session to end
+     *
+     * Lets the caller unblock many sessions before joining any of them.
+     */
+    void requestStop();
     bool isActive() const;
+    
+    /**
+     * @brief Share the server's passive port range (call before start)
+     *
+     * Without one, the session allocates from its own view of the range.
+     */
+    void setPassivePortAllocator(std::shared_ptr<PassivePortAllocator> allocator);
+    void setPerformanceMonitor(std::shared_ptr<PerformanceMonitor> monitor);
+    
+    /**
+     * @brief Charge the session's memory to the server's budget (call before start)
+     *
+     * Without one, nothing is counted and nothing is refused for memory.
+     */
+    void setMemoryAccountant(std::shared_ptr<MemoryAccountant> accountant);
+    
+    /**
+     * @brief Keep the session only for an admin user (call before start)
+     *
+     * For clients let in on a reserved slot while the server is full or
+     * overloaded; anyone else gets 421 at USER.
+     * @param retry_seconds Back-off the 421 suggests
+     * @param on_release Run once, when an admin has logged in or the session ends
+     */
+    void setAdminOnly(int retry_seconds, std::function<void()> on_release);
+    
+    /**
+     * @brief Use the server's users, PAM and TLS context (call before start)
+     *
+     * Without them, the session builds its own from its configuration.
+     */
+    void setSessionServices(std::shared_ptr<const SessionServices> services);
+    
+    /**
+     * @brief Follow configuration reloads (call before start)
+     *
+     * The session switches to the newest snapshot between commands, never
+     * while a transfer is running.
+     */
+    void setConfigStore(std::shared_ptr<ConfigStore> store);
+    
+    /**
+     * @brief Record the session's registry slot (call before start)
+     * @param on_close Run once, on the session's own thread, when it ends
+     */
+    void setRegistryHandle(uint64_t handle, std::function<void()> on_close);
+    uint64_t getRegistryHandle() const { return registry_handle_; }
 
 private:
+    // Per-command scratch, backed by the command's stack frame and gone
+    // once its replies are queued
+    using ArenaString = std::pmr::string;
+    static constexpr size_t ARENA_SIZE = 1024;
+    static constexpr size_t LISTING_CHUNK = 64 * 1024;
+
     void handleClient();
-    void sendResponse(const std::string& response);
-    std::string readLine();
+    bool processCommand(std::string_view line);
+    bool executeCommand(std::string_view line);
+    void sendResponse(std::string_view response);
+    void sendPreliminaryResponse(std::string_view response);
+    void flushResponses(bool more = false);
+    bool readLine(std::string& line);
+    void releaseResources();
+    void notifyClosed();
+    void chargeControlMemory();
+    bool admitSession();
+    bool admitTransfer();
+    bool admitUser(const std::string& username);
+    void releaseAdminSlot();
+    
+    // Reactor mode (all called on the event loop thread)
+    bool registerControl();
+    void onControlEvent(uint32_t events);
+    bool readControlInput();
+    void processInput();
+    void dispatchToWorker(const std::string& line);
+    void awaitDataConnection(const std::string& line);
+    void onDataConnectionReady();
+    void onDataConnectionTimeout();
+    void stopWaitingForData();
+    void armSessionTimers();
+    void cancelSessionTimers();
+    void onIdleTimeout();
+    void onLoginTimeout();
+    void armStallTimer();
+    void onStallCheck();
+    void abortTransfer(int error);
+    void shutdownControl();
+    void resumeReactor();
+    void closeReactor();
+    void beginHandshake();
+    void continueHandshake();
+    void onHandshakeStep(TlsHandshakeStatus status);
+    void onHandshakeTimeout();
+    void queueOutput(const std::string& data);
+    void flushPendingOutput();
+    void updateInterest();
+    ssize_t writeControl(const char* data, size_t length);
+    bool wouldBlock(ssize_t result) const;
+    void setBlocking(bool blocking);
     
     // FTP Command Handlers
     void handleUSER(const std::string& username);
     void handlePASS(const std::string& password);
     void handleQUIT();
+    void handleFEAT();
     void handlePWD();
     void handleCWD(const std::string& path);
     void handleLIST(const std::string& path);
@@ -73,34 +230,101 @@ private:
     // Data Connection Management
     int createPassiveDataSocket();
     int acceptDataConnection();
-    int connectActiveDataSocket();
+    int connectDataChannel();
+    bool secureDataConnection(int data_fd);
+    bool sendData(int data_fd, const char* data, size_t length);
+    bool beginDataConnection(int& wait_fd, bool& wait_writable);
+    int finishDataConnection(bool& retry);
+    void abortDataConnection();
+    void recordDataSetup(std::chrono::steady_clock::time_point started, bool established);
+    void closeDataConnection(int data_fd);
     void closeDataSocket();
+    TransferResult receiveUpload(int data_fd, int file_fd, uint64_t offset, std::string& method);
     std::string formatPassiveResponse(int port);
+    std::string formatActiveTarget() const;
     
     // Path and Permission Utilities
-    std::string resolvePath(const std::string& path);
-    bool validatePath(const std::string& path);
+    
+    /**
+     * @brief Map a client path to an absolute, symlink-free server path
+     * @return View into the command arena, valid until the command ends
+     */
+    std::string_view resolvePath(std::string_view path);
+    /**
+     * @brief Append the not-yet-existing tail of a path to its resolved ancestor
+     * @return Empty view if the tail contains ".." or a dangling symlink
+     */
+    std::string_view appendMissing(std::string_view ancestor, std::string_view missing);
+    bool validatePath(std::string_view path);
     bool hasPermission(const std::string& operation, const std::string& path);
-    bool isPathWithinHome(const std::string& path);
+    bool isPathWithinHome(std::string_view path);
+    std::string_view arenaCopy(std::string_view text);
 
     // SSL/TLS Support
     bool initializeSSL();
     bool upgradeToSSL();
+    bool finishUpgrade(bool accepted);
     void* getSSL() const { return ssl_; }
     
     // Security
     void applyChroot();
+    
+    void refreshConfig();
+    void ensureServices();
 
     int socket_;
     std::shared_ptr<Logger> logger_;
-    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<const FTPServerConfig> config_;  // this session's snapshot
+    std::shared_ptr<ConfigStore> config_store_;
+    uint64_t config_version_;
     std::shared_ptr<FTPUserManager> user_manager_;
     std::shared_ptr<SSLContext> ssl_context_;
     std::shared_ptr<FileCache> file_cache_;
     std::shared_ptr<PAMAuth> pam_auth_;
+    std::shared_ptr<PerformanceMonitor> performance_monitor_;
+    std::shared_ptr<MemoryAccountant> memory_accountant_;
+    MemoryAccountant::Charge control_charge_;  // the session and its control buffers
+    uint64_t registry_handle_;
+    std::function<void()> close_handler_;
+    int admin_only_retry_;  // non-zero while only an admin may log in
+    std::function<void()> admin_slot_release_;
     
     std::atomic<bool> active_;
     std::thread client_thread_;
+    LineBuffer input_buffer_;
+    std::string output_buffer_;  // replies not yet handed to the socket
+    std::string argument_;  // argument of the command being dispatched
+    
+    // Reactor state; busy_ means a worker owns the session and the
+    // control socket is not registered with the loop
+    std::shared_ptr<EventLoop> event_loop_;
+    std::shared_ptr<WorkerPool> workers_;
+    std::string pending_output_;
+    bool busy_;
+    bool reactor_closed_;
+    
+    // AUTH TLS handshake driven by socket readiness; handshake_events_ is
+    // what OpenSSL waits for. Steps run on tls_workers_ when there is one
+    std::shared_ptr<WorkerPool> tls_workers_;
+    bool handshaking_;
+    uint32_t handshake_events_;
+    uint64_t handshake_timer_;
+    
+    // A data command parked on the loop until its data connection is up
+    bool awaiting_data_;
+    std::string pending_data_command_;
+    int data_wait_fd_;
+    uint64_t data_timer_;
+    std::chrono::steady_clock::time_point data_setup_started_;
+    
+    // Session timeouts, armed on the loop's timing wheel
+    uint64_t idle_timer_;
+    uint64_t login_timer_;
+    uint64_t stall_timer_;
+    std::atomic<uint64_t> transfer_progress_;  // bytes moved, bumped by the worker
+    uint64_t stall_progress_seen_;
+    std::atomic<int> transfer_abort_error_;  // why a transfer was cut off from another thread, 0 if not
+    std::chrono::steady_clock::time_point connected_at_;
     
     bool authenticated_;
     std::string username_;
@@ -114,20 +338,25 @@ private:
     void* data_ssl_;  // SSL* for data connection
     
     // Data connection state
+    std::shared_ptr<PassivePortAllocator> passive_ports_;
     int passive_listen_socket_;
+    int passive_port_;
     int data_socket_;
-    std::mutex data_socket_mutex_;
-    std::string transfer_type_;  // "A" for ASCII, "I" for binary
-    std::string protection_level_;  // "C" for clear, "P" for private (encrypted)
+    int prepared_data_socket_;  // connected by the loop, not yet claimed by a handler
+    std::mutex data_socket_mutex_;  // also guards closing socket_ against requestStop()
+    TransferType transfer_type_;
+    ProtectionLevel protection_level_;
     
-    // Active mode state
-    std::string active_mode_ip_;
-    int active_mode_port_;
+    // Active mode state; the port is 0 once the target has been used
     bool active_mode_enabled_;
+    uint32_t active_mode_address_;  // network byte order
+    int active_mode_port_;
     
     // Transfer resume state
     std::streampos resume_position_;
     std::string rename_from_path_;
+    
+    std::pmr::memory_resource* arena_;  // set only while a command runs
 };
 
 } // namespace simple_sftpd
@@ -19,9 +19,11 @@
 #include <memory>
 #include <vector>
 #include <mutex>
+#include <condition_variable>
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <cstdint>
 
 namespace simple_sftpd {
 
@@ -29,7 +31,16 @@ class FTPConnection;
 class FTPServerConfig;
 class Logger;
 
-class FTPConnectionManager {
+/**
+ * @brief Registry of live sessions
+ *
+ * Sessions sit in a slot map addressed by (generation << 32) | index, so
+ * registering and removing one is O(1). Each session deregisters itself
+ * as it ends, which keeps the atomic live count that admission checks
+ * against exact; the cleanup loop only reaps sessions that somehow missed
+ * that.
+ */
+class FTPConnectionManager : public std::enable_shared_from_this<FTPConnectionManager> {
 public:
     FTPConnectionManager(std::shared_ptr<FTPServerConfig> config,
                         std::shared_ptr<Logger> logger);
@@ -41,7 +52,13 @@ public:
     void removeConnection(std::shared_ptr<FTPConnection> connection);
     void stopAllConnections();
     
-    size_t getConnectionCount() const;
+    /**
+     * @brief Wait for sessions to end on their own, then stop the rest
+     * @return Number of sessions still open at the deadline
+     */
+    size_t drainConnections(std::chrono::steady_clock::time_point deadline);
+    
+    size_t getConnectionCount() const { return connection_count_; }
     std::vector<std::shared_ptr<FTPConnection>> getConnections() const;
     
     // Connection Pooling
@@ -51,14 +68,25 @@ public:
     size_t getPoolSize() const { return pool_size_; }
 
 private:
+    struct Slot {
+        std::shared_ptr<FTPConnection> connection;
+        uint32_t generation = 1;  // bumped on release so stale handles miss
+    };
+
+    void releaseSlot(uint64_t handle);
     void cleanupLoop();
     void poolMaintenanceLoop();
 
     std::shared_ptr<FTPServerConfig> config_;
     std::shared_ptr<Logger> logger_;
     mutable std::mutex connections_mutex_;
-    std::vector<std::shared_ptr<FTPConnection>> connections_;
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> free_slots_;
+    std::atomic<size_t> connection_count_;
+    std::condition_variable drained_cv_;  // signalled when the count reaches zero
     std::atomic<bool> running_;
+    std::mutex stop_mutex_;
+    std::condition_variable stop_cv_;  // wakes the maintenance loops on stop()
     std::thread cleanup_thread_;
     std::chrono::seconds connection_timeout_;
     std::chrono::seconds cleanup_interval_;
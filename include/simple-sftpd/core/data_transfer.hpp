@@ -0,0 +1,210 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "simple-sftpd/core/memory_accountant.hpp"
+
+namespace simple_sftpd {
+
+class SSLContext;
+
+/**
+ * @brief Bandwidth limiter for a single data transfer
+ *
+ * Call wait() before moving a chunk and add() afterwards; wait() sleeps
+ * long enough to keep the average rate at or below the limit.
+ */
+class TransferThrottle {
+public:
+    /**
+     * @param max_bytes_per_second Limit, 0 or negative for unlimited
+     */
+    explicit TransferThrottle(int max_bytes_per_second);
+
+    void wait(size_t next_bytes);
+    void add(size_t bytes) {
+        total_bytes_ += bytes;
+        if (progress_) {
+            progress_->fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Also count moved bytes here, for a watchdog on another thread
+     */
+    void setProgressCounter(std::atomic<uint64_t>* counter) { progress_ = counter; }
+
+    /**
+     * @brief Cut rate-limit pauses short once this becomes non-zero
+     *
+     * Whoever sets it also shuts the data socket down, so the transfer
+     * fails on its next send or receive instead of sleeping first.
+     */
+    void setCancelFlag(const std::atomic<int>* cancelled) { cancelled_ = cancelled; }
+
+    /**
+     * @brief Charge this transfer's buffers to a session's memory account
+     */
+    void setMemoryAccount(std::shared_ptr<MemoryAccountant::Account> account) { memory_account_ = std::move(account); }
+    const std::shared_ptr<MemoryAccountant::Account>& getMemoryAccount() const { return memory_account_; }
+
+    /**
+     * @brief Hold off reading from the peer while the account is exhausted
+     *
+     * Receive loops call this before each read, so a full budget leaves
+     * data in the client's send queue (TCP backpressure) instead of ours.
+     * Gives up after a second, reading one more chunk into the buffer the
+     * transfer already holds.
+     */
+    void waitForMemory();
+
+    /**
+     * @brief Largest chunk to move at once so sleeps stay fine-grained
+     */
+    size_t chunkSize(size_t preferred) const;
+
+    bool isLimited() const { return max_rate_ > 0; }
+
+private:
+    int max_rate_;
+    uint64_t total_bytes_;
+    std::chrono::steady_clock::time_point start_time_;
+    std::atomic<uint64_t>* progress_;
+    const std::atomic<int>* cancelled_;
+    std::shared_ptr<MemoryAccountant::Account> memory_account_;
+};
+
+enum class TransferStatus {
+    COMPLETE,
+    UNSUPPORTED,  // zero-copy path not usable here; nothing was sent
+    OPEN_FAILED,
+    ABORTED       // peer or I/O error part way through
+};
+
+struct TransferResult {
+    TransferStatus status = TransferStatus::COMPLETE;
+    uint64_t bytes = 0;
+    int error = 0;  // errno for ABORTED/OPEN_FAILED
+    bool kernel_tls = false;  // TLS records were sealed or opened by the kernel (kTLS)
+};
+
+/**
+ * @brief File <-> data socket copy loops used by RETR/STOR/APPE
+ */
+class DataTransfer {
+public:
+    /**
+     * @brief Send a file with sendfile(2), page cache straight to the socket
+     * @return UNSUPPORTED if the kernel refuses before any byte is sent
+     */
+    static TransferResult sendFileZeroCopy(int socket_fd, const std::string& path,
+                                           uint64_t offset, TransferThrottle& throttle);
+
+    /**
+     * @brief Send a file through a user-space buffer (ASCII, TLS, fallback)
+     *
+     * The buffer comes from BufferPool::global() and grows or shrinks with
+     * the observed rate, as far as the throttle's memory account allows.
+     */
+    static TransferResult sendFileBuffered(int socket_fd, const std::string& path,
+                                           uint64_t offset, TransferThrottle& throttle);
+
+    /**
+     * @brief Send a file through this thread's io_uring
+     *
+     * File reads run ahead into registered buffers while the socket sends
+     * go out one at a time, in file order.
+     * @return UNSUPPORTED if io_uring is unavailable and nothing was sent
+     */
+    static TransferResult sendFileUring(int socket_fd, const std::string& path,
+                                        uint64_t offset, TransferThrottle& throttle);
+
+    /**
+     * @brief Send a file over a TLS-protected data connection (PROT P)
+     *
+     * Reads through the same pooled buffer as sendFileBuffered() and hands
+     * OpenSSL whole multiples of TLS_RECORD, so bulk data goes out in
+     * full-size records.
+     * @param ssl Data connection, already through its handshake
+     */
+    static TransferResult sendFileTls(SSLContext& tls, void* ssl, const std::string& path,
+                                      uint64_t offset, TransferThrottle& throttle);
+
+    /**
+     * @brief Send a file with SSL_sendfile(), encrypted by the kernel (kTLS)
+     *
+     * Page cache straight to the socket, as sendFileZeroCopy() does for
+     * clear text.
+     * @param ssl Data connection, already through its handshake
+     * @return UNSUPPORTED if the connection is not offloaded (kernel,
+     *         OpenSSL build or negotiated cipher) and nothing was sent
+     */
+    static TransferResult sendFileKernelTls(SSLContext& tls, void* ssl, const std::string& path,
+                                            uint64_t offset, TransferThrottle& throttle);
+
+    /**
+     * @brief Receive into a file with splice(2) through a pipe, no user-space copy
+     * @param file_fd Writable descriptor (not O_APPEND); data lands at offset
+     * @return UNSUPPORTED if the kernel refuses before any byte is consumed
+     */
+    static TransferResult receiveFileZeroCopy(int socket_fd, int file_fd,
+                                              uint64_t offset, TransferThrottle& throttle);
+
+    /**
+     * @brief Receive into a file through a pooled user-space buffer sized like sendFileBuffered()'s
+     */
+    static TransferResult receiveFileBuffered(int socket_fd, int file_fd,
+                                              uint64_t offset, TransferThrottle& throttle);
+
+    /**
+     * @brief Receive into a file over a TLS-protected data connection (PROT P)
+     *
+     * Ends at the client's close_notify (or a bare EOF, see SSLContext::isClosed()).
+     * Records are decrypted by the kernel when the connection has kTLS receive.
+     */
+    static TransferResult receiveFileTls(SSLContext& tls, void* ssl, int file_fd,
+                                         uint64_t offset, TransferThrottle& throttle);
+
+    /**
+     * @brief Receive into a file through this thread's io_uring
+     *
+     * Each recv is linked to the write of its buffer, so disk writes
+     * overlap with receiving the next chunk.
+     * @param file_fd Writable descriptor (not O_APPEND); data lands at offset
+     * @return UNSUPPORTED if io_uring is unavailable and nothing was consumed
+     */
+    static TransferResult receiveFileUring(int socket_fd, int file_fd,
+                                           uint64_t offset, TransferThrottle& throttle);
+
+    /**
+     * @brief Largest TLS record payload; TLS chunks are multiples of it
+     */
+    static constexpr size_t TLS_RECORD = 16 * 1024;
+
+    /**
+     * @brief Whether the kernel lets this process create an io_uring (probed once)
+     */
+    static bool isUringAvailable();
+};
+
+} // namespace simple_sftpd
@@ -0,0 +1,161 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include "simple-sftpd/core/timing_wheel.hpp"
+
+namespace simple_sftpd {
+
+class Logger;
+
+/**
+ * @brief Single-threaded readiness loop
+ *
+ * Wraps epoll (Linux only) with an eventfd for cross-thread wakeups.
+ * Registration calls (add, modify, remove) must be made on the loop
+ * thread; other threads use post() to run work there.
+ */
+class EventLoop {
+public:
+    static constexpr uint32_t EVENT_READ = 1;
+    static constexpr uint32_t EVENT_WRITE = 2;
+    static constexpr uint32_t EVENT_ERROR = 4;
+
+    using Handler = std::function<void(uint32_t events)>;
+    using Task = std::function<void()>;
+    using TimerId = uint64_t;
+
+    explicit EventLoop(std::shared_ptr<Logger> logger);
+    ~EventLoop();
+
+    /**
+     * @brief Start the loop thread
+     * @return false if epoll is unavailable on this platform
+     */
+    bool start();
+
+    /**
+     * @brief Stop the loop thread and drop all registrations
+     */
+    void stop();
+
+    bool isRunning() const { return running_; }
+    bool isInLoopThread() const;
+
+    /**
+     * @brief Register a descriptor (level-triggered)
+     * @param fd Descriptor to watch
+     * @param events EVENT_READ and/or EVENT_WRITE, 0 to register paused
+     * @param handler Called on the loop thread with the ready events
+     */
+    bool add(int fd, uint32_t events, Handler handler);
+
+    /**
+     * @brief Change the interest set of a registered descriptor
+     */
+    bool modify(int fd, uint32_t events);
+
+    /**
+     * @brief Unregister a descriptor; pending events for it are discarded
+     */
+    void remove(int fd);
+
+    /**
+     * @brief Queue a task to run on the loop thread (thread-safe)
+     *
+     * Tasks posted to a loop that is not running are discarded.
+     */
+    void post(Task task);
+
+    /**
+     * @brief Run a task on the loop thread once delay has passed (loop thread only)
+     * @return Id for cancelTimer(); never 0
+     */
+    TimerId runAfter(std::chrono::milliseconds delay, Task task);
+
+    /**
+     * @brief Push a pending timer's deadline to delay from now (loop thread only)
+     * @return false if the timer already fired or was cancelled
+     */
+    bool rescheduleTimer(TimerId id, std::chrono::milliseconds delay);
+
+    /**
+     * @brief Drop a timer that has not fired yet (loop thread only)
+     */
+    void cancelTimer(TimerId id);
+
+    size_t getRegisteredCount() const { return registered_count_; }
+    
+    /**
+     * @brief How late the loop runs its timers, recently (thread-safe)
+     *
+     * Sampled by a probe timer every LAG_PROBE_INTERVAL; rises at once and
+     * decays over a few samples. Busy handlers and long task batches show
+     * up here before clients notice slow replies.
+     */
+    std::chrono::microseconds getLag() const { return std::chrono::microseconds(lag_us_.load(std::memory_order_relaxed)); }
+
+private:
+    struct Registration {
+        uint64_t token;
+        std::shared_ptr<Handler> handler;
+    };
+
+    using Clock = TimingWheel::Clock;
+
+    // Timer resolution; session timeouts are whole seconds
+    static constexpr std::chrono::milliseconds TIMER_TICK{10};
+    static constexpr std::chrono::milliseconds LAG_PROBE_INTERVAL{100};
+
+    void loop();
+    void runPostedTasks();
+    void runExpiredTimers();
+    int nextTimeout() const;
+    void wakeup();
+    void armLagProbe();
+
+    std::shared_ptr<Logger> logger_;
+    std::atomic<bool> running_;
+    std::thread thread_;
+    std::atomic<std::thread::id> loop_thread_id_;
+    int epoll_fd_;
+    int wakeup_fd_;
+
+    // Loop-thread only; the token guards against a recycled fd number
+    // receiving an event that was reported for its previous owner
+    std::unordered_map<int, Registration> registrations_;
+    uint32_t next_generation_;
+    std::atomic<size_t> registered_count_;
+
+    // Loop-thread only
+    TimingWheel timers_;
+    std::atomic<int64_t> lag_us_;
+
+    std::mutex tasks_mutex_;
+    std::vector<Task> tasks_;
+};
+
+} // namespace simple_sftpd
@@ -0,0 +1,109 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct iovec;
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace simple_sftpd {
+
+/**
+ * @brief Minimal io_uring instance driven through the raw system calls
+ *
+ * Covers what the data transfer engine needs: fixed-buffer file I/O,
+ * socket send/recv, linked entries and blocking completion waits.
+ * Linux only; init() fails cleanly (errno set) when the kernel or a
+ * seccomp policy does not provide io_uring.
+ */
+class IoUring {
+public:
+    struct Completion {
+        uint64_t user_data;
+        int result;  // bytes transferred, or -errno
+    };
+
+    IoUring();
+    ~IoUring();
+
+    IoUring(const IoUring&) = delete;
+    IoUring& operator=(const IoUring&) = delete;
+
+    /**
+     * @brief Create the rings
+     * @param entries Submission queue depth (rounded up by the kernel)
+     */
+    bool init(unsigned entries);
+    bool isReady() const { return ring_fd_ >= 0; }
+
+    /**
+     * @brief Pin buffers for the *Fixed operations; buf_index refers to this array
+     */
+    bool registerBuffers(const struct iovec* buffers, unsigned count);
+
+    // Queue an entry; false if the submission queue is full. With link set
+    // the next queued entry only starts once this one completes in full.
+    bool prepareReadFixed(int fd, void* buffer, unsigned length, uint64_t offset,
+                          unsigned buf_index, uint64_t user_data, bool link = false);
+    bool prepareWriteFixed(int fd, const void* buffer, unsigned length, uint64_t offset,
+                           unsigned buf_index, uint64_t user_data, bool link = false);
+    bool prepareSend(int fd, const void* buffer, unsigned length, int flags,
+                     uint64_t user_data, bool link = false);
+    bool prepareRecv(int fd, void* buffer, unsigned length, int flags,
+                     uint64_t user_data, bool link = false);
+
+    /**
+     * @brief Submit queued entries and block until at least wait_nr complete
+     * @return false with errno set if io_uring_enter fails
+     */
+    bool submitAndWait(unsigned wait_nr);
+
+    /**
+     * @brief Take the next completion without blocking
+     */
+    bool popCompletion(Completion& completion);
+
+private:
+    struct io_uring_sqe* nextSqe(uint64_t user_data, bool link);
+    void release();
+
+    int ring_fd_;
+    unsigned sq_entries_;
+    unsigned to_submit_;
+
+    void* sq_ring_;
+    size_t sq_ring_size_;
+    void* cq_ring_;
+    size_t cq_ring_size_;
+    struct io_uring_sqe* sqes_;
+    size_t sqes_size_;
+
+    // Pointers into the shared rings
+    unsigned* sq_head_;
+    unsigned* sq_tail_;
+    unsigned* sq_mask_;
+    unsigned* sq_array_;
+    unsigned* cq_head_;
+    unsigned* cq_tail_;
+    unsigned* cq_mask_;
+    struct io_uring_cqe* cqes_;
+};
+
+} // namespace simple_sftpd
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <string_view>
+#include <vector>
+#include <cstddef>
+
+namespace simple_sftpd {
+
+/**
+ * @brief Control-channel input buffer
+ *
+ * Socket reads land in the buffer (prepare/commit, or append from a
+ * caller's scratch array) and complete lines are located with memchr, so
+ * a command costs one read no matter how long it is, and bytes from
+ * pipelined commands stay queued for the next call. Lines longer than the limit are reported once and skipped
+ * up to the next newline.
+ */
+class LineBuffer {
+public:
+    enum class Status {
+        LINE,        // a complete line was returned
+        INCOMPLETE,  // more input is needed
+        TOO_LONG     // a line over the limit was discarded
+    };
+
+    explicit LineBuffer(size_t max_line_length = 1024);
+
+    /**
+     * @brief Get space for the next read
+     * @param length Bytes the caller intends to read
+     * @return Writable pointer; invalidates views returned by nextLine()
+     */
+    char* prepare(size_t length);
+
+    /**
+     * @brief Mark bytes written into prepare()'d space as received
+     */
+    void commit(size_t length);
+
+    /**
+     * @brief Copy received bytes in; grows only by what actually arrived
+     *
+     * Invalidates views returned by nextLine().
+     */
+    void append(const char* data, size_t length);
+
+    /**
+     * @brief Extract the next line without its CR/LF terminator
+     * @param line Set to a view into the buffer, valid until prepare()
+     */
+    Status nextLine(std::string_view& line);
+
+    size_t size() const { return end_ - begin_; }
+    bool empty() const { return begin_ == end_; }
+    size_t capacity() const { return data_.capacity(); }
+
+    /**
+     * @brief Free the storage if nothing is buffered (idle sessions)
+     *
+     * Storage of up to RETAINED_CAPACITY bytes is kept for the next
+     * command; only what a burst of pipelined input grew is returned.
+     */
+    void release();
+
+    /**
+     * @brief Drop everything buffered, including a partial line
+     */
+    void clear();
+
+    static constexpr size_t RETAINED_CAPACITY = 256;
+
+private:
+    void makeRoom(size_t length);
+
+    std::vector<char> data_;
+    size_t begin_;
+    size_t end_;
+    size_t scanned_;  // bytes before this offset hold no newline
+    size_t max_line_length_;
+    bool discarding_;
+};
+
+} // namespace simple_sftpd
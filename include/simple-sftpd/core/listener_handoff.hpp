@@ -0,0 +1,101 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace simple_sftpd {
+
+class Logger;
+
+/**
+ * @brief Passes listening sockets from a running daemon to its successor
+ *
+ * The running daemon listens on a Unix socket. A newly started binary
+ * connects, receives the listeners as SCM_RIGHTS ancillary data, starts
+ * accepting on them and acknowledges; only then does the old daemon stop
+ * accepting. Both processes hold the same sockets throughout, so the port
+ * never closes and no connect is refused.
+ *
+ * If the successor goes away before acknowledging, the old daemon keeps
+ * serving as if nothing happened.
+ */
+class ListenerHandoff {
+public:
+    ListenerHandoff(std::shared_ptr<Logger> logger, std::string path);
+    ~ListenerHandoff();
+
+    ListenerHandoff(const ListenerHandoff&) = delete;
+    ListenerHandoff& operator=(const ListenerHandoff&) = delete;
+
+    /**
+     * @brief Old daemon: open the Unix socket successors connect to
+     *
+     * Replaces a stale socket file left at the path. The socket is only
+     * accessible to its owner.
+     */
+    bool listen();
+
+    /**
+     * @brief Descriptor that becomes readable when a successor connects
+     */
+    int getSocket() const { return listen_socket_; }
+
+    /**
+     * @brief Old daemon: send the listeners to a connecting successor
+     *
+     * On success the path belongs to the successor and this object stops
+     * listening without removing it.
+     * @param ack_timeout How long the successor may take to start accepting
+     * @return true once the successor acknowledged
+     */
+    bool handOff(const std::vector<int>& listeners, std::chrono::milliseconds ack_timeout);
+
+    /**
+     * @brief New binary: fetch the listeners from the running daemon
+     * @param listeners Set to the received sockets, owned by the caller
+     */
+    bool fetch(std::vector<int>& listeners);
+
+    /**
+     * @brief New binary: tell the old daemon it may stop accepting
+     */
+    bool acknowledge();
+
+    /**
+     * @brief Close the Unix socket, removing the path if this side owns it
+     */
+    void close();
+
+    // SCM_RIGHTS limit per message on Linux is 253
+    static constexpr size_t MAX_LISTENERS = 64;
+
+private:
+    static bool sendSockets(int channel, const std::vector<int>& sockets);
+    static bool receiveSockets(int channel, std::vector<int>& sockets);
+    bool peerAllowed(int channel) const;
+
+    std::shared_ptr<Logger> logger_;
+    std::string path_;
+    int listen_socket_;
+    int channel_;  // successor side, held until acknowledge()
+};
+
+} // namespace simple_sftpd
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace simple_sftpd {
+
+/**
+ * @brief Server-wide budget for session and transfer memory
+ *
+ * Sessions charge what they hold - control buffers, directory listings,
+ * transfer buffers - to an Account for their user. A charge is refused
+ * when it would take the user past the per-user budget or the server
+ * past the global one; callers then make do with less or turn the client
+ * away. Control buffers are charged unconditionally, since a session
+ * cannot run without them, so usage can overshoot a budget slightly.
+ *
+ * Budgets of 0 are unlimited. Accounts for "" (sessions not yet logged
+ * in) count against the global budget only.
+ *
+ * Thread-safe. Create with std::make_shared; accounts keep the
+ * accountant alive.
+ */
+class MemoryAccountant : public std::enable_shared_from_this<MemoryAccountant> {
+public:
+    enum class Category : uint8_t { CONTROL, LISTING, TRANSFER };
+    static constexpr size_t CATEGORY_COUNT = 3;
+
+    /**
+     * @brief One user's share of the budget, shared by their sessions
+     */
+    class Account {
+    public:
+        Account(std::shared_ptr<MemoryAccountant> owner, std::string user);
+        ~Account();
+
+        Account(const Account&) = delete;
+        Account& operator=(const Account&) = delete;
+
+        /**
+         * @return false, charging nothing, if either budget would be exceeded
+         */
+        bool charge(Category category, size_t bytes);
+        void forceCharge(Category category, size_t bytes);
+        void release(Category category, size_t bytes);
+
+        /**
+         * @brief Whether bytes more could be charged right now
+         */
+        bool hasRoom(size_t bytes) const;
+        bool isExhausted() const { return !hasRoom(1); }
+
+        /**
+         * @brief hasRoom(), counting a refusal when there is none
+         */
+        bool admit(size_t bytes);
+
+        /**
+         * @brief Block until memory is released or the timeout passes
+         * @return true if there is room again
+         */
+        bool waitForRoom(std::chrono::milliseconds timeout);
+
+        size_t getUsage() const { return used_.load(std::memory_order_relaxed); }
+        const std::string& getUser() const { return user_; }
+
+    private:
+        std::shared_ptr<MemoryAccountant> owner_;
+        std::string user_;
+        std::atomic<size_t> used_;
+    };
+
+    /**
+     * @brief Memory held against an account; released when destroyed
+     *
+     * Without an account every resize() succeeds and nothing is counted,
+     * so code paths with and without a budget look the same.
+     */
+    class Charge {
+    public:
+        Charge() = default;
+        Charge(std::shared_ptr<Account> account, Category category)
+            : account_(std::move(account)), category_(category) {}
+        Charge(Charge&& other) noexcept;
+        Charge& operator=(Charge&& other) noexcept;
+        ~Charge() { reset(); }
+
+        Charge(const Charge&) = delete;
+        Charge& operator=(const Charge&) = delete;
+
+        /**
+         * @brief Hold bytes in total; growing is refused past a budget
+         */
+        bool resize(size_t bytes);
+
+        /**
+         * @brief Hold bytes in total whatever the budgets say
+         */
+        void force(size_t bytes);
+
+        size_t size() const { return bytes_; }
+        const std::shared_ptr<Account>& getAccount() const { return account_; }
+
+        /**
+         * @brief Release the memory and drop the account
+         */
+        void reset();
+
+    private:
+        std::shared_ptr<Account> account_;
+        Category category_ = Category::CONTROL;
+        size_t bytes_ = 0;
+    };
+
+    struct Stats {
+        size_t budget = 0;        // 0 = unlimited
+        size_t user_budget = 0;   // 0 = unlimited
+        size_t bytes_in_use = 0;
+        size_t control_bytes = 0;
+        size_t listing_bytes = 0;
+        size_t transfer_bytes = 0;
+        uint64_t refused = 0;     // charges and admissions turned down
+        uint64_t pauses = 0;      // waits for memory to be released
+        size_t accounts = 0;
+    };
+
+    /**
+     * @param budget Bytes all sessions together may hold, 0 for unlimited
+     * @param user_budget Bytes one user's sessions may hold, 0 for unlimited
+     */
+    MemoryAccountant(size_t budget, size_t user_budget);
+
+    MemoryAccountant(const MemoryAccountant&) = delete;
+    MemoryAccountant& operator=(const MemoryAccountant&) = delete;
+
+    /**
+     * @brief The account for a user, created on first use
+     */
+    std::shared_ptr<Account> account(const std::string& user);
+
+    /**
+     * @brief Change the budgets; lowering them releases nothing
+     */
+    void setLimits(size_t budget, size_t user_budget);
+
+    /**
+     * @brief Whether bytes more fit the global budget right now
+     */
+    bool hasRoom(size_t bytes) const;
+
+    Stats getStats() const;
+    size_t getUserUsage(const std::string& user) const;
+
+private:
+    bool chargeGlobal(Category category, size_t bytes, bool force);
+    void releaseGlobal(Category category, size_t bytes);
+    void forget(const std::string& user);
+
+    std::atomic<size_t> budget_;
+    std::atomic<size_t> user_budget_;
+    std::atomic<size_t> used_;
+    std::array<std::atomic<size_t>, CATEGORY_COUNT> by_category_;
+    std::atomic<uint64_t> refused_;
+    std::atomic<uint64_t> pauses_;
+
+    mutable std::mutex mutex_;  // guards accounts_ and waits on room_
+    std::condition_variable room_;
+    std::atomic<int> waiters_;
+    std::map<std::string, std::weak_ptr<Account>> accounts_;
+};
+
+} // namespace simple_sftpd
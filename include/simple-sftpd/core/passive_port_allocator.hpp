@@ -0,0 +1,111 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace simple_sftpd {
+
+class Logger;
+
+/**
+ * @brief Server-wide owner of the passive (PASV) port range
+ *
+ * Ports in use are tracked in a lock-free bitmap; each reservation starts
+ * at a random point in the range so sessions do not pile up at the low
+ * end. Optionally keeps a pool of sockets already bound and listening,
+ * which acquire() hands out without any bind() call.
+ *
+ * Sockets are non-blocking and close-on-exec.
+ */
+class PassivePortAllocator {
+public:
+    /**
+     * @param range_start First port of the range (inclusive)
+     * @param range_end Last port of the range (inclusive)
+     * @param pool_size Listening sockets to keep pre-bound, 0 to bind on demand
+     */
+    PassivePortAllocator(std::shared_ptr<Logger> logger, int range_start, int range_end, int pool_size = 0);
+    ~PassivePortAllocator();
+
+    PassivePortAllocator(const PassivePortAllocator&) = delete;
+    PassivePortAllocator& operator=(const PassivePortAllocator&) = delete;
+
+    /**
+     * @brief Fill the pre-bound pool
+     */
+    void start();
+
+    /**
+     * @brief Close pooled sockets; leased ports stay valid until released
+     */
+    void stop();
+
+    /**
+     * @brief Lease a listening socket on a free port in the range
+     * @param port Set to the leased port
+     * @return Listening socket, or -1 if the range is exhausted
+     */
+    int acquire(int& port);
+
+    /**
+     * @brief Close a leased socket and return its port to the range
+     */
+    void release(int port, int socket);
+
+    size_t getRangeSize() const { return port_count_; }
+    size_t getPortsInUse() const { return ports_in_use_; }
+    size_t getPooledCount() const;
+    uint64_t getPoolHits() const { return pool_hits_; }
+    uint64_t getExhaustedCount() const { return exhausted_; }
+    uint64_t getBindFailures() const { return bind_failures_; }
+
+private:
+    struct Lease {
+        int port;
+        int socket;
+    };
+
+    int reservePort();
+    void freePort(int port);
+    int bindLease(int& port);
+    void refillPool();
+
+    std::shared_ptr<Logger> logger_;
+    int range_start_;
+    size_t port_count_;
+    size_t pool_size_;
+
+    // Bit set = port leased (or pooled); bits past the range are preset
+    std::unique_ptr<std::atomic<uint64_t>[]> bits_;
+    size_t word_count_;
+
+    mutable std::mutex pool_mutex_;
+    std::vector<Lease> pool_;
+    bool pooling_;
+
+    std::atomic<size_t> ports_in_use_;
+    std::atomic<uint64_t> pool_hits_;
+    std::atomic<uint64_t> exhausted_;
+    std::atomic<uint64_t> bind_failures_;
+};
+
+} // namespace simple_sftpd
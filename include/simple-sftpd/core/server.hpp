@@ -16,21 +16,36 @@
 
 #pragma once
 
+#include <chrono>
 #include <memory>
 #include <string>
 #include <atomic>
 #include <thread>
 #include <vector>
+#include <mutex>
+#include <condition_variable>
+
+struct sockaddr_in;
 
 namespace simple_sftpd {
 
 class FTPServerConfig;
+class ConfigStore;
 class Logger;
 class FTPConnectionManager;
 class IPAccessControl;
 class PerformanceMonitor;
 class FileCache;
 class FTPRateLimiter;
+class EventLoop;
+class WorkerPool;
+class SessionSlab;
+class MemoryAccountant;
+class AdmissionController;
+class PassivePortAllocator;
+class TlsSessionCache;
+class TicketKeyRing;
+struct SessionServices;
 
 class FTPServer {
 public:
@@ -40,23 +55,139 @@ public:
     bool start();
     void stop();
     bool isRunning() const;
+    
+    /**
+     * @brief Serve on listening sockets inherited from a previous process
+     *
+     * Call before start(); each socket becomes one listener shard and the
+     * server takes ownership of them.
+     */
+    void adoptListeners(const std::vector<int>& sockets);
+    
+    /**
+     * @brief Listening sockets, for handing to a successor process
+     */
+    std::vector<int> getListenerSockets() const;
+    
+    /**
+     * @brief Stop accepting, let sessions finish until the timeout, then stop
+     *
+     * Used once a successor process accepts on the same listeners.
+     * Sessions still open at the deadline are closed, transfers included,
+     * so the old process never outlives the timeout by more than a moment.
+     * @return Number of sessions that had to be cut off
+     */
+    size_t drain(std::chrono::milliseconds timeout);
+    
+    /**
+     * @brief Switch to a new, already validated configuration
+     *
+     * New sessions, and existing ones between commands, see the new
+     * snapshot; running transfers finish on theirs. Access lists, rate
+     * limits, the passive port range and the log level take effect
+     * immediately, and the TLS certificates are loaded again for new
+     * sessions. Listener, engine and privilege settings only change on
+     * restart or upgrade.
+     * @return false if a TLS certificate failed to load; nothing is applied
+     *         and the server keeps its current configuration
+     */
+    bool reload(std::shared_ptr<const FTPServerConfig> next);
+    std::shared_ptr<ConfigStore> getConfigStore() const { return config_store_; }
+    
+    /**
+     * @brief Load the TLS certificates and keys again for new sessions
+     *
+     * Called when the watcher sees the files change. If any fails to load
+     * (a renewal caught half-written, say) the certificates in use stay.
+     * @return true if the new ones were published
+     */
+    bool reloadCertificates();
+    
+    size_t getListenerShardCount() const { return listeners_.size(); }
+    size_t getEventLoopCount() const { return event_loops_.size(); }
+    std::shared_ptr<PerformanceMonitor> getPerformanceMonitor() const { return performance_monitor_; }
+    std::shared_ptr<MemoryAccountant> getMemoryAccountant() const { return memory_accountant_; }
+    std::shared_ptr<AdmissionController> getAdmissionController() const { return admission_; }
+    std::shared_ptr<TlsSessionCache> getTlsSessionCache() const { return tls_session_cache_; }
+    std::shared_ptr<TicketKeyRing> getTicketKeyRing() const { return ticket_keys_; }
+    std::shared_ptr<PassivePortAllocator> getPassivePortAllocator() const;
+    std::shared_ptr<const SessionServices> getSessionServices() const;
 
 private:
-    void serverLoop();
-    void handleConnection(int client_socket);
+    struct ListenerShard {
+        int socket = -1;
+        int epoll_fd = -1;
+        std::thread thread;
+    };
+
+    int createListener(bool reuse_port);
+    bool adoptListener(int listen_socket);
+    void stopAccepting();
+    void serverLoop(size_t shard_index);
+    void acceptPending(size_t shard_index);
+    void admitConnection(int client_socket, const struct sockaddr_in& client_addr);
+    void checkAcceptQueue(int listen_socket);
+    bool setupEventLoop();
+    void closeEventLoop();
+    bool startReactor();
+    void stopReactor();
+    void closeListeners();
+    void handleConnection(int client_socket, int admin_only_retry);
     void dropPrivileges();
+    void applyAccessControl(const FTPServerConfig& config);
+    void applyRateLimits(const FTPServerConfig& config);
+    void watchCertificates();
 
-    std::shared_ptr<FTPServerConfig> config_;
+    std::shared_ptr<FTPServerConfig> config_;  // as started; listener and engine settings
+    std::shared_ptr<ConfigStore> config_store_;  // latest snapshot, for everything reloadable
     std::shared_ptr<Logger> logger_;
     std::shared_ptr<FTPConnectionManager> connection_manager_;
     std::shared_ptr<IPAccessControl> ip_access_control_;
     std::shared_ptr<PerformanceMonitor> performance_monitor_;
     std::shared_ptr<FileCache> file_cache_;
     std::shared_ptr<FTPRateLimiter> rate_limiter_;
+    std::shared_ptr<PassivePortAllocator> passive_ports_;  // shared by every session
+    std::shared_ptr<const SessionServices> session_services_;  // users, PAM, TLS; rebuilt on reload
+    std::shared_ptr<SessionSlab> session_slab_;  // closed sessions' memory, reused for new ones
+    std::shared_ptr<MemoryAccountant> memory_accountant_;  // budget every session charges to
+    std::shared_ptr<AdmissionController> admission_;
+    std::shared_ptr<IPAccessControl> admin_networks_;  // null when no admin_ips are configured
+    std::shared_ptr<TlsSessionCache> tls_session_cache_;  // kept across reloads, like ticket_keys_
+    std::shared_ptr<TicketKeyRing> ticket_keys_;
+    // ip_access_control_, admin_networks_, rate_limiter_ and passive_ports_
+    // are replaced on reload; use std::atomic_load / std::atomic_store
+    
+    // Serializes rebuilding session_services_ (reload vs. certificate watcher)
+    std::mutex services_mutex_;
+    std::string certificate_stamp_;  // files behind session_services_; guarded by services_mutex_
+    
+    // Polls the certificate files every ssl_cert_check_seconds
+    std::thread certificate_watcher_;
+    std::mutex certificate_watch_mutex_;
+    std::condition_variable certificate_watch_cv_;
+    bool certificate_watch_stop_;
     
     std::atomic<bool> running_;
-    std::thread server_thread_;
-    int server_socket_;
+    std::atomic<bool> accepting_;
+    std::vector<int> adopted_listeners_;
+    
+    // One SO_REUSEPORT listener and acceptor thread per shard
+    std::vector<std::unique_ptr<ListenerShard>> listeners_;
+    
+    // Shared wakeup for every acceptor (eventfd on Linux, pipe elsewhere)
+    int wakeup_read_fd_;
+    int wakeup_write_fd_;
+    
+    // Spare descriptor released to shed connections on EMFILE
+    std::mutex reserve_fd_mutex_;
+    int reserve_fd_;
+    
+    // Reactor engine: sessions are spread round-robin over the loops
+    bool reactor_mode_;
+    std::vector<std::shared_ptr<EventLoop>> event_loops_;
+    std::shared_ptr<WorkerPool> worker_pool_;
+    std::shared_ptr<WorkerPool> tls_worker_pool_;  // null unless tls_worker_threads > 0
+    std::atomic<size_t> next_event_loop_;
 };
 
 } // namespace simple_sftpd
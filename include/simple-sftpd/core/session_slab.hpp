@@ -0,0 +1,113 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace simple_sftpd {
+
+/**
+ * @brief Recycles fixed-size blocks for session objects
+ *
+ * Blocks are carved from slabs of BLOCKS_PER_SLAB and kept on a free list
+ * when released, so a closed session's memory goes straight to the next
+ * connection instead of back to malloc. The block size is fixed by the
+ * first allocation; requests of any other size fall through to operator
+ * new. Slabs are only freed with the SessionSlab itself.
+ *
+ * Thread-safe: sessions are created on acceptor threads and destroyed on
+ * whichever thread drops the last reference.
+ */
+class SessionSlab {
+public:
+    SessionSlab() = default;
+    SessionSlab(const SessionSlab&) = delete;
+    SessionSlab& operator=(const SessionSlab&) = delete;
+
+    void* allocate(size_t size, size_t alignment);
+    void deallocate(void* block, size_t size, size_t alignment);
+
+    size_t getBlockSize() const;
+    size_t getCapacity() const;  // blocks carved so far
+    size_t getInUse() const;
+
+    static constexpr size_t BLOCKS_PER_SLAB = 64;
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    bool fits(size_t size, size_t alignment) const;
+    void grow();
+
+    mutable std::mutex mutex_;
+    std::vector<std::unique_ptr<unsigned char[]>> slabs_;
+    FreeBlock* free_ = nullptr;
+    size_t block_size_ = 0;
+    size_t capacity_ = 0;
+    size_t in_use_ = 0;
+};
+
+/**
+ * @brief Allocator that serves single objects from a SessionSlab
+ *
+ * Meant for std::allocate_shared, which allocates the object and its
+ * control block as one; the slab keeps itself alive for as long as any
+ * object allocated from it.
+ */
+template <typename T>
+class SlabAllocator {
+public:
+    using value_type = T;
+
+    explicit SlabAllocator(std::shared_ptr<SessionSlab> slab) : slab_(std::move(slab)) {}
+    template <typename U>
+    SlabAllocator(const SlabAllocator<U>& other) : slab_(other.slab_) {}
+
+    T* allocate(size_t count) {
+        if (count != 1) {
+            return static_cast<T*>(::operator new(count * sizeof(T)));
+        }
+        return static_cast<T*>(slab_->allocate(sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* block, size_t count) {
+        if (count != 1) {
+            ::operator delete(block);
+            return;
+        }
+        slab_->deallocate(block, sizeof(T), alignof(T));
+    }
+
+    template <typename U>
+    bool operator==(const SlabAllocator<U>& other) const { return slab_ == other.slab_; }
+    template <typename U>
+    bool operator!=(const SlabAllocator<U>& other) const { return slab_ != other.slab_; }
+
+private:
+    template <typename U>
+    friend class SlabAllocator;
+
+    std::shared_ptr<SessionSlab> slab_;
+};
+
+} // namespace simple_sftpd
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace simple_sftpd {
+
+/**
+ * @brief Hierarchical timing wheel
+ *
+ * Four levels of 64 slots; a timer sits in the level whose slot width
+ * matches how far away it is and drops a level each time the wheel turns
+ * past it. Arming, re-arming and cancelling are O(1) list operations, and
+ * advance() only touches slots that are due. Deadlines are rounded up to
+ * the tick; timers beyond the top level's reach (2^24 ticks) are parked
+ * there and re-placed when it turns.
+ *
+ * Not thread-safe; EventLoop keeps one per loop thread.
+ */
+class TimingWheel {
+public:
+    using Clock = std::chrono::steady_clock;
+    using TimerId = uint64_t;
+    using Callback = std::function<void()>;
+
+    explicit TimingWheel(std::chrono::milliseconds tick = std::chrono::milliseconds(10),
+                         Clock::time_point start = Clock::now());
+
+    TimingWheel(const TimingWheel&) = delete;
+    TimingWheel& operator=(const TimingWheel&) = delete;
+
+    /**
+     * @brief Arm a timer
+     * @return Id for reschedule()/cancel(); never 0
+     */
+    TimerId schedule(Clock::time_point deadline, Callback callback);
+
+    /**
+     * @brief Move an armed timer to a new deadline
+     * @return false if the timer already fired or was cancelled
+     */
+    bool reschedule(TimerId id, Clock::time_point deadline);
+
+    /**
+     * @brief Disarm a timer; stale ids are ignored
+     */
+    void cancel(TimerId id);
+
+    /**
+     * @brief Run every timer due at or before now, in deadline order
+     *
+     * Timers that round to the same tick run in no particular order.
+     * Callbacks may arm, re-arm and cancel timers, including each other.
+     * @return Number of callbacks run
+     */
+    size_t advance(Clock::time_point now);
+
+    /**
+     * @brief Earliest moment advance() may have work to do
+     *
+     * Exact for timers in the lowest level, otherwise the point where the
+     * next occupied slot moves down. Clock::time_point::max() when empty.
+     */
+    Clock::time_point nextDeadline() const;
+
+    size_t size() const { return armed_; }
+    bool empty() const { return armed_ == 0; }
+
+    /**
+     * @brief Disarm everything without running callbacks
+     */
+    void clear();
+
+private:
+    static constexpr unsigned LEVEL_BITS = 6;
+    static constexpr unsigned SLOTS = 1u << LEVEL_BITS;
+    static constexpr unsigned LEVELS = 4;
+    static constexpr uint64_t MAX_SPAN = (1ull << (LEVEL_BITS * LEVELS)) - 1;
+
+    struct Node {
+        Callback callback;
+        uint64_t expires = 0;  // tick
+        uint32_t generation = 1;
+        int32_t prev = -1;
+        int32_t next = -1;
+        int32_t bucket = -1;  // level * SLOTS + slot, -1 when free
+    };
+
+    Node* lookup(TimerId id);
+    uint64_t tickFor(Clock::time_point deadline) const;
+    void place(uint32_t index);
+    void unlink(uint32_t index);
+    void release(uint32_t index);
+    void cascade(unsigned level);
+    uint64_t nextEventTick() const;
+
+    std::chrono::nanoseconds tick_;
+    Clock::time_point start_;
+    uint64_t current_;  // last tick processed
+
+    std::vector<Node> nodes_;
+    std::vector<uint32_t> free_nodes_;
+    std::array<int32_t, LEVELS * SLOTS> heads_;
+    std::array<uint64_t, LEVELS> occupied_;  // bit per non-empty slot
+    size_t armed_;
+};
+
+} // namespace simple_sftpd
@@ -0,0 +1,80 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <memory>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+
+namespace simple_sftpd {
+
+class Logger;
+
+/**
+ * @brief Fixed pool of threads for blocking session work
+ *
+ * Event loops hand off commands that touch the filesystem, wait on a
+ * data connection or run an authentication backend so the loop thread
+ * never blocks.
+ */
+class WorkerPool {
+public:
+    using Task = std::function<void()>;
+
+    explicit WorkerPool(std::shared_ptr<Logger> logger);
+    ~WorkerPool();
+
+    /**
+     * @brief Start the worker threads
+     * @param thread_count Number of threads (at least one is started)
+     */
+    bool start(size_t thread_count);
+
+    /**
+     * @brief Stop accepting work and join the threads
+     *
+     * Running tasks are waited for; tasks still queued are discarded.
+     */
+    void stop();
+
+    /**
+     * @brief Queue a task
+     * @return false if the pool is not running
+     */
+    bool submit(Task task);
+
+    size_t getThreadCount() const { return threads_.size(); }
+    size_t getQueueDepth() const;
+
+private:
+    void workerLoop();
+
+    std::shared_ptr<Logger> logger_;
+    std::atomic<bool> running_;
+    std::vector<std::thread> threads_;
+
+    mutable std::mutex queue_mutex_;
+    std::condition_variable queue_cv_;
+    std::deque<Task> queue_;
+};
+
+} // namespace simple_sftpd
@@ -26,7 +26,8 @@ class Logger;
 /**
  * @brief PAM Authentication
  * 
- * Provides Pluggable Authentication Modules integration
+ * Provides Pluggable Authentication Modules integration. One instance
+ * may be shared by sessions authenticating concurrently.
  */
 class PAMAuth {
 public:
@@ -50,8 +51,6 @@ public:
 private:
     std::shared_ptr<Logger> logger_;
     bool pam_available_;
-    
-    [[maybe_unused]] void* pam_handle_; // pam_handle_t* (void* to avoid PAM dependency in header)
 };
 
 } // namespace simple_sftpd
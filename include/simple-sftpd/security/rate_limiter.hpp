@@ -20,6 +20,7 @@
 #include <map>
 #include <chrono>
 #include <mutex>
+#include <memory>
 
 namespace simple_sftpd {
 
@@ -16,6 +16,9 @@
 
 #pragma once
 
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <memory>
 #include <string>
 
@@ -28,6 +31,16 @@
 namespace simple_sftpd {
 
 class Logger;
+class TicketKeyRing;
+class TlsSessionCache;
+class TlsContextRegistry;
+
+enum class TlsHandshakeStatus {
+    DONE,
+    WANT_READ,   // call again once the socket is readable
+    WANT_WRITE,  // call again once the socket is writable
+    FAILED
+};
 
 /**
  * @brief SSL Context wrapper for OpenSSL
@@ -52,6 +65,33 @@ public:
                     const std::string& ca_file = "", bool require_client_cert = false,
                     const std::string& client_ca_file = "");
 
+    /**
+     * @brief Keep resumable sessions in a server-wide cache instead of this context's own
+     *
+     * Call after initialize(). The cache outlives reloads, so clients
+     * resume across them.
+     * @param lifetime How long sessions and tickets stay resumable
+     */
+    void setSessionCache(std::shared_ptr<TlsSessionCache> cache, std::chrono::seconds lifetime);
+
+    /**
+     * @brief Encrypt session tickets with a shared, rotating key ring
+     *
+     * Call after initialize(). Without it every context (so every reload
+     * and every process) has its own random ticket key. Needs OpenSSL 3.
+     */
+    void setTicketKeys(std::shared_ptr<TicketKeyRing> keys);
+
+    /**
+     * @brief Serve other certificates to clients asking for other names (SNI)
+     *
+     * Call after initialize(), on the default context. Clients that send
+     * no name, or one the registry does not know, get this context's
+     * certificate. The registry's contexts should share this one's
+     * session cache and ticket keys so sessions resume whichever served them.
+     */
+    void setServerNames(std::shared_ptr<const TlsContextRegistry> server_names);
+
     /**
      * @brief Create SSL connection from socket
      * @param socket File descriptor for socket
@@ -60,11 +100,25 @@ public:
     void* createSSL(int socket);
 
     /**
-     * @brief Accept SSL handshake (server side)
+     * @brief Advance the server handshake as far as the socket allows
+     *
+     * Never waits: on a non-blocking socket it returns WANT_READ or
+     * WANT_WRITE instead, for an event loop to call again on readiness.
      * @param ssl SSL connection
-     * @return true if successful, false otherwise
      */
-    bool acceptSSL(void* ssl);
+    TlsHandshakeStatus acceptStep(void* ssl);
+
+    /**
+     * @brief Accept SSL handshake (server side), giving up at a deadline
+     *
+     * Runs acceptStep() and polls the socket in between, so a client that
+     * stalls mid-handshake costs at most the timeout whether the socket is
+     * blocking or not.
+     * @param ssl SSL connection
+     * @param timeout Longest the whole handshake may take
+     * @return true if successful, false on failure or timeout
+     */
+    bool acceptSSL(void* ssl, std::chrono::milliseconds timeout);
 
     /**
      * @brief Connect SSL handshake (client side)
@@ -91,6 +145,64 @@ public:
      */
     int writeSSL(void* ssl, const void* buf, int len);
 
+    /**
+     * @brief Check whether a failed read/write on a non-blocking socket should be retried
+     * @param ssl SSL connection
+     * @param ret Return value of readSSL() or writeSSL()
+     * @return true if OpenSSL is only waiting for the socket (WANT_READ/WANT_WRITE)
+     */
+    bool shouldRetry(void* ssl, int ret) const;
+
+    /**
+     * @brief Check whether a failed read means the peer closed the connection
+     * @param ssl SSL connection
+     * @param ret Return value of readSSL()
+     * @return true for a close_notify (or, where OpenSSL allows, a bare EOF)
+     */
+    bool isClosed(void* ssl, int ret) const;
+
+    /**
+     * @brief Check whether the handshake resumed an earlier session
+     * @param ssl SSL connection after a successful acceptSSL()
+     * @return true if no full key exchange took place
+     */
+    bool isSessionReused(void* ssl) const;
+
+    /**
+     * @brief Ask OpenSSL to hand record encryption to the kernel (kTLS)
+     *
+     * Call before acceptSSL(). Where the kernel or the negotiated cipher
+     * cannot take over, the connection quietly stays in user space; check
+     * isKernelTlsSend()/isKernelTlsReceive() after the handshake.
+     * @param ssl SSL connection
+     */
+    void enableKernelTls(void* ssl);
+
+    /**
+     * @brief Check whether the kernel encrypts what this connection sends
+     */
+    bool isKernelTlsSend(void* ssl) const;
+
+    /**
+     * @brief Check whether the kernel decrypts what this connection receives
+     */
+    bool isKernelTlsReceive(void* ssl) const;
+
+    /**
+     * @brief Send part of a file with SSL_sendfile(), page cache to kTLS socket
+     * @param ssl SSL connection with isKernelTlsSend()
+     * @param file_fd Readable file descriptor
+     * @param offset File position to start at
+     * @param length Most bytes to send
+     * @return Bytes sent, or <= 0 on error (see shouldRetry())
+     */
+    long sendFile(void* ssl, int file_fd, uint64_t offset, size_t length);
+
+    /**
+     * @brief Whether this OpenSSL build and kernel can offload TLS (probed once)
+     */
+    static bool isKernelTlsAvailable();
+
     /**
      * @brief Shutdown SSL connection
      * @param ssl SSL connection
@@ -126,12 +238,27 @@ private:
     std::shared_ptr<Logger> logger_;
     bool enabled_;
     bool initialized_;
+    std::shared_ptr<TlsSessionCache> session_cache_;
+    std::shared_ptr<TicketKeyRing> ticket_keys_;
+    std::shared_ptr<const TlsContextRegistry> server_names_;
 
 #ifdef SIMPLE_SFTPD_SSL_ENABLED
     SSL_CTX* ctx_;
 #endif
 
     void logSSLErrors();
+
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+    static SSLContext* fromSSL(SSL* ssl);
+    static int newSessionCallback(SSL* ssl, SSL_SESSION* session);
+    static SSL_SESSION* getSessionCallback(SSL* ssl, const unsigned char* id, int length, int* copy);
+    static void removeSessionCallback(SSL_CTX* ctx, SSL_SESSION* session);
+    static int serverNameCallback(SSL* ssl, int* alert, void* arg);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    static int ticketKeyCallback(SSL* ssl, unsigned char* key_name, unsigned char* iv,
+                                 EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int encrypt);
+#endif
+#endif
 };
 
 } // namespace simple_sftpd
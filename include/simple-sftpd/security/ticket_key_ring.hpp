@@ -0,0 +1,116 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace simple_sftpd {
+
+class Logger;
+
+/**
+ * @brief Session-ticket keys shared by every listener and process
+ *
+ * Tickets are encrypted with the newest key; the SLOTS - 1 keys before it
+ * still decrypt, so a ticket stays usable for at least that many rotation
+ * intervals. Keys rotate lazily: whoever asks for the encryption key after
+ * the interval has passed replaces the oldest slot with a fresh random key.
+ *
+ * The ring lives in shared memory. With a POSIX shared-memory name every
+ * process that opens it (an upgraded daemon taking over the listeners, or
+ * prefork workers) encrypts and decrypts with the same keys, so a client
+ * resumes wherever it lands. Without one the mapping is anonymous and
+ * shared with forked children only. The segment is created owner-only
+ * (0600) and protected by a robust process-shared mutex, so a process
+ * dying mid-rotation does not wedge the others.
+ *
+ * Thread-safe.
+ */
+class TicketKeyRing {
+public:
+    static constexpr size_t NAME_SIZE = 16;
+    static constexpr size_t KEY_SIZE = 32;
+    static constexpr size_t SLOTS = 3;
+
+    struct Key {
+        unsigned char name[NAME_SIZE];
+        unsigned char aes_key[KEY_SIZE];
+        unsigned char hmac_key[KEY_SIZE];
+    };
+
+    struct Stats {
+        uint64_t rotations = 0;  // by any process sharing the ring
+        uint64_t hits = 0;  // tickets whose key was found
+        uint64_t misses = 0;  // tickets under an unknown or retired key
+        bool shared = false;  // backed by a named segment
+    };
+
+    /**
+     * @param shm_name Shared-memory object name ("/name"), empty for an anonymous ring;
+     *                 an unusable name falls back to anonymous with a warning
+     * @param rotation_interval Age at which the encryption key is replaced
+     */
+    TicketKeyRing(std::shared_ptr<Logger> logger, const std::string& shm_name,
+                  std::chrono::seconds rotation_interval);
+    ~TicketKeyRing();
+
+    TicketKeyRing(const TicketKeyRing&) = delete;
+    TicketKeyRing& operator=(const TicketKeyRing&) = delete;
+
+    /**
+     * @brief Key to encrypt a new ticket with, rotating first if it is due
+     */
+    Key encryptionKey();
+
+    /**
+     * @brief Key a ticket names, counting a hit or a miss
+     * @param current Set to whether it is still the encryption key (if
+     *                not, the client should get a fresh ticket)
+     */
+    bool find(const unsigned char* name, Key& key, bool& current);
+
+    /**
+     * @brief Replace the oldest key now and make it the encryption key
+     */
+    void rotate();
+
+    void setRotationInterval(std::chrono::seconds interval);
+
+    Stats getStats() const;
+
+private:
+    struct Shared;
+
+    bool attach(const std::string& shm_name);
+    void lock() const;
+    void unlock() const;
+    void rotateLocked(int64_t now);
+
+    std::shared_ptr<Logger> logger_;
+    Shared* shared_;
+    bool named_;
+    std::atomic<int64_t> rotation_seconds_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+};
+
+} // namespace simple_sftpd
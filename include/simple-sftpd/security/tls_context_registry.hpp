@@ -0,0 +1,58 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace simple_sftpd {
+
+class SSLContext;
+
+/**
+ * @brief TLS contexts of the virtual hosts, keyed by server name (SNI)
+ *
+ * Filled once, then only read, so handshakes look names up without a
+ * lock. Certificates are renewed by building a whole new registry and
+ * publishing it with the rest of the session services; handshakes that
+ * already picked a context keep it until they end.
+ */
+class TlsContextRegistry {
+public:
+    /**
+     * @param hostname Exact name, or "*.example.com" for any single label under it
+     */
+    void add(const std::string& hostname, std::shared_ptr<SSLContext> context);
+
+    /**
+     * @brief Context for a client's server name, or null for the default
+     *
+     * Names are matched case-insensitively; an exact entry wins over a wildcard.
+     */
+    std::shared_ptr<SSLContext> find(std::string_view server_name) const;
+
+    size_t size() const { return contexts_.size(); }
+    bool empty() const { return contexts_.empty(); }
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<SSLContext>> contexts_;
+};
+
+} // namespace simple_sftpd
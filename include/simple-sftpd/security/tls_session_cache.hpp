@@ -0,0 +1,108 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace simple_sftpd {
+
+/**
+ * @brief Server-wide cache of TLS sessions, keyed by session ID
+ *
+ * Replaces OpenSSL's internal cache, which is per SSL_CTX (so lost on
+ * every reload) and behind one lock. Sessions are kept serialized (DER),
+ * spread over SHARDS independently locked LRU lists; each shard holds at
+ * most its share of the capacity and drops entries past their lifetime.
+ *
+ * Thread-safe.
+ */
+class TlsSessionCache {
+public:
+    static constexpr size_t SHARDS = 16;
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;  // includes expired entries
+        uint64_t stores = 0;
+        uint64_t evictions = 0;  // pushed out by capacity, not expiry
+        size_t entries = 0;
+    };
+
+    /**
+     * @param capacity Most sessions held, 0 = cache nothing
+     * @param lifetime How long a session may be resumed after it was stored
+     */
+    TlsSessionCache(size_t capacity, std::chrono::seconds lifetime);
+
+    TlsSessionCache(const TlsSessionCache&) = delete;
+    TlsSessionCache& operator=(const TlsSessionCache&) = delete;
+
+    /**
+     * @brief Remember a session; replaces one stored under the same ID
+     */
+    void store(std::string_view id, std::string session);
+
+    /**
+     * @brief Fetch a live session, counting a hit or a miss
+     * @return false if unknown or expired
+     */
+    bool lookup(std::string_view id, std::string& session);
+
+    void remove(std::string_view id);
+
+    /**
+     * @brief Change the bounds; shrinking evicts on the next store per shard
+     */
+    void setLimits(size_t capacity, std::chrono::seconds lifetime);
+
+    Stats getStats() const;
+
+private:
+    struct Entry {
+        std::string id;
+        std::string session;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru;  // most recently used first
+        std::unordered_map<std::string_view, std::list<Entry>::iterator> index;  // views into lru ids
+    };
+
+    Shard& shardFor(std::string_view id);
+    static void erase(Shard& shard, std::list<Entry>::iterator entry);
+
+    std::array<Shard, SHARDS> shards_;
+    std::atomic<size_t> shard_capacity_;
+    std::atomic<int64_t> lifetime_seconds_;
+    std::atomic<uint64_t> hits_;
+    std::atomic<uint64_t> misses_;
+    std::atomic<uint64_t> stores_;
+    std::atomic<uint64_t> evictions_;
+};
+
+} // namespace simple_sftpd
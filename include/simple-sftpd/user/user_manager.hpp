@@ -19,6 +19,7 @@
 #include <memory>
 #include <string>
 #include <map>
+#include <vector>
 #include <mutex>
 
 namespace simple_sftpd {
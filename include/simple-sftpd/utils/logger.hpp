@@ -16,6 +16,7 @@
 
 #pragma once
 
+#include <atomic>
 #include <string>
 #include <fstream>
 #include <mutex>
@@ -52,6 +53,7 @@ public:
 
     void setLevel(LogLevel level);
     LogLevel getLevel() const;
+    bool isEnabled(LogLevel level) const { return level >= level_; }
     void setFormat(LogFormat format);
     LogFormat getFormat() const;
 
@@ -63,7 +65,7 @@ private:
     std::string escapeJsonString(const std::string& str) const;
 
     std::string log_file_;
-    LogLevel level_;
+    std::atomic<LogLevel> level_;  // changed by a configuration reload while sessions log
     LogFormat format_;
     bool console_;
     bool file_;
@@ -16,14 +16,20 @@
 
 #pragma once
 
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <string>
 #include <memory>
+#include <vector>
 
 namespace simple_sftpd {
 
 class Logger;
+class BufferPool;
+class MemoryAccountant;
+class TlsSessionCache;
+class TicketKeyRing;
 
 /**
  * @brief Performance Monitor
@@ -39,6 +45,50 @@ public:
     void recordConnection();
     void recordDisconnection();
     void recordActiveConnection();
+    void recordAcceptQueueOverflow();
+    
+    // Listener shard statistics (setListenerShards must be called before accepting)
+    void setListenerShards(size_t shard_count);
+    void recordShardAccept(size_t shard_index);
+    std::vector<uint64_t> getShardAccepts() const;
+    
+    // Data connection setup (PASV accept / PORT connect); failures include timeouts
+    static constexpr size_t DATA_SETUP_BUCKETS = 8;
+    static const std::array<int, DATA_SETUP_BUCKETS - 1> DATA_SETUP_BUCKET_BOUNDS_MS;  // last bucket is open-ended
+    void recordDataConnectionSetup(std::chrono::microseconds elapsed, bool established);
+    std::vector<uint64_t> getDataConnectionSetupHistogram() const;
+    uint64_t getDataConnectionFailures() const { return data_connection_failures_; }
+    
+    // TLS handshakes on control (AUTH TLS) and data (PROT P) connections;
+    // a resumed handshake reused an earlier session instead of a key exchange
+    void recordTlsHandshake(bool data_channel, bool resumed);
+    void recordTlsHandshakeFailure();
+    uint64_t getTlsFullHandshakes() const { return tls_full_handshakes_; }
+    uint64_t getTlsResumedHandshakes() const { return tls_resumed_handshakes_; }
+    uint64_t getTlsDataHandshakes() const { return tls_data_handshakes_; }
+    uint64_t getTlsHandshakeFailures() const { return tls_handshake_failures_; }
+    double getTlsResumptionRate() const;  // resumed share of all handshakes, 0 before any
+    
+    // Where resumed sessions come from; the getters read 0 until one is set
+    void setTlsSessionCache(std::shared_ptr<const TlsSessionCache> cache);
+    void setTicketKeyRing(std::shared_ptr<const TicketKeyRing> ring);
+    uint64_t getTlsSessionCacheHits() const;
+    uint64_t getTlsSessionCacheMisses() const;
+    uint64_t getTlsTicketHits() const;
+    uint64_t getTlsTicketMisses() const;
+    
+    // Transfer buffer pool; the getters read 0 until one is set
+    void setBufferPool(std::shared_ptr<const BufferPool> pool);
+    uint64_t getBufferPoolHits() const;
+    uint64_t getBufferPoolMisses() const;
+    uint64_t getBufferBytesInUse() const;
+    
+    // Session memory budget; the getters read 0 until one is set
+    void setMemoryAccountant(std::shared_ptr<const MemoryAccountant> accountant);
+    uint64_t getMemoryBytesInUse() const;
+    uint64_t getMemoryBudget() const;
+    uint64_t getMemoryRefusals() const;
+    uint64_t getMemoryPauses() const;
     
     // Transfer statistics
     void recordTransfer(size_t bytes, bool upload);
@@ -57,6 +107,7 @@ public:
     uint64_t getTotalDownloads() const { return total_downloads_; }
     uint64_t getTotalRequests() const { return total_requests_; }
     uint64_t getTotalErrors() const { return total_errors_; }
+    uint64_t getAcceptQueueOverflows() const { return accept_queue_overflows_; }
     
     // Performance metrics
     double getAverageTransferRate() const; // bytes per second
@@ -76,6 +127,19 @@ private:
     std::atomic<uint64_t> total_downloads_;
     std::atomic<uint64_t> total_requests_;
     std::atomic<uint64_t> total_errors_;
+    std::atomic<uint64_t> accept_queue_overflows_;
+    std::unique_ptr<std::atomic<uint64_t>[]> shard_accepts_;
+    size_t shard_count_;
+    std::array<std::atomic<uint64_t>, DATA_SETUP_BUCKETS> data_setup_histogram_;
+    std::atomic<uint64_t> data_connection_failures_;
+    std::atomic<uint64_t> tls_full_handshakes_;
+    std::atomic<uint64_t> tls_resumed_handshakes_;
+    std::atomic<uint64_t> tls_data_handshakes_;
+    std::atomic<uint64_t> tls_handshake_failures_;
+    std::shared_ptr<const BufferPool> buffer_pool_;
+    std::shared_ptr<const MemoryAccountant> memory_accountant_;
+    std::shared_ptr<const TlsSessionCache> tls_session_cache_;
+    std::shared_ptr<const TicketKeyRing> ticket_keys_;
     
     std::atomic<uint64_t> total_transfer_time_ms_;
     std::chrono::steady_clock::time_point start_time_;
@@ -14,8 +14,11 @@
 #include <thread>
 #include <chrono>
 #include <atomic>
+#include <poll.h>
 #include "simple-sftpd/core/server.hpp"
+#include "simple-sftpd/core/listener_handoff.hpp"
 #include "simple-sftpd/config/server_config.hpp"
+#include "simple-sftpd/config/config_store.hpp"
 #include "simple-sftpd/utils/logger.hpp"
 #include "simple-sftpd/user/user_manager.hpp"
 #include "simple-sftpd/user/user.hpp"
@@ -26,9 +29,11 @@ using namespace simple_sftpd;
 std::shared_ptr<FTPServer> g_server;
 std::shared_ptr<Logger> g_logger;
 std::atomic<bool> g_shutdown_requested(false);
+std::atomic<bool> g_handed_off(false);  // the PID file belongs to the successor
+std::atomic<bool> g_reload_requested(false);
 
 // Forward declarations
-bool startServer(const std::string& config_file, bool daemon_mode);
+bool startServer(const std::string& config_file, bool daemon_mode, bool upgrade = false);
 
 // PID file path
 std::string getPidFile() {
@@ -39,6 +44,13 @@ std::string getPidFile() {
     #endif
 }
 
+/**
+ * @brief Unix socket a new binary connects to for the listening sockets
+ */
+std::string getUpgradeSocket() {
+    return "/var/run/simple-sftpd.upgrade.sock";
+}
+
 /**
  * @brief Write PID to file
  */
@@ -106,7 +118,18 @@ void signalHandler(int signal) {
     if (g_server) {
         g_server->stop();
     }
-    removePidFile();
+    if (!g_handed_off) {
+        removePidFile();
+    }
+}
+
+/**
+ * @brief SIGHUP handler: ask the main loop to reload the configuration
+ * @param signal Signal number
+ */
+void reloadSignalHandler(int signal) {
+    (void)signal;
+    g_reload_requested = true;
 }
 
 /**
@@ -128,6 +151,7 @@ void printUsage() {
     std::cout << "  start                Start the FTP server" << std::endl;
     std::cout << "  stop                 Stop the FTP server" << std::endl;
     std::cout << "  restart              Restart the FTP server" << std::endl;
+    std::cout << "  upgrade              Take over from the running server without dropping clients" << std::endl;
     std::cout << "  status               Show server status" << std::endl;
     std::cout << "  reload               Reload configuration" << std::endl;
     std::cout << "  test                 Test server configuration" << std::endl;
@@ -250,7 +274,7 @@ void setupSignalHandlers() {
     signal(SIGINT, signalHandler);
     signal(SIGTERM, signalHandler);
     #ifndef _WIN32
-    signal(SIGHUP, signalHandler);
+    signal(SIGHUP, reloadSignalHandler);
     #endif
 }
 
@@ -411,6 +435,71 @@ bool restartServer(const std::string& config_file, bool daemon_mode) {
     return false;
 }
 
+/**
+ * @brief Re-read the configuration file and publish it to the server
+ *
+ * A file that fails to load or validate, or names a certificate that
+ * fails to load, is reported and ignored; the server keeps running on its
+ * current configuration.
+ */
+void reloadServerConfiguration(const std::string& config_file) {
+    std::vector<std::string> errors;
+    auto config = ConfigStore::load(config_file, errors);
+    if (!config) {
+        g_logger->error("Configuration reload rejected, keeping the current configuration");
+        for (const auto& error : errors) {
+            g_logger->error("  " + error);
+        }
+        return;
+    }
+    if (!g_server->reload(config)) {
+        return;
+    }
+    g_logger->info("Configuration reloaded from " + config_file);
+}
+
+/**
+ * @brief Serve the running daemon's listeners until asked to hand them on
+ *
+ * Polls the upgrade socket while the server runs, and applies SIGHUP
+ * reloads. When a new binary takes the listeners, stops accepting and
+ * gives open sessions until the drain timeout to finish.
+ */
+void serveUntilShutdown(const std::string& config_file) {
+    ListenerHandoff upgrade_channel(g_logger, getUpgradeSocket());
+    if (!upgrade_channel.listen()) {
+        g_logger->warn("Binary upgrades without downtime are unavailable");
+    }
+
+    while (!g_shutdown_requested && g_server->isRunning()) {
+        if (g_reload_requested.exchange(false)) {
+            reloadServerConfiguration(config_file);
+        }
+        if (upgrade_channel.getSocket() < 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+            continue;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = upgrade_channel.getSocket();
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        if (upgrade_channel.handOff(g_server->getListenerSockets(), std::chrono::seconds(30))) {
+            g_handed_off = true;
+            g_logger->info("New process is accepting connections");
+            auto current = g_server->getConfigStore()->current();
+            size_t cut_off = g_server->drain(std::chrono::seconds(current->connection.drain_timeout_seconds));
+            g_logger->info("Drain complete" +
+                           (cut_off > 0 ? ", " + std::to_string(cut_off) + " sessions closed at the deadline"
+                                        : std::string()));
+            break;
+        }
+    }
+}
+
 /**
  * @brief Show server status
  * @param config_file Configuration file path
@@ -454,8 +543,7 @@ bool reloadConfiguration() {
     std::cout << "Reloading configuration (PID: " << pid << ")..." << std::endl;
     #ifndef _WIN32
     if (kill(pid, SIGHUP) == 0) {
-        std::cout << "Configuration reload signal sent" << std::endl;
-        std::cout << "Note: Full configuration reload requires server restart in v0.1.0" << std::endl;
+        std::cout << "Configuration reload signal sent; the server log reports the result" << std::endl;
         return true;
     }
     #endif
@@ -680,9 +768,10 @@ bool handleSslCommand(const std::vector<std::string>& args, const std::string& c
  * @brief Start the FTP server
  * @param config_file Configuration file path
  * @param daemon_mode Run as daemon
+ * @param upgrade Take the listening sockets over from the running server
  * @return true if started successfully, false otherwise
  */
-bool startServer(const std::string& config_file, bool daemon_mode) {
+bool startServer(const std::string& config_file, bool daemon_mode, bool upgrade) {
     try {
         // Load configuration
         auto config = std::make_shared<FTPServerConfig>();
@@ -726,6 +815,19 @@ bool startServer(const std::string& config_file, bool daemon_mode) {
         // Create and start server
         g_server = std::make_shared<FTPServer>(config);
 
+        // The old server keeps accepting until this one acknowledges, so a
+        // failure anywhere before that leaves clients unaffected
+        std::unique_ptr<ListenerHandoff> predecessor;
+        if (upgrade) {
+            predecessor = std::make_unique<ListenerHandoff>(g_logger, getUpgradeSocket());
+            std::vector<int> listeners;
+            if (!predecessor->fetch(listeners)) {
+                g_logger->error("Upgrade failed: could not take over the running server's listeners");
+                return false;
+            }
+            g_server->adoptListeners(listeners);
+        }
+
         if (!g_server->start()) {
             g_logger->error("Failed to start FTP server");
             return false;
@@ -734,16 +836,20 @@ bool startServer(const std::string& config_file, bool daemon_mode) {
         // Write PID file
         writePidFile();
 
+        if (predecessor && !predecessor->acknowledge()) {
+            g_logger->warn("Previous server went away before the handoff completed");
+        }
+
         g_logger->info("FTP server started successfully");
         g_logger->info("Listening on " + config->connection.bind_address + ":" + std::to_string(config->connection.bind_port));
 
         // Main server loop
-        while (!g_shutdown_requested && g_server->isRunning()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(100));
-        }
+        serveUntilShutdown(config_file);
 
         g_logger->info("FTP server shutdown complete");
-        removePidFile();
+        if (!g_handed_off) {
+            removePidFile();
+        }
         return true;
     } catch (const std::exception& e) {
         std::cerr << "Error starting FTP server: " << e.what() << std::endl;
@@ -828,12 +934,13 @@ int main(int argc, char* argv[]) {
     }
 
     // Setup signal handlers for server commands
-    if (command.empty() || command == "start") {
+    bool serving = command.empty() || command == "start" || command == "upgrade";
+    if (serving) {
         setupSignalHandlers();
     }
 
     // Handle daemon mode
-    if (daemon_mode && !foreground_mode && (command.empty() || command == "start")) {
+    if (daemon_mode && !foreground_mode && serving) {
         if (!daemonize()) {
             std::cerr << "Error: Failed to daemonize process" << std::endl;
             return 1;
@@ -841,8 +948,8 @@ int main(int argc, char* argv[]) {
     }
 
     // Start server if no specific command or start command
-    if (command.empty() || command == "start") {
-        if (!startServer(config_file, daemon_mode)) {
+    if (serving) {
+        if (!startServer(config_file, daemon_mode, command == "upgrade")) {
             return 1;
         }
     } else {
@@ -0,0 +1,59 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/config/config_store.hpp"
+#include "simple-sftpd/config/server_config.hpp"
+#include <filesystem>
+
+namespace simple_sftpd {
+
+ConfigStore::ConfigStore(std::shared_ptr<const FTPServerConfig> initial)
+    : current_(std::move(initial)), version_(1) {
+}
+
+std::shared_ptr<const FTPServerConfig> ConfigStore::current() const {
+    return std::atomic_load_explicit(&current_, std::memory_order_acquire);
+}
+
+void ConfigStore::publish(std::shared_ptr<const FTPServerConfig> next) {
+    if (!next) {
+        return;
+    }
+    std::atomic_store_explicit(&current_, std::move(next), std::memory_order_release);
+    version_.fetch_add(1, std::memory_order_release);
+}
+
+std::shared_ptr<FTPServerConfig> ConfigStore::load(const std::string& filename, std::vector<std::string>& errors) {
+    // A missing file would otherwise load as all defaults
+    if (!std::filesystem::exists(filename)) {
+        errors.assign(1, "Configuration file not found: " + filename);
+        return nullptr;
+    }
+    
+    auto config = std::make_shared<FTPServerConfig>();
+    bool loaded = config->loadFromFile(filename);
+    if (loaded && config->validate()) {
+        errors.clear();
+        return config;
+    }
+    errors = config->getErrors();
+    if (errors.empty()) {
+        errors.push_back("Failed to load configuration from " + filename);
+    }
+    return nullptr;
+}
+
+} // namespace simple_sftpd
@@ -19,8 +19,11 @@
 #include <iostream>
 #include <sstream>
 #include <algorithm>
+#include <utility>
 #include <cctype>
 #include <filesystem>
+#include <arpa/inet.h>
+#include <strings.h>
 
 #if defined(ENABLE_JSON) || defined(SIMPLE_SFTPD_JSON_ENABLED)
 #include <json/json.h>
@@ -31,6 +34,43 @@
 
 namespace simple_sftpd {
 
+namespace {
+
+// "a, b, c" or "[a, b, c]" into its trimmed, unquoted items
+std::vector<std::string> splitList(std::string value) {
+    if (value.size() >= 2 && value.front() == '[' && value.back() == ']') {
+        value = value.substr(1, value.size() - 2);
+    }
+    std::vector<std::string> items;
+    std::istringstream stream(value);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        item.erase(0, item.find_first_not_of(" \t\"'"));
+        item.erase(item.find_last_not_of(" \t\"'") + 1);
+        if (!item.empty()) {
+            items.push_back(item);
+        }
+    }
+    return items;
+}
+
+bool isAddressOrRange(const std::string& entry) {
+    size_t slash = entry.find('/');
+    std::string address = entry.substr(0, slash);
+    struct in_addr parsed;
+    if (inet_pton(AF_INET, address.c_str(), &parsed) != 1) {
+        return false;
+    }
+    if (slash == std::string::npos) {
+        return true;
+    }
+    std::string prefix = entry.substr(slash + 1);
+    return !prefix.empty() && prefix.size() <= 2 &&
+           std::all_of(prefix.begin(), prefix.end(), ::isdigit) && std::stoi(prefix) <= 32;
+}
+
+} // namespace
+
 bool FTPServerConfig::loadFromFile(const std::string& filename) {
     clearErrors();
     
@@ -135,6 +175,36 @@ bool FTPServerConfig::loadFromINI(const std::string& filename) {
                 connection.max_connections = std::stoi(value);
             } else if (key == "timeout_seconds" || key == "connection_timeout") {
                 connection.timeout_seconds = std::stoi(value);
+            } else if (key == "login_timeout_seconds") {
+                connection.login_timeout_seconds = std::stoi(value);
+            } else if (key == "data_stall_timeout_seconds") {
+                connection.data_stall_timeout_seconds = std::stoi(value);
+            } else if (key == "drain_timeout_seconds") {
+                connection.drain_timeout_seconds = std::stoi(value);
+            } else if (key == "listener_shards") {
+                connection.listener_shards = std::stoi(value);
+            } else if (key == "engine") {
+                connection.engine = value;
+            } else if (key == "event_loop_threads") {
+                connection.event_loop_threads = std::stoi(value);
+            } else if (key == "worker_threads") {
+                connection.worker_threads = std::stoi(value);
+            } else if (key == "tls_worker_threads") {
+                connection.tls_worker_threads = std::stoi(value);
+            } else if (key == "transfer_engine") {
+                connection.transfer_engine = value;
+            } else if (key == "transfer_buffer_memory_mb") {
+                connection.transfer_buffer_memory_mb = std::stoi(value);
+            } else if (key == "memory_budget_mb") {
+                connection.memory_budget_mb = std::stoi(value);
+            } else if (key == "user_memory_budget_mb") {
+                connection.user_memory_budget_mb = std::stoi(value);
+            } else if (key == "reserved_admin_slots") {
+                connection.reserved_admin_slots = std::stoi(value);
+            } else if (key == "max_loop_lag_ms") {
+                connection.max_loop_lag_ms = std::stoi(value);
+            } else if (key == "max_worker_queue_depth") {
+                connection.max_worker_queue_depth = std::stoi(value);
             }
         } else if (current_section == "logging") {
             if (key == "log_file") {
@@ -173,8 +243,46 @@ bool FTPServerConfig::loadFromINI(const std::string& filename) {
                 security.require_client_cert = (value == "true" || value == "1");
             } else if (key == "ssl_client_ca_file") {
                 security.ssl_client_ca_file = value;
+            } else if (key == "require_ssl_reuse") {
+                security.require_ssl_reuse = (value == "true" || value == "1");
+            } else if (key == "ssl_kernel_offload") {
+                security.ssl_kernel_offload = (value == "true" || value == "1");
+            } else if (key == "ssl_session_cache_size") {
+                security.ssl_session_cache_size = std::stoi(value);
+            } else if (key == "ssl_session_timeout_seconds") {
+                security.ssl_session_timeout_seconds = std::stoi(value);
+            } else if (key == "ssl_handshake_timeout_seconds") {
+                security.ssl_handshake_timeout_seconds = std::stoi(value);
+            } else if (key == "ssl_cert_check_seconds") {
+                security.ssl_cert_check_seconds = std::stoi(value);
+            } else if (key == "ssl_ticket_key_rotation_seconds") {
+                security.ssl_ticket_key_rotation_seconds = std::stoi(value);
+            } else if (key == "ssl_ticket_key_shm") {
+                security.ssl_ticket_key_shm = value;
             } else if (key == "enable_pam") {
                 security.enable_pam = (value == "true" || value == "1");
+            } else if (key == "allowed_ips") {
+                security.allowed_ips = splitList(value);
+            } else if (key == "blocked_ips") {
+                security.blocked_ips = splitList(value);
+            } else if (key == "admin_users") {
+                security.admin_users = splitList(value);
+            } else if (key == "admin_ips") {
+                security.admin_ips = splitList(value);
+            }
+        } else if (current_section.compare(0, 13, "virtual_host ") == 0) {
+            std::string hostname = current_section.substr(13);
+            hostname.erase(0, hostname.find_first_not_of(" \t"));
+            auto host = std::find_if(virtual_hosts.begin(), virtual_hosts.end(),
+                                     [&hostname](const VirtualHostConfig& entry) { return entry.hostname == hostname; });
+            if (host == virtual_hosts.end()) {
+                virtual_hosts.push_back(VirtualHostConfig{hostname, "", ""});
+                host = virtual_hosts.end() - 1;
+            }
+            if (key == "ssl_cert_file") {
+                host->ssl_cert_file = value;
+            } else if (key == "ssl_key_file") {
+                host->ssl_key_file = value;
             }
         } else if (current_section == "rate_limit") {
             if (key == "enabled") {
@@ -220,9 +328,26 @@ bool FTPServerConfig::loadFromJSON(const std::string& filename) {
         if (conn.isMember("bind_port")) connection.bind_port = conn["bind_port"].asInt();
         if (conn.isMember("max_connections")) connection.max_connections = conn["max_connections"].asInt();
         if (conn.isMember("timeout_seconds")) connection.timeout_seconds = conn["timeout_seconds"].asInt();
+        if (conn.isMember("login_timeout_seconds")) connection.login_timeout_seconds = conn["login_timeout_seconds"].asInt();
+        if (conn.isMember("data_stall_timeout_seconds")) connection.data_stall_timeout_seconds = conn["data_stall_timeout_seconds"].asInt();
+        if (conn.isMember("drain_timeout_seconds")) connection.drain_timeout_seconds = conn["drain_timeout_seconds"].asInt();
         if (conn.isMember("passive_mode")) connection.passive_mode = conn["passive_mode"].asBool();
         if (conn.isMember("passive_port_range_start")) connection.passive_port_range_start = conn["passive_port_range_start"].asInt();
         if (conn.isMember("passive_port_range_end")) connection.passive_port_range_end = conn["passive_port_range_end"].asInt();
+        if (conn.isMember("passive_pool_size")) connection.passive_pool_size = conn["passive_pool_size"].asInt();
+        if (conn.isMember("data_connection_timeout_seconds")) connection.data_connection_timeout_seconds = conn["data_connection_timeout_seconds"].asInt();
+        if (conn.isMember("listener_shards")) connection.listener_shards = conn["listener_shards"].asInt();
+        if (conn.isMember("engine")) connection.engine = conn["engine"].asString();
+        if (conn.isMember("event_loop_threads")) connection.event_loop_threads = conn["event_loop_threads"].asInt();
+        if (conn.isMember("worker_threads")) connection.worker_threads = conn["worker_threads"].asInt();
+        if (conn.isMember("tls_worker_threads")) connection.tls_worker_threads = conn["tls_worker_threads"].asInt();
+        if (conn.isMember("transfer_engine")) connection.transfer_engine = conn["transfer_engine"].asString();
+        if (conn.isMember("transfer_buffer_memory_mb")) connection.transfer_buffer_memory_mb = conn["transfer_buffer_memory_mb"].asInt();
+        if (conn.isMember("memory_budget_mb")) connection.memory_budget_mb = conn["memory_budget_mb"].asInt();
+        if (conn.isMember("user_memory_budget_mb")) connection.user_memory_budget_mb = conn["user_memory_budget_mb"].asInt();
+        if (conn.isMember("reserved_admin_slots")) connection.reserved_admin_slots = conn["reserved_admin_slots"].asInt();
+        if (conn.isMember("max_loop_lag_ms")) connection.max_loop_lag_ms = conn["max_loop_lag_ms"].asInt();
+        if (conn.isMember("max_worker_queue_depth")) connection.max_worker_queue_depth = conn["max_worker_queue_depth"].asInt();
     }
     
     // Parse logging section
@@ -245,12 +370,48 @@ bool FTPServerConfig::loadFromJSON(const std::string& filename) {
         if (sec.isMember("ssl_ca_file")) security.ssl_ca_file = sec["ssl_ca_file"].asString();
         if (sec.isMember("require_client_cert")) security.require_client_cert = sec["require_client_cert"].asBool();
         if (sec.isMember("ssl_client_ca_file")) security.ssl_client_ca_file = sec["ssl_client_ca_file"].asString();
+        if (sec.isMember("require_ssl_reuse")) security.require_ssl_reuse = sec["require_ssl_reuse"].asBool();
+        if (sec.isMember("ssl_kernel_offload")) security.ssl_kernel_offload = sec["ssl_kernel_offload"].asBool();
+        if (sec.isMember("ssl_session_cache_size")) security.ssl_session_cache_size = sec["ssl_session_cache_size"].asInt();
+        if (sec.isMember("ssl_session_timeout_seconds")) security.ssl_session_timeout_seconds = sec["ssl_session_timeout_seconds"].asInt();
+        if (sec.isMember("ssl_handshake_timeout_seconds")) security.ssl_handshake_timeout_seconds = sec["ssl_handshake_timeout_seconds"].asInt();
+        if (sec.isMember("ssl_cert_check_seconds")) security.ssl_cert_check_seconds = sec["ssl_cert_check_seconds"].asInt();
+        if (sec.isMember("ssl_ticket_key_rotation_seconds")) security.ssl_ticket_key_rotation_seconds = sec["ssl_ticket_key_rotation_seconds"].asInt();
+        if (sec.isMember("ssl_ticket_key_shm")) security.ssl_ticket_key_shm = sec["ssl_ticket_key_shm"].asString();
         if (sec.isMember("chroot_enabled")) security.chroot_enabled = sec["chroot_enabled"].asBool();
         if (sec.isMember("chroot_directory")) security.chroot_directory = sec["chroot_directory"].asString();
         if (sec.isMember("drop_privileges")) security.drop_privileges = sec["drop_privileges"].asBool();
         if (sec.isMember("run_as_user")) security.run_as_user = sec["run_as_user"].asString();
         if (sec.isMember("run_as_group")) security.run_as_group = sec["run_as_group"].asString();
         if (sec.isMember("enable_pam")) security.enable_pam = sec["enable_pam"].asBool();
+        std::pair<const char*, std::vector<std::string>*> lists[] = {
+            {"allowed_ips", &security.allowed_ips},
+            {"blocked_ips", &security.blocked_ips},
+            {"admin_users", &security.admin_users},
+            {"admin_ips", &security.admin_ips},
+        };
+        for (const auto& [key, target] : lists) {
+            if (!sec.isMember(key)) {
+                continue;
+            }
+            std::vector<std::string> entries;
+            if (sec[key].isArray()) {
+                for (const auto& entry : sec[key]) {
+                    entries.push_back(entry.asString());
+                }
+            } else {
+                entries = splitList(sec[key].asString());
+            }
+            *target = entries;
+        }
+    }
+    
+    // Parse virtual_hosts: [{"hostname": ..., "ssl_cert_file": ..., "ssl_key_file": ...}]
+    if (root.isMember("virtual_hosts")) {
+        for (const auto& host : root["virtual_hosts"]) {
+            virtual_hosts.push_back(VirtualHostConfig{host["hostname"].asString(), host["ssl_cert_file"].asString(),
+                                                      host["ssl_key_file"].asString()});
+        }
     }
     
     // Parse rate_limit section
@@ -336,12 +497,46 @@ bool FTPServerConfig::loadFromYAML(const std::string& filename) {
                 connection.max_connections = std::stoi(value);
             } else if (key == "timeout_seconds") {
                 connection.timeout_seconds = std::stoi(value);
+            } else if (key == "login_timeout_seconds") {
+                connection.login_timeout_seconds = std::stoi(value);
+            } else if (key == "data_stall_timeout_seconds") {
+                connection.data_stall_timeout_seconds = std::stoi(value);
+            } else if (key == "drain_timeout_seconds") {
+                connection.drain_timeout_seconds = std::stoi(value);
             } else if (key == "passive_mode") {
                 connection.passive_mode = (value == "true" || value == "1");
             } else if (key == "passive_port_range_start") {
                 connection.passive_port_range_start = std::stoi(value);
             } else if (key == "passive_port_range_end") {
                 connection.passive_port_range_end = std::stoi(value);
+            } else if (key == "passive_pool_size") {
+                connection.passive_pool_size = std::stoi(value);
+            } else if (key == "data_connection_timeout_seconds") {
+                connection.data_connection_timeout_seconds = std::stoi(value);
+            } else if (key == "listener_shards") {
+                connection.listener_shards = std::stoi(value);
+            } else if (key == "engine") {
+                connection.engine = value;
+            } else if (key == "event_loop_threads") {
+                connection.event_loop_threads = std::stoi(value);
+            } else if (key == "worker_threads") {
+                connection.worker_threads = std::stoi(value);
+            } else if (key == "tls_worker_threads") {
+                connection.tls_worker_threads = std::stoi(value);
+            } else if (key == "transfer_engine") {
+                connection.transfer_engine = value;
+            } else if (key == "transfer_buffer_memory_mb") {
+                connection.transfer_buffer_memory_mb = std::stoi(value);
+            } else if (key == "memory_budget_mb") {
+                connection.memory_budget_mb = std::stoi(value);
+            } else if (key == "user_memory_budget_mb") {
+                connection.user_memory_budget_mb = std::stoi(value);
+            } else if (key == "reserved_admin_slots") {
+                connection.reserved_admin_slots = std::stoi(value);
+            } else if (key == "max_loop_lag_ms") {
+                connection.max_loop_lag_ms = std::stoi(value);
+            } else if (key == "max_worker_queue_depth") {
+                connection.max_worker_queue_depth = std::stoi(value);
             }
         } else if (current_section == "logging") {
             if (key == "log_file") {
@@ -370,6 +565,22 @@ bool FTPServerConfig::loadFromYAML(const std::string& filename) {
                 security.require_client_cert = (value == "true" || value == "1");
             } else if (key == "ssl_client_ca_file") {
                 security.ssl_client_ca_file = value;
+            } else if (key == "require_ssl_reuse") {
+                security.require_ssl_reuse = (value == "true" || value == "1");
+            } else if (key == "ssl_kernel_offload") {
+                security.ssl_kernel_offload = (value == "true" || value == "1");
+            } else if (key == "ssl_session_cache_size") {
+                security.ssl_session_cache_size = std::stoi(value);
+            } else if (key == "ssl_session_timeout_seconds") {
+                security.ssl_session_timeout_seconds = std::stoi(value);
+            } else if (key == "ssl_handshake_timeout_seconds") {
+                security.ssl_handshake_timeout_seconds = std::stoi(value);
+            } else if (key == "ssl_cert_check_seconds") {
+                security.ssl_cert_check_seconds = std::stoi(value);
+            } else if (key == "ssl_ticket_key_rotation_seconds") {
+                security.ssl_ticket_key_rotation_seconds = std::stoi(value);
+            } else if (key == "ssl_ticket_key_shm") {
+                security.ssl_ticket_key_shm = value;
             } else if (key == "chroot_enabled") {
                 security.chroot_enabled = (value == "true" || value == "1");
             } else if (key == "chroot_directory") {
@@ -382,6 +593,14 @@ bool FTPServerConfig::loadFromYAML(const std::string& filename) {
                 security.run_as_group = value;
             } else if (key == "enable_pam") {
                 security.enable_pam = (value == "true" || value == "1");
+            } else if (key == "allowed_ips") {
+                security.allowed_ips = splitList(value);
+            } else if (key == "blocked_ips") {
+                security.blocked_ips = splitList(value);
+            } else if (key == "admin_users") {
+                security.admin_users = splitList(value);
+            } else if (key == "admin_ips") {
+                security.admin_ips = splitList(value);
             }
         } else if (current_section == "rate_limit") {
             if (key == "enabled") {
@@ -418,6 +637,131 @@ bool FTPServerConfig::validate() {
         addError("Invalid timeout: " + std::to_string(connection.timeout_seconds));
     }
     
+    if (connection.login_timeout_seconds < 0) {
+        addError("Invalid login timeout: " + std::to_string(connection.login_timeout_seconds));
+    }
+    
+    if (connection.data_stall_timeout_seconds < 0) {
+        addError("Invalid data stall timeout: " + std::to_string(connection.data_stall_timeout_seconds));
+    }
+    
+    if (connection.drain_timeout_seconds < 0) {
+        addError("Invalid drain timeout: " + std::to_string(connection.drain_timeout_seconds));
+    }
+    
+    for (const auto* list : {&security.allowed_ips, &security.blocked_ips}) {
+        for (const auto& entry : *list) {
+            if (!isAddressOrRange(entry)) {
+                addError("Invalid IP address or range: " + entry);
+            }
+        }
+    }
+    
+    if (connection.passive_port_range_start <= 0 || connection.passive_port_range_end > 65535 ||
+        connection.passive_port_range_start > connection.passive_port_range_end) {
+        addError("Invalid passive port range: " + std::to_string(connection.passive_port_range_start) +
+                 "-" + std::to_string(connection.passive_port_range_end));
+    }
+    
+    if (connection.data_connection_timeout_seconds <= 0) {
+        addError("Invalid data connection timeout: " + std::to_string(connection.data_connection_timeout_seconds));
+    }
+    
+    if (connection.passive_pool_size < 0 ||
+        connection.passive_pool_size > connection.passive_port_range_end - connection.passive_port_range_start + 1) {
+        addError("Invalid passive pool size: " + std::to_string(connection.passive_pool_size));
+    }
+    
+    if (connection.listener_shards < 0) {
+        addError("Invalid listener shards: " + std::to_string(connection.listener_shards));
+    }
+    
+    if (connection.engine != "threads" && connection.engine != "reactor") {
+        addError("Invalid connection engine: " + connection.engine);
+    }
+    
+    if (connection.event_loop_threads < 0) {
+        addError("Invalid event loop threads: " + std::to_string(connection.event_loop_threads));
+    }
+    
+    if (connection.worker_threads < 1) {
+        addError("Invalid worker threads: " + std::to_string(connection.worker_threads));
+    }
+    
+    if (connection.tls_worker_threads < 0) {
+        addError("Invalid TLS worker threads: " + std::to_string(connection.tls_worker_threads));
+    }
+    
+    if (connection.transfer_engine != "zero_copy" && connection.transfer_engine != "io_uring") {
+        addError("Invalid transfer engine: " + connection.transfer_engine);
+    }
+    
+    if (connection.transfer_buffer_memory_mb < 0) {
+        addError("Invalid transfer buffer memory: " + std::to_string(connection.transfer_buffer_memory_mb));
+    }
+    
+    if (connection.memory_budget_mb < 0) {
+        addError("Invalid memory budget: " + std::to_string(connection.memory_budget_mb));
+    }
+    
+    if (connection.user_memory_budget_mb < 0) {
+        addError("Invalid user memory budget: " + std::to_string(connection.user_memory_budget_mb));
+    }
+    
+    if (connection.reserved_admin_slots < 0 || connection.reserved_admin_slots >= connection.max_connections) {
+        addError("Invalid reserved admin slots: " + std::to_string(connection.reserved_admin_slots) +
+                 " (must be below max connections)");
+    }
+    
+    if (connection.max_loop_lag_ms < 0) {
+        addError("Invalid max loop lag: " + std::to_string(connection.max_loop_lag_ms));
+    }
+    
+    if (connection.max_worker_queue_depth < 0) {
+        addError("Invalid max worker queue depth: " + std::to_string(connection.max_worker_queue_depth));
+    }
+    
+    if (security.ssl_session_cache_size < 0) {
+        addError("Invalid SSL session cache size: " + std::to_string(security.ssl_session_cache_size));
+    }
+    
+    if (security.ssl_session_timeout_seconds <= 0) {
+        addError("Invalid SSL session timeout: " + std::to_string(security.ssl_session_timeout_seconds));
+    }
+    
+    if (security.ssl_handshake_timeout_seconds <= 0) {
+        addError("Invalid SSL handshake timeout: " + std::to_string(security.ssl_handshake_timeout_seconds));
+    }
+    
+    if (security.ssl_ticket_key_rotation_seconds < 0) {
+        addError("Invalid SSL ticket key rotation: " + std::to_string(security.ssl_ticket_key_rotation_seconds));
+    }
+    
+    if (!security.ssl_ticket_key_shm.empty() &&
+        (security.ssl_ticket_key_shm[0] != '/' || security.ssl_ticket_key_shm.find('/', 1) != std::string::npos)) {
+        addError("Invalid SSL ticket key shared memory name: " + security.ssl_ticket_key_shm +
+                 " (must be \"/name\")");
+    }
+    
+    if (security.ssl_cert_check_seconds < 0) {
+        addError("Invalid SSL certificate check interval: " + std::to_string(security.ssl_cert_check_seconds));
+    }
+    
+    for (size_t i = 0; i < virtual_hosts.size(); ++i) {
+        const VirtualHostConfig& host = virtual_hosts[i];
+        if (host.hostname.empty() || host.ssl_cert_file.empty() || host.ssl_key_file.empty()) {
+            addError("Virtual host \"" + host.hostname + "\" needs a hostname, ssl_cert_file and ssl_key_file");
+        }
+        for (size_t j = 0; j < i; ++j) {
+            if (strcasecmp(virtual_hosts[j].hostname.c_str(), host.hostname.c_str()) == 0) {
+                addError("Duplicate virtual host: " + host.hostname);
+            }
+        }
+    }
+    if (!virtual_hosts.empty() && security.ssl_cert_file.empty()) {
+        addError("Virtual hosts need a default certificate (security.ssl_cert_file)");
+    }
+    
     return errors_.empty();
 }
 
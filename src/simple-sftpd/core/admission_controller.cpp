@@ -0,0 +1,115 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/admission_controller.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace simple_sftpd {
+
+AdmissionController::AdmissionController(const Limits& limits)
+    : limits_(limits), admin_only_sessions_(0),
+      jitter_(static_cast<std::minstd_rand::result_type>(std::chrono::steady_clock::now().time_since_epoch().count())),
+      window_start_(std::chrono::steady_clock::now()), window_rejections_(0), previous_rejections_(0),
+      admitted_(0), admin_only_(0), rejected_(0) {
+}
+
+void AdmissionController::setLimits(const Limits& limits) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    limits_ = limits;
+}
+
+AdmissionController::Decision AdmissionController::decide(const Load& load, bool privileged) {
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(mutex_);
+    
+    Decision decision;
+    bool full = limits_.max_sessions > 0 && load.sessions >= limits_.max_sessions;
+    bool reserved = limits_.reserved_slots > 0 && load.sessions + limits_.reserved_slots >= limits_.max_sessions;
+    if (!full && ((!reserved && !isOverloaded(load)) || privileged)) {
+        ++admitted_;
+        return decision;
+    }
+    
+    decision.retry_seconds = retryAfter(load, now);
+    if (!full && admin_only_sessions_ < limits_.reserved_slots) {
+        ++admin_only_sessions_;
+        ++admin_only_;
+        decision.verdict = Verdict::ADMIN_ONLY;
+        return decision;
+    }
+    
+    ++rejected_;
+    ++window_rejections_;
+    decision.verdict = Verdict::REJECT;
+    return decision;
+}
+
+void AdmissionController::releaseAdminOnly() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (admin_only_sessions_ > 0) {
+        --admin_only_sessions_;
+    }
+}
+
+AdmissionController::Stats AdmissionController::getStats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.admitted = admitted_;
+    stats.admin_only = admin_only_;
+    stats.rejected = rejected_;
+    stats.admin_only_sessions = admin_only_sessions_;
+    return stats;
+}
+
+bool AdmissionController::isOverloaded(const Load& load) const {
+    if (limits_.max_loop_lag.count() > 0 && load.loop_lag > limits_.max_loop_lag) {
+        return true;
+    }
+    return limits_.max_queue_depth > 0 && load.queue_depth > limits_.max_queue_depth;
+}
+
+int AdmissionController::retryAfter(const Load& load, std::chrono::steady_clock::time_point now) {
+    if (now - window_start_ >= REJECTION_WINDOW) {
+        previous_rejections_ = now - window_start_ >= 2 * REJECTION_WINDOW ? 0 : window_rejections_;
+        window_rejections_ = 0;
+        window_start_ = now;
+    }
+    
+    // How far past its worst limit the server is...
+    double pressure = 1.0;
+    if (limits_.max_sessions > 0) {
+        pressure = std::max(pressure, static_cast<double>(load.sessions) / limits_.max_sessions);
+    }
+    if (limits_.max_loop_lag.count() > 0) {
+        pressure = std::max(pressure, static_cast<double>(load.loop_lag.count()) / limits_.max_loop_lag.count());
+    }
+    if (limits_.max_queue_depth > 0) {
+        pressure = std::max(pressure, static_cast<double>(load.queue_depth) / limits_.max_queue_depth);
+    }
+    
+    // ...and how many clients are already waiting to come back, relative
+    // to what the server holds
+    uint64_t recent = window_rejections_ + previous_rejections_;
+    double storm = 1.0 + static_cast<double>(recent) / std::max<size_t>(limits_.max_sessions, 1);
+    
+    std::uniform_real_distribution<double> spread(0.75, 1.25);
+    double seconds = MIN_RETRY_SECONDS * pressure * storm * spread(jitter_);
+    return static_cast<int>(std::clamp(std::lround(seconds), static_cast<long>(MIN_RETRY_SECONDS),
+                                       static_cast<long>(MAX_RETRY_SECONDS)));
+}
+
+} // namespace simple_sftpd
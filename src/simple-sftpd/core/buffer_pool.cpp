@@ -0,0 +1,217 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/buffer_pool.hpp"
+#include <sys/mman.h>
+#include <algorithm>
+#include <functional>
+#include <thread>
+
+namespace simple_sftpd {
+
+BufferPool::Buffer::Buffer(Buffer&& other) noexcept
+    : pool_(other.pool_), data_(other.data_), size_(other.size_) {
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+    other.size_ = 0;
+}
+
+BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        reset();
+        pool_ = other.pool_;
+        data_ = other.data_;
+        size_ = other.size_;
+        other.pool_ = nullptr;
+        other.data_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+void BufferPool::Buffer::reset() {
+    if (data_) {
+        pool_->release(data_, size_);
+        pool_ = nullptr;
+        data_ = nullptr;
+        size_ = 0;
+    }
+}
+
+BufferPool::BufferPool(size_t memory_limit)
+    : memory_limit_(memory_limit), hits_(0), misses_(0), bytes_in_use_(0), bytes_mapped_(0),
+      hugepage_bytes_(0), hugetlb_usable_(true) {
+}
+
+BufferPool::~BufferPool() {
+    for (const Mapping& mapping : mappings_) {
+        munmap(mapping.address, mapping.length);
+    }
+}
+
+std::shared_ptr<BufferPool> BufferPool::global() {
+    // Never destroyed: threads hand their buffers back while they exit
+    static std::shared_ptr<BufferPool>* pool = new std::shared_ptr<BufferPool>(std::make_shared<BufferPool>());
+    return *pool;
+}
+
+BufferPool::Buffer BufferPool::acquire(size_t preferred, size_t minimum) {
+    preferred = std::min(std::max(preferred, MIN_BUFFER), MAX_BUFFER);
+    minimum = std::min(std::max(minimum, MIN_BUFFER), preferred);
+    size_t top = classIndex(preferred);
+    size_t bottom = classIndex(minimum);
+
+    size_t index = top;
+    char* data = takeFree(index);
+    bool hit = data != nullptr;
+    if (!data) {
+        data = mapClass(index);
+    }
+    // At the memory limit: any free buffer that is big enough will do
+    while (!data && index > bottom) {
+        data = takeFree(--index);
+        hit = data != nullptr;
+    }
+
+    (hit ? hits_ : misses_).fetch_add(1, std::memory_order_relaxed);
+    if (!data) {
+        return Buffer();
+    }
+    size_t size = MIN_BUFFER << index;
+    bytes_in_use_.fetch_add(size, std::memory_order_relaxed);
+    return Buffer(this, data, size);
+}
+
+BufferPool::Stats BufferPool::getStats() const {
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.bytes_in_use = bytes_in_use_.load(std::memory_order_relaxed);
+    stats.bytes_mapped = bytes_mapped_.load(std::memory_order_relaxed);
+    stats.hugepage_bytes = hugepage_bytes_.load(std::memory_order_relaxed);
+    return stats;
+}
+
+size_t BufferPool::classSize(size_t bytes) {
+    return MIN_BUFFER << classIndex(bytes);
+}
+
+size_t BufferPool::classIndex(size_t bytes) {
+    size_t index = 0;
+    while (index + 1 < SIZE_CLASSES && (MIN_BUFFER << index) < bytes) {
+        ++index;
+    }
+    return index;
+}
+
+BufferPool::CacheShard& BufferPool::shardFor(std::array<CacheShard, CACHE_SHARDS>& shards) {
+    thread_local const size_t slot = std::hash<std::thread::id>()(std::this_thread::get_id()) % CACHE_SHARDS;
+    return shards[slot];
+}
+
+char* BufferPool::takeFree(size_t index) {
+    CacheShard& shard = shardFor(shards_);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.count[index] > 0) {
+            return shard.buffers[index][--shard.count[index]];
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (free_[index].empty()) {
+        return nullptr;
+    }
+    char* data = free_[index].back();
+    free_[index].pop_back();
+    return data;
+}
+
+char* BufferPool::mapClass(size_t index) {
+    size_t size = MIN_BUFFER << index;
+    size_t length = std::max(size, CHUNK_SIZE);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (bytes_mapped_.load(std::memory_order_relaxed) + length > memory_limit_.load(std::memory_order_relaxed)) {
+        return nullptr;
+    }
+    char* chunk = static_cast<char*>(mapChunk(length));
+    if (!chunk) {
+        return nullptr;
+    }
+    mappings_.push_back(Mapping{chunk, length});
+    bytes_mapped_.fetch_add(length, std::memory_order_relaxed);
+
+    // The first piece goes to the caller, the rest wait on the free list
+    for (size_t offset = length; offset > size; offset -= size) {
+        free_[index].push_back(chunk + offset - size);
+    }
+    return chunk;
+}
+
+void* BufferPool::mapChunk(size_t length) {
+#ifdef MAP_HUGETLB
+    if (hugetlb_usable_.load(std::memory_order_relaxed)) {
+        void* huge = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (huge != MAP_FAILED) {
+            hugepage_bytes_.fetch_add(length, std::memory_order_relaxed);
+            return huge;
+        }
+        // None reserved (vm.nr_hugepages) or all taken; do not ask again
+        hugetlb_usable_.store(false, std::memory_order_relaxed);
+    }
+#endif
+
+    // Over-map so the chunk can start on a 2 MiB boundary, where
+    // transparent hugepages can back it
+    size_t span = length + CHUNK_SIZE;
+    void* raw = mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        return nullptr;
+    }
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = (start + CHUNK_SIZE - 1) & ~(static_cast<uintptr_t>(CHUNK_SIZE) - 1);
+    if (aligned > start) {
+        munmap(raw, aligned - start);
+    }
+    size_t tail = start + span - (aligned + length);
+    if (tail > 0) {
+        munmap(reinterpret_cast<void*>(aligned + length), tail);
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(reinterpret_cast<void*>(aligned), length, MADV_HUGEPAGE);
+#endif
+    return reinterpret_cast<void*>(aligned);
+}
+
+void BufferPool::release(char* data, size_t size) {
+    bytes_in_use_.fetch_sub(size, std::memory_order_relaxed);
+    size_t index = classIndex(size);
+
+    CacheShard& shard = shardFor(shards_);
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (shard.count[index] < CACHED_PER_CLASS) {
+            shard.buffers[index][shard.count[index]++] = data;
+            return;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_[index].push_back(data);
+}
+
+} // namespace simple_sftpd
@@ -15,23 +15,37 @@
  */
 
 #include "simple-sftpd/core/connection.hpp"
+#include "simple-sftpd/core/buffer_pool.hpp"
+#include "simple-sftpd/core/command_table.hpp"
+#include "simple-sftpd/core/data_transfer.hpp"
+#include "simple-sftpd/core/event_loop.hpp"
+#include "simple-sftpd/core/passive_port_allocator.hpp"
+#include "simple-sftpd/core/worker_pool.hpp"
 #include "simple-sftpd/utils/logger.hpp"
+#include "simple-sftpd/utils/performance_monitor.hpp"
 #include "simple-sftpd/user/user_manager.hpp"
 #include "simple-sftpd/user/user.hpp"
 #include "simple-sftpd/config/server_config.hpp"
+#include "simple-sftpd/config/config_store.hpp"
 #include "simple-sftpd/security/ssl_context.hpp"
+#include "simple-sftpd/security/tls_context_registry.hpp"
 #include "simple-sftpd/utils/file_cache.hpp"
 #include "simple-sftpd/security/pam_auth.hpp"
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
-#include <sys/select.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <charconv>
 #include <cstring>
-#include <sstream>
+#include <string_view>
 #include <algorithm>
-#include <vector>
 #include <filesystem>
 #include <fstream>
 #include <dirent.h>
@@ -41,53 +55,146 @@
 #ifndef _WIN32
 #include <pwd.h>
 #endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+#ifndef MSG_MORE
+#define MSG_MORE 0
+#endif
 
 namespace simple_sftpd {
 
-FTPConnection::FTPConnection(int socket, std::shared_ptr<Logger> logger, std::shared_ptr<FTPServerConfig> config)
-    : socket_(socket), logger_(logger), config_(config), active_(false),
-      authenticated_(false), current_user_(nullptr), current_directory_("/"),
-      ssl_enabled_(false), ssl_active_(false), ssl_(nullptr), data_ssl_(nullptr),
-      passive_listen_socket_(-1), data_socket_(-1), transfer_type_("A"), protection_level_("C"),
-      active_mode_port_(0), active_mode_enabled_(false), resume_position_(0) {
-    user_manager_ = std::make_shared<FTPUserManager>(logger_);
+namespace {
+
+// Control-channel reads are sized for a batch of pipelined commands
+const size_t READ_CHUNK = 4096;
+
+// Reactor sessions stop reading once this much unparsed input is queued
+const size_t MAX_PENDING_INPUT = 16384;
+
+// Queued replies are written early once they reach this size
+const size_t OUTPUT_FLUSH_THRESHOLD = 16384;
+
+// Split "VERB argument" without copying; the argument is trimmed of
+// surrounding blanks and keeps its original case
+void splitCommand(std::string_view line, std::string_view& verb, std::string_view& argument) {
+    const char* blanks = " \t";
+    size_t verb_begin = line.find_first_not_of(blanks);
+    if (verb_begin == std::string_view::npos) {
+        verb = std::string_view();
+        argument = std::string_view();
+        return;
+    }
+    
+    size_t verb_end = line.find_first_of(blanks, verb_begin);
+    verb = line.substr(verb_begin, verb_end == std::string_view::npos ? std::string_view::npos : verb_end - verb_begin);
+    
+    size_t arg_begin = verb_end == std::string_view::npos ? std::string_view::npos : line.find_first_not_of(blanks, verb_end);
+    if (arg_begin == std::string_view::npos) {
+        argument = std::string_view();
+        return;
+    }
+    size_t arg_end = line.find_last_not_of(blanks);
+    argument = line.substr(arg_begin, arg_end - arg_begin + 1);
+}
+
+} // namespace
+
+std::shared_ptr<const SessionServices> SessionServices::create(const FTPServerConfig& config,
+                                                               std::shared_ptr<Logger> logger,
+                                                               std::shared_ptr<TlsSessionCache> session_cache,
+                                                               std::shared_ptr<TicketKeyRing> ticket_keys) {
+    auto services = std::make_shared<SessionServices>();
+    services->user_manager = std::make_shared<FTPUserManager>(logger);
     
     // Add default test user for development/testing
     auto test_user = std::make_shared<FTPUser>("test", "test", "/tmp");
-    user_manager_->addUser(test_user);
+    services->user_manager->addUser(test_user);
     
     // Add anonymous user if allowed
-    if (config->security.allow_anonymous) {
+    if (config.security.allow_anonymous) {
         auto anon_user = std::make_shared<FTPUser>("anonymous", "", "/tmp");
-        user_manager_->addUser(anon_user);
+        services->user_manager->addUser(anon_user);
     }
     
     // Initialize PAM if enabled
-    if (config->security.enable_pam) {
-        pam_auth_ = std::make_shared<PAMAuth>(logger_);
-        if (pam_auth_->isAvailable()) {
-            logger_->info("PAM authentication enabled");
+    if (config.security.enable_pam) {
+        services->pam_auth = std::make_shared<PAMAuth>(logger);
+        if (services->pam_auth->isAvailable()) {
+            logger->info("PAM authentication enabled");
         } else {
-            logger_->warn("PAM authentication requested but not available");
+            logger->warn("PAM authentication requested but not available");
         }
     }
     
-    // Initialize SSL if configured
-    if (!config->security.ssl_cert_file.empty() && !config->security.ssl_key_file.empty()) {
-        ssl_context_ = std::make_shared<SSLContext>(logger_);
-        if (ssl_context_->initialize(config->security.ssl_cert_file, config->security.ssl_key_file, 
-                                     config->security.ssl_ca_file, config->security.require_client_cert,
-                                     config->security.ssl_client_ca_file)) {
-            ssl_enabled_ = true;
-            logger_->info("SSL/TLS enabled for connection");
+    // Initialize SSL if configured; reads the certificate and key from disk
+    if (!config.security.ssl_cert_file.empty() && !config.security.ssl_key_file.empty()) {
+        auto ssl_context = std::make_shared<SSLContext>(logger);
+        if (ssl_context->initialize(config.security.ssl_cert_file, config.security.ssl_key_file,
+                                    config.security.ssl_ca_file, config.security.require_client_cert,
+                                    config.security.ssl_client_ca_file)) {
+            // A zero-sized cache leaves OpenSSL's own per-context one in place
+            ssl_context->setSessionCache(config.security.ssl_session_cache_size > 0 ? session_cache : nullptr,
+                                         std::chrono::seconds(config.security.ssl_session_timeout_seconds));
+            ssl_context->setTicketKeys(ticket_keys);
+            
+            // Each virtual host gets its own context, picked by the SNI name
+            // the client sends; resumption state is shared with the default
+            auto server_names = std::make_shared<TlsContextRegistry>();
+            for (const VirtualHostConfig& host : config.virtual_hosts) {
+                auto host_context = std::make_shared<SSLContext>(logger);
+                if (!host_context->initialize(host.ssl_cert_file, host.ssl_key_file, config.security.ssl_ca_file,
+                                              config.security.require_client_cert,
+                                              config.security.ssl_client_ca_file)) {
+                    logger->warn("Failed to initialize SSL context for virtual host " + host.hostname);
+                    services->certificates_loaded = false;
+                    continue;
+                }
+                host_context->setSessionCache(config.security.ssl_session_cache_size > 0 ? session_cache : nullptr,
+                                              std::chrono::seconds(config.security.ssl_session_timeout_seconds));
+                host_context->setTicketKeys(ticket_keys);
+                server_names->add(host.hostname, host_context);
+            }
+            ssl_context->setServerNames(server_names);
+            services->ssl_context = ssl_context;
+            logger->info("SSL/TLS enabled");
+            if (config.security.ssl_kernel_offload) {
+                logger->info(SSLContext::isKernelTlsAvailable()
+                                 ? "Kernel TLS offload available for protected data connections"
+                                 : "Kernel TLS offload unavailable (kernel tls module or OpenSSL support missing)");
+            }
         } else {
-            logger_->warn("Failed to initialize SSL context");
+            logger->warn("Failed to initialize SSL context");
+            services->certificates_loaded = false;
         }
     }
+    return services;
+}
+
+FTPConnection::FTPConnection(int socket, std::shared_ptr<Logger> logger, std::shared_ptr<const FTPServerConfig> config)
+    : socket_(socket), logger_(logger), config_(config), config_version_(0), registry_handle_(0),
+      admin_only_retry_(0), active_(false),
+      busy_(false), reactor_closed_(false), handshaking_(false), handshake_events_(0), handshake_timer_(0),
+      awaiting_data_(false), data_wait_fd_(-1), data_timer_(0),
+      idle_timer_(0), login_timer_(0), stall_timer_(0), transfer_progress_(0), stall_progress_seen_(0),
+      transfer_abort_error_(0),
+      connected_at_(std::chrono::steady_clock::now()),
+      authenticated_(false), current_user_(nullptr), current_directory_("/"),
+      ssl_enabled_(false), ssl_active_(false), ssl_(nullptr), data_ssl_(nullptr),
+      passive_listen_socket_(-1), passive_port_(-1), data_socket_(-1), prepared_data_socket_(-1),
+      transfer_type_(TransferType::ASCII), protection_level_(ProtectionLevel::CLEAR),
+      active_mode_enabled_(false), active_mode_address_(0), active_mode_port_(0), resume_position_(0),
+      arena_(nullptr) {
 }
 
 FTPConnection::~FTPConnection() {
-    stop();
+    if (event_loop_) {
+        // The loop and any worker have already let go of a reactor session
+        releaseResources();
+    } else {
+        stop();
+    }
+    releaseAdminSlot();
 }
 
 void FTPConnection::start() {
@@ -95,18 +202,90 @@ void FTPConnection::start() {
         return;
     }
     
+    ensureServices();
     active_ = true;
+    connected_at_ = std::chrono::steady_clock::now();
     client_thread_ = std::thread(&FTPConnection::handleClient, this);
     logger_->info("FTP connection started");
 }
 
+void FTPConnection::startReactor(std::shared_ptr<EventLoop> event_loop, std::shared_ptr<WorkerPool> workers,
+                                 std::shared_ptr<WorkerPool> tls_workers) {
+    if (active_) {
+        return;
+    }
+    
+    ensureServices();
+    active_ = true;
+    connected_at_ = std::chrono::steady_clock::now();
+    event_loop_ = event_loop;
+    workers_ = workers;
+    tls_workers_ = tls_workers;
+    
+    auto self = shared_from_this();
+    event_loop_->post([self]() {
+        if (!self->admitSession()) {
+            self->sendResponse("421 Server out of memory, try again later");
+            self->closeReactor();
+            return;
+        }
+        self->sendResponse("220 Welcome to Simple Secure FTP Daemon");
+        self->flushResponses();
+        if (!self->registerControl()) {
+            self->closeReactor();
+            return;
+        }
+        self->armSessionTimers();
+    });
+    logger_->info("FTP connection started");
+}
+
 void FTPConnection::stop() {
-    if (!active_) {
+    requestStop();
+    if (event_loop_) {
         return;
     }
     
+    if (client_thread_.joinable()) {
+        if (client_thread_.get_id() != std::this_thread::get_id()) {
+            client_thread_.join();
+        } else {
+            client_thread_.detach();  // the session thread dropped the last reference
+        }
+    }
+    
+    releaseResources();
+}
+
+void FTPConnection::requestStop() {
     active_ = false;
     
+    // Unblock the session thread or worker if it is waiting in
+    // recv()/SSL_read() or moving a file. Reactor sessions need this too: a
+    // loop that is stopping drops the teardown posted below, and the worker
+    // pool would then wait for the transfer to finish.
+    abortTransfer(ECANCELED);
+    shutdownControl();
+    
+    if (event_loop_) {
+        // Reactor sessions are torn down on their loop thread
+        std::weak_ptr<FTPConnection> weak_self = weak_from_this();
+        event_loop_->post([weak_self]() {
+            if (auto self = weak_self.lock()) {
+                self->closeReactor();
+            }
+        });
+    }
+}
+
+void FTPConnection::shutdownControl() {
+    std::lock_guard<std::mutex> lock(data_socket_mutex_);
+    if (socket_ >= 0) {
+        shutdown(socket_, SHUT_RDWR);
+    }
+}
+
+void FTPConnection::releaseResources() {
     // Cleanup SSL
     if (ssl_context_ && ssl_) {
         ssl_context_->shutdownSSL(ssl_);
@@ -120,180 +299,1000 @@ void FTPConnection::stop() {
     }
     
     closeDataSocket();
-    if (socket_ >= 0) {
-        close(socket_);
-        socket_ = -1;
+    bool closed = false;
+    {
+        // requestStop() may shut the descriptor down from another thread
+        std::lock_guard<std::mutex> lock(data_socket_mutex_);
+        if (socket_ >= 0) {
+            close(socket_);
+            socket_ = -1;
+            closed = true;
+        }
     }
-    if (client_thread_.joinable()) {
-        client_thread_.join();
+    if (closed) {
+        logger_->info("FTP connection stopped");
     }
-    logger_->info("FTP connection stopped");
 }
 
 bool FTPConnection::isActive() const {
     return active_;
 }
 
+void FTPConnection::setPassivePortAllocator(std::shared_ptr<PassivePortAllocator> allocator) {
+    passive_ports_ = allocator;
+}
+
+void FTPConnection::setPerformanceMonitor(std::shared_ptr<PerformanceMonitor> monitor) {
+    performance_monitor_ = monitor;
+}
+
+void FTPConnection::setMemoryAccountant(std::shared_ptr<MemoryAccountant> accountant) {
+    memory_accountant_ = accountant;
+    if (accountant) {
+        control_charge_ = MemoryAccountant::Charge(accountant->account(""), MemoryAccountant::Category::CONTROL);
+        chargeControlMemory();
+    }
+}
+
+void FTPConnection::chargeControlMemory() {
+    // Never refused: the session needs these to answer at all. Called
+    // between commands, which is when the buffers change size
+    control_charge_.force(sizeof(*this) + input_buffer_.capacity() + output_buffer_.capacity() +
+                          pending_output_.capacity() + argument_.capacity());
+}
+
+bool FTPConnection::admitSession() {
+    const auto& account = control_charge_.getAccount();
+    return !account || account->admit(0);
+}
+
+void FTPConnection::setAdminOnly(int retry_seconds, std::function<void()> on_release) {
+    admin_only_retry_ = std::max(retry_seconds, 1);
+    admin_slot_release_ = std::move(on_release);
+}
+
+bool FTPConnection::admitUser(const std::string& username) {
+    if (admin_only_retry_ == 0) {
+        return true;
+    }
+    const auto& admins = config_->security.admin_users;
+    if (std::find(admins.begin(), admins.end(), username) != admins.end()) {
+        return true;
+    }
+    logger_->warn("Server overloaded, turning away " + username + " on a reserved slot");
+    sendResponse("421 Service not available, try again in " + std::to_string(admin_only_retry_) + " seconds");
+    return false;
+}
+
+void FTPConnection::releaseAdminSlot() {
+    admin_only_retry_ = 0;
+    std::function<void()> release;
+    release.swap(admin_slot_release_);
+    if (release) {
+        release();
+    }
+}
+
+bool FTPConnection::admitTransfer() {
+    // Refused before anything is allocated; a transfer needs at least the
+    // smallest pooled buffer to be worth starting
+    const auto& account = control_charge_.getAccount();
+    if (account && !account->admit(BufferPool::MIN_BUFFER)) {
+        logger_->warn("Memory budget exhausted, refusing data transfer for " +
+                      (username_.empty() ? std::string("anonymous session") : username_));
+        sendResponse("425 Not enough memory for a data transfer, try again later");
+        return false;
+    }
+    return true;
+}
+
+void FTPConnection::setSessionServices(std::shared_ptr<const SessionServices> services) {
+    if (!services) {
+        return;
+    }
+    user_manager_ = services->user_manager;
+    pam_auth_ = services->pam_auth;
+    ssl_context_ = services->ssl_context;
+    ssl_enabled_ = ssl_context_ != nullptr;
+}
+
+void FTPConnection::ensureServices() {
+    if (!user_manager_) {
+        setSessionServices(SessionServices::create(*config_, logger_));
+    }
+}
+
+void FTPConnection::setConfigStore(std::shared_ptr<ConfigStore> store) {
+    config_store_ = store;
+    if (store) {
+        config_version_ = store->version();
+        config_ = store->current();
+    }
+}
+
+void FTPConnection::refreshConfig() {
+    // One atomic load per command; the snapshot is only fetched after a reload
+    if (config_store_ && config_store_->version() != config_version_) {
+        config_version_ = config_store_->version();
+        config_ = config_store_->current();
+    }
+}
+
+void FTPConnection::setRegistryHandle(uint64_t handle, std::function<void()> on_close) {
+    registry_handle_ = handle;
+    close_handler_ = std::move(on_close);
+}
+
+void FTPConnection::notifyClosed() {
+    // Deregister before giving back a reserved slot, so admission never
+    // sees the slot free while the session still counts
+    std::function<void()> handler;
+    handler.swap(close_handler_);
+    std::function<void()> release;
+    release.swap(admin_slot_release_);
+    admin_only_retry_ = 0;
+    if (handler) {
+        handler();
+    }
+    if (release) {
+        release();
+    }
+}
+
 void FTPConnection::handleClient() {
+    // Deregistering below may drop the last outside reference; hold one so
+    // the session is destroyed only once this thread is done with it
+    auto self = weak_from_this().lock();
+    
+    if (!admitSession()) {
+        sendResponse("421 Server out of memory, try again later");
+        flushResponses();
+        active_ = false;
+        notifyClosed();
+        return;
+    }
+    
     // Send welcome message
     sendResponse("220 Welcome to Simple Secure FTP Daemon");
     
     std::string line;
-    while (active_ && (line = readLine()).length() > 0) {
+    while (active_ && readLine(line)) {
         if (line.empty()) {
             continue;
         }
-        
-        // Parse command
-        std::istringstream iss(line);
-        std::string command;
-        std::string argument;
-        
-        iss >> command;
-        std::getline(iss, argument);
-        
-        // Trim whitespace from argument
-        argument.erase(0, argument.find_first_not_of(" \t"));
-        argument.erase(argument.find_last_not_of(" \t") + 1);
-        
-        // Convert command to uppercase
-        std::transform(command.begin(), command.end(), command.begin(), ::toupper);
-        
-        logger_->debug("Received command: " + command + (argument.empty() ? "" : " " + argument));
-        
-        // Handle commands
-        if (command == "USER") {
-            handleUSER(argument);
-        } else if (command == "PASS") {
-            handlePASS(argument);
-        } else if (command == "QUIT") {
-            handleQUIT();
+        refreshConfig();
+        if (!processCommand(line)) {
             break;
-        } else if (command == "NOOP") {
-            sendResponse("200 NOOP command successful");
-        } else if (command == "SYST") {
-            sendResponse("215 UNIX Type: L8");
-        } else if (command == "FEAT") {
-            sendResponse("211-Features:");
-            if (ssl_enabled_) {
-                sendResponse(" AUTH TLS");
-                sendResponse(" PBSZ");
-                sendResponse(" PROT");
-            }
-            sendResponse("211 End");
-        } else if (command == "AUTH") {
-            handleAUTH(argument);
-        } else if (command == "PBSZ") {
-            handlePBSZ(argument);
-        } else if (command == "PROT") {
-            handlePROT(argument);
-        } else if (authenticated_) {
-            // Commands that require authentication
-            if (command == "PWD" || command == "XPWD") {
-                handlePWD();
-            } else if (command == "CWD" || command == "XCWD") {
-                handleCWD(argument);
-            } else if (command == "LIST" || command == "NLST") {
-                handleLIST(argument);
-            } else if (command == "PASV") {
-                handlePASV();
-            } else if (command == "TYPE") {
-                handleTYPE(argument);
-            } else if (command == "SIZE") {
-                handleSIZE(argument);
-            } else if (command == "RETR") {
-                handleRETR(argument);
-            } else if (command == "STOR") {
-                handleSTOR(argument);
-            } else if (command == "DELE") {
-                handleDELE(argument);
-            } else if (command == "MKD" || command == "XMKD") {
-                handleMKD(argument);
-            } else if (command == "RMD" || command == "XRMD") {
-                handleRMD(argument);
-            } else if (command == "REST") {
-                handleREST(argument);
-            } else if (command == "APPE") {
-                handleAPPE(argument);
-            } else if (command == "RNFR") {
-                handleRNFR(argument);
-            } else if (command == "RNTO") {
-                handleRNTO(argument);
-            } else {
-                sendResponse("502 Command not implemented");
-            }
-        } else {
-            sendResponse("530 Please login with USER and PASS");
         }
     }
     
+    flushResponses();
     active_ = false;
+    notifyClosed();
 }
 
-void FTPConnection::sendResponse(const std::string& response) {
-    if (socket_ < 0) {
-        return;
+bool FTPConnection::processCommand(std::string_view line) {
+    // Paths and composed replies come from here; a command that outgrows
+    // the buffer spills to the heap rather than failing
+    alignas(std::max_align_t) unsigned char scratch[ARENA_SIZE];
+    std::pmr::monotonic_buffer_resource arena(scratch, sizeof(scratch), std::pmr::new_delete_resource());
+    arena_ = &arena;
+    bool keep_open = executeCommand(line);
+    
+    // Everything the command built is in the queued replies by now
+    arena_ = nullptr;
+    chargeControlMemory();
+    return keep_open;
+}
+
+bool FTPConnection::executeCommand(std::string_view line) {
+    std::string_view verb;
+    std::string_view argument_view;
+    splitCommand(line, verb, argument_view);
+    
+    // Reused across commands so steady-state dispatch does not allocate
+    argument_.assign(argument_view.data(), argument_view.length());
+    const std::string& argument = argument_;
+    
+    if (logger_->isEnabled(LogLevel::DEBUG)) {
+        logger_->debug("Received command: " + std::string(verb) + (argument.empty() ? "" : " " + argument));
     }
     
-    std::string full_response = response + "\r\n";
-    ssize_t sent;
+    const CommandSpec* spec = findCommand(verb);
+    if (!spec) {
+        sendResponse(authenticated_ ? "502 Command not implemented" : "530 Please login with USER and PASS");
+        return true;
+    }
+    if ((spec->flags & CMD_NEEDS_AUTH) && !authenticated_) {
+        sendResponse("530 Please login with USER and PASS");
+        return true;
+    }
     
-    if (ssl_active_ && ssl_ && ssl_context_) {
-        sent = ssl_context_->writeSSL(ssl_, full_response.c_str(), full_response.length());
-    } else {
-        sent = send(socket_, full_response.c_str(), full_response.length(), 0);
+    switch (spec->id) {
+    case CommandId::USER:
+        if (!admitUser(argument)) {
+            return false;
+        }
+        handleUSER(argument);
+        break;
+    case CommandId::PASS:
+        handlePASS(argument);
+        break;
+    case CommandId::QUIT:
+        handleQUIT();
+        return false;
+    case CommandId::NOOP:
+        sendResponse("200 NOOP command successful");
+        break;
+    case CommandId::SYST:
+        sendResponse("215 UNIX Type: L8");
+        break;
+    case CommandId::FEAT:
+        handleFEAT();
+        break;
+    case CommandId::AUTH:
+        handleAUTH(argument);
+        break;
+    case CommandId::PBSZ:
+        handlePBSZ(argument);
+        break;
+    case CommandId::PROT:
+        handlePROT(argument);
+        break;
+    case CommandId::PWD:
+        handlePWD();
+        break;
+    case CommandId::CWD:
+        handleCWD(argument);
+        break;
+    case CommandId::LIST:
+        handleLIST(argument);
+        break;
+    case CommandId::PASV:
+        handlePASV();
+        break;
+    case CommandId::PORT:
+        handlePORT(argument);
+        break;
+    case CommandId::TYPE:
+        handleTYPE(argument);
+        break;
+    case CommandId::SIZE:
+        handleSIZE(argument);
+        break;
+    case CommandId::RETR:
+        handleRETR(argument);
+        break;
+    case CommandId::STOR:
+        handleSTOR(argument);
+        break;
+    case CommandId::DELE:
+        handleDELE(argument);
+        break;
+    case CommandId::MKD:
+        handleMKD(argument);
+        break;
+    case CommandId::RMD:
+        handleRMD(argument);
+        break;
+    case CommandId::REST:
+        handleREST(argument);
+        break;
+    case CommandId::APPE:
+        handleAPPE(argument);
+        break;
+    case CommandId::RNFR:
+        handleRNFR(argument);
+        break;
+    case CommandId::RNTO:
+        handleRNTO(argument);
+        break;
     }
     
-    if (sent < 0) {
-        logger_->error("Failed to send response: " + std::string(strerror(errno)));
-        active_ = false;
-    } else {
-        logger_->debug("Sent: " + response);
+    return true;
+}
+
+void FTPConnection::handleFEAT() {
+    // Advertised features come straight from the command table
+    sendResponse("211-Features:");
+    for (const CommandSpec& spec : command_table::COMMANDS) {
+        if (spec.feature.empty() || ((spec.flags & CMD_TLS_FEATURE) && !ssl_enabled_)) {
+            continue;
+        }
+        output_buffer_ += ' ';
+        output_buffer_.append(spec.feature.data(), spec.feature.length());
+        output_buffer_ += "\r\n";
     }
+    sendResponse("211 End");
 }
 
-std::string FTPConnection::readLine() {
+void FTPConnection::sendResponse(std::string_view response) {
     if (socket_ < 0) {
-        return "";
+        return;
+    }
+    
+    // Replies are queued and written together by flushResponses()
+    output_buffer_.append(response.data(), response.length());
+    output_buffer_ += "\r\n";
+    if (logger_->isEnabled(LogLevel::DEBUG)) {
+        logger_->debug("Sent: " + std::string(response));
+    }
+    
+    if (output_buffer_.length() >= OUTPUT_FLUSH_THRESHOLD) {
+        flushResponses();
     }
+}
 
-    std::string line;
-    char buffer[1];
+void FTPConnection::sendPreliminaryResponse(std::string_view response) {
+    sendResponse(response);
     
-    while (active_) {
-        ssize_t received;
+    // Corked: a short transfer's 226 leaves in the same segment, a long
+    // one releases the 150 after the kernel's cork timeout
+    flushResponses(true);
+}
+
+void FTPConnection::flushResponses(bool more) {
+    if (output_buffer_.empty() || socket_ < 0) {
+        output_buffer_.clear();
+        return;
+    }
+    
+    // The loop thread must never block on a slow reader
+    if (event_loop_ && event_loop_->isInLoopThread()) {
+        queueOutput(output_buffer_);
+        output_buffer_.clear();
+        return;
+    }
+    
+    size_t offset = 0;
+    while (offset < output_buffer_.length()) {
+        ssize_t sent;
+        if (ssl_active_ && ssl_ && ssl_context_) {
+            // One record for everything queued
+            sent = ssl_context_->writeSSL(ssl_, output_buffer_.data() + offset,
+                                          static_cast<int>(output_buffer_.length() - offset));
+        } else {
+            sent = send(socket_, output_buffer_.data() + offset, output_buffer_.length() - offset,
+                        MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        }
+        
+        if (sent <= 0) {
+            if (sent < 0 && errno == EINTR) {
+                continue;
+            }
+            logger_->error("Failed to send response: " + std::string(strerror(errno)));
+            active_ = false;
+            break;
+        }
+        offset += sent;
+    }
+    output_buffer_.clear();
+}
+
+bool FTPConnection::readLine(std::string& line) {
+    while (active_ && socket_ >= 0) {
+        std::string_view view;
+        LineBuffer::Status status = input_buffer_.nextLine(view);
+        if (status == LineBuffer::Status::LINE) {
+            line.assign(view.data(), view.length());
+            return true;
+        }
+        if (status == LineBuffer::Status::TOO_LONG) {
+            sendResponse("500 Line too long");
+            continue;
+        }
+        
+        // Replies to everything handled so far go out before we block
+        flushResponses();
+        
+        // Wait no longer than the idle limit, or the login deadline if sooner
+        auto limit = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::seconds(config_->connection.timeout_seconds));
+        bool login_pending = !authenticated_ && config_->connection.login_timeout_seconds > 0;
+        if (login_pending) {
+            auto login_left = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::seconds(config_->connection.login_timeout_seconds) -
+                (std::chrono::steady_clock::now() - connected_at_));
+            login_pending = login_left < limit;
+            limit = std::max(std::min(limit, login_left), std::chrono::milliseconds(1));
+        }
+        struct timeval timeout;
+        timeout.tv_sec = static_cast<time_t>(limit.count() / 1000);
+        timeout.tv_usec = static_cast<suseconds_t>((limit.count() % 1000) * 1000);
+        setsockopt(socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
         
+        // One read picks up every command the client has pipelined
+        char buffer[READ_CHUNK];
+        ssize_t received;
         if (ssl_active_ && ssl_ && ssl_context_) {
-            received = ssl_context_->readSSL(ssl_, buffer, 1);
+            received = ssl_context_->readSSL(ssl_, buffer, READ_CHUNK);
         } else {
-            received = recv(socket_, buffer, 1, 0);
+            received = recv(socket_, buffer, READ_CHUNK, 0);
         }
         
         if (received <= 0) {
+            if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && active_) {
+                logger_->info(login_pending ? "Closing control connection that did not log in in time"
+                                            : "Closing idle control connection");
+                sendResponse(login_pending ? "421 Login timeout: closing control connection"
+                                           : "421 Timeout: closing control connection");
+                flushResponses();
+            }
             if (received == 0) {
                 // Connection closed
                 active_ = false;
             }
-            break;
+            return false;
+        }
+        input_buffer_.append(buffer, received);
+    }
+    
+    return false;
+}
+
+bool FTPConnection::registerControl() {
+    auto self = shared_from_this();
+    return event_loop_->add(socket_, EventLoop::EVENT_READ, [self](uint32_t events) {
+        self->onControlEvent(events);
+    });
+}
+
+void FTPConnection::onControlEvent(uint32_t events) {
+    if (events & EventLoop::EVENT_WRITE) {
+        flushPendingOutput();
+    }
+    
+    if (handshaking_) {
+        // The 234 has to be out before the client sends its ClientHello
+        if (!active_) {
+            closeReactor();
+        } else if (pending_output_.empty()) {
+            continueHandshake();
+        } else {
+            updateInterest();
+        }
+        return;
+    }
+    
+    bool open = true;
+    if (events & (EventLoop::EVENT_READ | EventLoop::EVENT_ERROR)) {
+        open = readControlInput();
+    }
+    
+    // Run whatever arrived before a hangup (e.g. "QUIT" then close)
+    processInput();
+    if (!open) {
+        closeReactor();
+        return;
+    }
+    updateInterest();
+}
+
+bool FTPConnection::readControlInput() {
+    // Read into scratch space so the input buffer only grows by what
+    // arrived, typically a few dozen bytes
+    char buffer[READ_CHUNK];
+    while (input_buffer_.size() < MAX_PENDING_INPUT) {
+        ssize_t received;
+        if (ssl_active_ && ssl_ && ssl_context_) {
+            received = ssl_context_->readSSL(ssl_, buffer, READ_CHUNK);
+        } else {
+            received = recv(socket_, buffer, READ_CHUNK, 0);
         }
         
-        if (buffer[0] == '\n') {
-            // Remove \r if present
-            if (!line.empty() && line.back() == '\r') {
-                line.pop_back();
+        if (received > 0) {
+            input_buffer_.append(buffer, received);
+            if (idle_timer_ != 0) {
+                event_loop_->rescheduleTimer(idle_timer_, std::chrono::seconds(config_->connection.timeout_seconds));
             }
+            continue;
+        }
+        if (received == 0) {
+            return false;
+        }
+        return wouldBlock(received);
+    }
+    
+    return true;
+}
+
+void FTPConnection::processInput() {
+    while (active_ && !busy_ && !awaiting_data_ && !handshaking_ && !reactor_closed_ && pending_output_.empty()) {
+        std::string_view view;
+        LineBuffer::Status status = input_buffer_.nextLine(view);
+        if (status == LineBuffer::Status::INCOMPLETE) {
             break;
         }
-        
-        line += buffer[0];
-        
-        // Safety limit
-        if (line.length() > 1024) {
-            break;
+        if (status == LineBuffer::Status::TOO_LONG) {
+            sendResponse("500 Line too long");
+            continue;
+        }
+        if (view.empty()) {
+            continue;
+        }
+        
+        // Nothing runs on a worker here, so the snapshot can change hands
+        refreshConfig();
+        
+        std::string_view verb;
+        std::string_view argument;
+        splitCommand(view, verb, argument);
+        const CommandSpec* spec = findCommand(verb);
+        bool runnable = spec && (authenticated_ || !(spec->flags & CMD_NEEDS_AUTH));
+        if (runnable && (spec->flags & CMD_NEEDS_DATA)) {
+            awaitDataConnection(std::string(view));
+            return;
+        }
+        if (runnable && ((spec->flags & CMD_BLOCKING) || (spec->id == CommandId::PASS && pam_auth_))) {
+            dispatchToWorker(std::string(view));
+            return;
+        }
+        
+        if (!processCommand(view)) {
+            active_ = false;
+        }
+    }
+    
+    // Replies to the whole pipelined batch go out in one write
+    flushResponses();
+    
+    // Idle sessions keep at most a small input buffer
+    input_buffer_.release();
+    
+    if (!active_ && !busy_) {
+        closeReactor();
+    }
+}
+
+void FTPConnection::dispatchToWorker(const std::string& line) {
+    // Detach from the loop so readiness on the control socket is not
+    // reported while the worker owns the session
+    event_loop_->remove(socket_);
+    busy_ = true;
+    
+    // Earlier replies the socket did not take yet are written by the
+    // worker ahead of its own, keeping them in order
+    flushResponses();
+    output_buffer_.swap(pending_output_);
+    
+    auto self = shared_from_this();
+    bool submitted = workers_->submit([self, line]() {
+        // Handlers expect blocking I/O (SSL_accept, 150/226 replies)
+        self->setBlocking(true);
+        if (!self->processCommand(line)) {
+            self->active_ = false;
+        }
+        if (self->prepared_data_socket_ >= 0) {
+            // The handler bailed out (e.g. 550) before claiming the connection
+            self->closeDataConnection(self->prepared_data_socket_);
+            self->prepared_data_socket_ = -1;
+        }
+        self->flushResponses();
+        self->setBlocking(false);
+        
+        self->event_loop_->post([self]() {
+            self->resumeReactor();
+        });
+    });
+    
+    if (!submitted) {
+        busy_ = false;
+        closeReactor();
+    }
+}
+
+void FTPConnection::awaitDataConnection(const std::string& line) {
+    // Replies to earlier commands in the batch go out first
+    flushResponses();
+    
+    int wait_fd;
+    bool wait_writable;
+    if (!beginDataConnection(wait_fd, wait_writable)) {
+        dispatchToWorker(line);  // no data channel; the handler replies 425
+        return;
+    }
+    
+    // Park the command on the loop instead of pinning a worker while a
+    // slow (or NAT-broken) client connects
+    auto self = shared_from_this();
+    uint32_t events = wait_writable ? EventLoop::EVENT_WRITE : EventLoop::EVENT_READ;
+    if (!event_loop_->add(wait_fd, events, [self](uint32_t) { self->onDataConnectionReady(); })) {
+        abortDataConnection();
+        dispatchToWorker(line);
+        return;
+    }
+    
+    awaiting_data_ = true;
+    pending_data_command_ = line;
+    data_wait_fd_ = wait_fd;
+    data_setup_started_ = std::chrono::steady_clock::now();
+    data_timer_ = event_loop_->runAfter(std::chrono::seconds(config_->connection.data_connection_timeout_seconds),
+                                        [self]() { self->onDataConnectionTimeout(); });
+    updateInterest();
+}
+
+void FTPConnection::onDataConnectionReady() {
+    bool retry = false;
+    int data_fd = finishDataConnection(retry);
+    if (retry) {
+        return;  // keep waiting
+    }
+    
+    stopWaitingForData();
+    recordDataSetup(data_setup_started_, data_fd >= 0);
+    std::string line;
+    line.swap(pending_data_command_);
+    
+    if (data_fd < 0) {
+        sendResponse("425 Can't open data connection");
+        processInput();
+        updateInterest();
+        return;
+    }
+    
+    prepared_data_socket_ = data_fd;
+    armStallTimer();
+    dispatchToWorker(line);
+}
+
+void FTPConnection::onDataConnectionTimeout() {
+    data_timer_ = 0;
+    if (!awaiting_data_) {
+        return;
+    }
+    
+    logger_->error("Timeout waiting for data connection");
+    stopWaitingForData();
+    abortDataConnection();
+    recordDataSetup(data_setup_started_, false);
+    pending_data_command_.clear();
+    
+    sendResponse("425 Can't open data connection");
+    processInput();
+    updateInterest();
+}
+
+void FTPConnection::stopWaitingForData() {
+    if (data_wait_fd_ >= 0) {
+        event_loop_->remove(data_wait_fd_);
+        data_wait_fd_ = -1;
+    }
+    if (data_timer_ != 0) {
+        event_loop_->cancelTimer(data_timer_);
+        data_timer_ = 0;
+    }
+    awaiting_data_ = false;
+}
+
+void FTPConnection::armSessionTimers() {
+    // Weak captures: a pending timer must not keep a closed session alive
+    std::weak_ptr<FTPConnection> weak_self = weak_from_this();
+    idle_timer_ = event_loop_->runAfter(std::chrono::seconds(config_->connection.timeout_seconds), [weak_self]() {
+        if (auto self = weak_self.lock()) {
+            self->onIdleTimeout();
+        }
+    });
+    
+    if (config_->connection.login_timeout_seconds > 0 && !authenticated_) {
+        auto remaining = std::chrono::seconds(config_->connection.login_timeout_seconds) -
+                         (std::chrono::steady_clock::now() - connected_at_);
+        login_timer_ = event_loop_->runAfter(
+            std::max(std::chrono::duration_cast<std::chrono::milliseconds>(remaining), std::chrono::milliseconds(0)),
+            [weak_self]() {
+                if (auto self = weak_self.lock()) {
+                    self->onLoginTimeout();
+                }
+            });
+    }
+}
+
+void FTPConnection::cancelSessionTimers() {
+    for (uint64_t* timer : {&idle_timer_, &login_timer_, &stall_timer_, &handshake_timer_}) {
+        if (*timer != 0) {
+            event_loop_->cancelTimer(*timer);
+            *timer = 0;
+        }
+    }
+}
+
+void FTPConnection::onIdleTimeout() {
+    if (reactor_closed_) {
+        idle_timer_ = 0;
+        return;
+    }
+    
+    // A command still running (or waiting for its data connection) is
+    // activity; the stall watchdog covers transfers that stop moving
+    if (busy_ || awaiting_data_) {
+        std::weak_ptr<FTPConnection> weak_self = weak_from_this();
+        idle_timer_ = event_loop_->runAfter(std::chrono::seconds(config_->connection.timeout_seconds), [weak_self]() {
+            if (auto self = weak_self.lock()) {
+                self->onIdleTimeout();
+            }
+        });
+        return;
+    }
+    
+    idle_timer_ = 0;
+    logger_->info("Closing idle control connection");
+    sendResponse("421 Timeout: closing control connection");
+    closeReactor();
+}
+
+void FTPConnection::onLoginTimeout() {
+    login_timer_ = 0;
+    if (reactor_closed_ || authenticated_) {
+        return;
+    }
+    
+    if (busy_) {
+        // PASS is being checked right now; look again shortly
+        std::weak_ptr<FTPConnection> weak_self = weak_from_this();
+        login_timer_ = event_loop_->runAfter(std::chrono::seconds(1), [weak_self]() {
+            if (auto self = weak_self.lock()) {
+                self->onLoginTimeout();
+            }
+        });
+        return;
+    }
+    
+    logger_->info("Closing control connection that did not log in within " +
+                  std::to_string(config_->connection.login_timeout_seconds) + "s");
+    sendResponse("421 Login timeout: closing control connection");
+    closeReactor();
+}
+
+void FTPConnection::armStallTimer() {
+    if (config_->connection.data_stall_timeout_seconds <= 0) {
+        return;
+    }
+    
+    stall_progress_seen_ = transfer_progress_.load(std::memory_order_relaxed);
+    transfer_abort_error_ = 0;
+    std::weak_ptr<FTPConnection> weak_self = weak_from_this();
+    stall_timer_ = event_loop_->runAfter(std::chrono::seconds(config_->connection.data_stall_timeout_seconds),
+                                         [weak_self]() {
+                                             if (auto self = weak_self.lock()) {
+                                                 self->onStallCheck();
+                                             }
+                                         });
+}
+
+void FTPConnection::onStallCheck() {
+    stall_timer_ = 0;
+    if (reactor_closed_ || !busy_) {
+        return;
+    }
+    
+    // The worker only bumps a counter; the loop checks it once per period
+    // instead of re-arming a timer on every chunk
+    uint64_t progress = transfer_progress_.load(std::memory_order_relaxed);
+    if (progress != stall_progress_seen_) {
+        armStallTimer();
+        return;
+    }
+    
+    logger_->warn("Data transfer made no progress for " +
+                  std::to_string(config_->connection.data_stall_timeout_seconds) + "s, aborting");
+    abortTransfer(ETIMEDOUT);
+}
+
+void FTPConnection::abortTransfer(int error) {
+    std::lock_guard<std::mutex> lock(data_socket_mutex_);
+    if (data_socket_ >= 0) {
+        // The transfer's blocked send/recv returns and it replies 426;
+        // data_ssl_, kTLS included, runs over this same descriptor
+        transfer_abort_error_ = error;
+        shutdown(data_socket_, SHUT_RDWR);
+    }
+}
+
+void FTPConnection::resumeReactor() {
+    busy_ = false;
+    if (stall_timer_ != 0) {
+        event_loop_->cancelTimer(stall_timer_);
+        stall_timer_ = 0;
+    }
+    if (!active_ || reactor_closed_ || !registerControl()) {
+        closeReactor();
+        return;
+    }
+    
+    // Commands pipelined behind the one the worker just finished
+    onControlEvent(EventLoop::EVENT_READ);
+}
+
+void FTPConnection::closeReactor() {
+    if (reactor_closed_) {
+        return;
+    }
+    
+    active_ = false;
+    if (busy_) {
+        // Unblock the worker, including one in the middle of a transfer;
+        // resumeReactor() finishes the teardown
+        abortTransfer(ECANCELED);
+        shutdownControl();
+        return;
+    }
+    
+    reactor_closed_ = true;
+    cancelSessionTimers();
+    if (awaiting_data_) {
+        stopWaitingForData();
+        abortDataConnection();
+    }
+    flushResponses();
+    flushPendingOutput();
+    event_loop_->remove(socket_);
+    releaseResources();
+    notifyClosed();
+}
+
+void FTPConnection::beginHandshake() {
+    ssl_ = ssl_context_->createSSL(socket_);
+    if (!ssl_) {
+        logger_->error("Failed to create SSL connection: " + ssl_context_->getLastError());
+        active_ = false;
+        return;
+    }
+    
+    // The client speaks first. Commands wait until the handshake is done,
+    // which must happen before the deadline however slowly the client sends
+    handshaking_ = true;
+    handshake_events_ = EventLoop::EVENT_READ;
+    std::weak_ptr<FTPConnection> weak_self = weak_from_this();
+    handshake_timer_ = event_loop_->runAfter(std::chrono::seconds(config_->security.ssl_handshake_timeout_seconds),
+                                             [weak_self]() {
+                                                 if (auto self = weak_self.lock()) {
+                                                     self->onHandshakeTimeout();
+                                                 }
+                                             });
+}
+
+void FTPConnection::continueHandshake() {
+    if (!tls_workers_) {
+        onHandshakeStep(ssl_context_->acceptStep(ssl_));
+        return;
+    }
+    
+    // Key exchange and signing are the costly part of a session; keep them
+    // off the loop. The socket stays non-blocking, so a step never waits
+    // on the client and the worker is only held for the CPU work
+    event_loop_->remove(socket_);
+    busy_ = true;
+    auto self = shared_from_this();
+    bool submitted = tls_workers_->submit([self]() {
+        TlsHandshakeStatus status = self->ssl_context_->acceptStep(self->ssl_);
+        self->event_loop_->post([self, status]() {
+            self->busy_ = false;
+            if (!self->active_ || self->reactor_closed_ || !self->registerControl()) {
+                self->closeReactor();
+                return;
+            }
+            self->onHandshakeStep(status);
+        });
+    });
+    
+    if (!submitted) {
+        busy_ = false;
+        closeReactor();
+    }
+}
+
+void FTPConnection::onHandshakeStep(TlsHandshakeStatus status) {
+    if (status == TlsHandshakeStatus::WANT_READ || status == TlsHandshakeStatus::WANT_WRITE) {
+        handshake_events_ = status == TlsHandshakeStatus::WANT_READ ? EventLoop::EVENT_READ : EventLoop::EVENT_WRITE;
+        updateInterest();
+        return;
+    }
+    
+    handshaking_ = false;
+    if (handshake_timer_ != 0) {
+        event_loop_->cancelTimer(handshake_timer_);
+        handshake_timer_ = 0;
+    }
+    if (!finishUpgrade(status == TlsHandshakeStatus::DONE)) {
+        closeReactor();
+        return;
+    }
+    
+    // A first command sent right behind the client's Finished may already
+    // be decrypted inside OpenSSL, where epoll cannot see it
+    onControlEvent(EventLoop::EVENT_READ);
+}
+
+void FTPConnection::onHandshakeTimeout() {
+    handshake_timer_ = 0;
+    if (reactor_closed_ || !handshaking_) {
+        return;
+    }
+    
+    logger_->warn("TLS handshake not completed within " +
+                  std::to_string(config_->security.ssl_handshake_timeout_seconds) + "s, closing control connection");
+    if (performance_monitor_) {
+        performance_monitor_->recordTlsHandshakeFailure();
+    }
+    closeReactor();
+}
+
+void FTPConnection::queueOutput(const std::string& data) {
+    if (!pending_output_.empty()) {
+        pending_output_ += data;
+        return;
+    }
+    
+    size_t offset = 0;
+    while (offset < data.length()) {
+        ssize_t sent = writeControl(data.data() + offset, data.length() - offset);
+        if (sent > 0) {
+            offset += sent;
+            continue;
+        }
+        if (wouldBlock(sent)) {
+            pending_output_.assign(data, offset, std::string::npos);
+            updateInterest();
+            return;
+        }
+        logger_->error("Failed to send response: " + std::string(strerror(errno)));
+        active_ = false;
+        return;
+    }
+}
+
+void FTPConnection::flushPendingOutput() {
+    while (!pending_output_.empty()) {
+        ssize_t sent = writeControl(pending_output_.data(), pending_output_.length());
+        if (sent > 0) {
+            pending_output_.erase(0, sent);
+            continue;
+        }
+        if (!wouldBlock(sent)) {
+            logger_->error("Failed to send response: " + std::string(strerror(errno)));
+            pending_output_.clear();
+            active_ = false;
         }
+        return;
+    }
+}
+
+void FTPConnection::updateInterest() {
+    if (busy_ || reactor_closed_) {
+        return;
+    }
+    
+    // Stop reading while replies are backed up so a client that never
+    // reads cannot grow pending_output_ without bound
+    uint32_t events = pending_output_.empty() ? EventLoop::EVENT_READ : EventLoop::EVENT_WRITE;
+    if (handshaking_ && pending_output_.empty()) {
+        events = handshake_events_;
+    } else if (awaiting_data_ && pending_output_.empty()) {
+        events = 0;  // pipelined input waits for the data command; hangups still arrive
+    }
+    event_loop_->modify(socket_, events);
+}
+
+ssize_t FTPConnection::writeControl(const char* data, size_t length) {
+    if (ssl_active_ && ssl_ && ssl_context_) {
+        return ssl_context_->writeSSL(ssl_, data, static_cast<int>(length));
+    }
+    return send(socket_, data, length, MSG_NOSIGNAL);
+}
+
+bool FTPConnection::wouldBlock(ssize_t result) const {
+    if (ssl_active_ && ssl_ && ssl_context_) {
+        return ssl_context_->shouldRetry(ssl_, static_cast<int>(result));
+    }
+    return result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+}
+
+void FTPConnection::setBlocking(bool blocking) {
+    if (socket_ < 0) {
+        return;
     }
     
-    return line;
+    int flags = fcntl(socket_, F_GETFL, 0);
+    fcntl(socket_, F_SETFL, blocking ? (flags & ~O_NONBLOCK) : (flags | O_NONBLOCK));
 }
 
 // FTP Command Handlers
@@ -342,6 +1341,7 @@ void FTPConnection::handlePASS(const std::string& password) {
     
     if (login_success && current_user_) {
         authenticated_ = true;
+        releaseAdminSlot();  // an admin on a reserved slot is a regular session now
         current_directory_ = current_user_->getHomeDirectory();
         // Ensure current directory is within home
         if (!isPathWithinHome(current_directory_)) {
@@ -353,6 +1353,13 @@ void FTPConnection::handlePASS(const std::string& password) {
             applyChroot();
         }
         
+        if (memory_accountant_) {
+            // From here on the session also counts against the user's budget
+            control_charge_ = MemoryAccountant::Charge(memory_accountant_->account(username_),
+                                                       MemoryAccountant::Category::CONTROL);
+            chargeControlMemory();
+        }
+        
         sendResponse("230 User logged in, proceed");
         logger_->info("User " + username_ + " logged in");
     } else {
@@ -367,19 +1374,23 @@ void FTPConnection::handleQUIT() {
 }
 
 void FTPConnection::handlePWD() {
-    sendResponse("257 \"" + current_directory_ + "\"");
+    ArenaString reply(arena_);
+    reply.reserve(current_directory_.length() + 6);
+    reply.append("257 \"").append(current_directory_).append("\"");
+    sendResponse(reply);
 }
 
 void FTPConnection::handleCWD(const std::string& path) {
-    std::string new_path = resolvePath(path);
+    std::string_view new_path = resolvePath(path);
     
     if (!validatePath(new_path)) {
         sendResponse("550 Invalid path");
         return;
     }
     
-    if (std::filesystem::exists(new_path) && std::filesystem::is_directory(new_path)) {
-        current_directory_ = new_path;
+    struct stat st;
+    if (stat(new_path.data(), &st) == 0 && S_ISDIR(st.st_mode)) {
+        current_directory_.assign(new_path.data(), new_path.length());
         sendResponse("250 CWD command successful");
     } else {
         sendResponse("550 Failed to change directory");
@@ -392,7 +1403,7 @@ void FTPConnection::handleLIST(const std::string& path) {
         return;
     }
     
-    std::string list_path = path.empty() ? current_directory_ : resolvePath(path);
+    std::string list_path(resolvePath(path));
     
     if (!validatePath(list_path)) {
         sendResponse("550 Invalid path");
@@ -404,7 +1415,11 @@ void FTPConnection::handleLIST(const std::string& path) {
         return;
     }
     
-    sendResponse("150 Opening ASCII mode data connection for file list");
+    if (!admitTransfer()) {
+        return;
+    }
+    
+    sendPreliminaryResponse("150 Opening ASCII mode data connection for file list");
     
     // Accept data connection
     int data_fd = acceptDataConnection();
@@ -413,7 +1428,18 @@ void FTPConnection::handleLIST(const std::string& path) {
         return;
     }
     
+    // Entries go out in LISTING_CHUNK pieces, so a huge directory holds
+    // no more memory than a small one
+    MemoryAccountant::Charge listing_charge(control_charge_.getAccount(), MemoryAccountant::Category::LISTING);
+    listing_charge.force(LISTING_CHUNK);
     std::string listing;
+    listing.reserve(LISTING_CHUNK);
+    bool sent = true;
+    auto flushListing = [&]() {
+        sent = sent && sendData(data_fd, listing.data(), listing.length());
+        listing.clear();
+    };
+    
     if (std::filesystem::is_directory(list_path)) {
         try {
             for (const auto& entry : std::filesystem::directory_iterator(list_path)) {
@@ -426,10 +1452,16 @@ void FTPConnection::handleLIST(const std::string& path) {
                 (void)std::filesystem::last_write_time(entry.path()); // Suppress unused warning
                 
                 listing += perms + " 1 owner group " + std::to_string(size) + " " + filename + "\r\n";
+                if (listing.length() >= LISTING_CHUNK - 512) {
+                    flushListing();
+                    if (!sent) {
+                        break;
+                    }
+                }
             }
         } catch (const std::exception& e) {
             logger_->error("Error listing directory: " + std::string(e.what()));
-            close(data_fd);
+            closeDataConnection(data_fd);
             sendResponse("550 Error listing directory");
             return;
         }
@@ -441,9 +1473,9 @@ void FTPConnection::handleLIST(const std::string& path) {
     }
     
     // Send listing through data connection
-    send(data_fd, listing.c_str(), listing.length(), 0);
-    close(data_fd);
-    sendResponse("226 Transfer complete");
+    flushListing();
+    closeDataConnection(data_fd);
+    sendResponse(sent ? "226 Transfer complete" : "426 Connection closed, transfer aborted");
 }
 
 void FTPConnection::handlePASV() {
@@ -465,61 +1497,72 @@ void FTPConnection::handlePASV() {
 void FTPConnection::handlePORT(const std::string& address_port) {
     // Parse PORT command: PORT h1,h2,h3,h4,p1,p2
     // Example: PORT 192,168,1,100,4,28
-    std::vector<int> parts;
-    std::istringstream iss(address_port);
-    std::string token;
-    
-    while (std::getline(iss, token, ',')) {
-        try {
-            parts.push_back(std::stoi(token));
-        } catch (...) {
-            sendResponse("501 Invalid PORT command format");
-            return;
+    int parts[6];
+    size_t count = 0;
+    const char* cursor = address_port.data();
+    const char* end = cursor + address_port.length();
+    while (count < 6) {
+        auto parsed = std::from_chars(cursor, end, parts[count]);
+        if (parsed.ec != std::errc() || parts[count] < 0 || parts[count] > 255) {
+            break;
+        }
+        cursor = parsed.ptr;
+        if (++count < 6) {
+            if (cursor == end || *cursor != ',') {
+                break;
+            }
+            ++cursor;
         }
     }
     
-    if (parts.size() != 6) {
+    if (count != 6 || cursor != end) {
         sendResponse("501 Invalid PORT command format");
         return;
     }
     
-    // Build IP address
-    active_mode_ip_ = std::to_string(parts[0]) + "." +
-                      std::to_string(parts[1]) + "." +
-                      std::to_string(parts[2]) + "." +
-                      std::to_string(parts[3]);
-    
     // Calculate port: p1 * 256 + p2
-    active_mode_port_ = parts[4] * 256 + parts[5];
-    
-    if (active_mode_port_ < 1024 || active_mode_port_ > 65535) {
+    int port = parts[4] * 256 + parts[5];
+    if (port < 1024) {
         sendResponse("501 Invalid port number");
         return;
     }
     
     // Close any existing passive connection
     closeDataSocket();
+    active_mode_address_ = htonl((static_cast<uint32_t>(parts[0]) << 24) | (static_cast<uint32_t>(parts[1]) << 16) |
+                                 (static_cast<uint32_t>(parts[2]) << 8) | static_cast<uint32_t>(parts[3]));
+    active_mode_port_ = port;
     active_mode_enabled_ = true;
     
-    logger_->info("Active mode enabled: " + active_mode_ip_ + ":" + std::to_string(active_mode_port_));
+    logger_->info("Active mode enabled: " + formatActiveTarget());
     sendResponse("200 PORT command successful");
 }
 
 void FTPConnection::handleTYPE(const std::string& type) {
-    if (type == "A" || type == "I") {
-        transfer_type_ = type;
-        sendResponse("200 Type set to " + type);
+    if (type == "A") {
+        transfer_type_ = TransferType::ASCII;
+        sendResponse("200 Type set to A");
+    } else if (type == "I") {
+        transfer_type_ = TransferType::BINARY;
+        sendResponse("200 Type set to I");
     } else {
         sendResponse("504 Command not implemented for that parameter");
     }
 }
 
 void FTPConnection::handleSIZE(const std::string& filename) {
-    std::string filepath = resolvePath(filename);
+    std::string_view filepath = resolvePath(filename);
     
-    if (std::filesystem::exists(filepath) && std::filesystem::is_regular_file(filepath)) {
-        auto size = std::filesystem::file_size(filepath);
-        sendResponse("213 " + std::to_string(size));
+    if (!validatePath(filepath)) {
+        sendResponse("550 Invalid path");
+        return;
+    }
+    
+    struct stat st;
+    if (stat(filepath.data(), &st) == 0 && S_ISREG(st.st_mode)) {
+        char reply[32] = "213 ";
+        auto written = std::to_chars(reply + 4, reply + sizeof(reply), static_cast<uint64_t>(st.st_size));
+        sendResponse(std::string_view(reply, written.ptr - reply));
     } else {
         sendResponse("550 File not found");
     }
@@ -531,7 +1574,7 @@ void FTPConnection::handleRETR(const std::string& filename) {
         return;
     }
     
-    std::string filepath = resolvePath(filename);
+    std::string filepath(resolvePath(filename));
     
     if (!validatePath(filepath)) {
         sendResponse("550 Invalid path");
@@ -543,7 +1586,12 @@ void FTPConnection::handleRETR(const std::string& filename) {
         return;
     }
     
-    sendResponse("150 Opening " + transfer_type_ + " mode data connection");
+    if (!admitTransfer()) {
+        return;
+    }
+    
+    sendPreliminaryResponse(transfer_type_ == TransferType::BINARY ? "150 Opening I mode data connection"
+                                                                    : "150 Opening A mode data connection");
     
     // Accept data connection
     int data_fd = acceptDataConnection();
@@ -552,58 +1600,103 @@ void FTPConnection::handleRETR(const std::string& filename) {
         return;
     }
     
-    // Open file
-    std::ifstream file(filepath, std::ios::binary);
-    if (!file.is_open()) {
-        close(data_fd);
+    uint64_t offset = resume_position_ > 0 ? static_cast<uint64_t>(resume_position_) : 0;
+    if (offset > 0) {
+        logger_->debug("Resuming transfer from position: " + std::to_string(offset));
+    }
+    
+    // Binary clear-text transfers go from the page cache straight to the
+    // socket (or through io_uring when configured); ASCII data needs the
+    // bytes in user space, and PROT P data goes through OpenSSL
+    TransferThrottle throttle(config_->rate_limit.max_transfer_rate);
+    throttle.setProgressCounter(&transfer_progress_);
+    throttle.setCancelFlag(&transfer_abort_error_);
+    throttle.setMemoryAccount(control_charge_.getAccount());
+    TransferResult result;
+    result.status = TransferStatus::UNSUPPORTED;
+    std::string method;
+    if (data_ssl_) {
+        // With kTLS the kernel encrypts, so binary files can skip user space
+        // entirely; otherwise (or for a cipher it cannot offload) OpenSSL does
+        if (transfer_type_ == TransferType::BINARY) {
+            method = "ktls sendfile";
+            result = DataTransfer::sendFileKernelTls(*ssl_context_, data_ssl_, filepath, offset, throttle);
+        }
+        if (result.status == TransferStatus::UNSUPPORTED) {
+            result = DataTransfer::sendFileTls(*ssl_context_, data_ssl_, filepath, offset, throttle);
+            method = result.kernel_tls ? "ktls" : "tls";
+        }
+    } else if (transfer_type_ == TransferType::BINARY && protection_level_ == ProtectionLevel::CLEAR) {
+        if (config_->connection.transfer_engine == "io_uring") {
+            method = "io_uring";
+            result = DataTransfer::sendFileUring(data_fd, filepath, offset, throttle);
+        }
+        if (result.status == TransferStatus::UNSUPPORTED) {
+            method = "sendfile";
+            result = DataTransfer::sendFileZeroCopy(data_fd, filepath, offset, throttle);
+        }
+    }
+    if (result.status == TransferStatus::UNSUPPORTED) {
+        method = "buffered";
+        result = DataTransfer::sendFileBuffered(data_fd, filepath, offset, throttle);
+    }
+    int abort_error = transfer_abort_error_.exchange(0);
+    if (abort_error != 0 && result.status == TransferStatus::COMPLETE) {
+        result.status = TransferStatus::ABORTED;
+        result.error = abort_error;
+    }
+    closeDataConnection(data_fd);
+    
+    if (result.status == TransferStatus::OPEN_FAILED) {
         sendResponse("550 Failed to open file");
         return;
     }
-    
-    // Seek to resume position if set
-    if (resume_position_ > 0) {
-        file.seekg(resume_position_);
-        logger_->debug("Resuming transfer from position: " + std::to_string(resume_position_));
+    if (result.status == TransferStatus::ABORTED) {
+        logger_->error("Error sending file data: " + std::string(strerror(result.error)));
+        sendResponse("426 Connection closed, transfer aborted");
+        return;
     }
     
-    // Transfer file with bandwidth throttling
-    char buffer[8192];
-    size_t total_bytes = 0;
-    auto start_time = std::chrono::steady_clock::now();
-    int max_rate = config_->rate_limit.max_transfer_rate;
-    
-    while (file.read(buffer, sizeof(buffer)) || file.gcount() > 0) {
-        size_t bytes_read = file.gcount();
-        
-        // Bandwidth throttling for downloads
-        if (max_rate > 0) {
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time).count();
-            if (elapsed > 0) {
-                size_t allowed_bytes = (max_rate * elapsed) / 1000;
-                if (total_bytes + bytes_read > allowed_bytes) {
-                    size_t delay_ms = ((total_bytes + bytes_read - allowed_bytes) * 1000) / max_rate;
-                    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
-                }
-            }
+    resume_position_ = 0; // Reset resume position after transfer
+    logger_->info("File transfer complete: " + filename + " (" + std::to_string(result.bytes) +
+                  " bytes, " + method + ")");
+    sendResponse("226 Transfer complete");
+}
+
+TransferResult FTPConnection::receiveUpload(int data_fd, int file_fd, uint64_t offset, std::string& method) {
+    // Binary clear-text uploads are spliced from the socket into the file
+    // (or go through io_uring when configured); ASCII data needs the
+    // bytes in user space, and PROT P data goes through OpenSSL
+    TransferThrottle throttle(config_->rate_limit.max_transfer_rate);
+    throttle.setProgressCounter(&transfer_progress_);
+    throttle.setCancelFlag(&transfer_abort_error_);
+    throttle.setMemoryAccount(control_charge_.getAccount());
+    TransferResult result;
+    result.status = TransferStatus::UNSUPPORTED;
+    if (data_ssl_) {
+        result = DataTransfer::receiveFileTls(*ssl_context_, data_ssl_, file_fd, offset, throttle);
+        method = result.kernel_tls ? "ktls" : "tls";
+    } else if (transfer_type_ == TransferType::BINARY && protection_level_ == ProtectionLevel::CLEAR) {
+        if (config_->connection.transfer_engine == "io_uring") {
+            method = "io_uring";
+            result = DataTransfer::receiveFileUring(data_fd, file_fd, offset, throttle);
         }
-        
-        ssize_t sent = send(data_fd, buffer, bytes_read, 0);
-        if (sent < 0) {
-            logger_->error("Error sending file data: " + std::string(strerror(errno)));
-            file.close();
-            close(data_fd);
-            sendResponse("426 Connection closed, transfer aborted");
-            return;
+        if (result.status == TransferStatus::UNSUPPORTED) {
+            method = "splice";
+            result = DataTransfer::receiveFileZeroCopy(data_fd, file_fd, offset, throttle);
         }
-        total_bytes += sent;
     }
-    
-    file.close();
-    close(data_fd);
-    resume_position_ = 0; // Reset resume position after transfer
-    logger_->info("File transfer complete: " + filename + " (" + std::to_string(total_bytes) + " bytes)");
-    sendResponse("226 Transfer complete");
+    if (result.status == TransferStatus::UNSUPPORTED) {
+        method = "buffered";
+        result = DataTransfer::receiveFileBuffered(data_fd, file_fd, offset, throttle);
+    }
+    int abort_error = transfer_abort_error_.exchange(0);
+    if (abort_error != 0) {
+        // abortTransfer()'s shutdown() reads as end-of-file; keep it a failure
+        result.status = TransferStatus::ABORTED;
+        result.error = abort_error;
+    }
+    return result;
 }
 
 void FTPConnection::handleSTOR(const std::string& filename) {
@@ -612,14 +1705,19 @@ void FTPConnection::handleSTOR(const std::string& filename) {
         return;
     }
     
-    std::string filepath = resolvePath(filename);
+    std::string filepath(resolvePath(filename));
     
     if (!validatePath(filepath)) {
         sendResponse("550 Invalid path");
         return;
     }
     
-    sendResponse("150 Opening " + transfer_type_ + " mode data connection");
+    if (!admitTransfer()) {
+        return;
+    }
+    
+    sendPreliminaryResponse(transfer_type_ == TransferType::BINARY ? "150 Opening I mode data connection"
+                                                                    : "150 Opening A mode data connection");
     
     // Accept data connection
     int data_fd = acceptDataConnection();
@@ -634,61 +1732,38 @@ void FTPConnection::handleSTOR(const std::string& filename) {
         std::filesystem::create_directories(file_path.parent_path());
     }
     
-    // Open file for writing (with resume support)
-    std::ofstream file;
+    // Resume into an existing file at the REST offset, otherwise start fresh
+    uint64_t offset = 0;
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
     if (resume_position_ > 0 && std::filesystem::exists(filepath)) {
-        // Resume transfer - open in append mode from resume position
-        file.open(filepath, std::ios::binary | std::ios::in | std::ios::out);
-        if (file.is_open()) {
-            file.seekp(resume_position_);
-            logger_->debug("Resuming upload from position: " + std::to_string(resume_position_));
-        }
-    }
-    
-    if (!file.is_open()) {
-        file.open(filepath, std::ios::binary | std::ios::out);
+        offset = static_cast<uint64_t>(resume_position_);
+        logger_->debug("Resuming upload from position: " + std::to_string(offset));
+    } else {
+        flags |= O_TRUNC;
     }
     
-    if (!file.is_open()) {
-        close(data_fd);
+    int file_fd = open(filepath.c_str(), flags, 0666);
+    if (file_fd < 0) {
+        closeDataConnection(data_fd);
         sendResponse("550 Failed to create file");
         return;
     }
     
-    // Receive file with bandwidth throttling
-    char buffer[8192];
-    size_t total_bytes = 0;
-    auto start_time = std::chrono::steady_clock::now();
-    int max_rate = config_->rate_limit.max_transfer_rate;
+    std::string method;
+    TransferResult result = receiveUpload(data_fd, file_fd, offset, method);
+    close(file_fd);
+    closeDataConnection(data_fd);
+    resume_position_ = 0; // Reset resume position after transfer
     
-    while (true) {
-        ssize_t received = recv(data_fd, buffer, sizeof(buffer), 0);
-        if (received <= 0) {
-            break; // Connection closed or error
-        }
-        
-        // Bandwidth throttling for uploads
-        if (max_rate > 0) {
-            auto now = std::chrono::steady_clock::now();
-            auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time).count();
-            if (elapsed > 0) {
-                size_t allowed_bytes = (max_rate * elapsed) / 1000;
-                if (total_bytes + received > allowed_bytes) {
-                    size_t delay_ms = ((total_bytes + received - allowed_bytes) * 1000) / max_rate;
-                    std::this_thread::sleep_for(std::chrono::milliseconds(delay_ms));
-                }
-            }
-        }
-        
-        file.write(buffer, received);
-        total_bytes += received;
+    if (result.status == TransferStatus::ABORTED) {
+        logger_->error("Error receiving file data: " + std::string(strerror(result.error)));
+        sendResponse("426 Connection closed, transfer aborted");
+        return;
     }
     
-    file.close();
-    close(data_fd);
-    resume_position_ = 0; // Reset resume position after transfer
-    logger_->info("File upload complete: " + filename + " (" + std::to_string(total_bytes) + " bytes)");
-    logger_->info("[AUDIT] FILE_UPLOAD user=" + username_ + " file=" + filename + " size=" + std::to_string(total_bytes));
+    logger_->info("File upload complete: " + filename + " (" + std::to_string(result.bytes) +
+                  " bytes, " + method + ")");
+    logger_->info("[AUDIT] FILE_UPLOAD user=" + username_ + " file=" + filename + " size=" + std::to_string(result.bytes));
     sendResponse("226 Transfer complete");
 }
 
@@ -698,7 +1773,7 @@ void FTPConnection::handleDELE(const std::string& filename) {
         return;
     }
     
-    std::string filepath = resolvePath(filename);
+    std::string filepath(resolvePath(filename));
     
     if (!validatePath(filepath)) {
         sendResponse("550 Invalid path");
@@ -722,7 +1797,7 @@ void FTPConnection::handleMKD(const std::string& dirname) {
         return;
     }
     
-    std::string dirpath = resolvePath(dirname);
+    std::string dirpath(resolvePath(dirname));
     
     if (!validatePath(dirpath)) {
         sendResponse("550 Invalid path");
@@ -743,7 +1818,7 @@ void FTPConnection::handleRMD(const std::string& dirname) {
         return;
     }
     
-    std::string dirpath = resolvePath(dirname);
+    std::string dirpath(resolvePath(dirname));
     
     if (!validatePath(dirpath)) {
         sendResponse("550 Invalid path");
@@ -762,75 +1837,119 @@ void FTPConnection::handleRMD(const std::string& dirname) {
     }
 }
 
-std::string FTPConnection::resolvePath(const std::string& path) {
+std::string_view FTPConnection::resolvePath(std::string_view path) {
     if (path.empty()) {
         return current_directory_;
     }
     
-    std::string resolved;
+    ArenaString joined(arena_);
     if (path[0] == '/') {
         // Absolute path - resolve relative to user's home directory
         if (current_user_) {
-            resolved = current_user_->getHomeDirectory() + path;
-        } else {
-            resolved = path;
+            joined = current_user_->getHomeDirectory();
         }
     } else {
         // Relative path
-        resolved = current_directory_ + "/" + path;
+        joined = current_directory_;
+        joined += '/';
     }
+    joined.append(path.data(), path.length());
     
-    // Normalize path (remove .. and .)
-    std::filesystem::path p(resolved);
-    try {
-        return std::filesystem::canonical(p).string();
-    } catch (const std::exception&) {
-        // If canonical fails, at least normalize
-        return p.lexically_normal().string();
+    // Follow symlinks so validatePath() sees where the path really leads
+    char real[PATH_MAX];
+    if (realpath(joined.c_str(), real)) {
+        return arenaCopy(real);
+    }
+    
+    // Something about to be created (STOR, MKD): resolve the deepest existing
+    // ancestor and append the missing components to it. Any symlink on the
+    // way is then already followed, so a link to /etc cannot hide behind a
+    // directory that does not exist yet.
+    size_t split = joined.length();
+    while (errno == ENOENT && split > 0) {
+        split = joined.rfind('/', split - 1);
+        if (split == ArenaString::npos) {
+            break;
+        }
+        if (split == 0) {
+            return appendMissing("/", joined);
+        }
+        joined[split] = '\0';
+        bool ancestor_found = realpath(joined.c_str(), real) != nullptr;
+        joined[split] = '/';
+        if (ancestor_found) {
+            return appendMissing(real, std::string_view(joined).substr(split));
+        }
     }
+    // Unresolvable: an empty path never passes validatePath()
+    return {};
 }
 
-bool FTPConnection::validatePath(const std::string& path) {
-    if (!current_user_) {
-        return false;
+std::string_view FTPConnection::appendMissing(std::string_view ancestor, std::string_view missing) {
+    ArenaString rebuilt(ancestor, arena_);
+    size_t pos = 0;
+    bool first = true;
+    while (pos < missing.length()) {
+        size_t next = missing.find('/', pos);
+        if (next == std::string_view::npos) {
+            next = missing.length();
+        }
+        std::string_view part = missing.substr(pos, next - pos);
+        pos = next + 1;
+        if (part.empty() || part == ".") {
+            continue;
+        }
+        // ".." below a missing directory cannot be checked against the disk
+        if (part == "..") {
+            return {};
+        }
+        if (rebuilt.back() != '/') {
+            rebuilt += '/';
+        }
+        rebuilt.append(part.data(), part.length());
+        // realpath() failed on this component, so if it exists at all it is
+        // a dangling symlink that open(O_CREAT) would follow
+        struct stat st;
+        if (first && lstat(rebuilt.c_str(), &st) == 0) {
+            return {};
+        }
+        first = false;
     }
-    
-    std::string home = current_user_->getHomeDirectory();
-    std::string resolved = resolvePath(path);
-    
-    // Check if resolved path is within home directory
-    return isPathWithinHome(resolved);
+    return arenaCopy(rebuilt);
+}
+
+bool FTPConnection::validatePath(std::string_view path) {
+    // path comes from resolvePath(); resolving it again would prepend the
+    // home directory a second time
+    return current_user_ && isPathWithinHome(path);
 }
 
-bool FTPConnection::isPathWithinHome(const std::string& path) {
+bool FTPConnection::isPathWithinHome(std::string_view path) {
     if (!current_user_) {
         return false;
     }
     
-    std::string home = current_user_->getHomeDirectory();
-    std::filesystem::path path_p(path);
-    std::filesystem::path home_p(home);
-    
-    try {
-        std::filesystem::path canonical_path = std::filesystem::canonical(path_p);
-        std::filesystem::path canonical_home = std::filesystem::canonical(home_p);
-        
-        // Check if canonical_path starts with canonical_home
-        auto it = canonical_path.begin();
-        auto home_it = canonical_home.begin();
-        
-        while (home_it != canonical_home.end()) {
-            if (it == canonical_path.end() || *it != *home_it) {
-                return false;
-            }
-            ++it;
-            ++home_it;
-        }
-        return true;
-    } catch (const std::exception&) {
-        // If canonical fails, do simple string comparison
-        return path.find(home) == 0;
+    const std::string& home = current_user_->getHomeDirectory();
+    char real_home[PATH_MAX];
+    std::string_view root = realpath(home.c_str(), real_home) ? std::string_view(real_home) : std::string_view(home);
+    while (root.length() > 1 && root.back() == '/') {
+        root.remove_suffix(1);
+    }
+    if (root == "/") {
+        return !path.empty() && path[0] == '/';
     }
+    
+    // Match whole components: /home/al must not admit /home/alice
+    return path.compare(0, root.length(), root) == 0 &&
+           (path.length() == root.length() || path[root.length()] == '/');
+}
+
+std::string_view FTPConnection::arenaCopy(std::string_view text) {
+    // NUL-terminated so the view can go straight to system calls
+    char* copy = static_cast<char*>(arena_->allocate(text.length() + 1, 1));
+    std::memcpy(copy, text.data(), text.length());
+    copy[text.length()] = '\0';
+    return std::string_view(copy, text.length());
 }
 
 bool FTPConnection::hasPermission(const std::string& operation, const std::string& path) {
@@ -845,141 +1964,268 @@ bool FTPConnection::hasPermission(const std::string& operation, const std::strin
 int FTPConnection::createPassiveDataSocket() {
     closeDataSocket();
     
-    // Create socket
-    passive_listen_socket_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (passive_listen_socket_ < 0) {
-        logger_->error("Failed to create passive socket: " + std::string(strerror(errno)));
+    if (!passive_ports_) {
+        passive_ports_ = std::make_shared<PassivePortAllocator>(logger_, config_->connection.passive_port_range_start,
+                                                                config_->connection.passive_port_range_end);
+    }
+    
+    int port = -1;
+    int listen_socket = passive_ports_->acquire(port);
+    if (listen_socket < 0) {
+        logger_->error("Failed to bind passive socket in port range");
         return -1;
     }
     
-    // Set socket options
-    int reuse = 1;
-    setsockopt(passive_listen_socket_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    std::lock_guard<std::mutex> lock(data_socket_mutex_);
+    passive_listen_socket_ = listen_socket;
+    passive_port_ = port;
+    logger_->debug("Passive socket listening on port " + std::to_string(port));
+    return port;
+}
+
+int FTPConnection::acceptDataConnection() {
+    int data_fd = connectDataChannel();
+    if (data_fd >= 0 && protection_level_ == ProtectionLevel::PRIVATE && !secureDataConnection(data_fd)) {
+        closeDataConnection(data_fd);
+        return -1;
+    }
+    return data_fd;
+}
+
+bool FTPConnection::secureDataConnection(int data_fd) {
+    data_ssl_ = ssl_context_->createSSL(data_fd);
+    if (!data_ssl_) {
+        logger_->error("Failed to create data connection SSL: " + ssl_context_->getLastError());
+        if (performance_monitor_) {
+            performance_monitor_->recordTlsHandshakeFailure();
+        }
+        return false;
+    }
+    if (config_->security.ssl_kernel_offload && SSLContext::isKernelTlsAvailable()) {
+        ssl_context_->enableKernelTls(data_ssl_);
+    }
     
-    // Bind to any available port in the range
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
+    // A client that never finishes its handshake must not hold the
+    // handler past the data connection timeout
+    bool accepted = ssl_context_->acceptSSL(data_ssl_, std::chrono::seconds(config_->connection.data_connection_timeout_seconds));
     
-    int port_range_start = config_->connection.passive_port_range_start;
-    int port_range_end = config_->connection.passive_port_range_end;
+    // Clients offer the control connection's session, so a file costs a
+    // resumption rather than a full key exchange
+    bool resumed = accepted && ssl_context_->isSessionReused(data_ssl_);
+    if (accepted && !resumed && config_->security.require_ssl_reuse) {
+        logger_->warn("Data connection did not resume the control connection's TLS session");
+        accepted = false;
+    } else if (!accepted) {
+        logger_->error("Data connection TLS handshake failed: " + ssl_context_->getLastError());
+    }
     
-    for (int port = port_range_start; port <= port_range_end; ++port) {
-        addr.sin_port = htons(port);
-        if (bind(passive_listen_socket_, (struct sockaddr*)&addr, sizeof(addr)) == 0) {
-            if (listen(passive_listen_socket_, 1) == 0) {
-                logger_->debug("Passive socket listening on port " + std::to_string(port));
-                return port;
+    if (performance_monitor_) {
+        if (accepted) {
+            performance_monitor_->recordTlsHandshake(true, resumed);
+        } else {
+            performance_monitor_->recordTlsHandshakeFailure();
+        }
+    }
+    if (!accepted) {
+        ssl_context_->freeSSL(data_ssl_);
+        data_ssl_ = nullptr;
+    }
+    return accepted;
+}
+
+bool FTPConnection::sendData(int data_fd, const char* data, size_t length) {
+    while (length > 0) {
+        ssize_t written;
+        if (data_ssl_) {
+            written = ssl_context_->writeSSL(data_ssl_, data, static_cast<int>(length));
+            if (written <= 0 && ssl_context_->shouldRetry(data_ssl_, static_cast<int>(written))) {
+                continue;
+            }
+        } else {
+            written = send(data_fd, data, length, MSG_NOSIGNAL);
+            if (written < 0 && errno == EINTR) {
+                continue;
             }
         }
+        if (written <= 0) {
+            return false;
+        }
+        data += written;
+        length -= written;
+    }
+    return true;
+}
+
+int FTPConnection::connectDataChannel() {
+    // The event loop connects ahead of dispatching a data command
+    if (prepared_data_socket_ >= 0) {
+        int data_fd = prepared_data_socket_;
+        prepared_data_socket_ = -1;
+        return data_fd;
+    }
+    
+    auto started = std::chrono::steady_clock::now();
+    int wait_fd;
+    bool wait_writable;
+    if (!beginDataConnection(wait_fd, wait_writable)) {
+        return -1;
     }
     
-    close(passive_listen_socket_);
-    passive_listen_socket_ = -1;
-    logger_->error("Failed to bind passive socket in port range");
-    return -1;
+    auto deadline = started + std::chrono::seconds(config_->connection.data_connection_timeout_seconds);
+    while (true) {
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        struct pollfd pfd;
+        pfd.fd = wait_fd;
+        pfd.events = wait_writable ? POLLOUT : POLLIN;
+        pfd.revents = 0;
+        int ready = remaining.count() > 0 ? poll(&pfd, 1, static_cast<int>(remaining.count())) : 0;
+        if (ready < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ready <= 0) {
+            logger_->error("Timeout waiting for data connection");
+            abortDataConnection();
+            recordDataSetup(started, false);
+            return -1;
+        }
+        
+        bool retry = false;
+        int data_fd = finishDataConnection(retry);
+        if (retry) {
+            continue;
+        }
+        recordDataSetup(started, data_fd >= 0);
+        return data_fd;
+    }
 }
 
-int FTPConnection::acceptDataConnection() {
+bool FTPConnection::beginDataConnection(int& wait_fd, bool& wait_writable) {
     std::lock_guard<std::mutex> lock(data_socket_mutex_);
     
-    if (active_mode_enabled_) {
-        return connectActiveDataSocket();
+    if (!active_mode_enabled_) {
+        if (passive_listen_socket_ < 0) {
+            logger_->error("No passive socket available");
+            return false;
+        }
+        wait_fd = passive_listen_socket_;
+        wait_writable = false;
+        return true;
     }
     
-    if (passive_listen_socket_ < 0) {
-        logger_->error("No passive socket available");
-        return -1;
+    if (active_mode_port_ <= 0) {
+        logger_->error("Active mode parameters not set");
+        return false;
     }
     
-    // Set socket to non-blocking for timeout
-    int flags = fcntl(passive_listen_socket_, F_GETFL, 0);
-    fcntl(passive_listen_socket_, F_SETFL, flags | O_NONBLOCK);
-    
-    // Wait for connection with timeout
-    struct timeval timeout;
-    timeout.tv_sec = 10; // 10 second timeout
-    timeout.tv_usec = 0;
-    
-    fd_set read_fds;
-    FD_ZERO(&read_fds);
-    FD_SET(passive_listen_socket_, &read_fds);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(active_mode_port_);
+    addr.sin_addr.s_addr = active_mode_address_;
     
-    int result = select(passive_listen_socket_ + 1, &read_fds, nullptr, nullptr, &timeout);
-    if (result <= 0) {
-        logger_->error("Timeout waiting for data connection");
-        return -1;
+    data_socket_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (data_socket_ >= 0 &&
+        (connect(data_socket_, (struct sockaddr*)&addr, sizeof(addr)) == 0 || errno == EINPROGRESS)) {
+        wait_fd = data_socket_;
+        wait_writable = true;
+        return true;
     }
     
-    // Accept connection
-    struct sockaddr_in client_addr;
-    socklen_t client_len = sizeof(client_addr);
-    data_socket_ = accept(passive_listen_socket_, (struct sockaddr*)&client_addr, &client_len);
-    
-    if (data_socket_ < 0) {
-        logger_->error("Failed to accept data connection: " + std::string(strerror(errno)));
-        return -1;
+    logger_->error("Failed to connect to active mode target " + formatActiveTarget() + " - " +
+                   std::string(strerror(errno)));
+    if (data_socket_ >= 0) {
+        close(data_socket_);
+        data_socket_ = -1;
     }
-    
-    // Restore blocking mode
-    fcntl(passive_listen_socket_, F_SETFL, flags);
-    
-    logger_->debug("Data connection accepted from " + std::string(inet_ntoa(client_addr.sin_addr)));
-    return data_socket_;
+    active_mode_enabled_ = false;
+    active_mode_port_ = 0;
+    return false;
 }
 
-int FTPConnection::connectActiveDataSocket() {
-    if (active_mode_ip_.empty() || active_mode_port_ <= 0) {
-        logger_->error("Active mode parameters not set");
-        return -1;
+int FTPConnection::finishDataConnection(bool& retry) {
+    std::lock_guard<std::mutex> lock(data_socket_mutex_);
+    retry = false;
+    
+    if (!active_mode_enabled_) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        // accept4 without SOCK_NONBLOCK: handlers use blocking I/O on the data socket
+        int data_fd = accept4(passive_listen_socket_, (struct sockaddr*)&client_addr, &client_len, SOCK_CLOEXEC);
+        if (data_fd < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR || errno == ECONNABORTED) {
+                retry = true;  // the client gave up before we got to it
+                return -1;
+            }
+            logger_->error("Failed to accept data connection: " + std::string(strerror(errno)));
+            return -1;
+        }
+        data_socket_ = data_fd;
+        logger_->debug("Data connection accepted from " + std::string(inet_ntoa(client_addr.sin_addr)));
+        return data_socket_;
     }
     
-    data_socket_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (data_socket_ < 0) {
-        logger_->error("Failed to create active mode socket: " + std::string(strerror(errno)));
-        return -1;
+    // PORT mode: the non-blocking connect has completed one way or the other
+    int error = 0;
+    socklen_t error_len = sizeof(error);
+    if (getsockopt(data_socket_, SOL_SOCKET, SO_ERROR, &error, &error_len) != 0) {
+        error = errno;
     }
     
-    struct sockaddr_in addr;
-    std::memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_port = htons(active_mode_port_);
+    std::string target = formatActiveTarget();
+    active_mode_enabled_ = false;
+    active_mode_port_ = 0;
     
-    if (inet_pton(AF_INET, active_mode_ip_.c_str(), &addr.sin_addr) <= 0) {
-        logger_->error("Invalid active mode IP: " + active_mode_ip_);
+    if (error != 0) {
+        logger_->error("Failed to connect to active mode target " + target + " - " + std::string(strerror(error)));
         close(data_socket_);
         data_socket_ = -1;
-        active_mode_enabled_ = false;
-        active_mode_ip_.clear();
-        active_mode_port_ = 0;
         return -1;
     }
     
-    // Set connect timeout (10 seconds)
-    struct timeval timeout;
-    timeout.tv_sec = 10;
-    timeout.tv_usec = 0;
-    setsockopt(data_socket_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
-    setsockopt(data_socket_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    int flags = fcntl(data_socket_, F_GETFL, 0);
+    fcntl(data_socket_, F_SETFL, flags & ~O_NONBLOCK);
+    logger_->debug("Active mode data connection established to " + target);
+    return data_socket_;
+}
+
+void FTPConnection::abortDataConnection() {
+    std::lock_guard<std::mutex> lock(data_socket_mutex_);
     
-    if (connect(data_socket_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
-        logger_->error("Failed to connect to active mode target " + active_mode_ip_ + ":" +
-                       std::to_string(active_mode_port_) + " - " + std::string(strerror(errno)));
-        close(data_socket_);
-        data_socket_ = -1;
+    // A passive listener stays open for a retry; a PORT connect is one-shot
+    if (active_mode_enabled_) {
+        if (data_socket_ >= 0) {
+            close(data_socket_);
+            data_socket_ = -1;
+        }
         active_mode_enabled_ = false;
-        active_mode_ip_.clear();
         active_mode_port_ = 0;
-        return -1;
     }
+}
+
+void FTPConnection::recordDataSetup(std::chrono::steady_clock::time_point started, bool established) {
+    if (performance_monitor_) {
+        performance_monitor_->recordDataConnectionSetup(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started),
+            established);
+    }
+}
+
+void FTPConnection::closeDataConnection(int data_fd) {
+    std::lock_guard<std::mutex> lock(data_socket_mutex_);
     
-    logger_->debug("Active mode data connection established to " + active_mode_ip_ + ":" +
-                   std::to_string(active_mode_port_));
-    active_mode_enabled_ = false;
-    active_mode_ip_.clear();
-    active_mode_port_ = 0;
-    return data_socket_;
+    // close_notify first, so the client can tell a complete file from a cut one
+    if (data_ssl_) {
+        ssl_context_->shutdownSSL(data_ssl_);
+        ssl_context_->freeSSL(data_ssl_);
+        data_ssl_ = nullptr;
+    }
+    
+    // Forget the descriptor too, or a later closeDataSocket() would close
+    // whatever the number has been reused for
+    close(data_fd);
+    if (data_socket_ == data_fd) {
+        data_socket_ = -1;
+    }
 }
 
 void FTPConnection::closeDataSocket() {
@@ -991,8 +2237,13 @@ void FTPConnection::closeDataSocket() {
     }
     
     if (passive_listen_socket_ >= 0) {
-        close(passive_listen_socket_);
+        if (passive_ports_) {
+            passive_ports_->release(passive_port_, passive_listen_socket_);
+        } else {
+            close(passive_listen_socket_);
+        }
         passive_listen_socket_ = -1;
+        passive_port_ = -1;
     }
 }
 
@@ -1007,6 +2258,14 @@ std::string FTPConnection::formatPassiveResponse(int port) {
     return "227 Entering Passive Mode (" + ip + "," + std::to_string(p1) + "," + std::to_string(p2) + ")";
 }
 
+std::string FTPConnection::formatActiveTarget() const {
+    struct in_addr addr;
+    addr.s_addr = active_mode_address_;
+    char ip[INET_ADDRSTRLEN] = "";
+    inet_ntop(AF_INET, &addr, ip, sizeof(ip));
+    return std::string(ip) + ":" + std::to_string(active_mode_port_);
+}
+
 // SSL/TLS Command Handlers
 void FTPConnection::handleAUTH(const std::string& method) {
     std::string method_upper = method;
@@ -1023,15 +2282,18 @@ void FTPConnection::handleAUTH(const std::string& method) {
             return;
         }
         
+        // The client starts its handshake once it sees the 234 in clear text
         sendResponse("234 AUTH TLS successful");
+        flushResponses();
+        
+        // Anything pipelined behind AUTH arrived in clear text; running it
+        // as if it had come over TLS would let it be injected
+        input_buffer_.clear();
         
-        // Upgrade connection to SSL
-        if (!upgradeToSSL()) {
-            logger_->error("Failed to upgrade connection to SSL");
+        if (event_loop_ && event_loop_->isInLoopThread()) {
+            beginHandshake();  // completes on the loop as the socket allows
+        } else if (!upgradeToSSL()) {
             active_ = false;
-        } else {
-            ssl_active_ = true;
-            logger_->info("Connection upgraded to SSL/TLS");
         }
     } else {
         sendResponse("504 Unsupported AUTH method");
@@ -1059,17 +2321,14 @@ void FTPConnection::handlePROT(const std::string& level) {
     std::transform(level_upper.begin(), level_upper.end(), level_upper.begin(), ::toupper);
     
     if (level_upper == "C" || level_upper == "CLEAR") {
-        protection_level_ = "C";
+        protection_level_ = ProtectionLevel::CLEAR;
         sendResponse("200 Protection level set to Clear");
     } else if (level_upper == "P" || level_upper == "PRIVATE") {
-        protection_level_ = "P";
+        protection_level_ = ProtectionLevel::PRIVATE;
         sendResponse("200 Protection level set to Private");
-    } else if (level_upper == "S" || level_upper == "SAFE") {
-        protection_level_ = "S";
-        sendResponse("200 Protection level set to Safe");
-    } else if (level_upper == "E" || level_upper == "CONFIDENTIAL") {
-        protection_level_ = "E";
-        sendResponse("200 Protection level set to Confidential");
+    } else if (level_upper == "S" || level_upper == "SAFE" || level_upper == "E" || level_upper == "CONFIDENTIAL") {
+        // TLS only protects a connection as a whole (RFC 4217)
+        sendResponse("536 Requested PROT level not supported by mechanism");
     } else {
         sendResponse("504 Unsupported protection level");
     }
@@ -1086,13 +2345,25 @@ bool FTPConnection::upgradeToSSL() {
         return false;
     }
     
-    if (!ssl_context_->acceptSSL(ssl_)) {
-        logger_->error("SSL handshake failed: " + ssl_context_->getLastError());
+    return finishUpgrade(ssl_context_->acceptSSL(ssl_, std::chrono::seconds(config_->security.ssl_handshake_timeout_seconds)));
+}
+
+bool FTPConnection::finishUpgrade(bool accepted) {
+    if (!accepted) {
+        logger_->error("SSL handshake failed");  // SSLContext logged the cause
         ssl_context_->freeSSL(ssl_);
         ssl_ = nullptr;
+        if (performance_monitor_) {
+            performance_monitor_->recordTlsHandshakeFailure();
+        }
         return false;
     }
     
+    ssl_active_ = true;
+    if (performance_monitor_) {
+        performance_monitor_->recordTlsHandshake(false, ssl_context_->isSessionReused(ssl_));
+    }
+    logger_->info("Connection upgraded to SSL/TLS");
     return true;
 }
 
@@ -1146,14 +2417,18 @@ void FTPConnection::handleAPPE(const std::string& filename) {
         return;
     }
     
-    std::string filepath = resolvePath(filename);
+    std::string filepath(resolvePath(filename));
     
     if (!validatePath(filepath)) {
         sendResponse("550 Invalid path");
         return;
     }
     
-    sendResponse("150 Opening data connection for append");
+    if (!admitTransfer()) {
+        return;
+    }
+    
+    sendPreliminaryResponse("150 Opening data connection for append");
     
     int data_fd = acceptDataConnection();
     if (data_fd < 0) {
@@ -1161,28 +2436,33 @@ void FTPConnection::handleAPPE(const std::string& filename) {
         return;
     }
     
-    std::ofstream file;
-    if (std::filesystem::exists(filepath)) {
-        file.open(filepath, std::ios::binary | std::ios::app);
-    } else {
-        file.open(filepath, std::ios::binary | std::ios::out);
-    }
-    
-    if (!file.is_open()) {
-        close(data_fd);
+    // splice() refuses O_APPEND descriptors, so append at an explicit offset
+    int file_fd = open(filepath.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+    struct stat file_stat;
+    if (file_fd < 0 || fstat(file_fd, &file_stat) != 0) {
+        if (file_fd >= 0) {
+            close(file_fd);
+        }
+        closeDataConnection(data_fd);
         sendResponse("550 Failed to open file for append");
         return;
     }
     
-    char buffer[8192];
-    ssize_t received;
-    while ((received = recv(data_fd, buffer, sizeof(buffer), 0)) > 0) {
-        file.write(buffer, received);
+    std::string method;
+    TransferResult result = receiveUpload(data_fd, file_fd, static_cast<uint64_t>(file_stat.st_size), method);
+    close(file_fd);
+    closeDataConnection(data_fd);
+    resume_position_ = 0; // Reset resume position
+    
+    if (result.status == TransferStatus::ABORTED) {
+        logger_->error("Error receiving file data: " + std::string(strerror(result.error)));
+        sendResponse("426 Connection closed, transfer aborted");
+        return;
     }
     
-    file.close();
-    close(data_fd);
-    resume_position_ = 0; // Reset resume position
+    logger_->info("File append complete: " + filename + " (" + std::to_string(result.bytes) +
+                  " bytes, " + method + ")");
+    logger_->info("[AUDIT] FILE_APPEND user=" + username_ + " file=" + filename + " size=" + std::to_string(result.bytes));
     sendResponse("226 Transfer complete");
 }
 
@@ -1192,7 +2472,7 @@ void FTPConnection::handleRNFR(const std::string& filename) {
         return;
     }
     
-    std::string filepath = resolvePath(filename);
+    std::string filepath(resolvePath(filename));
     
     if (!validatePath(filepath)) {
         sendResponse("550 Invalid path");
@@ -1220,7 +2500,7 @@ void FTPConnection::handleRNTO(const std::string& filename) {
         return;
     }
     
-    std::string filepath = resolvePath(filename);
+    std::string filepath(resolvePath(filename));
     
     if (!validatePath(filepath)) {
         sendResponse("550 Invalid path");
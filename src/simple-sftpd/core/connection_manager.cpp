@@ -18,13 +18,13 @@
 #include "simple-sftpd/core/connection.hpp"
 #include "simple-sftpd/utils/logger.hpp"
 #include <atomic>
-#include <algorithm>
+#include <string>
 
 namespace simple_sftpd {
 
 FTPConnectionManager::FTPConnectionManager(std::shared_ptr<FTPServerConfig> config,
                                          std::shared_ptr<Logger> logger)
-    : config_(config), logger_(logger), running_(false),
+    : config_(config), logger_(logger), connection_count_(0), running_(false),
       connection_timeout_(std::chrono::seconds(300)),
       cleanup_interval_(std::chrono::seconds(60)),
       pool_size_(10) {
@@ -51,7 +51,11 @@ void FTPConnectionManager::stop() {
         return;
     }
     
-    running_ = false;
+    {
+        std::lock_guard<std::mutex> lock(stop_mutex_);
+        running_ = false;
+    }
+    stop_cv_.notify_all();
     if (cleanup_thread_.joinable()) {
         cleanup_thread_.join();
     }
@@ -68,55 +72,138 @@ void FTPConnectionManager::stop() {
 }
 
 void FTPConnectionManager::addConnection(std::shared_ptr<FTPConnection> connection) {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-    connections_.push_back(connection);
+    if (!connection) {
+        return;
+    }
+    
+    uint64_t handle;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        uint32_t index;
+        if (!free_slots_.empty()) {
+            index = free_slots_.back();
+            free_slots_.pop_back();
+        } else {
+            index = static_cast<uint32_t>(slots_.size());
+            slots_.emplace_back();
+        }
+        slots_[index].connection = connection;
+        handle = (static_cast<uint64_t>(slots_[index].generation) << 32) | index;
+        ++connection_count_;
+    }
+    
+    // Weak, so a session outliving the manager does not call into a dead one
+    std::weak_ptr<FTPConnectionManager> weak_self = weak_from_this();
+    connection->setRegistryHandle(handle, [weak_self, handle]() {
+        if (auto self = weak_self.lock()) {
+            self->releaseSlot(handle);
+        }
+    });
 }
 
 void FTPConnectionManager::removeConnection(std::shared_ptr<FTPConnection> connection) {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-    connections_.erase(
-        std::remove(connections_.begin(), connections_.end(), connection),
-        connections_.end()
-    );
+    if (connection) {
+        releaseSlot(connection->getRegistryHandle());
+    }
+}
+
+void FTPConnectionManager::releaseSlot(uint64_t handle) {
+    std::shared_ptr<FTPConnection> released;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        uint32_t index = static_cast<uint32_t>(handle);
+        uint32_t generation = static_cast<uint32_t>(handle >> 32);
+        if (index >= slots_.size() || slots_[index].generation != generation || !slots_[index].connection) {
+            return;  // already removed, or the slot has moved on to another session
+        }
+        released.swap(slots_[index].connection);
+        ++slots_[index].generation;
+        free_slots_.push_back(index);
+        if (--connection_count_ == 0) {
+            drained_cv_.notify_all();
+        }
+    }
+    // The last reference may go here; tear down outside the lock
 }
 
 void FTPConnectionManager::stopAllConnections() {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-    for (auto& connection : connections_) {
-        if (connection) {
-            connection->stop();
+    std::vector<std::shared_ptr<FTPConnection>> connections;
+    {
+        std::lock_guard<std::mutex> lock(connections_mutex_);
+        free_slots_.clear();
+        for (uint32_t index = 0; index < slots_.size(); ++index) {
+            if (slots_[index].connection) {
+                connections.push_back(std::move(slots_[index].connection));
+                slots_[index].connection.reset();
+                ++slots_[index].generation;
+            }
+            free_slots_.push_back(index);
         }
+        connection_count_ = 0;
+    }
+    drained_cv_.notify_all();
+    
+    // Stopping a session thread joins it, and the session deregisters on
+    // its way out, so this must not hold connections_mutex_. Unblock every
+    // session first so they wind down in parallel rather than one by one.
+    for (auto& connection : connections) {
+        connection->requestStop();
+    }
+    for (auto& connection : connections) {
+        connection->stop();
     }
-    connections_.clear();
 }
 
-size_t FTPConnectionManager::getConnectionCount() const {
-    std::lock_guard<std::mutex> lock(connections_mutex_);
-    return connections_.size();
+size_t FTPConnectionManager::drainConnections(std::chrono::steady_clock::time_point deadline) {
+    size_t remaining;
+    {
+        std::unique_lock<std::mutex> lock(connections_mutex_);
+        drained_cv_.wait_until(lock, deadline, [this] { return connection_count_ == 0; });
+        remaining = connection_count_;
+    }
+    if (remaining > 0) {
+        logger_->warn("Drain deadline reached, closing " + std::to_string(remaining) + " remaining session" +
+                      (remaining == 1 ? "" : "s"));
+        stopAllConnections();
+    }
+    return remaining;
 }
 
 std::vector<std::shared_ptr<FTPConnection>> FTPConnectionManager::getConnections() const {
     std::lock_guard<std::mutex> lock(connections_mutex_);
-    return connections_;
+    std::vector<std::shared_ptr<FTPConnection>> connections;
+    connections.reserve(connection_count_);
+    for (const Slot& slot : slots_) {
+        if (slot.connection) {
+            connections.push_back(slot.connection);
+        }
+    }
+    return connections;
 }
 
 void FTPConnectionManager::cleanupLoop() {
     while (running_) {
-        std::this_thread::sleep_for(cleanup_interval_);
+        {
+            std::unique_lock<std::mutex> lock(stop_mutex_);
+            if (stop_cv_.wait_for(lock, cleanup_interval_, [this] { return !running_; })) {
+                break;
+            }
+        }
         
-        // Clean up inactive connections
-        std::lock_guard<std::mutex> lock(connections_mutex_);
-        auto it = connections_.begin();
-        while (it != connections_.end()) {
-            if (!(*it) || !(*it)->isActive()) {
-                if (*it) {
-                    (*it)->stop();
+        // Sessions deregister themselves; this only catches stragglers
+        std::vector<std::shared_ptr<FTPConnection>> inactive;
+        {
+            std::lock_guard<std::mutex> lock(connections_mutex_);
+            for (const Slot& slot : slots_) {
+                if (slot.connection && !slot.connection->isActive()) {
+                    inactive.push_back(slot.connection);
                 }
-                it = connections_.erase(it);
-            } else {
-                ++it;
             }
         }
+        for (auto& connection : inactive) {
+            connection->stop();
+            removeConnection(connection);
+        }
     }
 }
 
@@ -169,7 +256,12 @@ void FTPConnectionManager::setPoolSize(size_t pool_size) {
 
 void FTPConnectionManager::poolMaintenanceLoop() {
     while (running_) {
-        std::this_thread::sleep_for(std::chrono::seconds(30));
+        {
+            std::unique_lock<std::mutex> lock(stop_mutex_);
+            if (stop_cv_.wait_for(lock, std::chrono::seconds(30), [this] { return !running_; })) {
+                break;
+            }
+        }
         
         // Clean up inactive connections from pool
         std::lock_guard<std::mutex> lock(pool_mutex_);
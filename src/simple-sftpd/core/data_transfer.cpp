@@ -0,0 +1,962 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/data_transfer.hpp"
+#include "simple-sftpd/core/buffer_pool.hpp"
+#include "simple-sftpd/core/io_uring.hpp"
+#include "simple-sftpd/security/ssl_context.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <memory>
+#include <thread>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+namespace simple_sftpd {
+
+namespace {
+
+// Unthrottled sendfile() calls move this much per syscall
+const size_t ZERO_COPY_CHUNK = 4 * 1024 * 1024;
+
+// Buffered copies use pooled buffers sized to hold about
+// BUFFER_FILL_TIME of the observed rate, re-checked every
+// BUFFER_RESIZE_INTERVAL; BUFFERED_CHUNK is the fallback when the pool
+// is at its memory limit, one full TLS record
+const size_t BUFFERED_CHUNK = DataTransfer::TLS_RECORD;
+const std::chrono::milliseconds BUFFER_FILL_TIME(2);
+const std::chrono::milliseconds BUFFER_RESIZE_INTERVAL(100);
+
+// Longest a receive holds off reading while memory is exhausted
+const std::chrono::milliseconds MEMORY_PAUSE(1000);
+
+// A rate-limit pause checks for cancellation this often
+const std::chrono::milliseconds CANCEL_POLL(100);
+
+// Requested splice() pipe capacity; the kernel may grant less
+// (/proc/sys/fs/pipe-max-size for unprivileged processes)
+const int SPLICE_PIPE_SIZE = 1024 * 1024;
+
+// io_uring engine: every thread that transfers gets one ring and
+// URING_SLOTS registered buffers of URING_CHUNK bytes
+const unsigned URING_DEPTH = 16;
+const unsigned URING_SLOTS = 4;
+const size_t URING_CHUNK = 256 * 1024;
+
+enum UringOp : uint64_t {
+    URING_READ = 0,
+    URING_SEND = 1,
+    URING_RECV = 2,
+    URING_WRITE = 3
+};
+
+uint64_t uringTag(unsigned slot, UringOp op) {
+    return (static_cast<uint64_t>(slot) << 8) | op;
+}
+
+struct UringEngine {
+    BufferPool::Buffer buffers;  // released after the ring
+    IoUring ring;
+    bool failed = false;
+    int error = 0;
+    
+    char* buffer(unsigned slot) { return buffers.data() + slot * URING_CHUNK; }
+};
+
+UringEngine* threadUringEngine() {
+    thread_local UringEngine engine;
+    if (engine.failed) {
+        return nullptr;
+    }
+    if (engine.ring.isReady()) {
+        return &engine;
+    }
+    
+    // A pool at its memory limit is passing; try again next transfer
+    BufferPool::Buffer buffers = BufferPool::global()->acquire(URING_SLOTS * URING_CHUNK, URING_SLOTS * URING_CHUNK);
+    if (!buffers) {
+        return nullptr;
+    }
+    
+    if (!engine.ring.init(URING_DEPTH)) {
+        engine.failed = true;
+        engine.error = errno;
+        return nullptr;
+    }
+    
+    engine.buffers = std::move(buffers);
+    struct iovec iov[URING_SLOTS];
+    for (unsigned i = 0; i < URING_SLOTS; ++i) {
+        iov[i].iov_base = engine.buffer(i);
+        iov[i].iov_len = URING_CHUNK;
+    }
+    if (!engine.ring.registerBuffers(iov, URING_SLOTS)) {
+        // Typically RLIMIT_MEMLOCK on older kernels
+        engine.failed = true;
+        engine.error = errno;
+        engine.buffers.reset();
+        return nullptr;
+    }
+    return &engine;
+}
+
+// Errors meaning "this kernel cannot do that operation", not I/O failures
+bool isUnsupportedError(int error) {
+    return error == EINVAL || error == EOPNOTSUPP || error == ENOSYS;
+}
+
+/**
+ * Buffer for one buffered copy, resized from the observed rate
+ *
+ * Starts at the pool's smallest class and moves to the class that holds
+ * about BUFFER_FILL_TIME of data, so a 10 GbE client gets megabyte reads
+ * and a slow one does not pin them. Only resized between chunks, when
+ * the buffer holds nothing. Pooled memory is charged to the throttle's
+ * memory account; a refused charge keeps the current size, or the small
+ * stack buffer to begin with.
+ */
+class TransferBuffer {
+public:
+    explicit TransferBuffer(const TransferThrottle& throttle)
+        : throttle_(throttle), charge_(throttle.getMemoryAccount(), MemoryAccountant::Category::TRANSFER),
+          window_start_(std::chrono::steady_clock::now()), window_bytes_(0) {
+        if (charge_.resize(BufferPool::MIN_BUFFER)) {
+            buffer_ = BufferPool::global()->acquire(BufferPool::MIN_BUFFER);
+            charge_.force(buffer_.size());
+        }
+    }
+    
+    char* data() { return buffer_ ? buffer_.data() : fallback_; }
+    
+    // Largest chunk to move next; throttled transfers stay fine-grained
+    size_t size() const { return throttle_.chunkSize(buffer_ ? buffer_.size() : sizeof(fallback_)); }
+    
+    void adapt(size_t bytes) {
+        window_bytes_ += bytes;
+        auto now = std::chrono::steady_clock::now();
+        auto elapsed = now - window_start_;
+        if (elapsed < BUFFER_RESIZE_INTERVAL) {
+            return;
+        }
+        
+        double rate = static_cast<double>(window_bytes_) / std::chrono::duration<double>(elapsed).count();
+        window_start_ = now;
+        window_bytes_ = 0;
+        double fill = rate * std::chrono::duration<double>(BUFFER_FILL_TIME).count();
+        size_t wanted = BufferPool::classSize(static_cast<size_t>(std::min(fill, static_cast<double>(BufferPool::MAX_BUFFER))));
+        wanted = std::max(throttle_.chunkSize(wanted), BufferPool::MIN_BUFFER);
+        
+        // Grow as far as memory allows; shrink only on a clear drop
+        size_t current = buffer_.size();
+        BufferPool::Buffer replacement;
+        if (wanted > current) {
+            size_t minimum = current > 0 ? current * 2 : BufferPool::MIN_BUFFER;
+            if (!charge_.resize(wanted) && !charge_.resize(minimum)) {
+                return;
+            }
+            replacement = BufferPool::global()->acquire(charge_.size(), minimum);
+        } else if (wanted * 4 <= current) {
+            replacement = BufferPool::global()->acquire(wanted, wanted);
+        }
+        if (replacement) {
+            buffer_ = std::move(replacement);
+        }
+        charge_.force(buffer_.size());
+    }
+    
+private:
+    const TransferThrottle& throttle_;
+    MemoryAccountant::Charge charge_;
+    BufferPool::Buffer buffer_;
+    std::chrono::steady_clock::time_point window_start_;
+    uint64_t window_bytes_;
+    char fallback_[BUFFERED_CHUNK];
+};
+
+// Whole records, so OpenSSL never cuts a short one in the middle of a file
+size_t tlsChunk(size_t size) {
+    return std::max(DataTransfer::TLS_RECORD, size / DataTransfer::TLS_RECORD * DataTransfer::TLS_RECORD);
+}
+
+// OpenSSL failures do not always leave an errno behind
+int tlsError() {
+    return errno != 0 ? errno : EPROTO;
+}
+
+bool writeAt(int file_fd, const char* data, size_t length, uint64_t& position) {
+    while (length > 0) {
+        ssize_t written = pwrite(file_fd, data, length, static_cast<off_t>(position));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        length -= written;
+        position += written;
+    }
+    return true;
+}
+
+} // namespace
+
+TransferThrottle::TransferThrottle(int max_bytes_per_second)
+    : max_rate_(max_bytes_per_second), total_bytes_(0),
+      start_time_(std::chrono::steady_clock::now()), progress_(nullptr), cancelled_(nullptr) {
+}
+
+void TransferThrottle::wait(size_t next_bytes) {
+    if (max_rate_ <= 0) {
+        return;
+    }
+    
+    auto now = std::chrono::steady_clock::now();
+    auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(now - start_time_).count();
+    if (elapsed > 0) {
+        uint64_t allowed_bytes = (static_cast<uint64_t>(max_rate_) * elapsed) / 1000;
+        if (total_bytes_ + next_bytes > allowed_bytes) {
+            uint64_t delay_ms = ((total_bytes_ + next_bytes - allowed_bytes) * 1000) / max_rate_;
+            // A low rate can mean pauses of seconds; stay responsive to a stop
+            auto resume = now + std::chrono::milliseconds(delay_ms);
+            while (!(cancelled_ && cancelled_->load(std::memory_order_relaxed))) {
+                auto left = resume - std::chrono::steady_clock::now();
+                if (left <= std::chrono::steady_clock::duration::zero()) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::min<std::chrono::steady_clock::duration>(left, CANCEL_POLL));
+            }
+        }
+    }
+}
+
+void TransferThrottle::waitForMemory() {
+    if (memory_account_) {
+        memory_account_->waitForRoom(MEMORY_PAUSE);
+    }
+}
+
+size_t TransferThrottle::chunkSize(size_t preferred) const {
+    if (max_rate_ <= 0) {
+        return preferred;
+    }
+    // About ten chunks per second of budget
+    size_t limited = std::max<size_t>(BUFFERED_CHUNK, static_cast<size_t>(max_rate_) / 10);
+    return std::min(preferred, limited);
+}
+
+TransferResult DataTransfer::sendFileZeroCopy(int socket_fd, const std::string& path,
+                                              uint64_t offset, TransferThrottle& throttle) {
+    TransferResult result;
+#ifdef __linux__
+    int file_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
+        result.status = TransferStatus::OPEN_FAILED;
+        result.error = errno;
+        return result;
+    }
+    
+    struct stat st;
+    if (fstat(file_fd, &st) != 0) {
+        result.status = TransferStatus::OPEN_FAILED;
+        result.error = errno;
+        close(file_fd);
+        return result;
+    }
+    
+    off_t position = static_cast<off_t>(offset);
+    while (position < st.st_size) {
+        size_t chunk = throttle.chunkSize(std::min<uint64_t>(ZERO_COPY_CHUNK, st.st_size - position));
+        throttle.wait(chunk);
+        
+        ssize_t sent = sendfile(socket_fd, file_fd, &position, chunk);
+        if (sent < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            result.error = errno;
+            if (result.bytes == 0 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+                // e.g. a filesystem without sendfile support; the caller copies instead
+                result.status = TransferStatus::UNSUPPORTED;
+            } else {
+                result.status = TransferStatus::ABORTED;
+            }
+            break;
+        }
+        if (sent == 0) {
+            break;  // file shrank underneath us
+        }
+        throttle.add(sent);
+        result.bytes += sent;
+    }
+    
+    close(file_fd);
+#else
+    (void)socket_fd;
+    (void)path;
+    (void)offset;
+    (void)throttle;
+    result.status = TransferStatus::UNSUPPORTED;
+#endif
+    return result;
+}
+
+TransferResult DataTransfer::sendFileBuffered(int socket_fd, const std::string& path,
+                                              uint64_t offset, TransferThrottle& throttle) {
+    TransferResult result;
+    int file_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
+        result.status = TransferStatus::OPEN_FAILED;
+        result.error = errno;
+        return result;
+    }
+    
+    TransferBuffer buffer(throttle);
+    uint64_t position = offset;
+    while (result.status == TransferStatus::COMPLETE) {
+        ssize_t bytes_read = pread(file_fd, buffer.data(), buffer.size(), static_cast<off_t>(position));
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result.status = TransferStatus::ABORTED;
+            result.error = errno;
+            break;
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        throttle.wait(bytes_read);
+        
+        ssize_t written = 0;
+        while (written < bytes_read) {
+            ssize_t sent = send(socket_fd, buffer.data() + written, bytes_read - written, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                result.status = TransferStatus::ABORTED;
+                result.error = errno;
+                break;
+            }
+            written += sent;
+        }
+        if (result.status != TransferStatus::COMPLETE) {
+            break;
+        }
+        position += bytes_read;
+        throttle.add(bytes_read);
+        result.bytes += bytes_read;
+        buffer.adapt(bytes_read);
+    }
+    
+    close(file_fd);
+    return result;
+}
+
+TransferResult DataTransfer::sendFileKernelTls(SSLContext& tls, void* ssl, const std::string& path,
+                                               uint64_t offset, TransferThrottle& throttle) {
+    TransferResult result;
+    if (!tls.isKernelTlsSend(ssl)) {
+        result.status = TransferStatus::UNSUPPORTED;
+        return result;
+    }
+    
+    int file_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
+        result.status = TransferStatus::OPEN_FAILED;
+        result.error = errno;
+        return result;
+    }
+    
+    struct stat st;
+    if (fstat(file_fd, &st) != 0) {
+        result.status = TransferStatus::OPEN_FAILED;
+        result.error = errno;
+        close(file_fd);
+        return result;
+    }
+    
+    result.kernel_tls = true;
+    uint64_t position = offset;
+    while (position < static_cast<uint64_t>(st.st_size)) {
+        size_t chunk = throttle.chunkSize(std::min<uint64_t>(ZERO_COPY_CHUNK, st.st_size - position));
+        throttle.wait(chunk);
+        
+        errno = 0;
+        long sent = tls.sendFile(ssl, file_fd, position, chunk);
+        if (sent <= 0) {
+            if (sent < 0 && tls.shouldRetry(ssl, static_cast<int>(sent))) {
+                continue;
+            }
+            if (sent == 0) {
+                break;  // file shrank underneath us
+            }
+            result.error = tlsError();
+            if (result.bytes == 0 && (errno == EINVAL || errno == ENOSYS || errno == EOPNOTSUPP)) {
+                // e.g. a filesystem without sendfile support; the caller copies instead
+                result.status = TransferStatus::UNSUPPORTED;
+                result.kernel_tls = false;
+            } else {
+                result.status = TransferStatus::ABORTED;
+            }
+            break;
+        }
+        position += sent;
+        throttle.add(sent);
+        result.bytes += sent;
+    }
+    
+    close(file_fd);
+    return result;
+}
+
+TransferResult DataTransfer::sendFileTls(SSLContext& tls, void* ssl, const std::string& path,
+                                         uint64_t offset, TransferThrottle& throttle) {
+    TransferResult result;
+    int file_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
+        result.status = TransferStatus::OPEN_FAILED;
+        result.error = errno;
+        return result;
+    }
+    
+    result.kernel_tls = tls.isKernelTlsSend(ssl);
+    TransferBuffer buffer(throttle);
+    uint64_t position = offset;
+    while (result.status == TransferStatus::COMPLETE) {
+        ssize_t bytes_read = pread(file_fd, buffer.data(), tlsChunk(buffer.size()), static_cast<off_t>(position));
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result.status = TransferStatus::ABORTED;
+            result.error = errno;
+            break;
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        throttle.wait(bytes_read);
+        
+        ssize_t written = 0;
+        while (written < bytes_read) {
+            errno = 0;
+            int sent = tls.writeSSL(ssl, buffer.data() + written, static_cast<int>(bytes_read - written));
+            if (sent <= 0) {
+                if (tls.shouldRetry(ssl, sent)) {
+                    continue;
+                }
+                result.status = TransferStatus::ABORTED;
+                result.error = tlsError();
+                break;
+            }
+            written += sent;
+        }
+        if (result.status != TransferStatus::COMPLETE) {
+            break;
+        }
+        position += bytes_read;
+        throttle.add(bytes_read);
+        result.bytes += bytes_read;
+        buffer.adapt(bytes_read);
+    }
+    
+    close(file_fd);
+    return result;
+}
+
+TransferResult DataTransfer::receiveFileZeroCopy(int socket_fd, int file_fd,
+                                                 uint64_t offset, TransferThrottle& throttle) {
+    TransferResult result;
+#ifdef __linux__
+    int pipe_fds[2];
+    if (pipe2(pipe_fds, O_CLOEXEC) != 0) {
+        result.status = TransferStatus::UNSUPPORTED;
+        result.error = errno;
+        return result;
+    }
+    
+    // Bigger pipes mean fewer splice() round trips per megabyte
+    fcntl(pipe_fds[1], F_SETPIPE_SZ, SPLICE_PIPE_SIZE);
+    int pipe_size = fcntl(pipe_fds[1], F_GETPIPE_SZ);
+    size_t chunk_limit = pipe_size > 0 ? static_cast<size_t>(pipe_size) : 65536;
+    
+    loff_t position = static_cast<loff_t>(offset);
+    while (true) {
+        size_t chunk = throttle.chunkSize(chunk_limit);
+        throttle.waitForMemory();
+        throttle.wait(chunk);
+        
+        ssize_t received = splice(socket_fd, nullptr, pipe_fds[1], nullptr, chunk, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (received < 0) {
+            if (errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            result.error = errno;
+            result.status = (result.bytes == 0 && errno == EINVAL) ? TransferStatus::UNSUPPORTED
+                                                                   : TransferStatus::ABORTED;
+            break;
+        }
+        if (received == 0) {
+            break;  // peer finished the upload
+        }
+        
+        // Drain the pipe into the file before reading more
+        size_t pending = received;
+        while (pending > 0) {
+            ssize_t written = splice(pipe_fds[0], nullptr, file_fd, &position, pending, SPLICE_F_MOVE | SPLICE_F_MORE);
+            if (written < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            pending -= written;
+        }
+        if (pending > 0) {
+            result.status = TransferStatus::ABORTED;
+            result.error = errno;
+            break;
+        }
+        
+        throttle.add(received);
+        result.bytes += received;
+    }
+    
+    close(pipe_fds[0]);
+    close(pipe_fds[1]);
+#else
+    (void)socket_fd;
+    (void)file_fd;
+    (void)offset;
+    (void)throttle;
+    result.status = TransferStatus::UNSUPPORTED;
+#endif
+    return result;
+}
+
+TransferResult DataTransfer::receiveFileBuffered(int socket_fd, int file_fd,
+                                                 uint64_t offset, TransferThrottle& throttle) {
+    TransferResult result;
+    uint64_t position = offset;
+    TransferBuffer buffer(throttle);
+    
+    while (true) {
+        throttle.waitForMemory();
+        ssize_t received = recv(socket_fd, buffer.data(), buffer.size(), 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result.status = TransferStatus::ABORTED;
+            result.error = errno;
+            break;
+        }
+        if (received == 0) {
+            break;
+        }
+        
+        throttle.wait(received);
+        if (!writeAt(file_fd, buffer.data(), received, position)) {
+            result.status = TransferStatus::ABORTED;
+            result.error = errno;
+            break;
+        }
+        throttle.add(received);
+        result.bytes += received;
+        buffer.adapt(received);
+    }
+    
+    return result;
+}
+
+TransferResult DataTransfer::receiveFileTls(SSLContext& tls, void* ssl, int file_fd,
+                                            uint64_t offset, TransferThrottle& throttle) {
+    TransferResult result;
+    result.kernel_tls = tls.isKernelTlsReceive(ssl);
+    uint64_t position = offset;
+    TransferBuffer buffer(throttle);
+    
+    while (true) {
+        throttle.waitForMemory();
+        errno = 0;
+        int received = tls.readSSL(ssl, buffer.data(), static_cast<int>(tlsChunk(buffer.size())));
+        if (received <= 0) {
+            if (tls.shouldRetry(ssl, received)) {
+                continue;
+            }
+            if (!tls.isClosed(ssl, received)) {
+                result.status = TransferStatus::ABORTED;
+                result.error = tlsError();
+            }
+            break;
+        }
+        
+        throttle.wait(received);
+        if (!writeAt(file_fd, buffer.data(), received, position)) {
+            result.status = TransferStatus::ABORTED;
+            result.error = errno;
+            break;
+        }
+        throttle.add(received);
+        result.bytes += received;
+        buffer.adapt(received);
+    }
+    
+    return result;
+}
+
+TransferResult DataTransfer::sendFileUring(int socket_fd, const std::string& path,
+                                           uint64_t offset, TransferThrottle& throttle) {
+    TransferResult result;
+    UringEngine* engine = threadUringEngine();
+    if (!engine) {
+        result.status = TransferStatus::UNSUPPORTED;
+        return result;
+    }
+    
+    int file_fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file_fd < 0) {
+        result.status = TransferStatus::OPEN_FAILED;
+        result.error = errno;
+        return result;
+    }
+    
+    struct stat st;
+    if (fstat(file_fd, &st) != 0) {
+        result.status = TransferStatus::OPEN_FAILED;
+        result.error = errno;
+        close(file_fd);
+        return result;
+    }
+    
+    struct Slot {
+        enum State { FREE, READING, READY, SENDING } state = FREE;
+        uint64_t seq = 0;
+        uint64_t offset = 0;
+        uint32_t length = 0;
+        uint32_t filled = 0;
+        uint32_t sent = 0;
+    };
+    Slot slots[URING_SLOTS];
+    
+    IoUring& ring = engine->ring;
+    uint64_t file_size = st.st_size;
+    uint64_t read_position = offset;
+    uint64_t next_read_seq = 0;
+    uint64_t next_send_seq = 0;
+    size_t chunk = throttle.chunkSize(URING_CHUNK);
+    unsigned in_flight = 0;
+    bool send_in_flight = false;
+    bool failed = false;
+    
+    auto fail = [&](int error) {
+        if (!failed) {
+            failed = true;
+            result.error = error;
+        }
+    };
+    
+    while (true) {
+        if (!failed) {
+            // Keep every free buffer busy reading ahead
+            for (unsigned i = 0; i < URING_SLOTS && read_position < file_size; ++i) {
+                Slot& slot = slots[i];
+                if (slot.state != Slot::FREE) {
+                    continue;
+                }
+                slot.seq = next_read_seq++;
+                slot.offset = read_position;
+                slot.length = static_cast<uint32_t>(std::min<uint64_t>(chunk, file_size - read_position));
+                slot.filled = 0;
+                slot.sent = 0;
+                read_position += slot.length;
+                
+                // Socket idle and this is the next chunk: chain the send behind the read
+                bool link = !send_in_flight && slot.seq == next_send_seq;
+                if (link) {
+                    throttle.wait(slot.length);
+                }
+                ring.prepareReadFixed(file_fd, engine->buffer(i), slot.length, slot.offset, i,
+                                      uringTag(i, URING_READ), link);
+                ++in_flight;
+                slot.state = Slot::READING;
+                if (link) {
+                    ring.prepareSend(socket_fd, engine->buffer(i), slot.length, MSG_NOSIGNAL,
+                                     uringTag(i, URING_SEND));
+                    ++in_flight;
+                    send_in_flight = true;
+                    slot.state = Slot::SENDING;
+                }
+            }
+            
+            // Sends are never queued back to back: two in flight on one
+            // stream socket may complete out of order
+            while (!send_in_flight) {
+                Slot* next = nullptr;
+                unsigned index = 0;
+                for (unsigned i = 0; i < URING_SLOTS; ++i) {
+                    if (slots[i].state == Slot::READY && slots[i].seq == next_send_seq) {
+                        next = &slots[i];
+                        index = i;
+                    }
+                }
+                if (!next) {
+                    break;
+                }
+                if (next->sent >= next->filled) {
+                    next->state = Slot::FREE;  // nothing left to read past a truncation
+                    ++next_send_seq;
+                    continue;
+                }
+                uint32_t remaining = next->filled - next->sent;
+                throttle.wait(remaining);
+                ring.prepareSend(socket_fd, engine->buffer(index) + next->sent, remaining, MSG_NOSIGNAL,
+                                 uringTag(index, URING_SEND));
+                ++in_flight;
+                send_in_flight = true;
+                next->state = Slot::SENDING;
+            }
+        }
+        
+        if (in_flight == 0) {
+            break;
+        }
+        if (!ring.submitAndWait(1)) {
+            // Entries may still be in flight; retire this ring for good
+            fail(errno);
+            engine->failed = true;
+            break;
+        }
+        
+        IoUring::Completion completion;
+        while (ring.popCompletion(completion)) {
+            --in_flight;
+            unsigned index = static_cast<unsigned>(completion.user_data >> 8);
+            Slot& slot = slots[index];
+            
+            if ((completion.user_data & 0xff) == URING_READ) {
+                if (completion.result < 0) {
+                    fail(-completion.result);  // a linked send completes with -ECANCELED
+                    slot.state = Slot::FREE;
+                    continue;
+                }
+                slot.filled = static_cast<uint32_t>(completion.result);
+                if (slot.filled < slot.length) {
+                    // File shrank; stop reading past the new end
+                    file_size = std::min(file_size, slot.offset + slot.filled);
+                    read_position = std::min(read_position, file_size);
+                }
+                if (slot.state == Slot::READING) {
+                    slot.state = Slot::READY;
+                }
+            } else {
+                send_in_flight = false;
+                if (completion.result == -ECANCELED) {
+                    // Short read broke the link; send what was read
+                    slot.state = failed ? Slot::FREE : Slot::READY;
+                    continue;
+                }
+                if (completion.result <= 0) {
+                    fail(completion.result < 0 ? -completion.result : EPIPE);
+                    slot.state = Slot::FREE;
+                    continue;
+                }
+                slot.sent += completion.result;
+                throttle.add(completion.result);
+                result.bytes += completion.result;
+                if (slot.sent >= slot.filled) {
+                    slot.state = Slot::FREE;
+                    ++next_send_seq;
+                } else {
+                    slot.state = Slot::READY;
+                }
+            }
+        }
+    }
+    
+    close(file_fd);
+    if (failed) {
+        if (result.bytes == 0 && isUnsupportedError(result.error)) {
+            engine->failed = true;  // e.g. a kernel without IORING_OP_SEND
+            result.status = TransferStatus::UNSUPPORTED;
+        } else {
+            result.status = TransferStatus::ABORTED;
+        }
+    }
+    return result;
+}
+
+TransferResult DataTransfer::receiveFileUring(int socket_fd, int file_fd,
+                                              uint64_t offset, TransferThrottle& throttle) {
+    TransferResult result;
+    UringEngine* engine = threadUringEngine();
+    if (!engine) {
+        result.status = TransferStatus::UNSUPPORTED;
+        return result;
+    }
+    
+    struct Slot {
+        bool busy = false;
+        bool received = false;       // recv completed
+        bool write_linked = false;   // linked write still outstanding
+        uint64_t offset = 0;
+        uint32_t filled = 0;
+        uint32_t written = 0;
+    };
+    Slot slots[URING_SLOTS];
+    
+    IoUring& ring = engine->ring;
+    uint64_t position = offset;
+    size_t chunk = throttle.chunkSize(URING_CHUNK);
+    unsigned in_flight = 0;
+    bool recv_in_flight = false;
+    bool eof = false;
+    bool failed = false;
+    
+    auto fail = [&](int error) {
+        if (!failed) {
+            failed = true;
+            result.error = error;
+            if (result.bytes > 0 || !isUnsupportedError(error)) {
+                shutdown(socket_fd, SHUT_RDWR);  // unblocks a pending recv
+            }
+        }
+    };
+    
+    // Write whatever part of a received buffer is still outstanding
+    auto writeRemainder = [&](unsigned index) {
+        Slot& slot = slots[index];
+        if (failed || slot.written >= slot.filled) {
+            slot.busy = false;
+            return;
+        }
+        ring.prepareWriteFixed(file_fd, engine->buffer(index) + slot.written, slot.filled - slot.written,
+                               slot.offset + slot.written, index, uringTag(index, URING_WRITE));
+        ++in_flight;
+    };
+    
+    while (true) {
+        if (!failed && !eof && !recv_in_flight) {
+            for (unsigned i = 0; i < URING_SLOTS; ++i) {
+                Slot& slot = slots[i];
+                if (slot.busy) {
+                    continue;
+                }
+                slot = Slot();
+                slot.busy = true;
+                slot.write_linked = true;
+                slot.offset = position;
+                throttle.waitForMemory();
+                throttle.wait(chunk);
+                
+                // MSG_WAITALL fills the buffer unless the upload ends, so the
+                // write is queued up front; a short recv cancels it instead
+                ring.prepareRecv(socket_fd, engine->buffer(i), static_cast<unsigned>(chunk), MSG_WAITALL,
+                                 uringTag(i, URING_RECV), true);
+                ring.prepareWriteFixed(file_fd, engine->buffer(i), static_cast<unsigned>(chunk), position, i,
+                                       uringTag(i, URING_WRITE));
+                in_flight += 2;
+                recv_in_flight = true;
+                break;
+            }
+        }
+        
+        if (in_flight == 0) {
+            break;
+        }
+        if (!ring.submitAndWait(1)) {
+            fail(errno);
+            engine->failed = true;
+            break;
+        }
+        
+        IoUring::Completion completion;
+        while (ring.popCompletion(completion)) {
+            --in_flight;
+            unsigned index = static_cast<unsigned>(completion.user_data >> 8);
+            Slot& slot = slots[index];
+            
+            if ((completion.user_data & 0xff) == URING_RECV) {
+                recv_in_flight = false;
+                slot.received = true;
+                if (completion.result < 0) {
+                    fail(-completion.result);
+                } else if (completion.result == 0) {
+                    eof = true;
+                } else {
+                    slot.filled = static_cast<uint32_t>(completion.result);
+                    position += slot.filled;
+                    throttle.add(slot.filled);
+                    result.bytes += slot.filled;
+                }
+                if (!slot.write_linked) {
+                    writeRemainder(index);
+                }
+                continue;
+            }
+            
+            if (slot.write_linked) {
+                slot.write_linked = false;
+                if (completion.result == -ECANCELED) {
+                    if (slot.received) {
+                        writeRemainder(index);
+                    }
+                    continue;  // otherwise the recv completion issues the write
+                }
+            }
+            if (completion.result <= 0) {
+                fail(completion.result < 0 ? -completion.result : EIO);
+                slot.busy = false;
+                continue;
+            }
+            slot.written += completion.result;
+            writeRemainder(index);
+        }
+    }
+    
+    if (failed) {
+        if (result.bytes == 0 && isUnsupportedError(result.error)) {
+            engine->failed = true;
+            result.status = TransferStatus::UNSUPPORTED;
+        } else {
+            result.status = TransferStatus::ABORTED;
+        }
+    }
+    return result;
+}
+
+bool DataTransfer::isUringAvailable() {
+    static const bool available = [] {
+        // Deliberately never closed: tearing a ring down queues kernel work
+        // that interrupts the calling thread's next blocking system call
+        static IoUring* probe = new IoUring();
+        return probe->init(2);
+    }();
+    return available;
+}
+
+} // namespace simple_sftpd
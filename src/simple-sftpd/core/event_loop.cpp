@@ -0,0 +1,315 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/event_loop.hpp"
+#include "simple-sftpd/utils/logger.hpp"
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <string>
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace simple_sftpd {
+
+namespace {
+
+#ifdef __linux__
+uint32_t toEpollEvents(uint32_t events) {
+    uint32_t epoll_events = 0;
+    if (events & EventLoop::EVENT_READ) {
+        epoll_events |= EPOLLIN | EPOLLRDHUP;
+    }
+    if (events & EventLoop::EVENT_WRITE) {
+        epoll_events |= EPOLLOUT;
+    }
+    return epoll_events;
+}
+
+uint32_t fromEpollEvents(uint32_t epoll_events) {
+    uint32_t events = 0;
+    if (epoll_events & (EPOLLIN | EPOLLRDHUP | EPOLLPRI)) {
+        events |= EventLoop::EVENT_READ;
+    }
+    if (epoll_events & EPOLLOUT) {
+        events |= EventLoop::EVENT_WRITE;
+    }
+    if (epoll_events & (EPOLLERR | EPOLLHUP)) {
+        events |= EventLoop::EVENT_ERROR;
+    }
+    return events;
+}
+#endif
+
+} // namespace
+
+EventLoop::EventLoop(std::shared_ptr<Logger> logger)
+    : logger_(logger), running_(false), epoll_fd_(-1), wakeup_fd_(-1),
+      next_generation_(0), registered_count_(0), timers_(TIMER_TICK), lag_us_(0) {
+}
+
+EventLoop::~EventLoop() {
+    stop();
+}
+
+bool EventLoop::start() {
+    if (running_) {
+        return true;
+    }
+
+#ifdef __linux__
+    epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd_ < 0) {
+        logger_->error("Failed to create epoll instance: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    wakeup_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_fd_ < 0) {
+        logger_->error("Failed to create eventfd: " + std::string(strerror(errno)));
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+        return false;
+    }
+
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;  // token 0 is reserved for the wakeup descriptor
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wakeup_fd_, &ev);
+
+    running_ = true;
+    thread_ = std::thread(&EventLoop::loop, this);
+    loop_thread_id_ = thread_.get_id();
+    return true;
+#else
+    logger_->error("Event loop requires epoll, which is not available on this platform");
+    return false;
+#endif
+}
+
+void EventLoop::stop() {
+    if (!running_.exchange(false)) {
+        return;
+    }
+
+    wakeup();
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    loop_thread_id_ = std::thread::id();
+
+    // Dropping the handlers releases whatever they captured
+    registrations_.clear();
+    registered_count_ = 0;
+    timers_.clear();
+    std::vector<Task> dropped;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        dropped.swap(tasks_);
+    }
+
+    if (wakeup_fd_ >= 0) {
+        close(wakeup_fd_);
+        wakeup_fd_ = -1;
+    }
+    if (epoll_fd_ >= 0) {
+        close(epoll_fd_);
+        epoll_fd_ = -1;
+    }
+}
+
+bool EventLoop::isInLoopThread() const {
+    return std::this_thread::get_id() == loop_thread_id_;
+}
+
+bool EventLoop::add(int fd, uint32_t events, Handler handler) {
+#ifdef __linux__
+    uint64_t token = (static_cast<uint64_t>(++next_generation_) << 32) | static_cast<uint32_t>(fd);
+
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = toEpollEvents(events);
+    ev.data.u64 = token;
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+        logger_->error("Failed to register descriptor with event loop: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    registrations_[fd] = Registration{token, std::make_shared<Handler>(std::move(handler))};
+    registered_count_ = registrations_.size();
+    return true;
+#else
+    (void)fd;
+    (void)events;
+    (void)handler;
+    return false;
+#endif
+}
+
+bool EventLoop::modify(int fd, uint32_t events) {
+#ifdef __linux__
+    auto it = registrations_.find(fd);
+    if (it == registrations_.end()) {
+        return false;
+    }
+
+    struct epoll_event ev;
+    std::memset(&ev, 0, sizeof(ev));
+    ev.events = toEpollEvents(events);
+    ev.data.u64 = it->second.token;
+    return epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &ev) == 0;
+#else
+    (void)fd;
+    (void)events;
+    return false;
+#endif
+}
+
+void EventLoop::remove(int fd) {
+#ifdef __linux__
+    auto it = registrations_.find(fd);
+    if (it == registrations_.end()) {
+        return;
+    }
+    epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, nullptr);
+    registrations_.erase(it);
+    registered_count_ = registrations_.size();
+#else
+    (void)fd;
+#endif
+}
+
+void EventLoop::post(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        if (!running_) {
+            return;  // the task (and whatever it captured) is dropped outside the lock
+        }
+        tasks_.push_back(std::move(task));
+    }
+    wakeup();
+}
+
+EventLoop::TimerId EventLoop::runAfter(std::chrono::milliseconds delay, Task task) {
+    return timers_.schedule(Clock::now() + delay, std::move(task));
+}
+
+bool EventLoop::rescheduleTimer(TimerId id, std::chrono::milliseconds delay) {
+    return timers_.reschedule(id, Clock::now() + delay);
+}
+
+void EventLoop::cancelTimer(TimerId id) {
+    timers_.cancel(id);
+}
+
+int EventLoop::nextTimeout() const {
+    Clock::time_point deadline = timers_.nextDeadline();
+    if (deadline == Clock::time_point::max()) {
+        return -1;
+    }
+    auto wait = deadline - Clock::now();
+    if (wait <= Clock::duration::zero()) {
+        return 0;
+    }
+    // Round up so the loop does not wake just before the deadline
+    auto wait_ms = std::chrono::ceil<std::chrono::milliseconds>(wait).count();
+    return static_cast<int>(std::min<decltype(wait_ms)>(wait_ms, std::numeric_limits<int>::max()));
+}
+
+void EventLoop::runExpiredTimers() {
+    timers_.advance(Clock::now());
+}
+
+void EventLoop::wakeup() {
+    if (wakeup_fd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(wakeup_fd_, &one, sizeof(one));
+        (void)written;
+    }
+}
+
+void EventLoop::runPostedTasks() {
+    std::vector<Task> tasks;
+    {
+        std::lock_guard<std::mutex> lock(tasks_mutex_);
+        tasks.swap(tasks_);
+    }
+    for (auto& task : tasks) {
+        task();
+    }
+}
+
+void EventLoop::armLagProbe() {
+    Clock::time_point due = Clock::now() + LAG_PROBE_INTERVAL;
+    runAfter(LAG_PROBE_INTERVAL, [this, due]() {
+        // Up to a tick late is the wheel's resolution, not lag
+        auto late = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - due - TIMER_TICK).count();
+        int64_t sample = std::max<int64_t>(late, 0);
+        int64_t previous = lag_us_.load(std::memory_order_relaxed);
+        lag_us_.store(std::max(sample, previous * 3 / 4), std::memory_order_relaxed);
+        armLagProbe();
+    });
+}
+
+void EventLoop::loop() {
+#ifdef __linux__
+    const int max_events = 256;
+    struct epoll_event events[max_events];
+    
+    armLagProbe();
+
+    while (running_) {
+        int ready = epoll_wait(epoll_fd_, events, max_events, nextTimeout());
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            logger_->error("epoll_wait failed: " + std::string(strerror(errno)));
+            break;
+        }
+
+        for (int i = 0; i < ready && running_; ++i) {
+            uint64_t token = events[i].data.u64;
+            if (token == 0) {
+                uint64_t value;
+                ssize_t drained = read(wakeup_fd_, &value, sizeof(value));
+                (void)drained;
+                continue;
+            }
+
+            int fd = static_cast<int>(token & 0xffffffffu);
+            auto it = registrations_.find(fd);
+            if (it == registrations_.end() || it->second.token != token) {
+                continue;  // removed earlier in this batch
+            }
+
+            // Hold a reference: the handler may remove its own registration
+            std::shared_ptr<Handler> handler = it->second.handler;
+            (*handler)(fromEpollEvents(events[i].events));
+        }
+
+        runPostedTasks();
+        runExpiredTimers();
+    }
+#endif
+}
+
+} // namespace simple_sftpd
@@ -0,0 +1,318 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/io_uring.hpp"
+#include <errno.h>
+#include <cstring>
+#include <unistd.h>
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define SIMPLE_SFTPD_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#endif
+
+namespace simple_sftpd {
+
+#ifdef SIMPLE_SFTPD_HAVE_IO_URING
+
+namespace {
+
+int ioUringSetup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+int ioUringEnter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+int ioUringRegister(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+} // namespace
+
+IoUring::IoUring()
+    : ring_fd_(-1), sq_entries_(0), to_submit_(0),
+      sq_ring_(nullptr), sq_ring_size_(0), cq_ring_(nullptr), cq_ring_size_(0),
+      sqes_(nullptr), sqes_size_(0),
+      sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(nullptr), sq_array_(nullptr),
+      cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(nullptr), cqes_(nullptr) {
+}
+
+IoUring::~IoUring() {
+    release();
+}
+
+bool IoUring::init(unsigned entries) {
+    if (ring_fd_ >= 0) {
+        return true;
+    }
+
+    struct io_uring_params params;
+    std::memset(&params, 0, sizeof(params));
+    ring_fd_ = ioUringSetup(entries, &params);
+    if (ring_fd_ < 0) {
+        return false;
+    }
+
+    sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && cq_ring_size_ > sq_ring_size_) {
+        sq_ring_size_ = cq_ring_size_;
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    ring_fd_, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        int saved = errno;
+        release();
+        errno = saved;
+        return false;
+    }
+
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+        cq_ring_size_ = 0;  // shares the SQ mapping
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        ring_fd_, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            int saved = errno;
+            release();
+            errno = saved;
+            return false;
+        }
+    }
+
+    sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring_fd_, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        int saved = errno;
+        release();
+        errno = saved;
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ring_);
+    char* cq = static_cast<char*>(cq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    sq_entries_ = params.sq_entries;
+    return true;
+}
+
+void IoUring::release() {
+    if (sqes_) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+    }
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);  // also unregisters any buffers
+        ring_fd_ = -1;
+    }
+}
+
+bool IoUring::registerBuffers(const struct iovec* buffers, unsigned count) {
+    return ioUringRegister(ring_fd_, IORING_REGISTER_BUFFERS, buffers, count) == 0;
+}
+
+struct io_uring_sqe* IoUring::nextSqe(uint64_t user_data, bool link) {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    unsigned tail = *sq_tail_ + to_submit_;
+    if (tail - head >= sq_entries_) {
+        return nullptr;
+    }
+
+    unsigned index = tail & *sq_mask_;
+    struct io_uring_sqe* sqe = &sqes_[index];
+    std::memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = user_data;
+    if (link) {
+        sqe->flags |= IOSQE_IO_LINK;
+    }
+    sq_array_[index] = index;
+    ++to_submit_;
+    return sqe;
+}
+
+bool IoUring::prepareReadFixed(int fd, void* buffer, unsigned length, uint64_t offset,
+                               unsigned buf_index, uint64_t user_data, bool link) {
+    struct io_uring_sqe* sqe = nextSqe(user_data, link);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_READ_FIXED;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->buf_index = static_cast<uint16_t>(buf_index);
+    return true;
+}
+
+bool IoUring::prepareWriteFixed(int fd, const void* buffer, unsigned length, uint64_t offset,
+                                unsigned buf_index, uint64_t user_data, bool link) {
+    struct io_uring_sqe* sqe = nextSqe(user_data, link);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_WRITE_FIXED;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = length;
+    sqe->off = offset;
+    sqe->buf_index = static_cast<uint16_t>(buf_index);
+    return true;
+}
+
+bool IoUring::prepareSend(int fd, const void* buffer, unsigned length, int flags,
+                          uint64_t user_data, bool link) {
+    struct io_uring_sqe* sqe = nextSqe(user_data, link);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_SEND;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = length;
+    sqe->msg_flags = static_cast<uint32_t>(flags);
+    return true;
+}
+
+bool IoUring::prepareRecv(int fd, void* buffer, unsigned length, int flags,
+                          uint64_t user_data, bool link) {
+    struct io_uring_sqe* sqe = nextSqe(user_data, link);
+    if (!sqe) {
+        return false;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buffer);
+    sqe->len = length;
+    sqe->msg_flags = static_cast<uint32_t>(flags);
+    return true;
+}
+
+bool IoUring::submitAndWait(unsigned wait_nr) {
+    // Publish the new tail before the kernel looks at the ring
+    __atomic_store_n(sq_tail_, *sq_tail_ + to_submit_, __ATOMIC_RELEASE);
+    to_submit_ = 0;
+
+    while (true) {
+        // Anything the kernel has not consumed yet, including leftovers
+        // from an interrupted or partial earlier call
+        unsigned pending = *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        int ret = ioUringEnter(ring_fd_, pending, wait_nr, wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0);
+        if (ret >= 0) {
+            return true;
+        }
+        if (errno != EINTR) {
+            return false;
+        }
+    }
+}
+
+bool IoUring::popCompletion(Completion& completion) {
+    unsigned head = *cq_head_;
+    if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+        return false;
+    }
+    const struct io_uring_cqe& cqe = cqes_[head & *cq_mask_];
+    completion.user_data = cqe.user_data;
+    completion.result = cqe.res;
+    __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#else
+
+IoUring::IoUring()
+    : ring_fd_(-1), sq_entries_(0), to_submit_(0),
+      sq_ring_(nullptr), sq_ring_size_(0), cq_ring_(nullptr), cq_ring_size_(0),
+      sqes_(nullptr), sqes_size_(0),
+      sq_head_(nullptr), sq_tail_(nullptr), sq_mask_(nullptr), sq_array_(nullptr),
+      cq_head_(nullptr), cq_tail_(nullptr), cq_mask_(nullptr), cqes_(nullptr) {
+}
+
+IoUring::~IoUring() {
+}
+
+bool IoUring::init(unsigned) {
+    errno = ENOSYS;
+    return false;
+}
+
+void IoUring::release() {
+}
+
+bool IoUring::registerBuffers(const struct iovec*, unsigned) {
+    errno = ENOSYS;
+    return false;
+}
+
+struct io_uring_sqe* IoUring::nextSqe(uint64_t, bool) {
+    return nullptr;
+}
+
+bool IoUring::prepareReadFixed(int, void*, unsigned, uint64_t, unsigned, uint64_t, bool) {
+    return false;
+}
+
+bool IoUring::prepareWriteFixed(int, const void*, unsigned, uint64_t, unsigned, uint64_t, bool) {
+    return false;
+}
+
+bool IoUring::prepareSend(int, const void*, unsigned, int, uint64_t, bool) {
+    return false;
+}
+
+bool IoUring::prepareRecv(int, void*, unsigned, int, uint64_t, bool) {
+    return false;
+}
+
+bool IoUring::submitAndWait(unsigned) {
+    errno = ENOSYS;
+    return false;
+}
+
+bool IoUring::popCompletion(Completion&) {
+    return false;
+}
+
+#endif
+
+} // namespace simple_sftpd
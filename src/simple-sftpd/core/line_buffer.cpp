@@ -0,0 +1,118 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/line_buffer.hpp"
+#include <cstring>
+
+namespace simple_sftpd {
+
+LineBuffer::LineBuffer(size_t max_line_length)
+    : begin_(0), end_(0), scanned_(0), max_line_length_(max_line_length), discarding_(false) {
+}
+
+char* LineBuffer::prepare(size_t length) {
+    makeRoom(length);
+    return data_.data() + end_;
+}
+
+void LineBuffer::commit(size_t length) {
+    end_ += length;
+}
+
+void LineBuffer::append(const char* data, size_t length) {
+    makeRoom(length);
+    std::memcpy(data_.data() + end_, data, length);
+    end_ += length;
+}
+
+void LineBuffer::makeRoom(size_t length) {
+    if (begin_ == end_) {
+        begin_ = end_ = scanned_ = 0;
+    } else if (begin_ > 0 && data_.size() - end_ < length) {
+        // Slide the unread tail to the front before growing
+        std::memmove(data_.data(), data_.data() + begin_, end_ - begin_);
+        end_ -= begin_;
+        scanned_ -= begin_;
+        begin_ = 0;
+    }
+
+    if (data_.size() - end_ < length) {
+        data_.resize(end_ + length);
+    }
+}
+
+LineBuffer::Status LineBuffer::nextLine(std::string_view& line) {
+    while (true) {
+        size_t from = scanned_ > begin_ ? scanned_ : begin_;
+        const char* newline = nullptr;
+        if (end_ > from) {
+            newline = static_cast<const char*>(std::memchr(data_.data() + from, '\n', end_ - from));
+        }
+
+        if (!newline) {
+            scanned_ = end_;
+            if (discarding_) {
+                // Still inside an over-long line; drop it as it arrives
+                begin_ = end_ = scanned_ = 0;
+                return Status::INCOMPLETE;
+            }
+            // Allow one extra byte for a CR whose LF has not arrived yet
+            if (end_ - begin_ > max_line_length_ + 1) {
+                discarding_ = true;
+                begin_ = end_ = scanned_ = 0;
+                return Status::TOO_LONG;
+            }
+            return Status::INCOMPLETE;
+        }
+
+        size_t line_begin = begin_;
+        size_t line_end = static_cast<size_t>(newline - data_.data());
+        begin_ = scanned_ = line_end + 1;
+
+        if (discarding_) {
+            // Tail of a line already reported as too long
+            discarding_ = false;
+            continue;
+        }
+
+        if (line_end > line_begin && data_[line_end - 1] == '\r') {
+            --line_end;
+        }
+        if (line_end - line_begin > max_line_length_) {
+            return Status::TOO_LONG;
+        }
+
+        line = std::string_view(data_.data() + line_begin, line_end - line_begin);
+        return Status::LINE;
+    }
+}
+
+void LineBuffer::clear() {
+    begin_ = end_ = scanned_ = 0;
+    discarding_ = false;
+}
+
+void LineBuffer::release() {
+    if (!empty()) {
+        return;
+    }
+    begin_ = end_ = scanned_ = 0;
+    if (data_.capacity() > RETAINED_CAPACITY) {
+        std::vector<char>().swap(data_);
+    }
+}
+
+} // namespace simple_sftpd
@@ -0,0 +1,293 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/listener_handoff.hpp"
+#include "simple-sftpd/utils/logger.hpp"
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace simple_sftpd {
+
+namespace {
+
+const uint32_t HANDOFF_MAGIC = 0x4f484653;  // "SFHO"
+const char HANDOFF_ACK = 'A';
+
+// Neither side should hang on a peer that stopped responding
+const int CHANNEL_TIMEOUT_SECONDS = 10;
+
+struct HandoffHeader {
+    uint32_t magic;
+    uint32_t count;
+};
+
+bool fillAddress(const std::string& path, struct sockaddr_un& addr) {
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+void setChannelTimeouts(int channel) {
+    struct timeval tv;
+    tv.tv_sec = CHANNEL_TIMEOUT_SECONDS;
+    tv.tv_usec = 0;
+    setsockopt(channel, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(channel, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+} // namespace
+
+ListenerHandoff::ListenerHandoff(std::shared_ptr<Logger> logger, std::string path)
+    : logger_(logger), path_(std::move(path)), listen_socket_(-1), channel_(-1) {
+}
+
+ListenerHandoff::~ListenerHandoff() {
+    close();
+}
+
+bool ListenerHandoff::listen() {
+    struct sockaddr_un addr;
+    if (!fillAddress(path_, addr)) {
+        logger_->error("Invalid upgrade socket path: " + path_);
+        return false;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (sock < 0) {
+        logger_->error("Failed to create upgrade socket: " + std::string(strerror(errno)));
+        return false;
+    }
+
+    // A predecessor that handed off, or crashed, leaves its file behind
+    unlink(path_.c_str());
+    if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) < 0 || ::listen(sock, 1) < 0) {
+        logger_->error("Failed to listen on upgrade socket " + path_ + ": " + std::string(strerror(errno)));
+        ::close(sock);
+        return false;
+    }
+    chmod(path_.c_str(), S_IRUSR | S_IWUSR);
+
+    listen_socket_ = sock;
+    return true;
+}
+
+bool ListenerHandoff::handOff(const std::vector<int>& listeners, std::chrono::milliseconds ack_timeout) {
+    if (listen_socket_ < 0 || listeners.empty() || listeners.size() > MAX_LISTENERS) {
+        return false;
+    }
+
+    int channel = accept4(listen_socket_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (channel < 0) {
+        return false;  // spurious wakeup, or the successor already gave up
+    }
+    if (!peerAllowed(channel)) {
+        logger_->warn("Rejected listener handoff request from another user");
+        ::close(channel);
+        return false;
+    }
+    setChannelTimeouts(channel);
+
+    if (!sendSockets(channel, listeners)) {
+        logger_->error("Failed to send listeners to new process: " + std::string(strerror(errno)));
+        ::close(channel);
+        return false;
+    }
+    logger_->info("Sent " + std::to_string(listeners.size()) + " listener" +
+                  (listeners.size() == 1 ? "" : "s") + " to new process, waiting for it to start");
+
+    // Until the successor confirms it is accepting, this process keeps
+    // accepting too; a failed start changes nothing for clients
+    struct pollfd pfd;
+    pfd.fd = channel;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    auto deadline = std::chrono::steady_clock::now() + ack_timeout;
+    int ready;
+    do {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        ready = poll(&pfd, 1, static_cast<int>(std::max<int64_t>(0, left.count())));
+    } while (ready < 0 && errno == EINTR);
+
+    char ack = 0;
+    bool acknowledged = ready > 0 && recv(channel, &ack, 1, 0) == 1 && ack == HANDOFF_ACK;
+    ::close(channel);
+    if (!acknowledged) {
+        logger_->warn("New process did not confirm the handoff, continuing to serve");
+        return false;
+    }
+
+    // The path now belongs to the successor; leave the file in place
+    ::close(listen_socket_);
+    listen_socket_ = -1;
+    return true;
+}
+
+bool ListenerHandoff::fetch(std::vector<int>& listeners) {
+    listeners.clear();
+    struct sockaddr_un addr;
+    if (!fillAddress(path_, addr)) {
+        logger_->error("Invalid upgrade socket path: " + path_);
+        return false;
+    }
+
+    int channel = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (channel < 0) {
+        logger_->error("Failed to create upgrade socket: " + std::string(strerror(errno)));
+        return false;
+    }
+    setChannelTimeouts(channel);
+
+    if (connect(channel, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        logger_->error("No running server accepts upgrades on " + path_ + ": " + std::string(strerror(errno)));
+        ::close(channel);
+        return false;
+    }
+    if (!receiveSockets(channel, listeners)) {
+        logger_->error("Failed to receive listeners from running server");
+        ::close(channel);
+        return false;
+    }
+
+    if (channel_ >= 0) {
+        ::close(channel_);
+    }
+    channel_ = channel;
+    return true;
+}
+
+bool ListenerHandoff::acknowledge() {
+    if (channel_ < 0) {
+        return false;
+    }
+    bool sent = send(channel_, &HANDOFF_ACK, 1, MSG_NOSIGNAL) == 1;
+    ::close(channel_);
+    channel_ = -1;
+    return sent;
+}
+
+void ListenerHandoff::close() {
+    if (listen_socket_ >= 0) {
+        ::close(listen_socket_);
+        listen_socket_ = -1;
+        unlink(path_.c_str());
+    }
+    if (channel_ >= 0) {
+        ::close(channel_);
+        channel_ = -1;
+    }
+}
+
+bool ListenerHandoff::sendSockets(int channel, const std::vector<int>& sockets) {
+    HandoffHeader header;
+    header.magic = HANDOFF_MAGIC;
+    header.count = static_cast<uint32_t>(sockets.size());
+    struct iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+    std::memset(control, 0, sizeof(control));
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = CMSG_SPACE(sizeof(int) * sockets.size());
+
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int) * sockets.size());
+    std::memcpy(CMSG_DATA(cmsg), sockets.data(), sizeof(int) * sockets.size());
+
+    ssize_t sent;
+    do {
+        sent = sendmsg(channel, &msg, MSG_NOSIGNAL);
+    } while (sent < 0 && errno == EINTR);
+    return sent == static_cast<ssize_t>(sizeof(header));
+}
+
+bool ListenerHandoff::receiveSockets(int channel, std::vector<int>& sockets) {
+    HandoffHeader header;
+    std::memset(&header, 0, sizeof(header));
+    struct iovec iov;
+    iov.iov_base = &header;
+    iov.iov_len = sizeof(header);
+
+    alignas(struct cmsghdr) char control[CMSG_SPACE(sizeof(int) * MAX_LISTENERS)];
+    struct msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t received;
+    do {
+        received = recvmsg(channel, &msg, MSG_CMSG_CLOEXEC | MSG_WAITALL);
+    } while (received < 0 && errno == EINTR);
+
+    // Take ownership of whatever arrived before judging the message
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); received > 0 && cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const unsigned char* data = CMSG_DATA(cmsg);
+            for (size_t i = 0; i < count; ++i) {
+                int fd;
+                std::memcpy(&fd, data + i * sizeof(int), sizeof(int));
+                sockets.push_back(fd);
+            }
+        }
+    }
+
+    bool valid = received == static_cast<ssize_t>(sizeof(header)) && header.magic == HANDOFF_MAGIC &&
+                 (msg.msg_flags & MSG_CTRUNC) == 0 && header.count == sockets.size() && !sockets.empty();
+    if (!valid) {
+        for (int fd : sockets) {
+            ::close(fd);
+        }
+        sockets.clear();
+    }
+    return valid;
+}
+
+bool ListenerHandoff::peerAllowed(int channel) const {
+#ifdef SO_PEERCRED
+    struct ucred cred;
+    socklen_t cred_len = sizeof(cred);
+    if (getsockopt(channel, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) < 0) {
+        return false;
+    }
+    return cred.uid == 0 || cred.uid == geteuid();
+#else
+    (void)channel;
+    return true;  // the socket file is owner-only
+#endif
+}
+
+} // namespace simple_sftpd
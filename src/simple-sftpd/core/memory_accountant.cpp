@@ -0,0 +1,220 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/memory_accountant.hpp"
+
+namespace simple_sftpd {
+
+MemoryAccountant::Account::Account(std::shared_ptr<MemoryAccountant> owner, std::string user)
+    : owner_(std::move(owner)), user_(std::move(user)), used_(0) {
+}
+
+MemoryAccountant::Account::~Account() {
+    owner_->forget(user_);
+}
+
+bool MemoryAccountant::Account::charge(Category category, size_t bytes) {
+    if (bytes == 0) {
+        return true;
+    }
+    size_t limit = user_.empty() ? 0 : owner_->user_budget_.load(std::memory_order_relaxed);
+    size_t used = used_.fetch_add(bytes) + bytes;
+    if (limit > 0 && used > limit) {
+        used_.fetch_sub(bytes);
+        owner_->refused_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (!owner_->chargeGlobal(category, bytes, false)) {
+        used_.fetch_sub(bytes);
+        return false;
+    }
+    return true;
+}
+
+void MemoryAccountant::Account::forceCharge(Category category, size_t bytes) {
+    used_.fetch_add(bytes);
+    owner_->chargeGlobal(category, bytes, true);
+}
+
+void MemoryAccountant::Account::release(Category category, size_t bytes) {
+    used_.fetch_sub(bytes);
+    owner_->releaseGlobal(category, bytes);
+}
+
+bool MemoryAccountant::Account::hasRoom(size_t bytes) const {
+    size_t limit = user_.empty() ? 0 : owner_->user_budget_.load(std::memory_order_relaxed);
+    if (limit > 0 && used_.load() + bytes > limit) {
+        return false;
+    }
+    return owner_->hasRoom(bytes);
+}
+
+bool MemoryAccountant::Account::admit(size_t bytes) {
+    if (hasRoom(bytes)) {
+        return true;
+    }
+    owner_->refused_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+bool MemoryAccountant::Account::waitForRoom(std::chrono::milliseconds timeout) {
+    if (!isExhausted()) {
+        return true;
+    }
+    owner_->pauses_.fetch_add(1, std::memory_order_relaxed);
+    
+    // Releases notify only while someone waits; waiters_ is raised under
+    // the lock before the check, so a release cannot slip in between
+    std::unique_lock<std::mutex> lock(owner_->mutex_);
+    owner_->waiters_.fetch_add(1);
+    bool room = owner_->room_.wait_for(lock, timeout, [this]() { return !isExhausted(); });
+    owner_->waiters_.fetch_sub(1);
+    return room;
+}
+
+MemoryAccountant::Charge::Charge(Charge&& other) noexcept
+    : account_(std::move(other.account_)), category_(other.category_), bytes_(other.bytes_) {
+    other.bytes_ = 0;
+}
+
+MemoryAccountant::Charge& MemoryAccountant::Charge::operator=(Charge&& other) noexcept {
+    if (this != &other) {
+        reset();
+        account_ = std::move(other.account_);
+        category_ = other.category_;
+        bytes_ = other.bytes_;
+        other.bytes_ = 0;
+    }
+    return *this;
+}
+
+bool MemoryAccountant::Charge::resize(size_t bytes) {
+    if (account_) {
+        if (bytes > bytes_) {
+            if (!account_->charge(category_, bytes - bytes_)) {
+                return false;
+            }
+        } else if (bytes < bytes_) {
+            account_->release(category_, bytes_ - bytes);
+        }
+    }
+    bytes_ = bytes;
+    return true;
+}
+
+void MemoryAccountant::Charge::force(size_t bytes) {
+    if (account_) {
+        if (bytes > bytes_) {
+            account_->forceCharge(category_, bytes - bytes_);
+        } else if (bytes < bytes_) {
+            account_->release(category_, bytes_ - bytes);
+        }
+    }
+    bytes_ = bytes;
+}
+
+void MemoryAccountant::Charge::reset() {
+    if (account_ && bytes_ > 0) {
+        account_->release(category_, bytes_);
+    }
+    account_.reset();
+    bytes_ = 0;
+}
+
+MemoryAccountant::MemoryAccountant(size_t budget, size_t user_budget)
+    : budget_(budget), user_budget_(user_budget), used_(0), by_category_{},
+      refused_(0), pauses_(0), waiters_(0) {
+}
+
+std::shared_ptr<MemoryAccountant::Account> MemoryAccountant::account(const std::string& user) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto& slot = accounts_[user];
+    auto existing = slot.lock();
+    if (existing) {
+        return existing;
+    }
+    auto created = std::make_shared<Account>(shared_from_this(), user);
+    slot = created;
+    return created;
+}
+
+void MemoryAccountant::setLimits(size_t budget, size_t user_budget) {
+    budget_.store(budget, std::memory_order_relaxed);
+    user_budget_.store(user_budget, std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    room_.notify_all();
+}
+
+bool MemoryAccountant::hasRoom(size_t bytes) const {
+    size_t budget = budget_.load(std::memory_order_relaxed);
+    return budget == 0 || used_.load() + bytes <= budget;
+}
+
+MemoryAccountant::Stats MemoryAccountant::getStats() const {
+    Stats stats;
+    stats.budget = budget_.load(std::memory_order_relaxed);
+    stats.user_budget = user_budget_.load(std::memory_order_relaxed);
+    stats.bytes_in_use = used_.load(std::memory_order_relaxed);
+    stats.control_bytes = by_category_[static_cast<size_t>(Category::CONTROL)].load(std::memory_order_relaxed);
+    stats.listing_bytes = by_category_[static_cast<size_t>(Category::LISTING)].load(std::memory_order_relaxed);
+    stats.transfer_bytes = by_category_[static_cast<size_t>(Category::TRANSFER)].load(std::memory_order_relaxed);
+    stats.refused = refused_.load(std::memory_order_relaxed);
+    stats.pauses = pauses_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.accounts = accounts_.size();
+    return stats;
+}
+
+size_t MemoryAccountant::getUserUsage(const std::string& user) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = accounts_.find(user);
+    if (it == accounts_.end()) {
+        return 0;
+    }
+    auto account = it->second.lock();
+    return account ? account->getUsage() : 0;
+}
+
+bool MemoryAccountant::chargeGlobal(Category category, size_t bytes, bool force) {
+    size_t budget = budget_.load(std::memory_order_relaxed);
+    size_t used = used_.fetch_add(bytes) + bytes;
+    if (!force && budget > 0 && used > budget) {
+        used_.fetch_sub(bytes);
+        refused_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    by_category_[static_cast<size_t>(category)].fetch_add(bytes, std::memory_order_relaxed);
+    return true;
+}
+
+void MemoryAccountant::releaseGlobal(Category category, size_t bytes) {
+    by_category_[static_cast<size_t>(category)].fetch_sub(bytes, std::memory_order_relaxed);
+    used_.fetch_sub(bytes);
+    if (waiters_.load() > 0) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        room_.notify_all();
+    }
+}
+
+void MemoryAccountant::forget(const std::string& user) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = accounts_.find(user);
+    if (it != accounts_.end() && it->second.expired()) {
+        accounts_.erase(it);
+    }
+}
+
+} // namespace simple_sftpd
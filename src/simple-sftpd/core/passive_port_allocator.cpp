@@ -0,0 +1,239 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/passive_port_allocator.hpp"
+#include "simple-sftpd/utils/logger.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+#include <cstring>
+#include <random>
+#include <string>
+
+namespace simple_sftpd {
+
+namespace {
+
+// A port held by some other process fails bind(); give up on a lease
+// after this many such ports rather than probing the whole range
+const int MAX_BIND_ATTEMPTS = 8;
+
+size_t randomBelow(size_t bound) {
+    thread_local std::minstd_rand generator(std::random_device{}());
+    return std::uniform_int_distribution<size_t>(0, bound - 1)(generator);
+}
+
+} // namespace
+
+PassivePortAllocator::PassivePortAllocator(std::shared_ptr<Logger> logger, int range_start,
+                                           int range_end, int pool_size)
+    : logger_(logger), range_start_(range_start),
+      port_count_(range_end >= range_start ? static_cast<size_t>(range_end - range_start + 1) : 0),
+      pool_size_(pool_size > 0 ? static_cast<size_t>(pool_size) : 0),
+      word_count_((port_count_ + 63) / 64), pooling_(false),
+      ports_in_use_(0), pool_hits_(0), exhausted_(0), bind_failures_(0) {
+    bits_.reset(new std::atomic<uint64_t>[word_count_ > 0 ? word_count_ : 1]);
+    for (size_t i = 0; i < word_count_; ++i) {
+        bits_[i].store(0, std::memory_order_relaxed);
+    }
+    if (port_count_ % 64 != 0) {
+        // Mark the tail of the last word as taken so the scan never returns it
+        bits_[word_count_ - 1].store(~0ULL << (port_count_ % 64), std::memory_order_relaxed);
+    }
+}
+
+PassivePortAllocator::~PassivePortAllocator() {
+    stop();
+}
+
+void PassivePortAllocator::start() {
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        pooling_ = pool_size_ > 0;
+    }
+    refillPool();
+}
+
+void PassivePortAllocator::stop() {
+    std::vector<Lease> pooled;
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        pooling_ = false;
+        pooled.swap(pool_);
+    }
+    for (const Lease& lease : pooled) {
+        close(lease.socket);
+        freePort(lease.port);
+    }
+}
+
+size_t PassivePortAllocator::getPooledCount() const {
+    std::lock_guard<std::mutex> lock(pool_mutex_);
+    return pool_.size();
+}
+
+int PassivePortAllocator::acquire(int& port) {
+    Lease lease{-1, -1};
+    {
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        if (!pool_.empty()) {
+            lease = pool_.back();
+            pool_.pop_back();
+        }
+    }
+
+    if (lease.socket >= 0) {
+        // Anyone who connected while the socket sat in the pool is not
+        // this session's client; drop them before handing it out
+        int stray;
+        while ((stray = accept(lease.socket, nullptr, nullptr)) >= 0) {
+            close(stray);
+        }
+        ++pool_hits_;
+        port = lease.port;
+        return lease.socket;
+    }
+
+    int sock = bindLease(port);
+    if (sock < 0) {
+        ++exhausted_;
+        logger_->warn("Passive port range exhausted (" + std::to_string(ports_in_use_.load()) + " of " +
+                      std::to_string(port_count_) + " ports in use)");
+    }
+    return sock;
+}
+
+void PassivePortAllocator::release(int port, int socket) {
+    if (socket >= 0) {
+        close(socket);
+    }
+    freePort(port);
+    refillPool();
+}
+
+int PassivePortAllocator::reservePort() {
+    if (port_count_ == 0) {
+        return -1;
+    }
+
+    size_t start = randomBelow(port_count_);
+    size_t start_word = start / 64;
+    uint64_t start_mask = ~0ULL << (start % 64);
+
+    // One extra step revisits the first word below the random start bit
+    for (size_t step = 0; step <= word_count_; ++step) {
+        size_t index = (start_word + step) % word_count_;
+        uint64_t word = bits_[index].load(std::memory_order_relaxed);
+        while (~word != 0) {
+            uint64_t free_bits = ~word;
+            if (step == 0 && (free_bits & start_mask) != 0) {
+                free_bits &= start_mask;
+            }
+            int bit = __builtin_ctzll(free_bits);
+            if (bits_[index].compare_exchange_weak(word, word | (1ULL << bit), std::memory_order_acq_rel)) {
+                ++ports_in_use_;
+                return range_start_ + static_cast<int>(index * 64 + bit);
+            }
+        }
+    }
+    return -1;
+}
+
+void PassivePortAllocator::freePort(int port) {
+    if (port < range_start_ || static_cast<size_t>(port - range_start_) >= port_count_) {
+        return;
+    }
+    size_t offset = static_cast<size_t>(port - range_start_);
+    uint64_t mask = 1ULL << (offset % 64);
+    if (bits_[offset / 64].fetch_and(~mask, std::memory_order_release) & mask) {
+        --ports_in_use_;
+    }
+}
+
+int PassivePortAllocator::bindLease(int& port) {
+    // Ports found held elsewhere stay reserved until this lease is settled,
+    // so the random scan cannot pick the same one twice
+    int held[MAX_BIND_ATTEMPTS];
+    int held_count = 0;
+    int sock = -1;
+
+    for (int attempt = 0; attempt < MAX_BIND_ATTEMPTS; ++attempt) {
+        int candidate = reservePort();
+        if (candidate < 0) {
+            break;
+        }
+
+        sock = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (sock < 0) {
+            logger_->error("Failed to create passive socket: " + std::string(strerror(errno)));
+            freePort(candidate);
+            break;
+        }
+
+        int reuse = 1;
+        setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(candidate);
+        if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == 0 && listen(sock, 1) == 0) {
+            port = candidate;
+            break;
+        }
+
+        // Held outside this server; try elsewhere
+        ++bind_failures_;
+        close(sock);
+        sock = -1;
+        held[held_count++] = candidate;
+    }
+
+    for (int i = 0; i < held_count; ++i) {
+        freePort(held[i]);
+    }
+    return sock;
+}
+
+void PassivePortAllocator::refillPool() {
+    while (true) {
+        {
+            std::lock_guard<std::mutex> lock(pool_mutex_);
+            if (!pooling_ || pool_.size() >= pool_size_) {
+                return;
+            }
+        }
+
+        Lease lease{-1, -1};
+        lease.socket = bindLease(lease.port);
+        if (lease.socket < 0) {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lock(pool_mutex_);
+        if (!pooling_ || pool_.size() >= pool_size_) {
+            // stop() ran, or another release filled the slot meanwhile
+            close(lease.socket);
+            freePort(lease.port);
+            return;
+        }
+        pool_.push_back(lease);
+    }
+}
+
+} // namespace simple_sftpd
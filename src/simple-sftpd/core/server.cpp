@@ -18,29 +18,104 @@
 #include "simple-sftpd/utils/logger.hpp"
 #include "simple-sftpd/core/connection_manager.hpp"
 #include "simple-sftpd/core/connection.hpp"
+#include "simple-sftpd/core/data_transfer.hpp"
+#include "simple-sftpd/core/event_loop.hpp"
+#include "simple-sftpd/core/passive_port_allocator.hpp"
+#include "simple-sftpd/core/session_slab.hpp"
+#include "simple-sftpd/core/buffer_pool.hpp"
+#include "simple-sftpd/core/memory_accountant.hpp"
+#include "simple-sftpd/core/admission_controller.hpp"
+#include "simple-sftpd/core/worker_pool.hpp"
 #include "simple-sftpd/config/server_config.hpp"
+#include "simple-sftpd/config/config_store.hpp"
 #include "simple-sftpd/user/user_manager.hpp"
 #include "simple-sftpd/user/user.hpp"
 #include "simple-sftpd/security/ip_access_control.hpp"
 #include "simple-sftpd/utils/performance_monitor.hpp"
 #include "simple-sftpd/utils/file_cache.hpp"
 #include "simple-sftpd/security/rate_limiter.hpp"
+#include "simple-sftpd/security/tls_session_cache.hpp"
+#include "simple-sftpd/security/ticket_key_ring.hpp"
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <errno.h>
 #include <cstring>
+#include <algorithm>
 #ifndef _WIN32
 #include <pwd.h>
 #include <grp.h>
+#include <signal.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/tcp.h>
+#else
+#include <poll.h>
+#endif
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
 #endif
 
 namespace simple_sftpd {
 
+namespace {
+
+LogLevel parseLogLevel(const std::string& name) {
+    std::string upper = name;
+    std::transform(upper.begin(), upper.end(), upper.begin(), ::toupper);
+    if (upper == "TRACE") return LogLevel::TRACE;
+    if (upper == "DEBUG") return LogLevel::DEBUG;
+    if (upper == "WARN") return LogLevel::WARN;
+    if (upper == "ERROR") return LogLevel::ERROR;
+    if (upper == "FATAL") return LogLevel::FATAL;
+    return LogLevel::INFO;
+}
+
+AdmissionController::Limits admissionLimits(const ConnectionConfig& connection) {
+    AdmissionController::Limits limits;
+    limits.max_sessions = static_cast<size_t>(std::max(connection.max_connections, 0));
+    limits.reserved_slots = static_cast<size_t>(std::max(connection.reserved_admin_slots, 0));
+    limits.max_loop_lag = std::chrono::milliseconds(std::max(connection.max_loop_lag_ms, 0));
+    limits.max_queue_depth = static_cast<size_t>(std::max(connection.max_worker_queue_depth, 0));
+    return limits;
+}
+
+// Identifies the certificate, key and CA files as they are on disk now;
+// renewals usually rename a new file into place, which changes the inode
+std::string certificateStamp(const FTPServerConfig& config) {
+    std::vector<const std::string*> paths = {&config.security.ssl_cert_file, &config.security.ssl_key_file,
+                                             &config.security.ssl_ca_file, &config.security.ssl_client_ca_file};
+    for (const VirtualHostConfig& host : config.virtual_hosts) {
+        paths.push_back(&host.ssl_cert_file);
+        paths.push_back(&host.ssl_key_file);
+    }
+    std::string stamp;
+    for (const std::string* path : paths) {
+        struct stat st;
+        stamp += *path;
+        if (!path->empty() && stat(path->c_str(), &st) == 0) {
+            stamp += ':' + std::to_string(st.st_ino) + ':' + std::to_string(st.st_size) + ':' +
+                     std::to_string(st.st_mtime);
+#ifdef __linux__
+            stamp += '.' + std::to_string(st.st_mtim.tv_nsec);
+#endif
+        }
+        stamp += '\n';
+    }
+    return stamp;
+}
+
+} // namespace
+
 FTPServer::FTPServer(std::shared_ptr<FTPServerConfig> config)
-    : config_(config), running_(false), server_socket_(-1) {
+    : config_(config), certificate_watch_stop_(false), running_(false), accepting_(false),
+      wakeup_read_fd_(-1), wakeup_write_fd_(-1), reserve_fd_(-1),
+      reactor_mode_(false), next_event_loop_(0) {
     LogFormat log_format = LogFormat::STANDARD;
     std::string format_upper = config->logging.log_format;
     std::transform(format_upper.begin(), format_upper.end(), format_upper.begin(), ::toupper);
@@ -49,18 +124,34 @@ FTPServer::FTPServer(std::shared_ptr<FTPServerConfig> config)
     } else if (format_upper == "EXTENDED") {
         log_format = LogFormat::EXTENDED;
     }
-    logger_ = std::make_shared<Logger>("", LogLevel::INFO, true, false, log_format);
+    logger_ = std::make_shared<Logger>("", parseLogLevel(config->logging.log_level), true, false, log_format);
+    config_store_ = std::make_shared<ConfigStore>(std::make_shared<const FTPServerConfig>(*config));
     connection_manager_ = std::make_shared<FTPConnectionManager>(config, logger_);
-    ip_access_control_ = std::make_shared<IPAccessControl>(logger_);
     performance_monitor_ = std::make_shared<PerformanceMonitor>(logger_);
     file_cache_ = std::make_shared<FileCache>(logger_, 1000, std::chrono::seconds(60));
+    passive_ports_ = std::make_shared<PassivePortAllocator>(logger_, config->connection.passive_port_range_start,
+                                                            config->connection.passive_port_range_end,
+                                                            config->connection.passive_pool_size);
     
-    // Initialize rate limiter if enabled
-    if (config->rate_limit.enabled) {
-        rate_limiter_ = std::make_shared<FTPRateLimiter>(logger_);
-        rate_limiter_->setRateLimit(config->rate_limit.max_requests_per_minute);
-        rate_limiter_->setConnectionLimit(config->rate_limit.max_connections_per_ip);
-    }
+    // Both outlive reloads so clients keep resuming across certificate renewals
+    tls_session_cache_ = std::make_shared<TlsSessionCache>(config->security.ssl_session_cache_size,
+                                                           std::chrono::seconds(config->security.ssl_session_timeout_seconds));
+    ticket_keys_ = std::make_shared<TicketKeyRing>(logger_, config->security.ssl_ticket_key_shm,
+                                                   std::chrono::seconds(config->security.ssl_ticket_key_rotation_seconds));
+    performance_monitor_->setTlsSessionCache(tls_session_cache_);
+    performance_monitor_->setTicketKeyRing(ticket_keys_);
+    
+    certificate_stamp_ = certificateStamp(*config);
+    session_services_ = SessionServices::create(*config, logger_, tls_session_cache_, ticket_keys_);
+    session_slab_ = std::make_shared<SessionSlab>();
+    memory_accountant_ = std::make_shared<MemoryAccountant>(static_cast<size_t>(config->connection.memory_budget_mb) << 20,
+                                                            static_cast<size_t>(config->connection.user_memory_budget_mb) << 20);
+    performance_monitor_->setBufferPool(BufferPool::global());
+    performance_monitor_->setMemoryAccountant(memory_accountant_);
+    admission_ = std::make_shared<AdmissionController>(admissionLimits(config->connection));
+    
+    applyAccessControl(*config);
+    applyRateLimits(*config);
 }
 
 FTPServer::~FTPServer() {
@@ -72,29 +163,150 @@ bool FTPServer::start() {
         return true;
     }
     
+#ifndef _WIN32
+    // Our own sends pass MSG_NOSIGNAL, but OpenSSL writes TLS records with
+    // write(); a client resetting mid-session must not kill the process
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    
+    // listener_shards = 0 means one acceptor per CPU core
+    size_t shard_count = 1;
+    if (config_->connection.listener_shards > 0) {
+        shard_count = static_cast<size_t>(config_->connection.listener_shards);
+    } else if (config_->connection.listener_shards == 0) {
+        shard_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    std::vector<int> adopted;
+    adopted.swap(adopted_listeners_);
+    if (!adopted.empty()) {
+        // Inherited from the process being upgraded: already bound and
+        // accepting, so there is no moment the port is closed
+        for (int listen_socket : adopted) {
+            if (!adoptListener(listen_socket)) {
+                close(listen_socket);
+                continue;
+            }
+            auto shard = std::make_unique<ListenerShard>();
+            shard->socket = listen_socket;
+            listeners_.push_back(std::move(shard));
+        }
+        if (listeners_.empty()) {
+            logger_->error("None of the inherited sockets is listening");
+            return false;
+        }
+        if (listeners_.size() != shard_count) {
+            logger_->info("Serving on " + std::to_string(listeners_.size()) +
+                          " inherited listeners; listener_shards takes effect on the next full restart");
+        }
+    } else {
+        for (size_t i = 0; i < shard_count; ++i) {
+            int listen_socket = createListener(shard_count > 1);
+            if (listen_socket < 0) {
+                closeListeners();
+                return false;
+            }
+            auto shard = std::make_unique<ListenerShard>();
+            shard->socket = listen_socket;
+            listeners_.push_back(std::move(shard));
+        }
+    }
+    
+    // Drop privileges if configured (after binding to privileged port)
+    dropPrivileges();
+    
+    if (!setupEventLoop()) {
+        closeEventLoop();
+        closeListeners();
+        return false;
+    }
+    
+    BufferPool::global()->setMemoryLimit(static_cast<size_t>(config_->connection.transfer_buffer_memory_mb) << 20);
+    if (config_->connection.transfer_engine == "io_uring" && !DataTransfer::isUringAvailable()) {
+        logger_->warn("io_uring is not available, data transfers use sendfile/splice");
+    }
+    
+    reactor_mode_ = config_->connection.engine == "reactor";
+    if (reactor_mode_ && !startReactor()) {
+        stopReactor();
+        closeEventLoop();
+        closeListeners();
+        return false;
+    }
+    
+    // Start connection manager
+    auto passive_ports = getPassivePortAllocator();
+    passive_ports->start();
+    
+    if (!connection_manager_->start()) {
+        logger_->error("Failed to start connection manager");
+        passive_ports->stop();
+        stopReactor();
+        closeEventLoop();
+        closeListeners();
+        return false;
+    }
+    
+    performance_monitor_->setListenerShards(listeners_.size());
+    
+    running_ = true;
+    accepting_ = true;
+    for (size_t i = 0; i < listeners_.size(); ++i) {
+        listeners_[i]->thread = std::thread(&FTPServer::serverLoop, this, i);
+    }
+    {
+        std::lock_guard<std::mutex> lock(certificate_watch_mutex_);
+        certificate_watch_stop_ = false;
+    }
+    certificate_watcher_ = std::thread(&FTPServer::watchCertificates, this);
+    
+    logger_->info("FTP Server started on " + config_->connection.bind_address + 
+                  ":" + std::to_string(config_->connection.bind_port) +
+                  " (" + std::to_string(listeners_.size()) + " listener shard" +
+                  (listeners_.size() == 1 ? "" : "s") + ", " +
+                  (reactor_mode_ ? std::to_string(event_loops_.size()) + " event loops" : "thread per connection") + ")");
+    return true;
+}
+
+int FTPServer::createListener(bool reuse_port) {
     // Create socket (support both IPv4 and IPv6)
-    server_socket_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (server_socket_ < 0) {
+    int listen_socket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listen_socket < 0) {
         logger_->error("Failed to create socket: " + std::string(strerror(errno)));
-        return false;
+        return -1;
     }
     
     // Enable IPv6 if available (dual-stack)
     int ipv6_only = 0;
-    setsockopt(server_socket_, IPPROTO_IPV6, IPV6_V6ONLY, &ipv6_only, sizeof(ipv6_only));
+    setsockopt(listen_socket, IPPROTO_IPV6, IPV6_V6ONLY, &ipv6_only, sizeof(ipv6_only));
     
     // Set socket options
     int opt = 1;
-    if (setsockopt(server_socket_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
+    if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0) {
         logger_->error("Failed to set socket options: " + std::string(strerror(errno)));
-        close(server_socket_);
-        server_socket_ = -1;
-        return false;
+        close(listen_socket);
+        return -1;
+    }
+    
+    // Let the kernel spread incoming handshakes across the shard listeners
+    if (reuse_port) {
+#ifdef SO_REUSEPORT
+        if (setsockopt(listen_socket, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0) {
+            logger_->error("Failed to set SO_REUSEPORT: " + std::string(strerror(errno)));
+            close(listen_socket);
+            return -1;
+        }
+#else
+        logger_->error("SO_REUSEPORT not supported, cannot open sharded listeners");
+        close(listen_socket);
+        return -1;
+#endif
     }
     
     // Set non-blocking mode
-    int flags = fcntl(server_socket_, F_GETFL, 0);
-    fcntl(server_socket_, F_SETFL, flags | O_NONBLOCK);
+    int flags = fcntl(listen_socket, F_GETFL, 0);
+    fcntl(listen_socket, F_SETFL, flags | O_NONBLOCK);
+    fcntl(listen_socket, F_SETFD, FD_CLOEXEC);
     
     // Bind socket
     struct sockaddr_in addr;
@@ -103,134 +315,679 @@ bool FTPServer::start() {
     addr.sin_addr.s_addr = inet_addr(config_->connection.bind_address.c_str());
     addr.sin_port = htons(config_->connection.bind_port);
     
-    if (bind(server_socket_, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+    if (bind(listen_socket, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
         logger_->error("Failed to bind socket: " + std::string(strerror(errno)));
-        close(server_socket_);
-        server_socket_ = -1;
-        return false;
+        close(listen_socket);
+        return -1;
     }
     
     // Listen
-    if (listen(server_socket_, config_->connection.max_connections) < 0) {
+    if (listen(listen_socket, config_->connection.max_connections) < 0) {
         logger_->error("Failed to listen on socket: " + std::string(strerror(errno)));
-        close(server_socket_);
-        server_socket_ = -1;
+        close(listen_socket);
+        return -1;
+    }
+    
+    return listen_socket;
+}
+
+bool FTPServer::adoptListener(int listen_socket) {
+    int listening = 0;
+    socklen_t len = sizeof(listening);
+    if (getsockopt(listen_socket, SOL_SOCKET, SO_ACCEPTCONN, &listening, &len) < 0 || !listening) {
+        logger_->error("Inherited socket " + std::to_string(listen_socket) + " is not listening");
         return false;
     }
     
-    // Drop privileges if configured (after binding to privileged port)
-    dropPrivileges();
+    fcntl(listen_socket, F_SETFL, fcntl(listen_socket, F_GETFL, 0) | O_NONBLOCK);
+    fcntl(listen_socket, F_SETFD, FD_CLOEXEC);
     
-    // Start connection manager
-    if (!connection_manager_->start()) {
-        logger_->error("Failed to start connection manager");
-        close(server_socket_);
-        server_socket_ = -1;
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    if (getsockname(listen_socket, (struct sockaddr*)&addr, &addr_len) == 0 &&
+        ntohs(addr.sin_port) != config_->connection.bind_port) {
+        logger_->warn("Inherited listener is bound to port " + std::to_string(ntohs(addr.sin_port)) +
+                      ", not the configured " + std::to_string(config_->connection.bind_port));
+    }
+    return true;
+}
+
+void FTPServer::adoptListeners(const std::vector<int>& sockets) {
+    adopted_listeners_ = sockets;
+}
+
+std::vector<int> FTPServer::getListenerSockets() const {
+    std::vector<int> sockets;
+    for (const auto& shard : listeners_) {
+        sockets.push_back(shard->socket);
+    }
+    return sockets;
+}
+
+size_t FTPServer::drain(std::chrono::milliseconds timeout) {
+    if (!running_) {
+        return 0;
+    }
+    
+    stopAccepting();
+    // Pooled passive sockets hold ports the successor could use
+    getPassivePortAllocator()->stop();
+    
+    size_t open_sessions = connection_manager_->getConnectionCount();
+    logger_->info("Stopped accepting, draining " + std::to_string(open_sessions) + " session" +
+                  (open_sessions == 1 ? "" : "s") + " for up to " +
+                  std::to_string(std::chrono::duration_cast<std::chrono::seconds>(timeout).count()) + "s");
+    size_t cut_off = connection_manager_->drainConnections(std::chrono::steady_clock::now() + timeout);
+    stop();
+    return cut_off;
+}
+
+bool FTPServer::reload(std::shared_ptr<const FTPServerConfig> next) {
+    if (!next) {
         return false;
     }
     
-    running_ = true;
-    server_thread_ = std::thread(&FTPServer::serverLoop, this);
+    // Certificates are often renewed in place, so reload them even when the
+    // paths are unchanged; open sessions keep the context they negotiated with.
+    // Load them first: a certificate that fails to load rejects the whole
+    // reload, as publishing services without TLS would break AUTH TLS.
+    std::string stamp = certificateStamp(*next);
+    auto services = SessionServices::create(*next, logger_, tls_session_cache_, ticket_keys_);
+    if (!services->certificates_loaded) {
+        logger_->error("Configuration reload rejected: TLS certificates failed to load, keeping the current configuration");
+        return false;
+    }
+    auto previous = config_store_->current();
     
-    logger_->info("FTP Server started on " + config_->connection.bind_address + 
-                  ":" + std::to_string(config_->connection.bind_port));
+    const ConnectionConfig& was = previous->connection;
+    const ConnectionConfig& now = next->connection;
+    std::string fixed;
+    auto note = [&fixed](bool changed, const char* name) {
+        if (changed) {
+            fixed += (fixed.empty() ? "" : ", ") + std::string(name);
+        }
+    };
+    note(was.bind_address != now.bind_address, "bind_address");
+    note(was.bind_port != now.bind_port, "bind_port");
+    note(was.listener_shards != now.listener_shards, "listener_shards");
+    note(was.engine != now.engine, "engine");
+    note(was.event_loop_threads != now.event_loop_threads, "event_loop_threads");
+    note(was.worker_threads != now.worker_threads, "worker_threads");
+    note(was.tls_worker_threads != now.tls_worker_threads, "tls_worker_threads");
+    if (was.transfer_buffer_memory_mb != now.transfer_buffer_memory_mb) {
+        // Lowering the cap unmaps nothing; it stops further growth
+        BufferPool::global()->setMemoryLimit(static_cast<size_t>(now.transfer_buffer_memory_mb) << 20);
+    }
+    admission_->setLimits(admissionLimits(now));
+    if (was.memory_budget_mb != now.memory_budget_mb || was.user_memory_budget_mb != now.user_memory_budget_mb) {
+        // Lowering a budget takes nothing back; it refuses further growth
+        memory_accountant_->setLimits(static_cast<size_t>(now.memory_budget_mb) << 20,
+                                      static_cast<size_t>(now.user_memory_budget_mb) << 20);
+    }
+    note(previous->security.drop_privileges != next->security.drop_privileges ||
+         previous->security.run_as_user != next->security.run_as_user ||
+         previous->security.run_as_group != next->security.run_as_group, "privilege settings");
+    note(previous->security.ssl_ticket_key_shm != next->security.ssl_ticket_key_shm, "ssl_ticket_key_shm");
+    tls_session_cache_->setLimits(next->security.ssl_session_cache_size,
+                                  std::chrono::seconds(next->security.ssl_session_timeout_seconds));
+    ticket_keys_->setRotationInterval(std::chrono::seconds(next->security.ssl_ticket_key_rotation_seconds));
+    if (!fixed.empty()) {
+        logger_->warn("Configuration reload: " + fixed + " only change on restart or upgrade");
+    }
+    
+    logger_->setLevel(parseLogLevel(next->logging.log_level));
+    applyAccessControl(*next);
+    applyRateLimits(*next);
+    
+    if (was.passive_port_range_start != now.passive_port_range_start ||
+        was.passive_port_range_end != now.passive_port_range_end ||
+        was.passive_pool_size != now.passive_pool_size) {
+        // Sessions already running keep leasing from the range they started with
+        auto allocator = std::make_shared<PassivePortAllocator>(logger_, now.passive_port_range_start,
+                                                                now.passive_port_range_end, now.passive_pool_size);
+        if (running_) {
+            allocator->start();
+        }
+        auto old_allocator = std::atomic_exchange(&passive_ports_, allocator);
+        old_allocator->stop();
+    }
+    
+    {
+        std::lock_guard<std::mutex> lock(services_mutex_);
+        certificate_stamp_ = stamp;
+        std::atomic_store(&session_services_, services);
+        config_store_->publish(next);
+    }
+    // The watcher picks up a changed ssl_cert_check_seconds
+    certificate_watch_cv_.notify_all();
+    logger_->info("Configuration reloaded (version " + std::to_string(config_store_->version()) + ")");
     return true;
 }
 
+bool FTPServer::reloadCertificates() {
+    std::lock_guard<std::mutex> lock(services_mutex_);
+    auto config = config_store_->current();
+    certificate_stamp_ = certificateStamp(*config);
+    auto services = SessionServices::create(*config, logger_, tls_session_cache_, ticket_keys_);
+    if (!services->certificates_loaded) {
+        // Try again when the files change once more
+        logger_->warn("TLS certificates not reloaded, new sessions keep the previous ones");
+        return false;
+    }
+    std::atomic_store(&session_services_, services);
+    logger_->info("TLS certificates reloaded for new sessions");
+    return true;
+}
+
+void FTPServer::watchCertificates() {
+    std::unique_lock<std::mutex> lock(certificate_watch_mutex_);
+    while (!certificate_watch_stop_) {
+        int interval = config_store_->current()->security.ssl_cert_check_seconds;
+        if (interval > 0) {
+            certificate_watch_cv_.wait_for(lock, std::chrono::seconds(interval));
+        } else {
+            certificate_watch_cv_.wait(lock);
+        }
+        if (certificate_watch_stop_) {
+            break;
+        }
+        lock.unlock();
+        
+        // Stat outside services_mutex_; a reload in between just makes the
+        // comparison below see its newer stamp
+        auto config = config_store_->current();
+        std::string stamp = certificateStamp(*config);
+        bool changed;
+        {
+            std::lock_guard<std::mutex> services_lock(services_mutex_);
+            changed = stamp != certificate_stamp_;
+        }
+        if (changed) {
+            logger_->info("TLS certificate files changed");
+            reloadCertificates();
+        }
+        lock.lock();
+    }
+}
+
+std::shared_ptr<PassivePortAllocator> FTPServer::getPassivePortAllocator() const {
+    return std::atomic_load(&passive_ports_);
+}
+
+std::shared_ptr<const SessionServices> FTPServer::getSessionServices() const {
+    return std::atomic_load(&session_services_);
+}
+
+void FTPServer::applyAccessControl(const FTPServerConfig& config) {
+    // Built complete, then published; admission never sees a half-filled list
+    auto access_control = std::make_shared<IPAccessControl>(logger_);
+    for (const auto& entry : config.security.allowed_ips) {
+        access_control->addWhitelist(entry);
+    }
+    for (const auto& entry : config.security.blocked_ips) {
+        access_control->addBlacklist(entry);
+    }
+    std::atomic_store(&ip_access_control_, access_control);
+    
+    std::shared_ptr<IPAccessControl> admin_networks;
+    if (!config.security.admin_ips.empty()) {
+        admin_networks = std::make_shared<IPAccessControl>(logger_);
+        for (const auto& entry : config.security.admin_ips) {
+            admin_networks->addWhitelist(entry);
+        }
+    }
+    std::atomic_store(&admin_networks_, admin_networks);
+}
+
+void FTPServer::applyRateLimits(const FTPServerConfig& config) {
+    if (!config.rate_limit.enabled) {
+        std::atomic_store(&rate_limiter_, std::shared_ptr<FTPRateLimiter>());
+        return;
+    }
+    // Keep the per-address windows when only the limits change
+    auto rate_limiter = std::atomic_load(&rate_limiter_);
+    if (!rate_limiter) {
+        rate_limiter = std::make_shared<FTPRateLimiter>(logger_);
+    }
+    rate_limiter->setRateLimit(config.rate_limit.max_requests_per_minute);
+    rate_limiter->setConnectionLimit(config.rate_limit.max_connections_per_ip);
+    std::atomic_store(&rate_limiter_, rate_limiter);
+}
+
 void FTPServer::stop() {
-    if (!running_) {
+    if (!running_.exchange(false)) {
         return;
     }
     
-    running_ = false;
+    stopAccepting();
+    {
+        std::lock_guard<std::mutex> lock(certificate_watch_mutex_);
+        certificate_watch_stop_ = true;
+    }
+    certificate_watch_cv_.notify_all();
+    if (certificate_watcher_.joinable()) {
+        certificate_watcher_.join();
+    }
     
-    // Close server socket
-    if (server_socket_ >= 0) {
-        close(server_socket_);
-        server_socket_ = -1;
+    // Reactor sessions close on their loop threads, so ask them to stop
+    // before the loops go away
+    if (connection_manager_) {
+        connection_manager_->stopAllConnections();
     }
+    stopReactor();
     
     // Stop connection manager
     if (connection_manager_) {
-        connection_manager_->stopAllConnections();
         connection_manager_->stop();
     }
+    getPassivePortAllocator()->stop();
     
-    // Wait for server thread
-    if (server_thread_.joinable()) {
-        server_thread_.join();
+    if (performance_monitor_->getTlsFullHandshakes() + performance_monitor_->getTlsResumedHandshakes() > 0) {
+        logger_->info("TLS handshakes: " + std::to_string(performance_monitor_->getTlsFullHandshakes()) + " full, " +
+                      std::to_string(performance_monitor_->getTlsResumedHandshakes()) + " resumed; session cache " +
+                      std::to_string(performance_monitor_->getTlsSessionCacheHits()) + " hits / " +
+                      std::to_string(performance_monitor_->getTlsSessionCacheMisses()) + " misses, tickets " +
+                      std::to_string(performance_monitor_->getTlsTicketHits()) + " hits / " +
+                      std::to_string(performance_monitor_->getTlsTicketMisses()) + " misses");
     }
-    
     logger_->info("FTP Server stopped");
 }
 
+void FTPServer::stopAccepting() {
+    if (!accepting_.exchange(false)) {
+        return;
+    }
+    
+    // Wake the accept loops so they exit without waiting for a new client
+    if (wakeup_write_fd_ >= 0) {
+        uint64_t one = 1;
+        ssize_t written = write(wakeup_write_fd_, &one, sizeof(one));
+        (void)written;
+    }
+    
+    // Wait for acceptor threads
+    for (auto& shard : listeners_) {
+        if (shard->thread.joinable()) {
+            shard->thread.join();
+        }
+    }
+    
+    if (listeners_.size() > 1) {
+        std::string distribution;
+        for (uint64_t accepts : performance_monitor_->getShardAccepts()) {
+            distribution += (distribution.empty() ? "" : ", ") + std::to_string(accepts);
+        }
+        logger_->info("Listener shard accepts: [" + distribution + "]");
+    }
+    
+    BufferPool::Stats buffers = BufferPool::global()->getStats();
+    if (buffers.hits + buffers.misses > 0) {
+        logger_->info("Transfer buffers: " + std::to_string(buffers.hits) + " hits, " +
+                      std::to_string(buffers.misses) + " misses, " + std::to_string(buffers.bytes_mapped >> 20) +
+                      " MiB mapped (" + std::to_string(buffers.hugepage_bytes >> 20) + " MiB hugepages)");
+    }
+    
+    AdmissionController::Stats admission = admission_->getStats();
+    if (admission.rejected + admission.admin_only > 0) {
+        logger_->info("Admission: " + std::to_string(admission.rejected) + " clients turned away, " +
+                      std::to_string(admission.admin_only) + " let in on reserved slots");
+    }
+    
+    MemoryAccountant::Stats memory = memory_accountant_->getStats();
+    if (memory.refused + memory.pauses > 0) {
+        logger_->info("Memory budget: " + std::to_string(memory.refused) + " charges refused, " +
+                      std::to_string(memory.pauses) + " transfer pauses");
+    }
+    
+    // A successor holding the same listeners keeps them open
+    closeEventLoop();
+    closeListeners();
+}
+
 bool FTPServer::isRunning() const {
     return running_;
 }
 
-void FTPServer::serverLoop() {
-    while (running_) {
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
+bool FTPServer::setupEventLoop() {
+#ifdef __linux__
+    // Level-triggered and never drained: a single write wakes every acceptor
+    wakeup_read_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wakeup_read_fd_ < 0) {
+        logger_->error("Failed to create eventfd: " + std::string(strerror(errno)));
+        return false;
+    }
+    wakeup_write_fd_ = wakeup_read_fd_;
+    
+    for (auto& shard : listeners_) {
+        shard->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (shard->epoll_fd < 0) {
+            logger_->error("Failed to create epoll instance: " + std::string(strerror(errno)));
+            return false;
+        }
         
-        int client_socket = accept(server_socket_, (struct sockaddr*)&client_addr, &client_len);
+        // Edge-triggered: every wakeup drains the whole accept backlog
+        struct epoll_event ev;
+        std::memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = shard->socket;
+        if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, shard->socket, &ev) < 0) {
+            logger_->error("Failed to register listener with epoll: " + std::string(strerror(errno)));
+            return false;
+        }
         
-        if (client_socket >= 0) {
-            // Get client IP address
-            char client_ip[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
-            
-            // Check IP access control
-            if (ip_access_control_ && !ip_access_control_->isAllowed(client_ip)) {
-                logger_->warn("Connection rejected from blocked IP: " + std::string(client_ip));
-                close(client_socket);
-                continue;
-            }
-            
-            // Check rate limiting
-            if (rate_limiter_ && !rate_limiter_->isAllowed(client_ip)) {
-                logger_->warn("Connection rejected due to rate limit: " + std::string(client_ip));
-                close(client_socket);
+        ev.events = EPOLLIN;
+        ev.data.fd = wakeup_read_fd_;
+        if (epoll_ctl(shard->epoll_fd, EPOLL_CTL_ADD, wakeup_read_fd_, &ev) < 0) {
+            logger_->error("Failed to register eventfd with epoll: " + std::string(strerror(errno)));
+            return false;
+        }
+    }
+#else
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        logger_->error("Failed to create wakeup pipe: " + std::string(strerror(errno)));
+        return false;
+    }
+    for (int fd : pipe_fds) {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+    wakeup_read_fd_ = pipe_fds[0];
+    wakeup_write_fd_ = pipe_fds[1];
+#endif
+    
+    reserve_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    return true;
+}
+
+void FTPServer::closeEventLoop() {
+    for (auto& shard : listeners_) {
+        if (shard->epoll_fd >= 0) {
+            close(shard->epoll_fd);
+            shard->epoll_fd = -1;
+        }
+    }
+    if (wakeup_write_fd_ >= 0 && wakeup_write_fd_ != wakeup_read_fd_) {
+        close(wakeup_write_fd_);
+    }
+    wakeup_write_fd_ = -1;
+    if (wakeup_read_fd_ >= 0) {
+        close(wakeup_read_fd_);
+        wakeup_read_fd_ = -1;
+    }
+    if (reserve_fd_ >= 0) {
+        close(reserve_fd_);
+        reserve_fd_ = -1;
+    }
+}
+
+bool FTPServer::startReactor() {
+    // event_loop_threads = 0 means one loop per CPU core
+    size_t loop_count = static_cast<size_t>(config_->connection.event_loop_threads);
+    if (loop_count == 0) {
+        loop_count = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    for (size_t i = 0; i < loop_count; ++i) {
+        auto loop = std::make_shared<EventLoop>(logger_);
+        if (!loop->start()) {
+            logger_->error("Failed to start event loop");
+            return false;
+        }
+        event_loops_.push_back(loop);
+    }
+    
+    worker_pool_ = std::make_shared<WorkerPool>(logger_);
+    if (!worker_pool_->start(static_cast<size_t>(std::max(1, config_->connection.worker_threads)))) {
+        return false;
+    }
+    
+    // Without its own pool the loops run handshake crypto themselves
+    if (config_->connection.tls_worker_threads > 0) {
+        tls_worker_pool_ = std::make_shared<WorkerPool>(logger_);
+        return tls_worker_pool_->start(static_cast<size_t>(config_->connection.tls_worker_threads));
+    }
+    return true;
+}
+
+void FTPServer::stopReactor() {
+    for (auto& loop : event_loops_) {
+        loop->stop();
+    }
+    if (worker_pool_) {
+        worker_pool_->stop();
+    }
+    if (tls_worker_pool_) {
+        tls_worker_pool_->stop();
+    }
+    event_loops_.clear();
+    worker_pool_.reset();
+    tls_worker_pool_.reset();
+}
+
+void FTPServer::closeListeners() {
+    for (auto& shard : listeners_) {
+        if (shard->socket >= 0) {
+            close(shard->socket);
+            shard->socket = -1;
+        }
+    }
+    listeners_.clear();
+}
+
+void FTPServer::serverLoop(size_t shard_index) {
+    ListenerShard& shard = *listeners_[shard_index];
+    
+    while (accepting_) {
+#ifdef __linux__
+        struct epoll_event events[2];
+        int ready = epoll_wait(shard.epoll_fd, events, 2, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
                 continue;
             }
-            
-            // Record request for rate limiting
-            if (rate_limiter_) {
-                rate_limiter_->recordRequest(client_ip);
+            logger_->error("epoll_wait failed: " + std::string(strerror(errno)));
+            break;
+        }
+        
+        bool listener_ready = false;
+        for (int i = 0; i < ready; ++i) {
+            if (events[i].data.fd == shard.socket) {
+                listener_ready = true;
             }
-            
-            // Check connection limit
-            if (connection_manager_->getConnectionCount() >= static_cast<size_t>(config_->connection.max_connections)) {
-                logger_->warn("Connection limit reached, rejecting new connection");
-                close(client_socket);
+        }
+#else
+        struct pollfd fds[2];
+        fds[0].fd = shard.socket;
+        fds[0].events = POLLIN;
+        fds[0].revents = 0;
+        fds[1].fd = wakeup_read_fd_;
+        fds[1].events = POLLIN;
+        fds[1].revents = 0;
+        int ready = poll(fds, 2, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
                 continue;
             }
-            
-            // Record connection
-            if (performance_monitor_) {
-                performance_monitor_->recordConnection();
-            }
-            
-            // Handle new connection
-            handleConnection(client_socket);
-        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
-            if (running_) {
-                logger_->error("Accept error: " + std::string(strerror(errno)));
+            logger_->error("poll failed: " + std::string(strerror(errno)));
+            break;
+        }
+        
+        bool listener_ready = (fds[0].revents & POLLIN) != 0;
+#endif
+        // stopAccepting() has written to the wakeup descriptor
+        if (!accepting_) {
+            break;
+        }
+        
+        if (listener_ready) {
+            checkAcceptQueue(shard.socket);
+            acceptPending(shard_index);
+        }
+    }
+}
+
+void FTPServer::acceptPending(size_t shard_index) {
+    int listen_socket = listeners_[shard_index]->socket;
+    
+    while (accepting_) {
+        struct sockaddr_in client_addr;
+        socklen_t client_len = sizeof(client_addr);
+        
+#ifdef __linux__
+        // Reactor sessions are driven by non-blocking I/O from the start
+        int accept_flags = SOCK_CLOEXEC | (reactor_mode_ ? SOCK_NONBLOCK : 0);
+        int client_socket = accept4(listen_socket, (struct sockaddr*)&client_addr, &client_len, accept_flags);
+#else
+        int client_socket = accept(listen_socket, (struct sockaddr*)&client_addr, &client_len);
+        if (client_socket >= 0) {
+            // BSD accept() inherits O_NONBLOCK from the listener; sessions use blocking I/O
+            fcntl(client_socket, F_SETFL, fcntl(client_socket, F_GETFL, 0) & ~O_NONBLOCK);
+            fcntl(client_socket, F_SETFD, FD_CLOEXEC);
+        }
+#endif
+        
+        if (client_socket >= 0) {
+            performance_monitor_->recordShardAccept(shard_index);
+            admitConnection(client_socket, client_addr);
+            continue;
+        }
+        
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            // Backlog drained
+            return;
+        }
+        if (errno == EINTR || errno == ECONNABORTED) {
+            continue;
+        }
+        if (errno == EMFILE || errno == ENFILE) {
+            // Out of descriptors: with edge-triggered readiness the pending
+            // connection would never be reported again, so free the spare
+            // descriptor, accept and immediately close the client, then re-arm.
+            std::lock_guard<std::mutex> lock(reserve_fd_mutex_);
+            if (reserve_fd_ >= 0) {
+                logger_->warn("Out of file descriptors, shedding pending connection");
+                close(reserve_fd_);
+                int shed = accept(listen_socket, nullptr, nullptr);
+                if (shed >= 0) {
+                    close(shed);
+                }
+                reserve_fd_ = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                continue;
             }
         }
         
-        // Small sleep to prevent CPU spinning
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        if (accepting_) {
+            logger_->error("Accept error: " + std::string(strerror(errno)));
+        }
+        return;
     }
 }
 
-void FTPServer::handleConnection(int client_socket) {
-    auto connection = std::make_shared<FTPConnection>(client_socket, logger_, config_);
-    connection_manager_->addConnection(connection);
-    connection->start();
+void FTPServer::checkAcceptQueue(int listen_socket) {
+#ifdef __linux__
+    // On a listening socket TCP_INFO reports the current accept queue length
+    // in tcpi_unacked and the configured backlog in tcpi_sacked. A full queue
+    // at wakeup means the kernel may already have dropped SYNs.
+    struct tcp_info info;
+    socklen_t info_len = sizeof(info);
+    if (getsockopt(listen_socket, IPPROTO_TCP, TCP_INFO, &info, &info_len) == 0 &&
+        info.tcpi_sacked > 0 && info.tcpi_unacked >= info.tcpi_sacked) {
+        if (performance_monitor_) {
+            performance_monitor_->recordAcceptQueueOverflow();
+        }
+        logger_->warn("Accept queue overflow (" + std::to_string(info.tcpi_unacked) +
+                      " pending, backlog " + std::to_string(info.tcpi_sacked) + ")");
+    }
+#else
+    (void)listen_socket;
+#endif
+}
+
+void FTPServer::admitConnection(int client_socket, const struct sockaddr_in& client_addr) {
+    // Get client IP address
+    char client_ip[INET_ADDRSTRLEN];
+    inet_ntop(AF_INET, &client_addr.sin_addr, client_ip, INET_ADDRSTRLEN);
+    
+    // Whatever the latest reload published
+    auto config = config_store_->current();
+    auto ip_access_control = std::atomic_load(&ip_access_control_);
+    auto rate_limiter = std::atomic_load(&rate_limiter_);
     
-    // Note: Connection will remove itself when done
-    // For now, we'll let the connection manager handle cleanup
+    // Check IP access control
+    if (ip_access_control && !ip_access_control->isAllowed(client_ip)) {
+        logger_->warn("Connection rejected from blocked IP: " + std::string(client_ip));
+        close(client_socket);
+        return;
+    }
+    
+    // Check rate limiting
+    if (rate_limiter && !rate_limiter->isAllowed(client_ip)) {
+        logger_->warn("Connection rejected due to rate limit: " + std::string(client_ip));
+        close(client_socket);
+        return;
+    }
+    
+    // Record request for rate limiting
+    if (rate_limiter) {
+        rate_limiter->recordRequest(client_ip);
+    }
+    
+    // Session count, loop lag and queued work decide; a refusal tells the
+    // client when to come back rather than resetting it into a retry loop
+    AdmissionController::Load load;
+    load.sessions = connection_manager_->getConnectionCount();
+    for (const auto& event_loop : event_loops_) {
+        load.loop_lag = std::max(load.loop_lag, std::chrono::duration_cast<std::chrono::milliseconds>(event_loop->getLag()));
+    }
+    if (worker_pool_) {
+        load.queue_depth = worker_pool_->getQueueDepth();
+    }
+    auto admin_networks = std::atomic_load(&admin_networks_);
+    bool privileged = admin_networks && admin_networks->isAllowed(client_ip);
+    AdmissionController::Decision admission = admission_->decide(load, privileged);
+    if (admission.verdict == AdmissionController::Verdict::REJECT) {
+        logger_->warn("Server overloaded (" + std::to_string(load.sessions) + " sessions, loop lag " +
+                      std::to_string(load.loop_lag.count()) + " ms, " + std::to_string(load.queue_depth) +
+                      " queued), turning away " + client_ip);
+        std::string reply = "421 Service not available, try again in " + std::to_string(admission.retry_seconds) +
+                            " seconds\r\n";
+        ssize_t sent = send(client_socket, reply.data(), reply.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        (void)sent;
+        close(client_socket);
+        return;
+    }
+    
+    // Record connection
+    if (performance_monitor_) {
+        performance_monitor_->recordConnection();
+    }
+    
+    // Handle new connection
+    handleConnection(client_socket,
+                     admission.verdict == AdmissionController::Verdict::ADMIN_ONLY ? admission.retry_seconds : 0);
+}
+
+void FTPServer::handleConnection(int client_socket, int admin_only_retry) {
+    auto connection = std::allocate_shared<FTPConnection>(SlabAllocator<FTPConnection>(session_slab_), client_socket,
+                                                          logger_, config_store_->current());
+    connection->setConfigStore(config_store_);
+    connection->setSessionServices(getSessionServices());
+    connection->setPassivePortAllocator(getPassivePortAllocator());
+    connection->setPerformanceMonitor(performance_monitor_);
+    connection->setMemoryAccountant(memory_accountant_);
+    if (admin_only_retry > 0) {
+        auto admission = admission_;
+        connection->setAdminOnly(admin_only_retry, [admission]() { admission->releaseAdminOnly(); });
+    }
+    connection_manager_->addConnection(connection);
+    if (reactor_mode_) {
+        size_t index = next_event_loop_.fetch_add(1) % event_loops_.size();
+        connection->startReactor(event_loops_[index], worker_pool_, tls_worker_pool_);
+    } else {
+        connection->start();
+    }
+    // The session deregisters itself from connection_manager_ when it ends
 }
 
 void FTPServer::dropPrivileges() {
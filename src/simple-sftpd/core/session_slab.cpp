@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/session_slab.hpp"
+#include <algorithm>
+
+namespace simple_sftpd {
+
+namespace {
+
+// Rounded so every block in a slab stays suitably aligned
+size_t roundedSize(size_t size) {
+    const size_t align = alignof(std::max_align_t);
+    return (size + align - 1) / align * align;
+}
+
+} // namespace
+
+void* SessionSlab::allocate(size_t size, size_t alignment) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (block_size_ == 0 && alignment <= alignof(std::max_align_t)) {
+            block_size_ = roundedSize(std::max(size, sizeof(FreeBlock)));
+        }
+        if (fits(size, alignment)) {
+            if (!free_) {
+                grow();
+            }
+            FreeBlock* block = free_;
+            free_ = block->next;
+            ++in_use_;
+            return block;
+        }
+    }
+    return ::operator new(size);
+}
+
+void SessionSlab::deallocate(void* block, size_t size, size_t alignment) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (fits(size, alignment)) {
+        // Most recently freed first: the next session reuses warm memory
+        FreeBlock* freed = static_cast<FreeBlock*>(block);
+        freed->next = free_;
+        free_ = freed;
+        --in_use_;
+        return;
+    }
+    ::operator delete(block);
+}
+
+size_t SessionSlab::getBlockSize() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return block_size_;
+}
+
+size_t SessionSlab::getCapacity() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return capacity_;
+}
+
+size_t SessionSlab::getInUse() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return in_use_;
+}
+
+bool SessionSlab::fits(size_t size, size_t alignment) const {
+    return block_size_ != 0 && roundedSize(std::max(size, sizeof(FreeBlock))) == block_size_ &&
+           alignment <= alignof(std::max_align_t);
+}
+
+void SessionSlab::grow() {
+    // new[] of unsigned char is aligned for any fundamental type
+    std::unique_ptr<unsigned char[]> slab(new unsigned char[block_size_ * BLOCKS_PER_SLAB]);
+    for (size_t i = BLOCKS_PER_SLAB; i-- > 0;) {
+        FreeBlock* block = reinterpret_cast<FreeBlock*>(slab.get() + i * block_size_);
+        block->next = free_;
+        free_ = block;
+    }
+    slabs_.push_back(std::move(slab));
+    capacity_ += BLOCKS_PER_SLAB;
+}
+
+} // namespace simple_sftpd
@@ -0,0 +1,231 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/timing_wheel.hpp"
+#include <algorithm>
+#include <limits>
+
+namespace simple_sftpd {
+
+namespace {
+
+uint64_t rotateRight(uint64_t bits, unsigned shift) {
+    shift &= 63;
+    return shift == 0 ? bits : (bits >> shift) | (bits << (64 - shift));
+}
+
+} // namespace
+
+TimingWheel::TimingWheel(std::chrono::milliseconds tick, Clock::time_point start)
+    : tick_(tick.count() > 0 ? tick : std::chrono::milliseconds(1)), start_(start), current_(0), armed_(0) {
+    heads_.fill(-1);
+    occupied_.fill(0);
+}
+
+TimingWheel::TimerId TimingWheel::schedule(Clock::time_point deadline, Callback callback) {
+    uint32_t index;
+    if (!free_nodes_.empty()) {
+        index = free_nodes_.back();
+        free_nodes_.pop_back();
+    } else {
+        index = static_cast<uint32_t>(nodes_.size());
+        nodes_.emplace_back();
+    }
+
+    Node& node = nodes_[index];
+    node.callback = std::move(callback);
+    node.expires = std::max(tickFor(deadline), current_ + 1);
+    place(index);
+    ++armed_;
+    return (static_cast<uint64_t>(node.generation) << 32) | index;
+}
+
+bool TimingWheel::reschedule(TimerId id, Clock::time_point deadline) {
+    Node* node = lookup(id);
+    if (!node) {
+        return false;
+    }
+    uint32_t index = static_cast<uint32_t>(id);
+    unlink(index);
+    node->expires = std::max(tickFor(deadline), current_ + 1);
+    place(index);
+    return true;
+}
+
+void TimingWheel::cancel(TimerId id) {
+    if (lookup(id)) {
+        release(static_cast<uint32_t>(id));
+    }
+}
+
+void TimingWheel::clear() {
+    for (uint32_t index = 0; index < nodes_.size(); ++index) {
+        if (nodes_[index].bucket >= 0) {
+            release(index);
+        }
+    }
+}
+
+size_t TimingWheel::advance(Clock::time_point now) {
+    uint64_t target = now > start_ ? static_cast<uint64_t>((now - start_) / tick_) : 0;
+    size_t fired = 0;
+
+    while (current_ < target) {
+        // Jump straight to the next tick with work instead of stepping
+        uint64_t next = nextEventTick();
+        if (next > target) {
+            current_ = target;
+            break;
+        }
+        current_ = next;
+
+        // Turning past a boundary brings the matching higher slot down
+        for (unsigned level = 1; level < LEVELS; ++level) {
+            if ((current_ & ((1ull << (LEVEL_BITS * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+
+        int32_t& head = heads_[current_ & (SLOTS - 1)];
+        while (head >= 0) {
+            uint32_t index = static_cast<uint32_t>(head);
+            Callback callback = std::move(nodes_[index].callback);
+            release(index);
+            ++fired;
+            callback();  // may grow nodes_; nothing is held across it
+        }
+    }
+    return fired;
+}
+
+TimingWheel::Clock::time_point TimingWheel::nextDeadline() const {
+    uint64_t next = nextEventTick();
+    if (next == std::numeric_limits<uint64_t>::max()) {
+        return Clock::time_point::max();
+    }
+    auto offset = Clock::time_point::max() - start_;
+    if (next > static_cast<uint64_t>(offset / tick_)) {
+        return Clock::time_point::max();
+    }
+    return start_ + std::chrono::duration_cast<Clock::duration>(tick_ * next);
+}
+
+TimingWheel::Node* TimingWheel::lookup(TimerId id) {
+    uint32_t index = static_cast<uint32_t>(id);
+    uint32_t generation = static_cast<uint32_t>(id >> 32);
+    if (index >= nodes_.size() || nodes_[index].generation != generation || nodes_[index].bucket < 0) {
+        return nullptr;
+    }
+    return &nodes_[index];
+}
+
+uint64_t TimingWheel::tickFor(Clock::time_point deadline) const {
+    if (deadline <= start_) {
+        return 0;
+    }
+    auto elapsed = deadline - start_;
+    auto ticks = elapsed / tick_;
+    // Round up so a timer never fires before its deadline
+    return static_cast<uint64_t>(ticks) + (elapsed % tick_ != Clock::duration::zero() ? 1 : 0);
+}
+
+void TimingWheel::place(uint32_t index) {
+    Node& node = nodes_[index];
+    uint64_t delta = node.expires - current_;
+    uint64_t expires = node.expires;
+    if (delta > MAX_SPAN) {
+        expires = current_ + MAX_SPAN;  // parked; re-placed when the top level turns
+        delta = MAX_SPAN;
+    }
+
+    unsigned level = 0;
+    while (level + 1 < LEVELS && delta >= (1ull << (LEVEL_BITS * (level + 1)))) {
+        ++level;
+    }
+    unsigned slot = static_cast<unsigned>(expires >> (LEVEL_BITS * level)) & (SLOTS - 1);
+    int32_t bucket = static_cast<int32_t>(level * SLOTS + slot);
+
+    node.bucket = bucket;
+    node.prev = -1;
+    node.next = heads_[bucket];
+    if (node.next >= 0) {
+        nodes_[node.next].prev = static_cast<int32_t>(index);
+    }
+    heads_[bucket] = static_cast<int32_t>(index);
+    occupied_[level] |= 1ull << slot;
+}
+
+void TimingWheel::unlink(uint32_t index) {
+    Node& node = nodes_[index];
+    if (node.prev >= 0) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        heads_[node.bucket] = node.next;
+    }
+    if (node.next >= 0) {
+        nodes_[node.next].prev = node.prev;
+    }
+    if (heads_[node.bucket] < 0) {
+        occupied_[node.bucket / SLOTS] &= ~(1ull << (node.bucket % SLOTS));
+    }
+    node.prev = -1;
+    node.next = -1;
+    node.bucket = -1;
+}
+
+void TimingWheel::release(uint32_t index) {
+    unlink(index);
+    Node& node = nodes_[index];
+    node.callback = nullptr;
+    if (++node.generation == 0) {
+        node.generation = 1;  // keep ids non-zero
+    }
+    free_nodes_.push_back(index);
+    --armed_;
+}
+
+void TimingWheel::cascade(unsigned level) {
+    unsigned slot = static_cast<unsigned>(current_ >> (LEVEL_BITS * level)) & (SLOTS - 1);
+    int32_t& head = heads_[level * SLOTS + slot];
+    int32_t index = head;
+    head = -1;
+    occupied_[level] &= ~(1ull << slot);
+
+    while (index >= 0) {
+        int32_t next = nodes_[index].next;
+        place(static_cast<uint32_t>(index));
+        index = next;
+    }
+}
+
+uint64_t TimingWheel::nextEventTick() const {
+    uint64_t best = std::numeric_limits<uint64_t>::max();
+    for (unsigned level = 0; level < LEVELS; ++level) {
+        if (occupied_[level] == 0) {
+            continue;
+        }
+        // Slots are visited starting just after the cursor; the cursor's own
+        // slot holds timers one full turn away
+        uint64_t base = current_ >> (LEVEL_BITS * level);
+        uint64_t rotated = rotateRight(occupied_[level], static_cast<unsigned>((base + 1) & (SLOTS - 1)));
+        uint64_t steps = static_cast<uint64_t>(__builtin_ctzll(rotated)) + 1;
+        best = std::min(best, (base + steps) << (LEVEL_BITS * level));
+    }
+    return best;
+}
+
+} // namespace simple_sftpd
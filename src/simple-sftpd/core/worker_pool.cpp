@@ -0,0 +1,104 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/core/worker_pool.hpp"
+#include "simple-sftpd/utils/logger.hpp"
+#include <algorithm>
+#include <exception>
+#include <string>
+
+namespace simple_sftpd {
+
+WorkerPool::WorkerPool(std::shared_ptr<Logger> logger)
+    : logger_(logger), running_(false) {
+}
+
+WorkerPool::~WorkerPool() {
+    stop();
+}
+
+bool WorkerPool::start(size_t thread_count) {
+    if (running_) {
+        return true;
+    }
+
+    running_ = true;
+    thread_count = std::max<size_t>(1, thread_count);
+    for (size_t i = 0; i < thread_count; ++i) {
+        threads_.emplace_back(&WorkerPool::workerLoop, this);
+    }
+    return true;
+}
+
+void WorkerPool::stop() {
+    std::deque<Task> dropped;
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (!running_) {
+            return;
+        }
+        running_ = false;
+        dropped.swap(queue_);
+    }
+    queue_cv_.notify_all();
+
+    for (auto& thread : threads_) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threads_.clear();
+}
+
+bool WorkerPool::submit(Task task) {
+    {
+        std::lock_guard<std::mutex> lock(queue_mutex_);
+        if (!running_) {
+            return false;
+        }
+        queue_.push_back(std::move(task));
+    }
+    queue_cv_.notify_one();
+    return true;
+}
+
+size_t WorkerPool::getQueueDepth() const {
+    std::lock_guard<std::mutex> lock(queue_mutex_);
+    return queue_.size();
+}
+
+void WorkerPool::workerLoop() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(queue_mutex_);
+            queue_cv_.wait(lock, [this] { return !running_ || !queue_.empty(); });
+            if (!running_) {
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+
+        try {
+            task();
+        } catch (const std::exception& e) {
+            logger_->error("Worker task failed: " + std::string(e.what()));
+        }
+    }
+}
+
+} // namespace simple_sftpd
@@ -16,6 +16,8 @@
 
 #include "simple-sftpd/security/pam_auth.hpp"
 #include "simple-sftpd/utils/logger.hpp"
+#include <cstdlib>
+#include <cstring>
 
 #ifndef _WIN32
 #ifdef __linux__
@@ -54,16 +56,11 @@ static int pam_conv_func(int num_msg, const struct pam_message** msg,
     
     return PAM_SUCCESS;
 }
-
-static struct pam_conv conv = {
-    pam_conv_func,
-    nullptr
-};
 #endif
 #endif
 
 PAMAuth::PAMAuth(std::shared_ptr<Logger> logger)
-    : logger_(logger), pam_available_(false), pam_handle_(nullptr) {
+    : logger_(logger), pam_available_(false) {
 #ifndef _WIN32
 #ifdef __linux__
     // Check if PAM is available
@@ -80,14 +77,6 @@ PAMAuth::PAMAuth(std::shared_ptr<Logger> logger)
 }
 
 PAMAuth::~PAMAuth() {
-#ifndef _WIN32
-#ifdef __linux__
-    if (pam_handle_) {
-        pam_end(static_cast<pam_handle_t*>(pam_handle_), 0);
-        pam_handle_ = nullptr;
-    }
-#endif
-#endif
 }
 
 bool PAMAuth::authenticate(const std::string& username, const std::string& password) {
@@ -97,9 +86,11 @@ bool PAMAuth::authenticate(const std::string& username, const std::string& passw
         return false;
     }
     
+    // Sessions authenticate concurrently, so each call has its own
+    // conversation and handle
     struct pam_data data;
     data.password = password.c_str();
-    conv.appdata_ptr = &data;
+    struct pam_conv conv = {pam_conv_func, &data};
     
     pam_handle_t* handle = nullptr;
     int ret = pam_start("simple-sftpd", username.c_str(), &conv, &handle);
@@ -108,13 +99,10 @@ bool PAMAuth::authenticate(const std::string& username, const std::string& passw
         return false;
     }
     
-    pam_handle_ = handle;
-    
     ret = pam_authenticate(handle, 0);
     if (ret != PAM_SUCCESS) {
         logger_->warn("PAM authentication failed for user: " + username);
         pam_end(handle, ret);
-        pam_handle_ = nullptr;
         return false;
     }
     
@@ -122,13 +110,11 @@ bool PAMAuth::authenticate(const std::string& username, const std::string& passw
     if (ret != PAM_SUCCESS) {
         logger_->warn("PAM account management failed for user: " + username);
         pam_end(handle, ret);
-        pam_handle_ = nullptr;
         return false;
     }
     
     logger_->info("PAM authentication successful for user: " + username);
     pam_end(handle, PAM_SUCCESS);
-    pam_handle_ = nullptr;
     return true;
 #else
     (void)username;
@@ -66,10 +66,12 @@ void FTPRateLimiter::recordRequest(const std::string& client_ip) {
 }
 
 void FTPRateLimiter::setRateLimit(int max_requests_per_minute) {
+    std::lock_guard<std::mutex> lock(rate_limit_mutex_);
     max_requests_per_minute_ = max_requests_per_minute;
 }
 
 void FTPRateLimiter::setConnectionLimit(int max_connections_per_ip) {
+    std::lock_guard<std::mutex> lock(rate_limit_mutex_);
     max_connections_per_ip_ = max_connections_per_ip;
 }
 
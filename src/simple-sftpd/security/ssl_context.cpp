@@ -15,14 +15,38 @@
  */
 
 #include "simple-sftpd/security/ssl_context.hpp"
+#include "simple-sftpd/security/ticket_key_ring.hpp"
+#include "simple-sftpd/security/tls_session_cache.hpp"
+#include "simple-sftpd/security/tls_context_registry.hpp"
 #include "simple-sftpd/utils/logger.hpp"
 #include <fstream>
 #include <cstring>
+#include <mutex>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#include <algorithm>
 
 #ifdef SIMPLE_SFTPD_SSL_ENABLED
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/x509.h>
+#include <openssl/rand.h>
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+#include <openssl/core_names.h>
+#endif
+#endif
+
+#if defined(SIMPLE_SFTPD_SSL_ENABLED) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS) && defined(__linux__)
+#define SIMPLE_SFTPD_KTLS 1
+#ifndef TCP_ULP
+#define TCP_ULP 31
+#endif
 #endif
 
 namespace simple_sftpd {
@@ -35,10 +59,13 @@ SSLContext::SSLContext(std::shared_ptr<Logger> logger)
 {
 #ifdef SIMPLE_SFTPD_SSL_ENABLED
     enabled_ = true;
-    // Initialize OpenSSL
-    SSL_library_init();
-    SSL_load_error_strings();
-    OpenSSL_add_all_algorithms();
+    // Process-wide; contexts are rebuilt on reload and must not repeat it
+    static std::once_flag openssl_initialized;
+    std::call_once(openssl_initialized, [] {
+        SSL_library_init();
+        SSL_load_error_strings();
+        OpenSSL_add_all_algorithms();
+    });
 #endif
 }
 
@@ -48,7 +75,6 @@ SSLContext::~SSLContext() {
         SSL_CTX_free(ctx_);
         ctx_ = nullptr;
     }
-    EVP_cleanup();
 #endif
 }
 
@@ -123,6 +149,18 @@ bool SSLContext::initialize(const std::string& cert_file, const std::string& key
     // Set cipher list (prefer secure ciphers)
     SSL_CTX_set_cipher_list(ctx_, "HIGH:!aNULL:!MD5:!RC4");
 
+    // Data connections resume the control connection's session (from the
+    // cache, or a ticket under TLS 1.3) instead of a full handshake each
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER);
+    static const unsigned char session_id_context[] = "simple-sftpd";
+    SSL_CTX_set_session_id_context(ctx_, session_id_context, sizeof(session_id_context) - 1);
+
+#ifdef SSL_OP_IGNORE_UNEXPECTED_EOF
+    // Many FTPS clients end an upload by closing the data socket without
+    // a close_notify; treat that like one
+    SSL_CTX_set_options(ctx_, SSL_OP_IGNORE_UNEXPECTED_EOF);
+#endif
+
     initialized_ = true;
     logger_->info("SSL context initialized successfully");
     logger_->info("Certificate: " + cert_file);
@@ -134,6 +172,161 @@ bool SSLContext::initialize(const std::string& cert_file, const std::string& key
 #endif
 }
 
+void SSLContext::setSessionCache(std::shared_ptr<TlsSessionCache> cache, std::chrono::seconds lifetime) {
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+    if (!ctx_) {
+        return;
+    }
+
+    SSL_CTX_set_timeout(ctx_, static_cast<long>(lifetime.count()));
+    if (!cache) {
+        return;
+    }
+    session_cache_ = std::move(cache);
+    SSL_CTX_set_app_data(ctx_, this);
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+    SSL_CTX_sess_set_new_cb(ctx_, newSessionCallback);
+    SSL_CTX_sess_set_get_cb(ctx_, getSessionCallback);
+    SSL_CTX_sess_set_remove_cb(ctx_, removeSessionCallback);
+#else
+    (void)cache;
+    (void)lifetime;
+#endif
+}
+
+void SSLContext::setTicketKeys(std::shared_ptr<TicketKeyRing> keys) {
+#if defined(SIMPLE_SFTPD_SSL_ENABLED) && OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (!ctx_ || !keys) {
+        return;
+    }
+    ticket_keys_ = std::move(keys);
+    SSL_CTX_set_app_data(ctx_, this);
+    SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx_, ticketKeyCallback);
+#else
+    (void)keys;
+    logger_->warn("Shared session ticket keys need OpenSSL 3; each context keeps its own");
+#endif
+}
+
+void SSLContext::setServerNames(std::shared_ptr<const TlsContextRegistry> server_names) {
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+    if (!ctx_ || !server_names || server_names->empty()) {
+        return;
+    }
+    server_names_ = std::move(server_names);
+    SSL_CTX_set_tlsext_servername_callback(ctx_, serverNameCallback);
+    SSL_CTX_set_tlsext_servername_arg(ctx_, this);
+#else
+    (void)server_names;
+#endif
+}
+
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+int SSLContext::serverNameCallback(SSL* ssl, int* alert, void* arg) {
+    (void)alert;
+    SSLContext* self = static_cast<SSLContext*>(arg);
+    const char* name = SSL_get_servername(ssl, TLSEXT_NAMETYPE_host_name);
+    if (!name) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    std::shared_ptr<SSLContext> context = self->server_names_->find(name);
+    if (!context || !context->ctx_) {
+        return SSL_TLSEXT_ERR_NOACK;  // unknown names get the default certificate
+    }
+
+    // Swaps in the certificate and verification settings. Resumption still
+    // goes through the session cache and ticket keys of the context the
+    // connection started on, which the virtual hosts share
+    SSL_set_SSL_CTX(ssl, context->ctx_);
+    return SSL_TLSEXT_ERR_OK;
+}
+
+SSLContext* SSLContext::fromSSL(SSL* ssl) {
+    return static_cast<SSLContext*>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+}
+
+int SSLContext::newSessionCallback(SSL* ssl, SSL_SESSION* session) {
+    SSLContext* self = fromSSL(ssl);
+    unsigned int id_length = 0;
+    const unsigned char* id = SSL_SESSION_get_id(session, &id_length);
+    int length = i2d_SSL_SESSION(session, nullptr);
+    if (!self || !self->session_cache_ || length <= 0) {
+        return 0;
+    }
+
+    std::string der(static_cast<size_t>(length), '\0');
+    unsigned char* out = reinterpret_cast<unsigned char*>(&der[0]);
+    i2d_SSL_SESSION(session, &out);
+    self->session_cache_->store(std::string_view(reinterpret_cast<const char*>(id), id_length), std::move(der));
+    return 0;  // the cache keeps its own copy, not a reference
+}
+
+SSL_SESSION* SSLContext::getSessionCallback(SSL* ssl, const unsigned char* id, int length, int* copy) {
+    *copy = 0;  // the returned session is new and handed over to OpenSSL
+    SSLContext* self = fromSSL(ssl);
+    std::string der;
+    if (!self || !self->session_cache_ ||
+        !self->session_cache_->lookup(std::string_view(reinterpret_cast<const char*>(id), length), der)) {
+        return nullptr;
+    }
+
+    const unsigned char* in = reinterpret_cast<const unsigned char*>(der.data());
+    return d2i_SSL_SESSION(nullptr, &in, static_cast<long>(der.size()));
+}
+
+void SSLContext::removeSessionCallback(SSL_CTX* ctx, SSL_SESSION* session) {
+    SSLContext* self = static_cast<SSLContext*>(SSL_CTX_get_app_data(ctx));
+    if (!self || !self->session_cache_) {
+        return;
+    }
+
+    unsigned int id_length = 0;
+    const unsigned char* id = SSL_SESSION_get_id(session, &id_length);
+    self->session_cache_->remove(std::string_view(reinterpret_cast<const char*>(id), id_length));
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+int SSLContext::ticketKeyCallback(SSL* ssl, unsigned char* key_name, unsigned char* iv,
+                                  EVP_CIPHER_CTX* cipher, EVP_MAC_CTX* mac, int encrypt) {
+    SSLContext* self = fromSSL(ssl);
+    if (!self || !self->ticket_keys_) {
+        return -1;
+    }
+
+    TicketKeyRing::Key key;
+    bool current = true;
+    int ok;
+    if (encrypt) {
+        key = self->ticket_keys_->encryptionKey();
+        std::memcpy(key_name, key.name, TicketKeyRing::NAME_SIZE);
+        ok = RAND_bytes(iv, EVP_CIPHER_get_iv_length(EVP_aes_256_cbc())) > 0 &&
+             EVP_EncryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) > 0;
+    } else {
+        if (!self->ticket_keys_->find(key_name, key, current)) {
+            return 0;  // unknown or retired key: full handshake, fresh ticket
+        }
+        ok = EVP_DecryptInit_ex(cipher, EVP_aes_256_cbc(), nullptr, key.aes_key, iv) > 0;
+    }
+
+    char digest[] = "SHA256";
+    OSSL_PARAM params[] = {
+        OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_key, sizeof(key.hmac_key)),
+        OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, digest, 0),
+        OSSL_PARAM_construct_end()
+    };
+    ok = ok && EVP_MAC_CTX_set_params(mac, params) > 0;
+    OPENSSL_cleanse(&key, sizeof(key));
+    if (!ok) {
+        return -1;
+    }
+    // 2 asks OpenSSL for a fresh ticket: needed when this one was sealed
+    // under an older key, and in TLS 1.3 always, since clients use each
+    // ticket once and otherwise run out after a single resumption
+    return encrypt || (current && SSL_version(ssl) < TLS1_3_VERSION) ? 1 : 2;
+}
+#endif
+#endif
+
 void* SSLContext::createSSL(int socket) {
 #ifdef SIMPLE_SFTPD_SSL_ENABLED
     if (!initialized_ || !ctx_) {
@@ -152,6 +345,9 @@ void* SSLContext::createSSL(int socket) {
         return nullptr;
     }
 
+    // Non-blocking sessions retry writes from a buffer that may have moved
+    SSL_set_mode(ssl, SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+
     return ssl;
 #else
     (void)socket;
@@ -159,24 +355,70 @@ void* SSLContext::createSSL(int socket) {
 #endif
 }
 
-bool SSLContext::acceptSSL(void* ssl) {
+TlsHandshakeStatus SSLContext::acceptStep(void* ssl) {
 #ifdef SIMPLE_SFTPD_SSL_ENABLED
     if (!ssl) {
-        return false;
+        return TlsHandshakeStatus::FAILED;
     }
 
     int ret = SSL_accept(static_cast<SSL*>(ssl));
-    if (ret <= 0) {
-        int err = SSL_get_error(static_cast<SSL*>(ssl), ret);
-        if (err != SSL_ERROR_WANT_READ && err != SSL_ERROR_WANT_WRITE) {
-            logSSLErrors();
-        }
+    if (ret == 1) {
+        return TlsHandshakeStatus::DONE;
+    }
+    switch (SSL_get_error(static_cast<SSL*>(ssl), ret)) {
+    case SSL_ERROR_WANT_READ:
+        return TlsHandshakeStatus::WANT_READ;
+    case SSL_ERROR_WANT_WRITE:
+        return TlsHandshakeStatus::WANT_WRITE;
+    default:
+        logSSLErrors();
+        return TlsHandshakeStatus::FAILED;
+    }
+#else
+    (void)ssl;
+    return TlsHandshakeStatus::FAILED;
+#endif
+}
+
+bool SSLContext::acceptSSL(void* ssl, std::chrono::milliseconds timeout) {
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+    if (!ssl) {
         return false;
     }
 
-    return true;
+    // Non-blocking for the duration, so no single read can outlast the deadline
+    int fd = SSL_get_fd(static_cast<SSL*>(ssl));
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags >= 0 && !(flags & O_NONBLOCK)) {
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    TlsHandshakeStatus status;
+    while ((status = acceptStep(ssl)) == TlsHandshakeStatus::WANT_READ || status == TlsHandshakeStatus::WANT_WRITE) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+        if (left.count() <= 0) {
+            logger_->warn("TLS handshake timed out");
+            status = TlsHandshakeStatus::FAILED;
+            break;
+        }
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = status == TlsHandshakeStatus::WANT_READ ? POLLIN : POLLOUT;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, static_cast<int>(std::min<int64_t>(left.count(), INT32_MAX))) < 0 && errno != EINTR) {
+            status = TlsHandshakeStatus::FAILED;
+            break;
+        }
+    }
+
+    if (flags >= 0 && !(flags & O_NONBLOCK)) {
+        fcntl(fd, F_SETFL, flags);
+    }
+    return status == TlsHandshakeStatus::DONE;
 #else
     (void)ssl;
+    (void)timeout;
     return false;
 #endif
 }
@@ -233,9 +475,126 @@ int SSLContext::writeSSL(void* ssl, const void* buf, int len) {
 #endif
 }
 
-void SSLContext::shutdownSSL(void* ssl) {
+bool SSLContext::shouldRetry(void* ssl, int ret) const {
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+    if (!ssl || ret > 0) {
+        return false;
+    }
+
+    int err = SSL_get_error(static_cast<SSL*>(ssl), ret);
+    return err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE;
+#else
+    (void)ssl;
+    (void)ret;
+    return false;
+#endif
+}
+
+bool SSLContext::isClosed(void* ssl, int ret) const {
 #ifdef SIMPLE_SFTPD_SSL_ENABLED
+    if (!ssl || ret > 0) {
+        return false;
+    }
+
+    return SSL_get_error(static_cast<SSL*>(ssl), ret) == SSL_ERROR_ZERO_RETURN;
+#else
+    (void)ssl;
+    (void)ret;
+    return false;
+#endif
+}
+
+bool SSLContext::isSessionReused(void* ssl) const {
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+    return ssl && SSL_session_reused(static_cast<SSL*>(ssl)) == 1;
+#else
+    (void)ssl;
+    return false;
+#endif
+}
+
+void SSLContext::enableKernelTls(void* ssl) {
+#ifdef SIMPLE_SFTPD_KTLS
     if (ssl) {
+        SSL_set_options(static_cast<SSL*>(ssl), SSL_OP_ENABLE_KTLS);
+    }
+#else
+    (void)ssl;
+#endif
+}
+
+bool SSLContext::isKernelTlsSend(void* ssl) const {
+#ifdef SIMPLE_SFTPD_KTLS
+    return ssl && BIO_get_ktls_send(SSL_get_wbio(static_cast<SSL*>(ssl)));
+#else
+    (void)ssl;
+    return false;
+#endif
+}
+
+bool SSLContext::isKernelTlsReceive(void* ssl) const {
+#ifdef SIMPLE_SFTPD_KTLS
+    return ssl && BIO_get_ktls_recv(SSL_get_rbio(static_cast<SSL*>(ssl)));
+#else
+    (void)ssl;
+    return false;
+#endif
+}
+
+long SSLContext::sendFile(void* ssl, int file_fd, uint64_t offset, size_t length) {
+#ifdef SIMPLE_SFTPD_KTLS
+    if (!ssl) {
+        return -1;
+    }
+
+    return SSL_sendfile(static_cast<SSL*>(ssl), file_fd, static_cast<off_t>(offset), length, 0);
+#else
+    (void)ssl;
+    (void)file_fd;
+    (void)offset;
+    (void)length;
+    return -1;
+#endif
+}
+
+bool SSLContext::isKernelTlsAvailable() {
+#ifdef SIMPLE_SFTPD_KTLS
+    // The tls ULP only attaches to a connected TCP socket, so try it on a
+    // loopback pair; the attempt also loads the module on demand
+    static const bool available = [] {
+        bool attached = false;
+        int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        int client = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t addr_len = sizeof(addr);
+        if (listener >= 0 && client >= 0 &&
+            bind(listener, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0 &&
+            listen(listener, 1) == 0 &&
+            getsockname(listener, reinterpret_cast<struct sockaddr*>(&addr), &addr_len) == 0 &&
+            connect(client, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+            attached = setsockopt(client, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) == 0;
+        }
+        if (client >= 0) {
+            close(client);
+        }
+        if (listener >= 0) {
+            close(listener);
+        }
+        return attached;
+    }();
+    return available;
+#else
+    return false;
+#endif
+}
+
+void SSLContext::shutdownSSL(void* ssl) {
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+    // Mid-handshake there is no session to close, only an error to queue
+    if (ssl && SSL_is_init_finished(static_cast<SSL*>(ssl))) {
         SSL_shutdown(static_cast<SSL*>(ssl));
     }
 #else
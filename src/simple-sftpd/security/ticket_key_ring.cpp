@@ -0,0 +1,235 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/security/ticket_key_ring.hpp"
+#include "simple-sftpd/utils/logger.hpp"
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <errno.h>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+namespace simple_sftpd {
+
+namespace {
+
+// Segment states; a layout change must change READY so old daemons and
+// new ones never share a ring they read differently
+const uint32_t STATE_INITIALIZING = 1;
+const uint32_t STATE_READY = 0x544b5231;  // "TKR1"
+
+// How long to wait for another process to finish setting up the segment
+// before assuming it died doing so
+const std::chrono::milliseconds ATTACH_TIMEOUT(1000);
+
+// getentropy() hands out at most 256 bytes per call
+void fillRandom(unsigned char* buffer, size_t length) {
+    while (length > 0) {
+        size_t chunk = std::min<size_t>(length, 256);
+        if (getentropy(buffer, chunk) != 0) {
+            throw std::runtime_error("getentropy failed: " + std::string(strerror(errno)));
+        }
+        buffer += chunk;
+        length -= chunk;
+    }
+}
+
+int64_t unixSeconds() {
+    return std::chrono::duration_cast<std::chrono::seconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+struct TicketKeyRing::Shared {
+    std::atomic<uint32_t> state;
+    pthread_mutex_t mutex;
+    uint64_t rotations;
+    int64_t rotated_at;  // when keys[current] was made, Unix seconds
+    uint32_t current;
+    Key keys[SLOTS];
+
+    void initialize() {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+#ifdef __linux__
+        pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+#endif
+        pthread_mutex_init(&mutex, &attr);
+        pthread_mutexattr_destroy(&attr);
+        rotations = 0;
+        rotated_at = unixSeconds();
+        current = 0;
+        fillRandom(reinterpret_cast<unsigned char*>(keys), sizeof(keys));
+    }
+};
+
+TicketKeyRing::TicketKeyRing(std::shared_ptr<Logger> logger, const std::string& shm_name,
+                             std::chrono::seconds rotation_interval)
+    : logger_(std::move(logger)), shared_(nullptr), named_(false),
+      rotation_seconds_(rotation_interval.count()), hits_(0), misses_(0) {
+    if (!shm_name.empty()) {
+        named_ = attach(shm_name);
+        if (!named_ && logger_) {
+            logger_->warn("Session ticket keys not shared: cannot use shared memory " + shm_name);
+        }
+    }
+    if (!named_) {
+        void* memory = mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        shared_ = new (memory) Shared();
+        shared_->initialize();
+        shared_->state.store(STATE_READY, std::memory_order_release);
+    }
+}
+
+TicketKeyRing::~TicketKeyRing() {
+    // A named segment outlives us on purpose: the next daemon keeps the keys
+    if (shared_) {
+        munmap(shared_, sizeof(Shared));
+    }
+}
+
+bool TicketKeyRing::attach(const std::string& shm_name) {
+    int fd = shm_open(shm_name.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    bool sized = fstat(fd, &st) == 0 &&
+                 (static_cast<size_t>(st.st_size) == sizeof(Shared) ||
+                  (st.st_size == 0 && ftruncate(fd, sizeof(Shared)) == 0));
+    void* memory = sized ? mmap(nullptr, sizeof(Shared), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if (memory == MAP_FAILED) {
+        return false;
+    }
+
+    // A fresh segment is all zeroes; exactly one process sets it up
+    shared_ = static_cast<Shared*>(memory);
+    uint32_t state = 0;
+    if (shared_->state.compare_exchange_strong(state, STATE_INITIALIZING, std::memory_order_acq_rel)) {
+        shared_->initialize();
+        shared_->state.store(STATE_READY, std::memory_order_release);
+        return true;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + ATTACH_TIMEOUT;
+    while (state == STATE_INITIALIZING && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        state = shared_->state.load(std::memory_order_acquire);
+    }
+    if (state == STATE_INITIALIZING) {
+        // The process setting it up died; finish the job
+        shared_->initialize();
+        shared_->state.store(STATE_READY, std::memory_order_release);
+        return true;
+    }
+    if (state != STATE_READY) {
+        // Written by an incompatible version
+        munmap(shared_, sizeof(Shared));
+        shared_ = nullptr;
+        return false;
+    }
+    return true;
+}
+
+void TicketKeyRing::lock() const {
+    int locked = pthread_mutex_lock(&shared_->mutex);
+#ifdef __linux__
+    if (locked == EOWNERDEAD) {
+        // rotateLocked() switches keys only once the new one is complete,
+        // so whatever the dead owner left is still consistent
+        pthread_mutex_consistent(&shared_->mutex);
+    }
+#else
+    (void)locked;
+#endif
+}
+
+void TicketKeyRing::unlock() const {
+    pthread_mutex_unlock(&shared_->mutex);
+}
+
+void TicketKeyRing::rotateLocked(int64_t now) {
+    uint32_t next = (shared_->current + 1) % SLOTS;
+    fillRandom(reinterpret_cast<unsigned char*>(&shared_->keys[next]), sizeof(Key));
+    shared_->rotated_at = now;
+    shared_->current = next;
+    shared_->rotations++;
+}
+
+TicketKeyRing::Key TicketKeyRing::encryptionKey() {
+    int64_t interval = rotation_seconds_.load(std::memory_order_relaxed);
+    int64_t now = unixSeconds();
+    lock();
+    if (interval > 0 && now - shared_->rotated_at >= interval) {
+        rotateLocked(now);
+    }
+    Key key = shared_->keys[shared_->current];
+    unlock();
+    return key;
+}
+
+bool TicketKeyRing::find(const unsigned char* name, Key& key, bool& current) {
+    bool found = false;
+    lock();
+    for (uint32_t slot = 0; slot < SLOTS; ++slot) {
+        if (std::memcmp(shared_->keys[slot].name, name, NAME_SIZE) == 0) {
+            key = shared_->keys[slot];
+            current = slot == shared_->current;
+            found = true;
+            break;
+        }
+    }
+    unlock();
+    (found ? hits_ : misses_).fetch_add(1, std::memory_order_relaxed);
+    return found;
+}
+
+void TicketKeyRing::rotate() {
+    int64_t now = unixSeconds();
+    lock();
+    rotateLocked(now);
+    unlock();
+}
+
+void TicketKeyRing::setRotationInterval(std::chrono::seconds interval) {
+    rotation_seconds_ = interval.count();
+}
+
+TicketKeyRing::Stats TicketKeyRing::getStats() const {
+    Stats stats;
+    lock();
+    stats.rotations = shared_->rotations;
+    unlock();
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.shared = named_;
+    return stats;
+}
+
+} // namespace simple_sftpd
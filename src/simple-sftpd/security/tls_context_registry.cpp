@@ -0,0 +1,53 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/security/tls_context_registry.hpp"
+#include <algorithm>
+#include <cctype>
+
+namespace simple_sftpd {
+
+namespace {
+
+std::string lowercase(std::string_view name) {
+    std::string lowered(name);
+    std::transform(lowered.begin(), lowered.end(), lowered.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return lowered;
+}
+
+} // namespace
+
+void TlsContextRegistry::add(const std::string& hostname, std::shared_ptr<SSLContext> context) {
+    contexts_[lowercase(hostname)] = std::move(context);
+}
+
+std::shared_ptr<SSLContext> TlsContextRegistry::find(std::string_view server_name) const {
+    std::string name = lowercase(server_name);
+    auto found = contexts_.find(name);
+    if (found != contexts_.end()) {
+        return found->second;
+    }
+
+    size_t dot = name.find('.');
+    if (dot == std::string::npos || dot == 0) {
+        return nullptr;
+    }
+    found = contexts_.find("*" + name.substr(dot));
+    return found != contexts_.end() ? found->second : nullptr;
+}
+
+} // namespace simple_sftpd
@@ -0,0 +1,106 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "simple-sftpd/security/tls_session_cache.hpp"
+#include <functional>
+#include <iterator>
+
+namespace simple_sftpd {
+
+TlsSessionCache::TlsSessionCache(size_t capacity, std::chrono::seconds lifetime)
+    : shard_capacity_(0), lifetime_seconds_(0), hits_(0), misses_(0), stores_(0), evictions_(0) {
+    setLimits(capacity, lifetime);
+}
+
+void TlsSessionCache::setLimits(size_t capacity, std::chrono::seconds lifetime) {
+    shard_capacity_ = (capacity + SHARDS - 1) / SHARDS;
+    lifetime_seconds_ = lifetime.count();
+}
+
+TlsSessionCache::Shard& TlsSessionCache::shardFor(std::string_view id) {
+    return shards_[std::hash<std::string_view>()(id) % SHARDS];
+}
+
+void TlsSessionCache::erase(Shard& shard, std::list<Entry>::iterator entry) {
+    shard.index.erase(std::string_view(entry->id));
+    shard.lru.erase(entry);
+}
+
+void TlsSessionCache::store(std::string_view id, std::string session) {
+    size_t capacity = shard_capacity_.load(std::memory_order_relaxed);
+    if (capacity == 0 || id.empty()) {
+        return;
+    }
+    auto expires = std::chrono::steady_clock::now() + std::chrono::seconds(lifetime_seconds_.load(std::memory_order_relaxed));
+
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.index.find(id);
+    if (found != shard.index.end()) {
+        erase(shard, found->second);
+    }
+    while (shard.lru.size() >= capacity) {
+        erase(shard, std::prev(shard.lru.end()));
+        evictions_.fetch_add(1, std::memory_order_relaxed);
+    }
+    shard.lru.push_front(Entry{std::string(id), std::move(session), expires});
+    shard.index.emplace(std::string_view(shard.lru.front().id), shard.lru.begin());
+    stores_.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool TlsSessionCache::lookup(std::string_view id, std::string& session) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.index.find(id);
+    if (found == shard.index.end()) {
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    if (found->second->expires <= std::chrono::steady_clock::now()) {
+        erase(shard, found->second);
+        misses_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, found->second);
+    session = found->second->session;
+    hits_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void TlsSessionCache::remove(std::string_view id) {
+    Shard& shard = shardFor(id);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto found = shard.index.find(id);
+    if (found != shard.index.end()) {
+        erase(shard, found->second);
+    }
+}
+
+TlsSessionCache::Stats TlsSessionCache::getStats() const {
+    Stats stats;
+    stats.hits = hits_.load(std::memory_order_relaxed);
+    stats.misses = misses_.load(std::memory_order_relaxed);
+    stats.stores = stores_.load(std::memory_order_relaxed);
+    stats.evictions = evictions_.load(std::memory_order_relaxed);
+    for (const Shard& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        stats.entries += shard.lru.size();
+    }
+    return stats;
+}
+
+} // namespace simple_sftpd
@@ -16,9 +16,17 @@
 
 #include "simple-sftpd/utils/performance_monitor.hpp"
 #include "simple-sftpd/utils/logger.hpp"
+#include "simple-sftpd/core/buffer_pool.hpp"
+#include "simple-sftpd/core/memory_accountant.hpp"
+#include "simple-sftpd/security/tls_session_cache.hpp"
+#include "simple-sftpd/security/ticket_key_ring.hpp"
 
 namespace simple_sftpd {
 
+const std::array<int, PerformanceMonitor::DATA_SETUP_BUCKETS - 1> PerformanceMonitor::DATA_SETUP_BUCKET_BOUNDS_MS = {
+    1, 10, 100, 500, 1000, 5000, 10000
+};
+
 PerformanceMonitor::PerformanceMonitor(std::shared_ptr<Logger> logger)
     : logger_(logger),
       total_connections_(0),
@@ -29,8 +37,18 @@ PerformanceMonitor::PerformanceMonitor(std::shared_ptr<Logger> logger)
       total_downloads_(0),
       total_requests_(0),
       total_errors_(0),
+      accept_queue_overflows_(0),
+      shard_count_(0),
+      data_connection_failures_(0),
+      tls_full_handshakes_(0),
+      tls_resumed_handshakes_(0),
+      tls_data_handshakes_(0),
+      tls_handshake_failures_(0),
       total_transfer_time_ms_(0),
       start_time_(std::chrono::steady_clock::now()) {
+    for (auto& bucket : data_setup_histogram_) {
+        bucket = 0;
+    }
 }
 
 void PerformanceMonitor::recordConnection() {
@@ -48,6 +66,137 @@ void PerformanceMonitor::recordActiveConnection() {
     // Already counted in recordConnection
 }
 
+void PerformanceMonitor::recordAcceptQueueOverflow() {
+    accept_queue_overflows_++;
+}
+
+void PerformanceMonitor::setListenerShards(size_t shard_count) {
+    shard_accepts_ = std::make_unique<std::atomic<uint64_t>[]>(shard_count);
+    for (size_t i = 0; i < shard_count; ++i) {
+        shard_accepts_[i] = 0;
+    }
+    shard_count_ = shard_count;
+}
+
+void PerformanceMonitor::recordShardAccept(size_t shard_index) {
+    if (shard_index < shard_count_) {
+        shard_accepts_[shard_index].fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+std::vector<uint64_t> PerformanceMonitor::getShardAccepts() const {
+    std::vector<uint64_t> accepts;
+    accepts.reserve(shard_count_);
+    for (size_t i = 0; i < shard_count_; ++i) {
+        accepts.push_back(shard_accepts_[i].load(std::memory_order_relaxed));
+    }
+    return accepts;
+}
+
+void PerformanceMonitor::recordDataConnectionSetup(std::chrono::microseconds elapsed, bool established) {
+    if (!established) {
+        data_connection_failures_++;
+        return;
+    }
+    
+    size_t bucket = 0;
+    while (bucket < DATA_SETUP_BUCKET_BOUNDS_MS.size() &&
+           elapsed >= std::chrono::milliseconds(DATA_SETUP_BUCKET_BOUNDS_MS[bucket])) {
+        ++bucket;
+    }
+    data_setup_histogram_[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+std::vector<uint64_t> PerformanceMonitor::getDataConnectionSetupHistogram() const {
+    std::vector<uint64_t> histogram;
+    histogram.reserve(DATA_SETUP_BUCKETS);
+    for (const auto& bucket : data_setup_histogram_) {
+        histogram.push_back(bucket.load(std::memory_order_relaxed));
+    }
+    return histogram;
+}
+
+void PerformanceMonitor::recordTlsHandshake(bool data_channel, bool resumed) {
+    if (resumed) {
+        tls_resumed_handshakes_++;
+    } else {
+        tls_full_handshakes_++;
+    }
+    if (data_channel) {
+        tls_data_handshakes_++;
+    }
+}
+
+void PerformanceMonitor::recordTlsHandshakeFailure() {
+    tls_handshake_failures_++;
+}
+
+double PerformanceMonitor::getTlsResumptionRate() const {
+    uint64_t resumed = tls_resumed_handshakes_;
+    uint64_t total = tls_full_handshakes_ + resumed;
+    return total > 0 ? static_cast<double>(resumed) / total : 0.0;
+}
+
+void PerformanceMonitor::setTlsSessionCache(std::shared_ptr<const TlsSessionCache> cache) {
+    tls_session_cache_ = cache;
+}
+
+void PerformanceMonitor::setTicketKeyRing(std::shared_ptr<const TicketKeyRing> ring) {
+    ticket_keys_ = ring;
+}
+
+uint64_t PerformanceMonitor::getTlsSessionCacheHits() const {
+    return tls_session_cache_ ? tls_session_cache_->getStats().hits : 0;
+}
+
+uint64_t PerformanceMonitor::getTlsSessionCacheMisses() const {
+    return tls_session_cache_ ? tls_session_cache_->getStats().misses : 0;
+}
+
+uint64_t PerformanceMonitor::getTlsTicketHits() const {
+    return ticket_keys_ ? ticket_keys_->getStats().hits : 0;
+}
+
+uint64_t PerformanceMonitor::getTlsTicketMisses() const {
+    return ticket_keys_ ? ticket_keys_->getStats().misses : 0;
+}
+
+void PerformanceMonitor::setBufferPool(std::shared_ptr<const BufferPool> pool) {
+    buffer_pool_ = pool;
+}
+
+uint64_t PerformanceMonitor::getBufferPoolHits() const {
+    return buffer_pool_ ? buffer_pool_->getStats().hits : 0;
+}
+
+uint64_t PerformanceMonitor::getBufferPoolMisses() const {
+    return buffer_pool_ ? buffer_pool_->getStats().misses : 0;
+}
+
+uint64_t PerformanceMonitor::getBufferBytesInUse() const {
+    return buffer_pool_ ? buffer_pool_->getStats().bytes_in_use : 0;
+}
+
+void PerformanceMonitor::setMemoryAccountant(std::shared_ptr<const MemoryAccountant> accountant) {
+    memory_accountant_ = accountant;
+}
+
+uint64_t PerformanceMonitor::getMemoryBytesInUse() const {
+    return memory_accountant_ ? memory_accountant_->getStats().bytes_in_use : 0;
+}
+
+uint64_t PerformanceMonitor::getMemoryBudget() const {
+    return memory_accountant_ ? memory_accountant_->getStats().budget : 0;
+}
+
+uint64_t PerformanceMonitor::getMemoryRefusals() const {
+    return memory_accountant_ ? memory_accountant_->getStats().refused : 0;
+}
+
+uint64_t PerformanceMonitor::getMemoryPauses() const {
+    return memory_accountant_ ? memory_accountant_->getStats().pauses : 0;
+}
+
 void PerformanceMonitor::recordTransfer(size_t bytes, bool upload) {
     total_transfers_++;
     total_bytes_transferred_ += bytes;
@@ -96,6 +245,18 @@ void PerformanceMonitor::reset() {
     total_downloads_ = 0;
     total_requests_ = 0;
     total_errors_ = 0;
+    accept_queue_overflows_ = 0;
+    for (size_t i = 0; i < shard_count_; ++i) {
+        shard_accepts_[i] = 0;
+    }
+    for (auto& bucket : data_setup_histogram_) {
+        bucket = 0;
+    }
+    data_connection_failures_ = 0;
+    tls_full_handshakes_ = 0;
+    tls_resumed_handshakes_ = 0;
+    tls_data_handshakes_ = 0;
+    tls_handshake_failures_ = 0;
     total_transfer_time_ms_ = 0;
     start_time_ = std::chrono::steady_clock::now();
 }
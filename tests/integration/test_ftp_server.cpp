@@ -16,11 +16,38 @@
 
 #include <gtest/gtest.h>
 #include "simple-sftpd/core/server.hpp"
+#include "simple-sftpd/core/connection.hpp"
+#include "simple-sftpd/core/admission_controller.hpp"
+#include "simple-sftpd/core/listener_handoff.hpp"
+#include "simple-sftpd/core/memory_accountant.hpp"
+#include "simple-sftpd/config/config_store.hpp"
 #include "simple-sftpd/config/server_config.hpp"
 #include "simple-sftpd/utils/logger.hpp"
+#include "simple-sftpd/utils/performance_monitor.hpp"
+#include <atomic>
+#include <future>
 #include <memory>
 #include <thread>
 #include <chrono>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include <sys/time.h>
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+#include <openssl/ssl.h>
+#include <openssl/ec.h>
+#include <openssl/pem.h>
+#include <openssl/x509.h>
+#endif
 
 using namespace simple_sftpd;
 
@@ -55,3 +82,1378 @@ TEST_F(FTPServerIntegrationTest, IsRunningInitiallyFalse) {
     EXPECT_FALSE(server_->isRunning());
 }
 
+
+static int connectTo(int port) {
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    if (client >= 0 && connect(client, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+        close(client);
+        return -1;
+    }
+    return client;
+}
+
+TEST_F(FTPServerIntegrationTest, AcceptsConnectionAndSendsBanner) {
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22121;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    int client = connectTo(22121);
+    ASSERT_GE(client, 0);
+
+    char banner[64] = {0};
+    ssize_t received = recv(client, banner, sizeof(banner) - 1, 0);
+    close(client);
+
+    ASSERT_GT(received, 3);
+    EXPECT_EQ(std::string(banner, 3), "220");
+}
+
+TEST_F(FTPServerIntegrationTest, ShardedListenersCountAccepts) {
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22122;
+    config_->connection.listener_shards = 4;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+    EXPECT_EQ(server_->getListenerShardCount(), 4U);
+
+    const int clients = 16;
+    for (int i = 0; i < clients; ++i) {
+        int client = connectTo(22122);
+        ASSERT_GE(client, 0);
+        char banner[64];
+        EXPECT_GT(recv(client, banner, sizeof(banner), 0), 0);
+        close(client);
+    }
+
+    auto accepts = server_->getPerformanceMonitor()->getShardAccepts();
+    ASSERT_EQ(accepts.size(), 4U);
+    uint64_t total = 0;
+    for (uint64_t count : accepts) {
+        total += count;
+    }
+    EXPECT_EQ(total, static_cast<uint64_t>(clients));
+}
+
+static std::string readUntil(int client, const std::string& needle) {
+    struct timeval timeout;
+    timeout.tv_sec = 5;
+    timeout.tv_usec = 0;
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    std::string received;
+    char buffer[256];
+    while (received.find(needle) == std::string::npos) {
+        ssize_t n = recv(client, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            break;
+        }
+        received.append(buffer, n);
+    }
+    return received;
+}
+
+TEST_F(FTPServerIntegrationTest, ReactorEngineHandlesPipelinedCommands) {
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22123;
+    config_->connection.engine = "reactor";
+    config_->connection.event_loop_threads = 2;
+    config_->connection.worker_threads = 2;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+    EXPECT_EQ(server_->getEventLoopCount(), 2U);
+
+    const int clients = 8;
+    std::vector<int> sockets;
+    for (int i = 0; i < clients; ++i) {
+        int client = connectTo(22123);
+        ASSERT_GE(client, 0);
+        EXPECT_EQ(readUntil(client, "\r\n").substr(0, 3), "220");
+        sockets.push_back(client);
+    }
+
+    // Several commands in one segment, including one that runs on a worker
+    for (int client : sockets) {
+        std::string commands = "USER test\r\nPASS test\r\nPWD\r\nMKD reactor_test_dir\r\nRMD reactor_test_dir\r\nNOOP\r\n";
+        ASSERT_EQ(send(client, commands.data(), commands.size(), 0), static_cast<ssize_t>(commands.size()));
+    }
+    for (int client : sockets) {
+        std::string replies = readUntil(client, "200 NOOP");
+        EXPECT_NE(replies.find("331 "), std::string::npos);
+        EXPECT_NE(replies.find("230 "), std::string::npos);
+        EXPECT_NE(replies.find("257 \""), std::string::npos);
+        EXPECT_NE(replies.find("200 NOOP"), std::string::npos);
+    }
+
+    for (int client : sockets) {
+        send(client, "QUIT\r\n", 6, 0);
+        EXPECT_NE(readUntil(client, "221").find("221"), std::string::npos);
+        close(client);
+    }
+}
+
+TEST_F(FTPServerIntegrationTest, RepliesToPipelinedCommandsAreCoalesced) {
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22124;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    int client = connectTo(22124);
+    ASSERT_GE(client, 0);
+    EXPECT_EQ(readUntil(client, "\r\n").substr(0, 3), "220");
+
+    std::string commands = "FEAT\r\nSYST\r\nNOOP\r\n";
+    ASSERT_EQ(send(client, commands.data(), commands.size(), 0), static_cast<ssize_t>(commands.size()));
+
+    // Multi-line FEAT plus two single-line replies arrive as one write
+    char buffer[512] = {0};
+    ssize_t received = recv(client, buffer, sizeof(buffer) - 1, 0);
+    ASSERT_GT(received, 0);
+    std::string replies(buffer, received);
+    EXPECT_EQ(replies.find("211-Features:"), 0U);
+    EXPECT_NE(replies.find("211 End\r\n215 "), std::string::npos);
+    EXPECT_NE(replies.find("200 NOOP"), std::string::npos);
+
+    close(client);
+}
+
+static int openPassiveData(int control) {
+    send(control, "PASV\r\n", 6, 0);
+    std::string reply = readUntil(control, ")\r\n");
+    size_t open = reply.find('(');
+    if (reply.compare(0, 3, "227") != 0 || open == std::string::npos) {
+        return -1;
+    }
+    int h1, h2, h3, h4, p1, p2;
+    if (sscanf(reply.c_str() + open, "(%d,%d,%d,%d,%d,%d)", &h1, &h2, &h3, &h4, &p1, &p2) != 6) {
+        return -1;
+    }
+    return connectTo(p1 * 256 + p2);
+}
+
+static std::string readAll(int fd) {
+    std::string data;
+    char buffer[65536];
+    ssize_t n;
+    while ((n = recv(fd, buffer, sizeof(buffer), 0)) > 0) {
+        data.append(buffer, n);
+    }
+    return data;
+}
+
+TEST_F(FTPServerIntegrationTest, RetrSendsWholeFileAndHonoursRest) {
+    const std::string path = "/tmp/simple_sftpd_retr_test.bin";
+    std::string content;
+    for (int i = 0; i < 300000; ++i) {
+        content += static_cast<char>((i * 131) & 0xff);
+    }
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << content;
+    }
+
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22125;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    int control = connectTo(22125);
+    ASSERT_GE(control, 0);
+    readUntil(control, "\r\n");
+    std::string login = "USER test\r\nPASS test\r\nTYPE I\r\n";
+    send(control, login.data(), login.size(), 0);
+    ASSERT_NE(readUntil(control, "200 Type").find("200 Type"), std::string::npos);
+
+    int data = openPassiveData(control);
+    ASSERT_GE(data, 0);
+    send(control, "RETR simple_sftpd_retr_test.bin\r\n", 33, 0);
+    EXPECT_EQ(readAll(data), content);
+    close(data);
+    EXPECT_NE(readUntil(control, "226").find("226"), std::string::npos);
+
+    data = openPassiveData(control);
+    ASSERT_GE(data, 0);
+    send(control, "REST 100000\r\n", 13, 0);
+    EXPECT_NE(readUntil(control, "350").find("350"), std::string::npos);
+    send(control, "RETR simple_sftpd_retr_test.bin\r\n", 33, 0);
+    EXPECT_EQ(readAll(data), content.substr(100000));
+    close(data);
+    EXPECT_NE(readUntil(control, "226").find("226"), std::string::npos);
+
+    close(control);
+    std::remove(path.c_str());
+}
+
+TEST_F(FTPServerIntegrationTest, StorAndAppeWriteUploadedBytes) {
+    const std::string path = "/tmp/simple_sftpd_stor_test.bin";
+    std::remove(path.c_str());
+    std::string content;
+    for (int i = 0; i < 300000; ++i) {
+        content += static_cast<char>((i * 137) & 0xff);
+    }
+
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22126;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    int control = connectTo(22126);
+    ASSERT_GE(control, 0);
+    readUntil(control, "\r\n");
+    std::string login = "USER test\r\nPASS test\r\nTYPE I\r\n";
+    send(control, login.data(), login.size(), 0);
+    ASSERT_NE(readUntil(control, "200 Type").find("200 Type"), std::string::npos);
+
+    auto upload = [&](const std::string& command, const std::string& payload) {
+        int data = openPassiveData(control);
+        ASSERT_GE(data, 0);
+        send(control, command.data(), command.size(), 0);
+        ASSERT_EQ(send(data, payload.data(), payload.size(), 0), static_cast<ssize_t>(payload.size()));
+        close(data);
+        EXPECT_NE(readUntil(control, "226").find("226"), std::string::npos);
+    };
+    auto stored = [&]() {
+        std::ifstream file(path, std::ios::binary);
+        return std::string(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    };
+
+    upload("STOR simple_sftpd_stor_test.bin\r\n", content);
+    EXPECT_EQ(stored(), content);
+
+    // Resume rewrites the tail in place without truncating the head
+    send(control, "REST 100000\r\n", 13, 0);
+    EXPECT_NE(readUntil(control, "350").find("350"), std::string::npos);
+    upload("STOR simple_sftpd_stor_test.bin\r\n", std::string(1000, 'x'));
+    std::string expected = content;
+    expected.replace(100000, 1000, std::string(1000, 'x'));
+    EXPECT_EQ(stored(), expected);
+
+    upload("APPE simple_sftpd_stor_test.bin\r\n", "tail");
+    EXPECT_EQ(stored(), expected + "tail");
+
+    close(control);
+    std::remove(path.c_str());
+}
+
+TEST_F(FTPServerIntegrationTest, IoUringEngineMovesFilesBothWays) {
+    const std::string path = "/tmp/simple_sftpd_uring_test.bin";
+    std::remove(path.c_str());
+    // Several ring buffers' worth, with a ragged tail
+    std::string content;
+    for (int i = 0; i < 1500000; ++i) {
+        content += static_cast<char>((i * 151) & 0xff);
+    }
+
+    // Falls back to sendfile/splice where the kernel has no io_uring
+    config_->connection.transfer_engine = "io_uring";
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22127;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    int control = connectTo(22127);
+    ASSERT_GE(control, 0);
+    readUntil(control, "\r\n");
+    std::string login = "USER test\r\nPASS test\r\nTYPE I\r\n";
+    send(control, login.data(), login.size(), 0);
+    ASSERT_NE(readUntil(control, "200 Type").find("200 Type"), std::string::npos);
+
+    int data = openPassiveData(control);
+    ASSERT_GE(data, 0);
+    send(control, "STOR simple_sftpd_uring_test.bin\r\n", 34, 0);
+    ASSERT_EQ(send(data, content.data(), content.size(), 0), static_cast<ssize_t>(content.size()));
+    close(data);
+    EXPECT_NE(readUntil(control, "226").find("226"), std::string::npos);
+
+    data = openPassiveData(control);
+    ASSERT_GE(data, 0);
+    send(control, "RETR simple_sftpd_uring_test.bin\r\n", 34, 0);
+    EXPECT_EQ(readAll(data), content);
+    close(data);
+    EXPECT_NE(readUntil(control, "226").find("226"), std::string::npos);
+
+    data = openPassiveData(control);
+    ASSERT_GE(data, 0);
+    send(control, "REST 700001\r\n", 13, 0);
+    EXPECT_NE(readUntil(control, "350").find("350"), std::string::npos);
+    send(control, "RETR simple_sftpd_uring_test.bin\r\n", 34, 0);
+    EXPECT_EQ(readAll(data), content.substr(700001));
+    close(data);
+    EXPECT_NE(readUntil(control, "226").find("226"), std::string::npos);
+
+    close(control);
+    std::remove(path.c_str());
+}
+
+TEST_F(FTPServerIntegrationTest, ReactorWaitsForDataConnectionsOnTheLoop) {
+    const std::string path = "/tmp/simple_sftpd_async_data_test.txt";
+    const std::string content = "parked until the data connection arrives\n";
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << content;
+    }
+
+    // A single worker: if waiting for a data connection pinned it, the
+    // second session's transfer could not run until the first gave up
+    config_->connection.engine = "reactor";
+    config_->connection.event_loop_threads = 1;
+    config_->connection.worker_threads = 1;
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22128;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    std::string login = "USER test\r\nPASS test\r\nTYPE I\r\n";
+    int slow = connectTo(22128);
+    int fast = connectTo(22128);
+    ASSERT_GE(slow, 0);
+    ASSERT_GE(fast, 0);
+    for (int control : {slow, fast}) {
+        readUntil(control, "\r\n");
+        send(control, login.data(), login.size(), 0);
+        ASSERT_NE(readUntil(control, "200 Type").find("200 Type"), std::string::npos);
+    }
+
+    // The slow client asks for the file but does not connect yet
+    std::string pasv = "PASV\r\n";
+    send(slow, pasv.data(), pasv.size(), 0);
+    std::string reply = readUntil(slow, ")");
+    size_t open_paren = reply.find('(');
+    ASSERT_NE(open_paren, std::string::npos);
+    int h1, h2, h3, h4, p1, p2;
+    ASSERT_EQ(sscanf(reply.c_str() + open_paren, "(%d,%d,%d,%d,%d,%d)", &h1, &h2, &h3, &h4, &p1, &p2), 6);
+    send(slow, "RETR simple_sftpd_async_data_test.txt\r\n", 39, 0);
+
+    // The fast client uses active mode: the server connects back to us
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(22129);
+    int reuse = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    ASSERT_EQ(bind(listener, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    ASSERT_EQ(listen(listener, 1), 0);
+    std::string port = "PORT 127,0,0,1," + std::to_string(22129 / 256) + "," + std::to_string(22129 % 256) + "\r\n";
+    send(fast, port.data(), port.size(), 0);
+    ASSERT_NE(readUntil(fast, "200 PORT").find("200 PORT"), std::string::npos);
+    send(fast, "RETR simple_sftpd_async_data_test.txt\r\n", 39, 0);
+    int active_data = accept(listener, nullptr, nullptr);
+    ASSERT_GE(active_data, 0);
+    EXPECT_EQ(readAll(active_data), content);
+    close(active_data);
+    EXPECT_NE(readUntil(fast, "226").find("226"), std::string::npos);
+    close(listener);
+
+    // Now the slow client shows up and still gets its file
+    int passive_data = connectTo(p1 * 256 + p2);
+    ASSERT_GE(passive_data, 0);
+    EXPECT_EQ(readAll(passive_data), content);
+    close(passive_data);
+    EXPECT_NE(readUntil(slow, "226").find("226"), std::string::npos);
+
+    uint64_t established = 0;
+    for (uint64_t count : server_->getPerformanceMonitor()->getDataConnectionSetupHistogram()) {
+        established += count;
+    }
+    EXPECT_EQ(established, 2u);
+
+    close(slow);
+    close(fast);
+    std::remove(path.c_str());
+}
+
+TEST_F(FTPServerIntegrationTest, DataConnectionTimeoutRepliesWithoutDroppingTheSession) {
+    config_->connection.engine = "reactor";
+    config_->connection.data_connection_timeout_seconds = 1;
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22130;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    int control = connectTo(22130);
+    ASSERT_GE(control, 0);
+    readUntil(control, "\r\n");
+    std::string commands = "USER test\r\nPASS test\r\nPASV\r\n";
+    send(control, commands.data(), commands.size(), 0);
+    ASSERT_NE(readUntil(control, "227").find("227"), std::string::npos);
+
+    auto started = std::chrono::steady_clock::now();
+    send(control, "LIST\r\nNOOP\r\n", 12, 0);
+    std::string replies = readUntil(control, "200 NOOP");
+    auto waited = std::chrono::steady_clock::now() - started;
+    EXPECT_NE(replies.find("425"), std::string::npos);
+    EXPECT_LT(replies.find("425"), replies.find("200 NOOP"));
+    EXPECT_GE(waited, std::chrono::milliseconds(900));
+    EXPECT_LT(waited, std::chrono::seconds(3));
+    EXPECT_EQ(server_->getPerformanceMonitor()->getDataConnectionFailures(), 1u);
+
+    close(control);
+}
+
+TEST_F(FTPServerIntegrationTest, LoginAndIdleTimeoutsCloseTheControlConnection) {
+    const int ports[] = {22131, 22132};
+    const char* engines[] = {"threads", "reactor"};
+    for (int i = 0; i < 2; ++i) {
+        SCOPED_TRACE(engines[i]);
+        config_->connection.engine = engines[i];
+        config_->connection.login_timeout_seconds = 1;
+        config_->connection.timeout_seconds = 2;
+        config_->connection.bind_address = "127.0.0.1";
+        config_->connection.bind_port = ports[i];
+        server_ = std::make_shared<FTPServer>(config_);
+        ASSERT_TRUE(server_->start());
+
+        int lurker = connectTo(ports[i]);
+        int idler = connectTo(ports[i]);
+        ASSERT_GE(lurker, 0);
+        ASSERT_GE(idler, 0);
+        readUntil(lurker, "\r\n");
+        readUntil(idler, "\r\n");
+        std::string login = "USER test\r\nPASS test\r\n";
+        send(idler, login.data(), login.size(), 0);
+        ASSERT_NE(readUntil(idler, "230").find("230"), std::string::npos);
+
+        auto started = std::chrono::steady_clock::now();
+        std::string replies = readUntil(lurker, "\r\n");
+        EXPECT_EQ(replies.compare(0, 3, "421"), 0) << replies;
+        EXPECT_EQ(readAll(lurker), "");  // and the server hung up
+        auto lurked = std::chrono::steady_clock::now() - started;
+        EXPECT_GE(lurked, std::chrono::milliseconds(900));
+        EXPECT_LT(lurked, std::chrono::seconds(3));
+
+        // Logged in, so only the longer idle limit applies
+        replies = readUntil(idler, "421");
+        EXPECT_NE(replies.find("421"), std::string::npos);
+        EXPECT_GE(std::chrono::steady_clock::now() - started, std::chrono::milliseconds(1900));
+
+        close(lurker);
+        close(idler);
+        server_->stop();
+    }
+}
+
+TEST_F(FTPServerIntegrationTest, StalledUploadIsAbortedByTheWatchdog) {
+    config_->connection.engine = "reactor";
+    config_->connection.data_stall_timeout_seconds = 1;
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22133;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    int control = connectTo(22133);
+    ASSERT_GE(control, 0);
+    readUntil(control, "\r\n");
+    std::string login = "USER test\r\nPASS test\r\nTYPE I\r\n";
+    send(control, login.data(), login.size(), 0);
+    ASSERT_NE(readUntil(control, "200 Type").find("200 Type"), std::string::npos);
+
+    int data = openPassiveData(control);
+    ASSERT_GE(data, 0);
+    send(control, "STOR simple_sftpd_stall_test.bin\r\n", 34, 0);
+    ASSERT_NE(readUntil(control, "150").find("150"), std::string::npos);
+    send(data, "partial", 7, 0);  // then nothing, without closing
+
+    auto started = std::chrono::steady_clock::now();
+    EXPECT_NE(readUntil(control, "426").find("426"), std::string::npos);
+    EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(4));
+
+    // The session itself carries on
+    send(control, "NOOP\r\n", 6, 0);
+    EXPECT_NE(readUntil(control, "200").find("200"), std::string::npos);
+
+    close(data);
+    close(control);
+    std::remove("/tmp/simple_sftpd_stall_test.bin");
+}
+
+TEST_F(FTPServerIntegrationTest, StoppingCutsOffSlowTransfers) {
+    const std::string name = "simple_sftpd_slow_" + std::to_string(getpid()) + ".bin";
+    std::ofstream("/tmp/" + name, std::ios::binary) << std::string(4 << 20, 'x');
+
+    struct Setup {
+        const char* engine;
+        int port;
+    };
+    for (const Setup& setup : {Setup{"reactor", 22146}, Setup{"threads", 22147}}) {
+        SCOPED_TRACE(setup.engine);
+        config_->connection.engine = setup.engine;
+        config_->connection.bind_address = "127.0.0.1";
+        config_->connection.bind_port = setup.port;
+        config_->rate_limit.max_transfer_rate = 64 * 1024;  // about a minute for the whole file
+        server_ = std::make_shared<FTPServer>(config_);
+        ASSERT_TRUE(server_->start());
+
+        int control = connectTo(setup.port);
+        ASSERT_GE(control, 0);
+        readUntil(control, "\r\n");
+        std::string login = "USER test\r\nPASS test\r\nTYPE I\r\n";
+        send(control, login.data(), login.size(), 0);
+        ASSERT_NE(readUntil(control, "200 Type").find("200 Type"), std::string::npos);
+        int data = openPassiveData(control);
+        ASSERT_GE(data, 0);
+        std::string retr = "RETR " + name + "\r\n";
+        send(control, retr.data(), retr.size(), 0);
+        ASSERT_NE(readUntil(control, "150").find("150"), std::string::npos);
+        char first[1024];
+        ASSERT_GT(recv(data, first, sizeof(first), 0), 0);
+
+        // Stopping does not wait for the transfer to finish
+        auto stopping = std::chrono::steady_clock::now();
+        server_->stop();
+        EXPECT_LT(std::chrono::steady_clock::now() - stopping, std::chrono::seconds(3));
+
+        struct timeval timeout = {5, 0};
+        setsockopt(data, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        EXPECT_LT(readAll(data).size(), size_t(4 << 20));
+        close(data);
+        close(control);
+    }
+    std::remove(("/tmp/" + name).c_str());
+}
+
+TEST_F(FTPServerIntegrationTest, UpgradeHandsListenersOverWithoutRefusingConnections) {
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22134;
+    config_->connection.listener_shards = 2;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    int existing = connectTo(22134);
+    ASSERT_GE(existing, 0);
+    readUntil(existing, "\r\n");
+    std::string login = "USER test\r\nPASS test\r\n";
+    send(existing, login.data(), login.size(), 0);
+    ASSERT_NE(readUntil(existing, "230").find("230"), std::string::npos);
+
+    // Keep connecting for the whole switch-over
+    std::atomic<bool> switching(true);
+    std::atomic<int> refused(0);
+    std::atomic<int> greeted(0);
+    std::thread prober([&] {
+        while (switching) {
+            int client = connectTo(22134);
+            if (client < 0) {
+                ++refused;
+                continue;
+            }
+            if (readUntil(client, "220").find("220") != std::string::npos) {
+                ++greeted;
+            }
+            close(client);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+    });
+
+    std::string path = "/tmp/simple_sftpd_upgrade_" + std::to_string(getpid()) + ".sock";
+    ListenerHandoff old_side(logger_, path);
+    ASSERT_TRUE(old_side.listen());
+    bool handed_off = false;
+    std::thread old_thread([&] {
+        struct pollfd pfd;
+        pfd.fd = old_side.getSocket();
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 5000) > 0) {
+            handed_off = old_side.handOff(server_->getListenerSockets(), std::chrono::seconds(5));
+        }
+    });
+
+    auto successor_config = std::make_shared<FTPServerConfig>(*config_);
+    successor_config->connection.engine = "reactor";
+    auto successor = std::make_shared<FTPServer>(successor_config);
+    ListenerHandoff new_side(logger_, path);
+    std::vector<int> listeners;
+    ASSERT_TRUE(new_side.fetch(listeners));
+    EXPECT_EQ(listeners.size(), 2u);
+    successor->adoptListeners(listeners);
+    ASSERT_TRUE(successor->start());
+    EXPECT_EQ(successor->getListenerShardCount(), 2u);
+    EXPECT_TRUE(new_side.acknowledge());
+    old_thread.join();
+    ASSERT_TRUE(handed_off);
+
+    auto drained = std::async(std::launch::async, [&] { return server_->drain(std::chrono::seconds(10)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+
+    // The old process still serves the session it already had
+    send(existing, "NOOP\r\n", 6, 0);
+    EXPECT_NE(readUntil(existing, "200").find("200"), std::string::npos);
+    send(existing, "QUIT\r\n", 6, 0);
+    EXPECT_NE(readUntil(existing, "221").find("221"), std::string::npos);
+    close(existing);
+
+    ASSERT_EQ(drained.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(drained.get(), 0u);
+    EXPECT_FALSE(server_->isRunning());
+
+    // Only the successor is left accepting
+    int after = connectTo(22134);
+    ASSERT_GE(after, 0);
+    EXPECT_NE(readUntil(after, "220").find("220"), std::string::npos);
+    close(after);
+
+    switching = false;
+    prober.join();
+    EXPECT_EQ(refused, 0);
+    EXPECT_GT(greeted, 0);
+    successor->stop();
+}
+
+TEST_F(FTPServerIntegrationTest, DrainCutsOffTransfersStillRunningAtTheDeadline) {
+    const std::string name = "simple_sftpd_drain_" + std::to_string(getpid()) + ".bin";
+    std::ofstream("/tmp/" + name, std::ios::binary) << std::string(4 << 20, 'x');
+    config_->connection.engine = "reactor";
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22148;
+    config_->rate_limit.max_transfer_rate = 64 * 1024;  // about a minute for the whole file
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    int control = connectTo(22148);
+    ASSERT_GE(control, 0);
+    readUntil(control, "\r\n");
+    std::string login = "USER test\r\nPASS test\r\nTYPE I\r\n";
+    send(control, login.data(), login.size(), 0);
+    ASSERT_NE(readUntil(control, "200 Type").find("200 Type"), std::string::npos);
+    int data = openPassiveData(control);
+    ASSERT_GE(data, 0);
+    std::string retr = "RETR " + name + "\r\n";
+    send(control, retr.data(), retr.size(), 0);
+    ASSERT_NE(readUntil(control, "150").find("150"), std::string::npos);
+
+    // The download outlasts the upgrade window, so it is the one session cut off
+    auto draining = std::chrono::steady_clock::now();
+    EXPECT_EQ(server_->drain(std::chrono::seconds(1)), 1u);
+    EXPECT_LT(std::chrono::steady_clock::now() - draining, std::chrono::seconds(3));
+    EXPECT_FALSE(server_->isRunning());
+
+    struct timeval timeout = {5, 0};
+    setsockopt(data, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    EXPECT_LT(readAll(data).size(), size_t(4 << 20));
+    close(data);
+    close(control);
+    std::remove(("/tmp/" + name).c_str());
+}
+
+TEST_F(FTPServerIntegrationTest, ReloadAppliesToNewSessionsWithoutDroppingExisting) {
+    config_->connection.engine = "reactor";
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22135;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    int existing = connectTo(22135);
+    ASSERT_GE(existing, 0);
+    readUntil(existing, "\r\n");
+    std::string login = "USER test\r\nPASS test\r\n";
+    send(existing, login.data(), login.size(), 0);
+    ASSERT_NE(readUntil(existing, "230").find("230"), std::string::npos);
+
+    auto blocking = std::make_shared<FTPServerConfig>(*config_);
+    blocking->security.blocked_ips = {"127.0.0.0/8"};
+    blocking->connection.timeout_seconds = 1;
+    uint64_t version = server_->getConfigStore()->version();
+    server_->reload(blocking);
+    EXPECT_NE(server_->getConfigStore()->version(), version);
+
+    // New connections are judged by the new lists
+    int rejected = connectTo(22135);
+    ASSERT_GE(rejected, 0);
+    EXPECT_EQ(readAll(rejected), "");
+    close(rejected);
+
+    // The logged-in session carries on and picks up the new idle limit
+    send(existing, "NOOP\r\n", 6, 0);
+    EXPECT_NE(readUntil(existing, "200").find("200"), std::string::npos);
+    auto started = std::chrono::steady_clock::now();
+    send(existing, "NOOP\r\n", 6, 0);
+    std::string replies = readUntil(existing, "421");
+    EXPECT_NE(replies.find("421"), std::string::npos) << replies;
+    EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(3));
+    close(existing);
+
+    server_->reload(std::make_shared<FTPServerConfig>(*config_));
+    int admitted = connectTo(22135);
+    ASSERT_GE(admitted, 0);
+    EXPECT_NE(readUntil(admitted, "220").find("220"), std::string::npos);
+    close(admitted);
+    server_->stop();
+}
+
+#ifdef SIMPLE_SFTPD_SSL_ENABLED
+// Self-signed P-256 certificate, written as PEM
+static bool writeTestCertificate(const std::string& cert_path, const std::string& key_path,
+                                 const char* common_name = "127.0.0.1", long serial = 1) {
+    EVP_PKEY* key = nullptr;
+    EVP_PKEY_CTX* key_ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, nullptr);
+    bool generated = key_ctx && EVP_PKEY_keygen_init(key_ctx) > 0 &&
+                     EVP_PKEY_CTX_set_ec_paramgen_curve_nid(key_ctx, NID_X9_62_prime256v1) > 0 &&
+                     EVP_PKEY_keygen(key_ctx, &key) > 0;
+    EVP_PKEY_CTX_free(key_ctx);
+    if (!generated) {
+        return false;
+    }
+
+    X509* cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), serial);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 3600);
+    X509_set_pubkey(cert, key);
+    X509_NAME* name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char*>(common_name), -1, -1, 0);
+    X509_set_issuer_name(cert, name);
+    bool written = X509_sign(cert, key, EVP_sha256()) > 0;
+
+    FILE* cert_file = std::fopen(cert_path.c_str(), "w");
+    FILE* key_file = std::fopen(key_path.c_str(), "w");
+    written = written && cert_file && key_file && PEM_write_X509(cert_file, cert) &&
+              PEM_write_PrivateKey(key_file, key, nullptr, nullptr, 0, nullptr, nullptr);
+    if (cert_file) std::fclose(cert_file);
+    if (key_file) std::fclose(key_file);
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return written;
+}
+
+// AUTH TLS on a fresh control connection, offering session and asking
+// for server_name (SNI) if given; returns the client side, or nullptr
+static SSL* startTls(SSL_CTX* client_ctx, int control, SSL_SESSION* session = nullptr,
+                     const char* server_name = nullptr) {
+    readUntil(control, "\r\n");
+    send(control, "AUTH TLS\r\n", 10, 0);
+    if (readUntil(control, "234").find("234") == std::string::npos) {
+        return nullptr;
+    }
+    SSL* ssl = SSL_new(client_ctx);
+    SSL_set_fd(ssl, control);
+    if (session) {
+        SSL_set_session(ssl, session);
+    }
+    if (server_name) {
+        SSL_set_tlsext_host_name(ssl, server_name);
+    }
+    if (SSL_connect(ssl) != 1) {
+        SSL_free(ssl);
+        return nullptr;
+    }
+    return ssl;
+}
+
+// "<common name>#<serial>" of the certificate the server presented
+static std::string peerCertificate(SSL* ssl) {
+    X509* peer = SSL_get_peer_certificate(ssl);
+    if (!peer) {
+        return "";
+    }
+    char common_name[256] = "";
+    X509_NAME_get_text_by_NID(X509_get_subject_name(peer), NID_commonName, common_name, sizeof(common_name));
+    std::string description = std::string(common_name) + "#" +
+                              std::to_string(ASN1_INTEGER_get(X509_get_serialNumber(peer)));
+    X509_free(peer);
+    return description;
+}
+
+// Next reply line; the server sends each reply as its own record
+static std::string tlsReply(SSL* ssl) {
+    std::string reply;
+    char buffer[512];
+    while (reply.find("\r\n") == std::string::npos) {
+        int received = SSL_read(ssl, buffer, sizeof(buffer));
+        if (received <= 0) {
+            break;
+        }
+        reply.append(buffer, received);
+    }
+    return reply;
+}
+
+static std::string tlsCommand(SSL* ssl, const std::string& command) {
+    std::string line = command + "\r\n";
+    SSL_write(ssl, line.data(), static_cast<int>(line.size()));
+    return tlsReply(ssl);
+}
+
+TEST_F(FTPServerIntegrationTest, SessionsShareOneTlsContextUntilReload) {
+    std::string cert = "/tmp/simple_sftpd_test_" + std::to_string(getpid()) + ".crt";
+    std::string key = "/tmp/simple_sftpd_test_" + std::to_string(getpid()) + ".key";
+    ASSERT_TRUE(writeTestCertificate(cert, key));
+    config_->connection.engine = "threads";
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22136;
+    config_->security.ssl_cert_file = cert;
+    config_->security.ssl_key_file = key;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+    auto services = server_->getSessionServices();
+    ASSERT_NE(services->ssl_context, nullptr);
+
+    SSL_CTX* client_ctx = SSL_CTX_new(TLS_client_method());
+    int first = connectTo(22136);
+    ASSERT_GE(first, 0);
+    SSL* first_tls = startTls(client_ctx, first);
+    ASSERT_NE(first_tls, nullptr);
+    EXPECT_EQ(tlsCommand(first_tls, "NOOP").compare(0, 3, "200"), 0);
+
+    // Reload loads the certificate again for new sessions only
+    server_->reload(std::make_shared<FTPServerConfig>(*config_));
+    EXPECT_NE(server_->getSessionServices(), services);
+    EXPECT_EQ(tlsCommand(first_tls, "NOOP").compare(0, 3, "200"), 0);
+
+    int second = connectTo(22136);
+    ASSERT_GE(second, 0);
+    SSL* second_tls = startTls(client_ctx, second);
+    ASSERT_NE(second_tls, nullptr);
+    EXPECT_EQ(tlsCommand(second_tls, "NOOP").compare(0, 3, "200"), 0);
+
+    SSL_free(first_tls);
+    SSL_free(second_tls);
+    SSL_CTX_free(client_ctx);
+    close(first);
+    close(second);
+    server_->stop();
+    unlink(cert.c_str());
+    unlink(key.c_str());
+}
+
+TEST_F(FTPServerIntegrationTest, ReloadWithBrokenCertificateKeepsTheCurrentOne) {
+    std::string cert = "/tmp/simple_sftpd_test_" + std::to_string(getpid()) + ".crt";
+    std::string key = "/tmp/simple_sftpd_test_" + std::to_string(getpid()) + ".key";
+    std::string broken = "/tmp/simple_sftpd_test_" + std::to_string(getpid()) + "_broken.crt";
+    ASSERT_TRUE(writeTestCertificate(cert, key));
+    std::ofstream(broken) << "-----BEGIN CERTIFICATE-----\nhalf-written\n";
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22149;
+    config_->security.ssl_cert_file = cert;
+    config_->security.ssl_key_file = key;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+    auto services = server_->getSessionServices();
+    uint64_t version = server_->getConfigStore()->version();
+
+    // What a SIGHUP does once the file parses: a certificate that does not
+    // load rejects the reload and nothing is applied
+    auto next = std::make_shared<FTPServerConfig>(*config_);
+    next->security.ssl_cert_file = broken;
+    EXPECT_FALSE(server_->reload(next));
+    EXPECT_EQ(server_->getSessionServices(), services);
+    EXPECT_EQ(server_->getConfigStore()->version(), version);
+
+    SSL_CTX* client_ctx = SSL_CTX_new(TLS_client_method());
+    int control = connectTo(22149);
+    ASSERT_GE(control, 0);
+    SSL* tls = startTls(client_ctx, control);
+    ASSERT_NE(tls, nullptr);
+    EXPECT_EQ(tlsCommand(tls, "NOOP").compare(0, 3, "200"), 0);
+
+    SSL_free(tls);
+    SSL_CTX_free(client_ctx);
+    close(control);
+    server_->stop();
+    unlink(cert.c_str());
+    unlink(key.c_str());
+    unlink(broken.c_str());
+}
+
+// PASV over a protected control connection; returns the connected data socket
+static int tlsPassiveData(SSL* control) {
+    std::string reply = tlsCommand(control, "PASV");
+    size_t open = reply.find('(');
+    int h1, h2, h3, h4, p1, p2;
+    if (reply.compare(0, 3, "227") != 0 || open == std::string::npos ||
+        sscanf(reply.c_str() + open, "(%d,%d,%d,%d,%d,%d)", &h1, &h2, &h3, &h4, &p1, &p2) != 6) {
+        return -1;
+    }
+    return connectTo(p1 * 256 + p2);
+}
+
+// Client side of a PROT P data connection, offering a session to resume
+static SSL* startDataTls(SSL_CTX* client_ctx, SSL_SESSION* session, int data) {
+    SSL* ssl = SSL_new(client_ctx);
+    SSL_set_fd(ssl, data);
+    SSL_set_session(ssl, session);
+    if (SSL_connect(ssl) != 1) {
+        SSL_free(ssl);
+        return nullptr;
+    }
+    return ssl;
+}
+
+static std::string tlsReadAll(SSL* ssl) {
+    std::string data;
+    char buffer[65536];
+    int received;
+    while ((received = SSL_read(ssl, buffer, sizeof(buffer))) > 0) {
+        data.append(buffer, received);
+    }
+    return data;
+}
+
+TEST_F(FTPServerIntegrationTest, ProtPrivateEncryptsDataAndResumesControlSession) {
+    std::string cert = "/tmp/simple_sftpd_prot_" + std::to_string(getpid()) + ".crt";
+    std::string key = "/tmp/simple_sftpd_prot_" + std::to_string(getpid()) + ".key";
+    ASSERT_TRUE(writeTestCertificate(cert, key));
+    const std::string name = "simple_sftpd_prot_test.bin";
+    const std::string path = "/tmp/" + name;
+    std::string content;
+    for (int i = 0; i < 200000; ++i) {
+        content += static_cast<char>((i * 151) & 0xff);
+    }
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << content;
+    }
+
+    config_->connection.engine = "threads";
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22140;
+    config_->security.ssl_cert_file = cert;
+    config_->security.ssl_key_file = key;
+    config_->security.require_ssl_reuse = true;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    SSL_CTX* client_ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_session_cache_mode(client_ctx, SSL_SESS_CACHE_CLIENT);
+    int control = connectTo(22140);
+    ASSERT_GE(control, 0);
+    SSL* control_tls = startTls(client_ctx, control);
+    ASSERT_NE(control_tls, nullptr);
+    EXPECT_EQ(tlsCommand(control_tls, "USER test").compare(0, 3, "331"), 0);
+    EXPECT_EQ(tlsCommand(control_tls, "PASS test").compare(0, 3, "230"), 0);
+    EXPECT_EQ(tlsCommand(control_tls, "PBSZ 0").compare(0, 3, "200"), 0);
+    EXPECT_EQ(tlsCommand(control_tls, "PROT S").compare(0, 3, "536"), 0);
+    EXPECT_EQ(tlsCommand(control_tls, "PROT P").compare(0, 3, "200"), 0);
+    EXPECT_EQ(tlsCommand(control_tls, "TYPE I").compare(0, 3, "200"), 0);
+
+    // Every file rides a resumed session, never a full handshake. TLS 1.3
+    // tickets are single use, so like real clients offer the newest one
+    SSL_SESSION* session = SSL_get1_session(control_tls);
+    auto keepNewestSession = [&session](SSL* data_tls) {
+        SSL_SESSION_free(session);
+        session = SSL_get1_session(data_tls);
+    };
+    for (int round = 0; round < 2; ++round) {
+        int data = tlsPassiveData(control_tls);
+        ASSERT_GE(data, 0);
+        EXPECT_EQ(tlsCommand(control_tls, "RETR " + name).compare(0, 3, "150"), 0);
+        SSL* data_tls = startDataTls(client_ctx, session, data);
+        ASSERT_NE(data_tls, nullptr);
+        EXPECT_EQ(SSL_session_reused(data_tls), 1);
+        std::string received = tlsReadAll(data_tls);
+        EXPECT_EQ(received.size(), content.size());
+        EXPECT_TRUE(received == content);
+        keepNewestSession(data_tls);
+        SSL_shutdown(data_tls);
+        SSL_free(data_tls);
+        close(data);
+        EXPECT_EQ(tlsReply(control_tls).compare(0, 3, "226"), 0);
+    }
+
+    int data = tlsPassiveData(control_tls);
+    ASSERT_GE(data, 0);
+    EXPECT_EQ(tlsCommand(control_tls, "LIST " + name).compare(0, 3, "150"), 0);
+    SSL* data_tls = startDataTls(client_ctx, session, data);
+    ASSERT_NE(data_tls, nullptr);
+    EXPECT_NE(tlsReadAll(data_tls).find(name), std::string::npos);
+    keepNewestSession(data_tls);
+    SSL_shutdown(data_tls);
+    SSL_free(data_tls);
+    close(data);
+    EXPECT_EQ(tlsReply(control_tls).compare(0, 3, "226"), 0);
+
+    const std::string upload_name = "simple_sftpd_prot_upload.bin";
+    const std::string upload = "/tmp/" + upload_name;
+    unlink(upload.c_str());
+    data = tlsPassiveData(control_tls);
+    ASSERT_GE(data, 0);
+    EXPECT_EQ(tlsCommand(control_tls, "STOR " + upload_name).compare(0, 3, "150"), 0);
+    data_tls = startDataTls(client_ctx, session, data);
+    ASSERT_NE(data_tls, nullptr);
+    EXPECT_EQ(SSL_write(data_tls, content.data(), static_cast<int>(content.size())), static_cast<int>(content.size()));
+    SSL_shutdown(data_tls);
+    shutdown(data, SHUT_WR);
+    EXPECT_EQ(tlsReply(control_tls).compare(0, 3, "226"), 0);
+    SSL_free(data_tls);
+    close(data);
+    std::ifstream uploaded(upload, std::ios::binary);
+    std::string stored((std::istreambuf_iterator<char>(uploaded)), std::istreambuf_iterator<char>());
+    EXPECT_TRUE(stored == content);
+
+    auto monitor = server_->getPerformanceMonitor();
+    EXPECT_EQ(monitor->getTlsFullHandshakes(), 1u);
+    EXPECT_EQ(monitor->getTlsDataHandshakes(), 4u);
+    EXPECT_EQ(monitor->getTlsResumedHandshakes(), 4u);
+    EXPECT_EQ(monitor->getTlsHandshakeFailures(), 0u);
+
+    SSL_SESSION_free(session);
+    SSL_free(control_tls);
+    SSL_CTX_free(client_ctx);
+    close(control);
+    server_->stop();
+    unlink(path.c_str());
+    unlink(upload.c_str());
+    unlink(cert.c_str());
+    unlink(key.c_str());
+}
+
+TEST_F(FTPServerIntegrationTest, ReconnectingClientsResumeAcrossReloads) {
+    std::string cert = "/tmp/simple_sftpd_resume_" + std::to_string(getpid()) + ".crt";
+    std::string key = "/tmp/simple_sftpd_resume_" + std::to_string(getpid()) + ".key";
+    ASSERT_TRUE(writeTestCertificate(cert, key));
+    config_->connection.engine = "threads";
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22141;
+    config_->security.ssl_cert_file = cert;
+    config_->security.ssl_key_file = key;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    // One client on TLS 1.3 tickets, one on TLS 1.2 session IDs; each
+    // reconnects after a reload has replaced the server's SSL_CTX
+    SSL_CTX* ticket_ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX* session_id_ctx = SSL_CTX_new(TLS_client_method());
+    SSL_CTX_set_max_proto_version(session_id_ctx, TLS1_2_VERSION);
+    SSL_CTX_set_options(session_id_ctx, SSL_OP_NO_TICKET);
+    for (SSL_CTX* client_ctx : {ticket_ctx, session_id_ctx}) {
+        SSL_SESSION* session = nullptr;
+        for (int visit = 0; visit < 2; ++visit) {
+            int control = connectTo(22141);
+            ASSERT_GE(control, 0);
+            SSL* control_tls = startTls(client_ctx, control, session);
+            ASSERT_NE(control_tls, nullptr);
+            EXPECT_EQ(SSL_session_reused(control_tls), visit);
+            // The reply also brings in any tickets sent after the handshake
+            EXPECT_EQ(tlsCommand(control_tls, "USER test").compare(0, 3, "331"), 0);
+            SSL_SESSION_free(session);
+            session = SSL_get1_session(control_tls);
+            SSL_shutdown(control_tls);
+            SSL_free(control_tls);
+            close(control);
+            server_->reload(std::make_shared<FTPServerConfig>(*config_));
+        }
+        SSL_SESSION_free(session);
+    }
+
+    auto monitor = server_->getPerformanceMonitor();
+    EXPECT_EQ(monitor->getTlsFullHandshakes(), 2u);
+    EXPECT_EQ(monitor->getTlsResumedHandshakes(), 2u);
+    EXPECT_DOUBLE_EQ(monitor->getTlsResumptionRate(), 0.5);
+    EXPECT_EQ(monitor->getTlsTicketHits(), 1u);
+    EXPECT_EQ(monitor->getTlsSessionCacheHits(), 1u);
+
+    SSL_CTX_free(ticket_ctx);
+    SSL_CTX_free(session_id_ctx);
+    server_->stop();
+    unlink(cert.c_str());
+    unlink(key.c_str());
+}
+
+TEST_F(FTPServerIntegrationTest, StalledTlsHandshakeTimesOutWithoutBlockingOthers) {
+    std::string cert = "/tmp/simple_sftpd_handshake_" + std::to_string(getpid()) + ".crt";
+    std::string key = "/tmp/simple_sftpd_handshake_" + std::to_string(getpid()) + ".key";
+    ASSERT_TRUE(writeTestCertificate(cert, key));
+    SSL_CTX* client_ctx = SSL_CTX_new(TLS_client_method());
+
+    struct Setup {
+        const char* engine;
+        int tls_worker_threads;
+        int port;
+    };
+    for (const Setup& setup : {Setup{"reactor", 0, 22142}, Setup{"reactor", 2, 22143}, Setup{"threads", 0, 22144}}) {
+        SCOPED_TRACE(std::string(setup.engine) + ", tls_worker_threads=" + std::to_string(setup.tls_worker_threads));
+        config_->connection.engine = setup.engine;
+        config_->connection.event_loop_threads = 1;
+        config_->connection.worker_threads = 1;
+        config_->connection.tls_worker_threads = setup.tls_worker_threads;
+        config_->connection.bind_address = "127.0.0.1";
+        config_->connection.bind_port = setup.port;
+        config_->security.ssl_cert_file = cert;
+        config_->security.ssl_key_file = key;
+        config_->security.ssl_handshake_timeout_seconds = 1;
+        server_ = std::make_shared<FTPServer>(config_);
+        ASSERT_TRUE(server_->start());
+
+        // Asks for TLS, then never sends a ClientHello
+        int stalled = connectTo(setup.port);
+        ASSERT_GE(stalled, 0);
+        readUntil(stalled, "\r\n");
+        send(stalled, "AUTH TLS\r\n", 10, 0);
+        EXPECT_NE(readUntil(stalled, "234").find("234"), std::string::npos);
+        auto stalled_at = std::chrono::steady_clock::now();
+
+        // Meanwhile the only loop and the only worker still serve others
+        int control = connectTo(setup.port);
+        ASSERT_GE(control, 0);
+        SSL* control_tls = startTls(client_ctx, control);
+        ASSERT_NE(control_tls, nullptr);
+        EXPECT_EQ(tlsCommand(control_tls, "USER test").compare(0, 3, "331"), 0);
+        EXPECT_EQ(tlsCommand(control_tls, "PASS test").compare(0, 3, "230"), 0);
+        EXPECT_LT(std::chrono::steady_clock::now() - stalled_at, std::chrono::milliseconds(900));
+
+        // The stalled one is dropped at its deadline
+        struct timeval timeout = {5, 0};
+        setsockopt(stalled, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        char byte;
+        EXPECT_LE(recv(stalled, &byte, 1, 0), 0);
+        EXPECT_LT(std::chrono::steady_clock::now() - stalled_at, std::chrono::seconds(4));
+        close(stalled);
+
+        auto monitor = server_->getPerformanceMonitor();
+        EXPECT_EQ(monitor->getTlsFullHandshakes(), 1u);
+        EXPECT_EQ(monitor->getTlsHandshakeFailures(), 1u);
+
+        SSL_shutdown(control_tls);
+        SSL_free(control_tls);
+        close(control);
+        server_->stop();
+    }
+
+    SSL_CTX_free(client_ctx);
+    unlink(cert.c_str());
+    unlink(key.c_str());
+}
+
+TEST_F(FTPServerIntegrationTest, VirtualHostCertificatesBySniAndRenewal) {
+    std::string base = "/tmp/simple_sftpd_sni_" + std::to_string(getpid());
+    ASSERT_TRUE(writeTestCertificate(base + ".crt", base + ".key"));
+    ASSERT_TRUE(writeTestCertificate(base + "_tenant.crt", base + "_tenant.key", "tenant.example"));
+    config_->connection.engine = "reactor";
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22145;
+    config_->security.ssl_cert_file = base + ".crt";
+    config_->security.ssl_key_file = base + ".key";
+    config_->security.ssl_cert_check_seconds = 1;
+    config_->virtual_hosts.push_back(VirtualHostConfig{"tenant.example", base + "_tenant.crt", base + "_tenant.key"});
+    ASSERT_TRUE(config_->validate());
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    SSL_CTX* client_ctx = SSL_CTX_new(TLS_client_method());
+    auto served = [client_ctx](const char* server_name) {
+        int control = connectTo(22145);
+        SSL* tls = control >= 0 ? startTls(client_ctx, control, nullptr, server_name) : nullptr;
+        std::string certificate = tls ? peerCertificate(tls) : "";
+        if (tls) {
+            SSL_shutdown(tls);
+            SSL_free(tls);
+        }
+        close(control);
+        return certificate;
+    };
+    EXPECT_EQ(served("tenant.example"), "tenant.example#1");
+    EXPECT_EQ(served("TENANT.Example"), "tenant.example#1");
+    EXPECT_EQ(served(nullptr), "127.0.0.1#1");
+    EXPECT_EQ(served("other.example"), "127.0.0.1#1");
+
+    // A session that stays open across the renewal
+    int control = connectTo(22145);
+    ASSERT_GE(control, 0);
+    SSL* control_tls = startTls(client_ctx, control, nullptr, "tenant.example");
+    ASSERT_NE(control_tls, nullptr);
+    EXPECT_EQ(tlsCommand(control_tls, "USER test").compare(0, 3, "331"), 0);
+
+    // Renewed in place; the watcher swaps it in for new sessions without a reload
+    auto services = server_->getSessionServices();
+    ASSERT_TRUE(writeTestCertificate(base + "_tenant.crt", base + "_tenant.key", "tenant.example", 2));
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (served("tenant.example") != "tenant.example#2" && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    }
+    EXPECT_EQ(served("tenant.example"), "tenant.example#2");
+    EXPECT_EQ(served(nullptr), "127.0.0.1#1");
+    EXPECT_NE(server_->getSessionServices(), services);
+    EXPECT_EQ(tlsCommand(control_tls, "PASS test").compare(0, 3, "230"), 0);
+    EXPECT_EQ(peerCertificate(control_tls), "tenant.example#1");
+
+    // A renewal caught half-written keeps the certificates in use
+    services = server_->getSessionServices();
+    std::ofstream(base + "_tenant.key") << "not a key";
+    EXPECT_FALSE(server_->reloadCertificates());
+    EXPECT_EQ(server_->getSessionServices(), services);
+    EXPECT_EQ(served("tenant.example"), "tenant.example#2");
+
+    SSL_shutdown(control_tls);
+    SSL_free(control_tls);
+    close(control);
+    SSL_CTX_free(client_ctx);
+    server_->stop();
+    for (const char* suffix : {".crt", ".key", "_tenant.crt", "_tenant.key"}) {
+        unlink((base + suffix).c_str());
+    }
+}
+#endif
+
+TEST_F(FTPServerIntegrationTest, PathsOutsideHomeAreRefused) {
+    config_->connection.engine = "reactor";
+    config_->connection.bind_address = "127.0.0.1";
+    config_->connection.bind_port = 22137;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+
+    // The test user's home is /tmp
+    std::string link = "sftpd-escape-" + std::to_string(getpid());
+    std::string link_path = "/tmp/" + link;
+    unlink(link_path.c_str());
+    ASSERT_EQ(symlink("/etc", link_path.c_str()), 0);
+
+    int control = connectTo(22137);
+    ASSERT_GE(control, 0);
+    readUntil(control, "\r\n");
+    std::string login = "USER test\r\nPASS test\r\n";
+    send(control, login.data(), login.size(), 0);
+    ASSERT_NE(readUntil(control, "230").find("230"), std::string::npos);
+
+    std::vector<std::string> escapes = {"CWD ../..", "CWD /../../etc", "CWD " + link, "SIZE /../etc/passwd",
+                                        "SIZE " + link + "/passwd"};
+    for (const std::string& command : escapes) {
+        std::string request = command + "\r\n";
+        send(control, request.data(), request.size(), 0);
+        std::string reply = readUntil(control, "\r\n");
+        EXPECT_EQ(reply.compare(0, 3, "550"), 0) << command << ": " << reply;
+    }
+
+    // Uploads below directories that do not exist yet, behind the link or
+    // through a dangling one, must not be created outside the home
+    std::string missing = "sftpd-escape-" + std::to_string(getpid()) + "-dir";
+    std::string dangling_path = link_path + "-dangling";
+    unlink(dangling_path.c_str());
+    ASSERT_EQ(symlink(("/etc/" + missing).c_str(), dangling_path.c_str()), 0);
+    std::vector<std::string> uploads = {"STOR " + link + "/" + missing + "/sub/file",
+                                        "STOR /" + link + "/./" + missing + "/../file",
+                                        "STOR " + link + "-dangling"};
+    for (const std::string& command : uploads) {
+        int data = openPassiveData(control);
+        ASSERT_GE(data, 0);
+        std::string request = command + "\r\n";
+        send(control, request.data(), request.size(), 0);
+        std::string reply = readUntil(control, "\r\n");
+        EXPECT_EQ(reply.compare(0, 3, "550"), 0) << command << ": " << reply;
+        close(data);
+    }
+    EXPECT_FALSE(std::filesystem::exists("/etc/" + missing));
+    std::filesystem::remove_all("/etc/" + missing);
+    unlink(dangling_path.c_str());
+
+    // Inside the home everything still works
+    send(control, "CWD /\r\nPWD\r\n", 12, 0);
+    std::string replies = readUntil(control, "257");
+    EXPECT_NE(replies.find("250"), std::string::npos) << replies;
+    EXPECT_NE(replies.find("257 \"/tmp\""), std::string::npos) << replies;
+
+    close(control);
+    unlink(link_path.c_str());
+    server_->stop();
+}
+
+TEST_F(FTPServerIntegrationTest, MemoryBudgetRefusesTransfersAndSessions) {
+    config_->connection.bind_port = 22138;
+    config_->connection.memory_budget_mb = 4;
+    config_->connection.user_memory_budget_mb = 1;
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+    auto accountant = server_->getMemoryAccountant();
+    ASSERT_TRUE(accountant);
+    std::ofstream("/tmp/simple_sftpd_memory_test.txt") << "listed\n";
+
+    int control = connectTo(22138);
+    ASSERT_GE(control, 0);
+    readUntil(control, "\r\n");
+    std::string login = "USER test\r\nPASS test\r\n";
+    send(control, login.data(), login.size(), 0);
+    ASSERT_NE(readUntil(control, "230").find("230"), std::string::npos);
+    EXPECT_GT(accountant->getUserUsage("test"), 0u);
+    EXPECT_GT(server_->getPerformanceMonitor()->getMemoryBytesInUse(), 0u);
+
+    // Other sessions of the same user hold the rest of their budget
+    auto account = accountant->account("test");
+    MemoryAccountant::Charge others(account, MemoryAccountant::Category::TRANSFER);
+    ASSERT_TRUE(others.resize((1u << 20) - account->getUsage()));
+
+    int data = openPassiveData(control);
+    ASSERT_GE(data, 0);
+    send(control, "LIST simple_sftpd_memory_test.txt\r\n", 35, 0);
+    std::string reply = readUntil(control, "\r\n");
+    EXPECT_EQ(reply.compare(0, 3, "425"), 0) << reply;
+    close(data);
+
+    others.reset();
+    data = openPassiveData(control);
+    ASSERT_GE(data, 0);
+    send(control, "LIST simple_sftpd_memory_test.txt\r\n", 35, 0);
+    EXPECT_NE(readAll(data).find("simple_sftpd_memory_test.txt"), std::string::npos);
+    close(data);
+    EXPECT_NE(readUntil(control, "226").find("226"), std::string::npos);
+
+    // With the whole server at its budget, new clients are turned away
+    MemoryAccountant::Charge elsewhere(accountant->account(""), MemoryAccountant::Category::CONTROL);
+    elsewhere.force(4u << 20);
+    int refused = connectTo(22138);
+    ASSERT_GE(refused, 0);
+    EXPECT_EQ(readUntil(refused, "\r\n").compare(0, 3, "421"), 0);
+    close(refused);
+    elsewhere.reset();
+
+    EXPECT_GE(server_->getPerformanceMonitor()->getMemoryRefusals(), 1u);
+    close(control);
+    unlink("/tmp/simple_sftpd_memory_test.txt");
+    server_->stop();
+}
+
+TEST_F(FTPServerIntegrationTest, OverloadKeepsReservedSlotsForAdmins) {
+    config_->connection.bind_port = 22139;
+    config_->connection.max_connections = 3;
+    config_->connection.reserved_admin_slots = 1;
+    config_->security.admin_users = {"test"};
+    server_ = std::make_shared<FTPServer>(config_);
+    ASSERT_TRUE(server_->start());
+    auto admission = server_->getAdmissionController();
+
+    std::vector<int> regular;
+    for (int i = 0; i < 2; ++i) {
+        regular.push_back(connectTo(22139));
+        ASSERT_GE(regular.back(), 0);
+        EXPECT_EQ(readUntil(regular.back(), "\r\n").compare(0, 3, "220"), 0);
+    }
+
+    // The reserved slot: served, but only an admin may log in
+    int probation = connectTo(22139);
+    ASSERT_GE(probation, 0);
+    EXPECT_EQ(readUntil(probation, "\r\n").compare(0, 3, "220"), 0);
+    send(probation, "USER someone\r\n", 14, 0);
+    std::string reply = readUntil(probation, "\r\n");
+    EXPECT_EQ(reply.compare(0, 40, "421 Service not available, try again in "), 0) << reply;
+    close(probation);
+    for (int i = 0; i < 100 && admission->getStats().admin_only_sessions > 0; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    int admin = connectTo(22139);
+    ASSERT_GE(admin, 0);
+    readUntil(admin, "\r\n");
+    std::string login = "USER test\r\nPASS test\r\n";
+    send(admin, login.data(), login.size(), 0);
+    EXPECT_NE(readUntil(admin, "230").find("230"), std::string::npos);
+    EXPECT_EQ(admission->getStats().admin_only_sessions, 0u);
+
+    // Full: a back-off hint instead of a reset
+    int turned_away = connectTo(22139);
+    ASSERT_GE(turned_away, 0);
+    reply = readUntil(turned_away, "\r\n");
+    int retry = 0;
+    EXPECT_EQ(sscanf(reply.c_str(), "421 Service not available, try again in %d seconds", &retry), 1) << reply;
+    EXPECT_GE(retry, AdmissionController::MIN_RETRY_SECONDS);
+    close(turned_away);
+
+    close(admin);
+    for (int fd : regular) {
+        close(fd);
+    }
+    server_->stop();
+}
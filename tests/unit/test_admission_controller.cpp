@@ -0,0 +1,116 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/core/admission_controller.hpp"
+
+using namespace simple_sftpd;
+
+using Verdict = AdmissionController::Verdict;
+
+namespace {
+
+AdmissionController::Limits testLimits() {
+    AdmissionController::Limits limits;
+    limits.max_sessions = 10;
+    limits.reserved_slots = 2;
+    limits.max_loop_lag = std::chrono::milliseconds(100);
+    limits.max_queue_depth = 50;
+    return limits;
+}
+
+AdmissionController::Load sessions(size_t count) {
+    AdmissionController::Load load;
+    load.sessions = count;
+    return load;
+}
+
+} // namespace
+
+TEST(AdmissionControllerTest, AdmitsUntilTheReservedSlots) {
+    AdmissionController admission(testLimits());
+    EXPECT_EQ(admission.decide(sessions(0), false).verdict, Verdict::ADMIT);
+    EXPECT_EQ(admission.decide(sessions(7), false).verdict, Verdict::ADMIT);
+
+    // The last two slots: admin addresses get in, others only to log in as an admin
+    EXPECT_EQ(admission.decide(sessions(8), true).verdict, Verdict::ADMIT);
+    AdmissionController::Decision first = admission.decide(sessions(8), false);
+    EXPECT_EQ(first.verdict, Verdict::ADMIN_ONLY);
+    EXPECT_GE(first.retry_seconds, AdmissionController::MIN_RETRY_SECONDS);
+    EXPECT_EQ(admission.decide(sessions(9), false).verdict, Verdict::ADMIN_ONLY);
+
+    // Both reserved slots are on probation now
+    EXPECT_EQ(admission.decide(sessions(9), false).verdict, Verdict::REJECT);
+    admission.releaseAdminOnly();
+    EXPECT_EQ(admission.decide(sessions(9), false).verdict, Verdict::ADMIN_ONLY);
+
+    AdmissionController::Stats stats = admission.getStats();
+    EXPECT_EQ(stats.admitted, 3u);
+    EXPECT_EQ(stats.admin_only, 3u);
+    EXPECT_EQ(stats.rejected, 1u);
+    EXPECT_EQ(stats.admin_only_sessions, 2u);
+}
+
+TEST(AdmissionControllerTest, FullServerTurnsEveryoneAway) {
+    AdmissionController admission(testLimits());
+    AdmissionController::Decision decision = admission.decide(sessions(10), true);
+    EXPECT_EQ(decision.verdict, Verdict::REJECT);
+    EXPECT_GE(decision.retry_seconds, AdmissionController::MIN_RETRY_SECONDS);
+    EXPECT_LE(decision.retry_seconds, AdmissionController::MAX_RETRY_SECONDS);
+}
+
+TEST(AdmissionControllerTest, ShedsOnLoopLagAndQueueDepth) {
+    AdmissionController::Limits limits = testLimits();
+    limits.reserved_slots = 0;
+    AdmissionController admission(limits);
+
+    AdmissionController::Load lagging = sessions(1);
+    lagging.loop_lag = std::chrono::milliseconds(150);
+    EXPECT_EQ(admission.decide(lagging, false).verdict, Verdict::REJECT);
+    EXPECT_EQ(admission.decide(lagging, true).verdict, Verdict::ADMIT);
+
+    AdmissionController::Load queued = sessions(1);
+    queued.queue_depth = 51;
+    EXPECT_EQ(admission.decide(queued, false).verdict, Verdict::REJECT);
+
+    // Limits of 0 are not checked
+    limits.max_loop_lag = std::chrono::milliseconds(0);
+    limits.max_queue_depth = 0;
+    admission.setLimits(limits);
+    lagging.queue_depth = 1000;
+    EXPECT_EQ(admission.decide(lagging, false).verdict, Verdict::ADMIT);
+}
+
+TEST(AdmissionControllerTest, BackoffGrowsWithOverloadAndRejections) {
+    AdmissionController::Limits limits = testLimits();
+    limits.reserved_slots = 0;
+    AdmissionController admission(limits);
+
+    AdmissionController::Load mild = sessions(1);
+    mild.loop_lag = std::chrono::milliseconds(101);
+    int first = admission.decide(mild, false).retry_seconds;
+    EXPECT_LE(first, 3);
+
+    // Ten times the lag limit, after many refusals: much longer, still capped
+    AdmissionController::Load severe = mild;
+    severe.loop_lag = std::chrono::milliseconds(1000);
+    int last = 0;
+    for (int i = 0; i < 100; ++i) {
+        last = admission.decide(severe, false).retry_seconds;
+    }
+    EXPECT_GT(last, 30);
+    EXPECT_LE(last, AdmissionController::MAX_RETRY_SECONDS);
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/core/buffer_pool.hpp"
+#include <cstring>
+#include <thread>
+#include <vector>
+
+using namespace simple_sftpd;
+
+TEST(BufferPoolTest, RoundsRequestsToSizeClasses) {
+    EXPECT_EQ(BufferPool::classSize(1), BufferPool::MIN_BUFFER);
+    EXPECT_EQ(BufferPool::classSize(64 * 1024), 64u * 1024);
+    EXPECT_EQ(BufferPool::classSize(64 * 1024 + 1), 128u * 1024);
+    EXPECT_EQ(BufferPool::classSize(3 * 1024 * 1024), 4u * 1024 * 1024);
+    EXPECT_EQ(BufferPool::classSize(100 * 1024 * 1024), BufferPool::MAX_BUFFER);
+}
+
+TEST(BufferPoolTest, ReusesReleasedBuffers) {
+    BufferPool pool;
+    char* first = nullptr;
+    {
+        BufferPool::Buffer buffer = pool.acquire(200 * 1024);
+        ASSERT_TRUE(buffer);
+        EXPECT_EQ(buffer.size(), 256u * 1024);
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(buffer.data()) % 4096, 0u);
+        std::memset(buffer.data(), 0x5a, buffer.size());
+        first = buffer.data();
+        EXPECT_EQ(pool.getStats().bytes_in_use, 256u * 1024);
+    }
+    BufferPool::Stats stats = pool.getStats();
+    EXPECT_EQ(stats.bytes_in_use, 0u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.bytes_mapped, BufferPool::CHUNK_SIZE);
+
+    // Same thread, same class: straight back from the cache
+    BufferPool::Buffer again = pool.acquire(256 * 1024);
+    EXPECT_EQ(again.data(), first);
+    EXPECT_EQ(pool.getStats().hits, 1u);
+
+    // The rest of the chunk serves the class without mapping more
+    std::vector<BufferPool::Buffer> more;
+    for (int i = 0; i < 7; ++i) {
+        more.push_back(pool.acquire(256 * 1024));
+        ASSERT_TRUE(more.back());
+    }
+    EXPECT_EQ(pool.getStats().bytes_mapped, BufferPool::CHUNK_SIZE);
+    EXPECT_EQ(pool.getStats().bytes_in_use, BufferPool::CHUNK_SIZE);
+}
+
+TEST(BufferPoolTest, MemoryLimitFallsBackToSmallerBuffers) {
+    BufferPool pool(2 * BufferPool::CHUNK_SIZE);
+    BufferPool::Buffer small = pool.acquire(BufferPool::MIN_BUFFER);
+    BufferPool::Buffer large = pool.acquire(2 * 1024 * 1024);
+    ASSERT_TRUE(small);
+    ASSERT_TRUE(large);
+    EXPECT_EQ(pool.getStats().bytes_mapped, 2 * BufferPool::CHUNK_SIZE);
+
+    // No room to map a 4 MiB buffer; the rest of the 64 KiB chunk will do
+    BufferPool::Buffer fallback = pool.acquire(BufferPool::MAX_BUFFER);
+    ASSERT_TRUE(fallback);
+    EXPECT_EQ(fallback.size(), BufferPool::MIN_BUFFER);
+
+    // Unless the caller needs more than what is free
+    BufferPool::Buffer refused = pool.acquire(BufferPool::MAX_BUFFER, 1024 * 1024);
+    EXPECT_FALSE(refused);
+    EXPECT_EQ(pool.getStats().bytes_mapped, 2 * BufferPool::CHUNK_SIZE);
+
+    // Once a big buffer comes back it can be lent again
+    large.reset();
+    BufferPool::Buffer reused = pool.acquire(BufferPool::MAX_BUFFER, 1024 * 1024);
+    ASSERT_TRUE(reused);
+    EXPECT_EQ(reused.size(), 2u * 1024 * 1024);
+}
+
+TEST(BufferPoolTest, ZeroLimitLendsNothing) {
+    BufferPool pool(0);
+    EXPECT_FALSE(pool.acquire(BufferPool::MIN_BUFFER));
+    EXPECT_EQ(pool.getStats().misses, 1u);
+    EXPECT_EQ(pool.getStats().bytes_mapped, 0u);
+}
+
+TEST(BufferPoolTest, BuffersMoveBetweenThreads) {
+    BufferPool pool;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&pool, t] {
+            for (int i = 0; i < 200; ++i) {
+                BufferPool::Buffer buffer = pool.acquire(BufferPool::MIN_BUFFER << (i % 3));
+                ASSERT_TRUE(buffer);
+                buffer.data()[0] = static_cast<char>(t);
+                buffer.data()[buffer.size() - 1] = static_cast<char>(t);
+                BufferPool::Buffer moved = std::move(buffer);
+                EXPECT_FALSE(buffer);
+                EXPECT_EQ(moved.data()[0], static_cast<char>(t));
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    BufferPool::Stats stats = pool.getStats();
+    EXPECT_EQ(stats.bytes_in_use, 0u);
+    EXPECT_EQ(stats.hits + stats.misses, 800u);
+    EXPECT_LE(stats.bytes_mapped, 3 * 4 * BufferPool::CHUNK_SIZE);
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/core/command_table.hpp"
+
+using namespace simple_sftpd;
+
+// Lookups are usable in constant expressions
+static_assert(findCommand("RETR") != nullptr, "RETR must be in the table");
+static_assert(findCommand("ABCD") == nullptr, "unknown verbs must miss");
+
+TEST(CommandTableTest, EveryVerbFindsItself) {
+    for (const CommandSpec& spec : command_table::COMMANDS) {
+        const CommandSpec* found = findCommand(spec.verb);
+        ASSERT_NE(found, nullptr) << spec.verb;
+        EXPECT_EQ(found->verb, spec.verb);
+    }
+}
+
+TEST(CommandTableTest, LookupIsCaseInsensitive) {
+    const CommandSpec* spec = findCommand("retr");
+    ASSERT_NE(spec, nullptr);
+    EXPECT_EQ(spec->id, CommandId::RETR);
+    EXPECT_EQ(findCommand("Pwd"), findCommand("PWD"));
+}
+
+TEST(CommandTableTest, AliasesShareHandler) {
+    EXPECT_EQ(findCommand("XPWD")->id, CommandId::PWD);
+    EXPECT_EQ(findCommand("NLST")->id, CommandId::LIST);
+    EXPECT_EQ(findCommand("XRMD")->id, CommandId::RMD);
+}
+
+TEST(CommandTableTest, RejectsUnknownAndMalformedVerbs) {
+    EXPECT_EQ(findCommand(""), nullptr);
+    EXPECT_EQ(findCommand("RE"), nullptr);
+    EXPECT_EQ(findCommand("RETRX"), nullptr);
+    EXPECT_EQ(findCommand("RET1"), nullptr);
+    EXPECT_EQ(findCommand("MLSD"), nullptr);
+}
+
+TEST(CommandTableTest, Flags) {
+    EXPECT_FALSE(findCommand("USER")->flags & CMD_NEEDS_AUTH);
+    EXPECT_TRUE(findCommand("CWD")->flags & CMD_NEEDS_AUTH);
+    EXPECT_TRUE(findCommand("STOR")->flags & CMD_NEEDS_DATA);
+    EXPECT_FALSE(findCommand("PASV")->flags & CMD_NEEDS_DATA);
+    EXPECT_TRUE(findCommand("RETR")->flags & CMD_BLOCKING);
+    // Anything that stats or resolves a path stays off the event loop
+    for (const char* verb : {"CWD", "XCWD", "SIZE", "RNFR", "RNTO", "DELE", "MKD", "RMD"}) {
+        EXPECT_TRUE(findCommand(verb)->flags & CMD_BLOCKING) << verb;
+    }
+    EXPECT_FALSE(findCommand("PWD")->flags & CMD_BLOCKING);
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/config/config_store.hpp"
+#include "simple-sftpd/config/server_config.hpp"
+#include <atomic>
+#include <fstream>
+#include <thread>
+#include <unistd.h>
+
+using namespace simple_sftpd;
+
+TEST(ConfigStoreTest, PublishedSnapshotsAreSeenWithoutDisturbingHeldOnes) {
+    auto first = std::make_shared<FTPServerConfig>();
+    first->rate_limit.max_transfer_rate = 1000;
+    ConfigStore store(first);
+    uint64_t version = store.version();
+
+    // A transfer holds on to the snapshot it started with
+    auto held = store.current();
+    auto second = std::make_shared<FTPServerConfig>();
+    second->rate_limit.max_transfer_rate = 2000;
+    store.publish(second);
+
+    EXPECT_NE(store.version(), version);
+    EXPECT_EQ(store.current()->rate_limit.max_transfer_rate, 2000);
+    EXPECT_EQ(held->rate_limit.max_transfer_rate, 1000);
+
+    store.publish(nullptr);  // ignored
+    EXPECT_EQ(store.current()->rate_limit.max_transfer_rate, 2000);
+}
+
+TEST(ConfigStoreTest, ReadersRaceWithPublishers) {
+    auto initial = std::make_shared<FTPServerConfig>();
+    initial->connection.login_timeout_seconds = initial->connection.timeout_seconds;
+    ConfigStore store(initial);
+    std::atomic<bool> done(false);
+    std::atomic<int> torn(0);
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            while (!done) {
+                auto snapshot = store.current();
+                // Each publish sets both fields to the same value
+                if (snapshot->connection.timeout_seconds != snapshot->connection.login_timeout_seconds) {
+                    ++torn;
+                }
+            }
+        });
+    }
+    for (int i = 1; i <= 2000; ++i) {
+        auto next = std::make_shared<FTPServerConfig>();
+        next->connection.timeout_seconds = i;
+        next->connection.login_timeout_seconds = i;
+        store.publish(next);
+    }
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    EXPECT_EQ(torn, 0);
+    EXPECT_EQ(store.current()->connection.timeout_seconds, 2000);
+}
+
+TEST(ConfigStoreTest, LoadRejectsInvalidOrMissingFiles) {
+    std::string path = "/tmp/simple_sftpd_config_store_" + std::to_string(getpid()) + ".conf";
+    std::vector<std::string> errors;
+    EXPECT_EQ(ConfigStore::load(path, errors), nullptr);
+    EXPECT_FALSE(errors.empty());
+
+    std::ofstream(path) << "[connection]\nbind_port = 0\n";
+    EXPECT_EQ(ConfigStore::load(path, errors), nullptr);
+    EXPECT_FALSE(errors.empty());
+
+    std::ofstream(path) << "[connection]\nbind_port = 2121\n";
+    auto config = ConfigStore::load(path, errors);
+    ASSERT_NE(config, nullptr);
+    EXPECT_EQ(config->connection.bind_port, 2121);
+    EXPECT_TRUE(errors.empty());
+    unlink(path.c_str());
+}
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/core/event_loop.hpp"
+#include "simple-sftpd/core/worker_pool.hpp"
+#include "simple-sftpd/utils/logger.hpp"
+#include <memory>
+#include <future>
+#include <chrono>
+#include <thread>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace simple_sftpd;
+
+class EventLoopTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        logger_ = std::make_shared<Logger>("", LogLevel::ERROR, false, false, LogFormat::STANDARD);
+        loop_ = std::make_shared<EventLoop>(logger_);
+    }
+
+    void TearDown() override {
+        loop_->stop();
+    }
+
+    std::shared_ptr<Logger> logger_;
+    std::shared_ptr<EventLoop> loop_;
+};
+
+#ifdef __linux__
+TEST_F(EventLoopTest, PostRunsOnLoopThread) {
+    ASSERT_TRUE(loop_->start());
+    EXPECT_FALSE(loop_->isInLoopThread());
+
+    std::promise<bool> ran;
+    loop_->post([this, &ran]() { ran.set_value(loop_->isInLoopThread()); });
+
+    auto result = ran.get_future();
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_TRUE(result.get());
+}
+
+TEST_F(EventLoopTest, ReadHandlerSeesDataUntilRemoved) {
+    ASSERT_TRUE(loop_->start());
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    std::promise<std::string> received;
+    loop_->post([this, &fds, &received]() {
+        loop_->add(fds[0], EventLoop::EVENT_READ, [this, &fds, &received](uint32_t events) {
+            char buffer[16];
+            ssize_t n = read(fds[0], buffer, sizeof(buffer));
+            loop_->remove(fds[0]);
+            received.set_value(std::string(buffer, n > 0 ? n : 0));
+        });
+    });
+
+    ASSERT_EQ(write(fds[1], "ping", 4), 4);
+    auto result = received.get_future();
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(result.get(), "ping");
+
+    // A second write must not reach the removed handler (it would set the promise twice)
+    ASSERT_EQ(write(fds[1], "pong", 4), 4);
+    std::promise<size_t> count;
+    loop_->post([this, &count]() { count.set_value(loop_->getRegisteredCount()); });
+    EXPECT_EQ(count.get_future().get(), 0U);
+
+    close(fds[0]);
+    close(fds[1]);
+}
+
+TEST_F(EventLoopTest, TimersFireInDeadlineOrderUnlessCancelled) {
+    ASSERT_TRUE(loop_->start());
+
+    std::promise<std::string> fired;
+    auto order = std::make_shared<std::string>();
+    loop_->post([this, order, &fired]() {
+        loop_->runAfter(std::chrono::milliseconds(60), [order, &fired]() {
+            *order += "late";
+            fired.set_value(*order);
+        });
+        EventLoop::TimerId cancelled = loop_->runAfter(std::chrono::milliseconds(30), [order]() {
+            *order += "cancelled,";
+        });
+        loop_->runAfter(std::chrono::milliseconds(10), [order]() { *order += "early,"; });
+        loop_->cancelTimer(cancelled);
+    });
+
+    auto result = fired.get_future();
+    ASSERT_EQ(result.wait_for(std::chrono::seconds(5)), std::future_status::ready);
+    EXPECT_EQ(result.get(), "early,late");
+}
+
+TEST_F(EventLoopTest, BlockedLoopReportsLag) {
+    ASSERT_TRUE(loop_->start());
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    EXPECT_LT(loop_->getLag(), std::chrono::milliseconds(100));
+
+    // Hold the loop thread across a probe; the probe fires that much late
+    loop_->post([]() { std::this_thread::sleep_for(std::chrono::milliseconds(400)); });
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (loop_->getLag() < std::chrono::milliseconds(200) && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    EXPECT_GE(loop_->getLag(), std::chrono::milliseconds(200));
+}
+#endif
+
+TEST_F(EventLoopTest, PostAfterStopIsDropped) {
+    bool ran = false;
+    loop_->post([&ran]() { ran = true; });
+    loop_->stop();
+    EXPECT_FALSE(ran);
+}
+
+TEST(WorkerPoolTest, RunsSubmittedTasks) {
+    auto logger = std::make_shared<Logger>("", LogLevel::ERROR, false, false, LogFormat::STANDARD);
+    WorkerPool pool(logger);
+    EXPECT_FALSE(pool.submit([]() {}));
+
+    ASSERT_TRUE(pool.start(2));
+    EXPECT_EQ(pool.getThreadCount(), 2U);
+
+    std::promise<void> done;
+    EXPECT_TRUE(pool.submit([&done]() { done.set_value(); }));
+    EXPECT_EQ(done.get_future().wait_for(std::chrono::seconds(5)), std::future_status::ready);
+
+    pool.stop();
+    EXPECT_FALSE(pool.submit([]() {}));
+}
@@ -19,7 +19,11 @@
 #include "simple-sftpd/config/server_config.hpp"
 #include "simple-sftpd/utils/logger.hpp"
 #include "simple-sftpd/core/connection.hpp"
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
 #include <memory>
+#include <thread>
 
 using namespace simple_sftpd;
 
@@ -62,3 +66,66 @@ TEST_F(FTPConnectionManagerTest, GetConnectionsEmpty) {
     EXPECT_TRUE(connections.empty());
 }
 
+
+TEST_F(FTPConnectionManagerTest, RemovedSlotsAreReusedWithoutConfusingHandles) {
+    int first_pair[2], second_pair[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, first_pair), 0);
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, second_pair), 0);
+    auto first = std::make_shared<FTPConnection>(first_pair[0], logger_, config_);
+    auto second = std::make_shared<FTPConnection>(second_pair[0], logger_, config_);
+
+    manager_->addConnection(first);
+    uint64_t stale = first->getRegistryHandle();
+    manager_->removeConnection(first);
+    EXPECT_EQ(manager_->getConnectionCount(), 0U);
+
+    manager_->addConnection(second);
+    EXPECT_EQ(static_cast<uint32_t>(second->getRegistryHandle()), static_cast<uint32_t>(stale));
+    EXPECT_NE(second->getRegistryHandle(), stale);
+
+    // A second removal of the old session must not evict its successor
+    manager_->removeConnection(first);
+    EXPECT_EQ(manager_->getConnectionCount(), 1U);
+    ASSERT_EQ(manager_->getConnections().size(), 1U);
+    EXPECT_EQ(manager_->getConnections()[0], second);
+
+    manager_->removeConnection(second);
+    EXPECT_EQ(manager_->getConnectionCount(), 0U);
+    close(first_pair[1]);
+    close(second_pair[1]);
+}
+
+TEST_F(FTPConnectionManagerTest, SessionsDeregisterAsTheyEnd) {
+    ASSERT_TRUE(manager_->start());
+    int pair[2];
+    ASSERT_EQ(socketpair(AF_UNIX, SOCK_STREAM, 0, pair), 0);
+    {
+        auto connection = std::make_shared<FTPConnection>(pair[0], logger_, config_);
+        manager_->addConnection(connection);
+        connection->start();
+    }
+    EXPECT_EQ(manager_->getConnectionCount(), 1U);
+
+    const char quit[] = "QUIT\r\n";
+    ASSERT_EQ(send(pair[1], quit, sizeof(quit) - 1, 0), static_cast<ssize_t>(sizeof(quit) - 1));
+    char buffer[256];
+    while (recv(pair[1], buffer, sizeof(buffer), 0) > 0) {
+        // drain until the session closes its end
+    }
+
+    // No waiting for the cleanup interval
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(2);
+    while (manager_->getConnectionCount() != 0 && std::chrono::steady_clock::now() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    EXPECT_EQ(manager_->getConnectionCount(), 0U);
+    EXPECT_TRUE(manager_->getConnections().empty());
+    close(pair[1]);
+}
+
+TEST_F(FTPConnectionManagerTest, StopDoesNotWaitForMaintenanceIntervals) {
+    ASSERT_TRUE(manager_->start());
+    auto started = std::chrono::steady_clock::now();
+    manager_->stop();
+    EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(1));
+}
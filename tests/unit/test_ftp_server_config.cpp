@@ -133,6 +133,68 @@ TEST_F(FTPServerConfigTest, LoadFromFileRateLimit) {
     EXPECT_EQ(config_->rate_limit.max_connections_per_ip, 5);
 }
 
+TEST_F(FTPServerConfigTest, LoadFromFileListenerShards) {
+    createTestConfig(
+        "[connection]\n"
+        "listener_shards = 8\n"
+    );
+
+    EXPECT_TRUE(config_->loadFromFile(test_config_file_));
+    EXPECT_EQ(config_->connection.listener_shards, 8);
+    EXPECT_TRUE(config_->validate());
+
+    config_->connection.listener_shards = -1;
+    EXPECT_FALSE(config_->validate());
+}
+
+TEST_F(FTPServerConfigTest, LoadFromFileAccessLists) {
+    createTestConfig(
+        "[security]\n"
+        "allowed_ips = 10.0.0.0/8, 192.168.1.7\n"
+        "blocked_ips = [\"10.0.0.66\"]\n"
+    );
+
+    EXPECT_TRUE(config_->loadFromFile(test_config_file_));
+    EXPECT_EQ(config_->security.allowed_ips, (std::vector<std::string>{"10.0.0.0/8", "192.168.1.7"}));
+    EXPECT_EQ(config_->security.blocked_ips, (std::vector<std::string>{"10.0.0.66"}));
+    EXPECT_TRUE(config_->validate());
+
+    config_->security.blocked_ips.push_back("10.0.0.0/33");
+    EXPECT_FALSE(config_->validate());
+}
+
+TEST_F(FTPServerConfigTest, LoadFromFileVirtualHosts) {
+    createTestConfig(
+        "[security]\n"
+        "ssl_cert_file = /etc/ssl/default.crt\n"
+        "ssl_key_file = /etc/ssl/default.key\n"
+        "ssl_cert_check_seconds = 30\n"
+        "\n"
+        "[virtual_host ftp.example.com]\n"
+        "ssl_cert_file = /etc/ssl/ftp.crt\n"
+        "ssl_key_file = /etc/ssl/ftp.key\n"
+        "\n"
+        "[virtual_host *.tenants.example]\n"
+        "ssl_cert_file = /etc/ssl/tenants.crt\n"
+        "ssl_key_file = /etc/ssl/tenants.key\n"
+    );
+
+    EXPECT_TRUE(config_->loadFromFile(test_config_file_));
+    EXPECT_EQ(config_->security.ssl_cert_check_seconds, 30);
+    ASSERT_EQ(config_->virtual_hosts.size(), 2u);
+    EXPECT_EQ(config_->virtual_hosts[0].hostname, "ftp.example.com");
+    EXPECT_EQ(config_->virtual_hosts[0].ssl_cert_file, "/etc/ssl/ftp.crt");
+    EXPECT_EQ(config_->virtual_hosts[1].hostname, "*.tenants.example");
+    EXPECT_EQ(config_->virtual_hosts[1].ssl_key_file, "/etc/ssl/tenants.key");
+    EXPECT_TRUE(config_->validate());
+
+    config_->virtual_hosts.push_back(VirtualHostConfig{"FTP.example.com", "/etc/ssl/a.crt", "/etc/ssl/a.key"});
+    EXPECT_FALSE(config_->validate());
+    config_->virtual_hosts.pop_back();
+    config_->virtual_hosts[1].ssl_key_file.clear();
+    EXPECT_FALSE(config_->validate());
+}
+
 TEST_F(FTPServerConfigTest, LoadFromFileWithComments) {
     createTestConfig(
         "# This is a comment\n"
@@ -0,0 +1,127 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/core/line_buffer.hpp"
+#include <cstring>
+#include <string>
+
+using namespace simple_sftpd;
+
+class LineBufferTest : public ::testing::Test {
+protected:
+    void feed(LineBuffer& buffer, const std::string& data) {
+        char* space = buffer.prepare(data.size());
+        std::memcpy(space, data.data(), data.size());
+        buffer.commit(data.size());
+    }
+
+    std::string next(LineBuffer& buffer) {
+        std::string_view line;
+        EXPECT_EQ(buffer.nextLine(line), LineBuffer::Status::LINE);
+        return std::string(line);
+    }
+};
+
+TEST_F(LineBufferTest, SplitsPipelinedCommands) {
+    LineBuffer buffer;
+    feed(buffer, "USER test\r\nPASS test\r\nPWD\n");
+
+    EXPECT_EQ(next(buffer), "USER test");
+    EXPECT_EQ(next(buffer), "PASS test");
+    EXPECT_EQ(next(buffer), "PWD");
+
+    std::string_view line;
+    EXPECT_EQ(buffer.nextLine(line), LineBuffer::Status::INCOMPLETE);
+    EXPECT_TRUE(buffer.empty());
+}
+
+TEST_F(LineBufferTest, KeepsPartialLineAcrossReads) {
+    LineBuffer buffer;
+    feed(buffer, "RETR file");
+
+    std::string_view line;
+    EXPECT_EQ(buffer.nextLine(line), LineBuffer::Status::INCOMPLETE);
+
+    feed(buffer, ".txt\r");
+    EXPECT_EQ(buffer.nextLine(line), LineBuffer::Status::INCOMPLETE);
+
+    feed(buffer, "\nNOOP\r\n");
+    EXPECT_EQ(next(buffer), "RETR file.txt");
+    EXPECT_EQ(next(buffer), "NOOP");
+}
+
+TEST_F(LineBufferTest, RejectsLineOverLimitOnce) {
+    LineBuffer buffer(16);
+    feed(buffer, std::string(40, 'x'));
+
+    std::string_view line;
+    EXPECT_EQ(buffer.nextLine(line), LineBuffer::Status::TOO_LONG);
+
+    // The rest of the long line is skipped; the next command is intact
+    feed(buffer, std::string(40, 'y') + "\r\nNOOP\r\n");
+    EXPECT_EQ(next(buffer), "NOOP");
+}
+
+TEST_F(LineBufferTest, RejectsCompleteLineOverLimit) {
+    LineBuffer buffer(16);
+    feed(buffer, std::string(17, 'x') + "\r\n" + std::string(16, 'z') + "\r\n");
+
+    std::string_view line;
+    EXPECT_EQ(buffer.nextLine(line), LineBuffer::Status::TOO_LONG);
+    EXPECT_EQ(next(buffer), std::string(16, 'z'));
+}
+
+TEST_F(LineBufferTest, ReleaseOnlyWhenEmpty) {
+    LineBuffer buffer;
+    feed(buffer, "NOOP\r\nSYST");
+    EXPECT_EQ(next(buffer), "NOOP");
+
+    buffer.release();
+    EXPECT_EQ(buffer.size(), 4U);
+
+    feed(buffer, "\r\n");
+    EXPECT_EQ(next(buffer), "SYST");
+    buffer.release();
+    EXPECT_TRUE(buffer.empty());
+}
+
+TEST_F(LineBufferTest, ReleaseKeepsSmallStorage) {
+    LineBuffer buffer;
+    buffer.append("NOOP\r\n", 6);
+    EXPECT_EQ(next(buffer), "NOOP");
+    buffer.release();
+    size_t kept = buffer.capacity();
+    EXPECT_GT(kept, 0U);
+    EXPECT_LE(kept, LineBuffer::RETAINED_CAPACITY);
+
+    // Commands that fit reuse the storage
+    buffer.append("PWD\r\n", 5);
+    EXPECT_EQ(next(buffer), "PWD");
+    EXPECT_EQ(buffer.capacity(), kept);
+
+    // A large pipelined burst gives its storage back
+    std::string burst;
+    for (int i = 0; i < 100; ++i) {
+        burst += "NOOP\r\n";
+    }
+    buffer.append(burst.data(), burst.size());
+    for (int i = 0; i < 100; ++i) {
+        EXPECT_EQ(next(buffer), "NOOP");
+    }
+    buffer.release();
+    EXPECT_EQ(buffer.capacity(), 0U);
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/core/listener_handoff.hpp"
+#include "simple-sftpd/utils/logger.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <unistd.h>
+#include <cstring>
+#include <thread>
+
+using namespace simple_sftpd;
+
+class ListenerHandoffTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        logger_ = std::make_shared<Logger>("", LogLevel::ERROR, false, false, LogFormat::STANDARD);
+        path_ = "/tmp/simple_sftpd_handoff_" + std::to_string(getpid()) + ".sock";
+    }
+
+    void TearDown() override {
+        unlink(path_.c_str());
+    }
+
+    // Loopback listener on an ephemeral port
+    static int openListener(int& port) {
+        int sock = socket(AF_INET, SOCK_STREAM, 0);
+        struct sockaddr_in addr;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (bind(sock, (struct sockaddr*)&addr, len) != 0 || listen(sock, 8) != 0 ||
+            getsockname(sock, (struct sockaddr*)&addr, &len) != 0) {
+            close(sock);
+            return -1;
+        }
+        port = ntohs(addr.sin_port);
+        return sock;
+    }
+
+    static bool waitReadable(int fd) {
+        struct pollfd pfd;
+        pfd.fd = fd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        return poll(&pfd, 1, 5000) > 0;
+    }
+
+    std::shared_ptr<Logger> logger_;
+    std::string path_;
+};
+
+TEST_F(ListenerHandoffTest, SuccessorReceivesWorkingListeners) {
+    int port = 0;
+    int original = openListener(port);
+    ASSERT_GE(original, 0);
+
+    ListenerHandoff old_side(logger_, path_);
+    ASSERT_TRUE(old_side.listen());
+    bool handed_off = false;
+    std::thread old_thread([&] {
+        if (waitReadable(old_side.getSocket())) {
+            handed_off = old_side.handOff({original}, std::chrono::seconds(5));
+        }
+    });
+
+    ListenerHandoff new_side(logger_, path_);
+    std::vector<int> received;
+    ASSERT_TRUE(new_side.fetch(received));
+    ASSERT_EQ(received.size(), 1u);
+    EXPECT_TRUE(new_side.acknowledge());
+    old_thread.join();
+    EXPECT_TRUE(handed_off);
+    EXPECT_LT(old_side.getSocket(), 0);
+
+    // The old process letting go does not close the port
+    close(original);
+    int client = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    ASSERT_EQ(connect(client, (struct sockaddr*)&addr, sizeof(addr)), 0);
+    int accepted = accept(received[0], nullptr, nullptr);
+    EXPECT_GE(accepted, 0);
+
+    close(accepted);
+    close(client);
+    close(received[0]);
+}
+
+TEST_F(ListenerHandoffTest, OldSideKeepsServingWithoutAcknowledgement) {
+    int port = 0;
+    int original = openListener(port);
+    ASSERT_GE(original, 0);
+
+    ListenerHandoff old_side(logger_, path_);
+    ASSERT_TRUE(old_side.listen());
+    bool handed_off = true;
+    std::thread old_thread([&] {
+        if (waitReadable(old_side.getSocket())) {
+            handed_off = old_side.handOff({original}, std::chrono::seconds(5));
+        }
+    });
+
+    {
+        // A successor that fails to start goes away without acknowledging
+        ListenerHandoff new_side(logger_, path_);
+        std::vector<int> received;
+        ASSERT_TRUE(new_side.fetch(received));
+        for (int fd : received) {
+            close(fd);
+        }
+    }
+    old_thread.join();
+    EXPECT_FALSE(handed_off);
+    EXPECT_GE(old_side.getSocket(), 0);  // a later upgrade can try again
+
+    close(original);
+}
+
+TEST_F(ListenerHandoffTest, FetchFailsWithoutRunningServer) {
+    ListenerHandoff new_side(logger_, path_);
+    std::vector<int> received;
+    EXPECT_FALSE(new_side.fetch(received));
+    EXPECT_TRUE(received.empty());
+    EXPECT_FALSE(new_side.acknowledge());
+}
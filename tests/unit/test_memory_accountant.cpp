@@ -0,0 +1,117 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/core/memory_accountant.hpp"
+#include <thread>
+
+using namespace simple_sftpd;
+
+using Category = MemoryAccountant::Category;
+
+TEST(MemoryAccountantTest, RefusesChargesPastTheGlobalBudget) {
+    auto accountant = std::make_shared<MemoryAccountant>(1000, 0);
+    auto alice = accountant->account("alice");
+    auto bob = accountant->account("bob");
+
+    EXPECT_TRUE(alice->charge(Category::TRANSFER, 600));
+    EXPECT_FALSE(bob->charge(Category::TRANSFER, 600));
+    EXPECT_EQ(bob->getUsage(), 0u);
+    EXPECT_TRUE(bob->charge(Category::LISTING, 400));
+    EXPECT_TRUE(bob->isExhausted());
+
+    MemoryAccountant::Stats stats = accountant->getStats();
+    EXPECT_EQ(stats.bytes_in_use, 1000u);
+    EXPECT_EQ(stats.transfer_bytes, 600u);
+    EXPECT_EQ(stats.listing_bytes, 400u);
+    EXPECT_EQ(stats.refused, 1u);
+
+    alice->release(Category::TRANSFER, 600);
+    EXPECT_TRUE(bob->charge(Category::TRANSFER, 600));
+}
+
+TEST(MemoryAccountantTest, UserBudgetsAreSeparate) {
+    auto accountant = std::make_shared<MemoryAccountant>(0, 1000);
+    auto alice = accountant->account("alice");
+
+    EXPECT_TRUE(alice->charge(Category::TRANSFER, 1000));
+    EXPECT_FALSE(alice->charge(Category::TRANSFER, 1));
+    EXPECT_TRUE(accountant->account("bob")->hasRoom(1000));
+
+    // Sessions of one user share the account
+    EXPECT_EQ(accountant->account("alice"), alice);
+    EXPECT_EQ(accountant->getUserUsage("alice"), 1000u);
+
+    // Not logged in yet: only the global budget applies
+    EXPECT_TRUE(accountant->account("")->charge(Category::CONTROL, 5000));
+}
+
+TEST(MemoryAccountantTest, ForcedChargesOvershootAndBlockGrowth) {
+    auto accountant = std::make_shared<MemoryAccountant>(1000, 0);
+    auto account = accountant->account("");
+
+    MemoryAccountant::Charge control(account, Category::CONTROL);
+    control.force(1500);
+    EXPECT_TRUE(account->isExhausted());
+    EXPECT_FALSE(accountant->hasRoom(1));
+
+    MemoryAccountant::Charge transfer(account, Category::TRANSFER);
+    EXPECT_FALSE(transfer.resize(100));
+    EXPECT_EQ(transfer.size(), 0u);
+
+    control.force(200);
+    EXPECT_TRUE(transfer.resize(800));
+    EXPECT_FALSE(transfer.resize(900));
+    EXPECT_TRUE(transfer.resize(300));
+    EXPECT_EQ(accountant->getStats().bytes_in_use, 500u);
+}
+
+TEST(MemoryAccountantTest, ChargesReleaseWhenDestroyed) {
+    auto accountant = std::make_shared<MemoryAccountant>(1000, 0);
+    {
+        MemoryAccountant::Charge charge(accountant->account("alice"), Category::LISTING);
+        ASSERT_TRUE(charge.resize(700));
+        MemoryAccountant::Charge moved(std::move(charge));
+        EXPECT_EQ(accountant->getStats().bytes_in_use, 700u);
+        EXPECT_EQ(accountant->getStats().accounts, 1u);
+    }
+    MemoryAccountant::Stats stats = accountant->getStats();
+    EXPECT_EQ(stats.bytes_in_use, 0u);
+    EXPECT_EQ(stats.listing_bytes, 0u);
+    EXPECT_EQ(stats.accounts, 0u);
+
+    // Without an account nothing is counted or refused
+    MemoryAccountant::Charge unaccounted;
+    EXPECT_TRUE(unaccounted.resize(1u << 30));
+}
+
+TEST(MemoryAccountantTest, WaitersWakeWhenMemoryIsReleased) {
+    auto accountant = std::make_shared<MemoryAccountant>(1000, 0);
+    auto account = accountant->account("alice");
+    ASSERT_TRUE(account->charge(Category::TRANSFER, 1000));
+
+    EXPECT_FALSE(account->waitForRoom(std::chrono::milliseconds(20)));
+
+    std::thread releaser([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        account->release(Category::TRANSFER, 500);
+    });
+    auto started = std::chrono::steady_clock::now();
+    EXPECT_TRUE(account->waitForRoom(std::chrono::seconds(10)));
+    EXPECT_LT(std::chrono::steady_clock::now() - started, std::chrono::seconds(5));
+    releaser.join();
+    EXPECT_EQ(accountant->getStats().pauses, 2u);
+}
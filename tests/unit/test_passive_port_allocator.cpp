@@ -0,0 +1,122 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/core/passive_port_allocator.hpp"
+#include "simple-sftpd/utils/logger.hpp"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <memory>
+#include <set>
+#include <vector>
+
+using namespace simple_sftpd;
+
+class PassivePortAllocatorTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        logger_ = std::make_shared<Logger>("", LogLevel::ERROR, false, false, LogFormat::STANDARD);
+    }
+
+    int boundPort(int socket) {
+        struct sockaddr_in addr;
+        socklen_t length = sizeof(addr);
+        getsockname(socket, reinterpret_cast<struct sockaddr*>(&addr), &length);
+        return ntohs(addr.sin_port);
+    }
+
+    std::shared_ptr<Logger> logger_;
+};
+
+// Ranges sit below the kernel's ephemeral ports so that client sockets
+// opened by other tests never occupy them
+TEST_F(PassivePortAllocatorTest, LeasesEveryPortOnceThenReportsExhaustion) {
+    PassivePortAllocator allocator(logger_, 31100, 31109);
+    std::set<int> ports;
+    std::vector<std::pair<int, int>> leases;
+
+    for (int i = 0; i < 10; ++i) {
+        int port = -1;
+        int sock = allocator.acquire(port);
+        ASSERT_GE(sock, 0);
+        EXPECT_GE(port, 31100);
+        EXPECT_LE(port, 31109);
+        EXPECT_EQ(boundPort(sock), port);
+        ports.insert(port);
+        leases.emplace_back(port, sock);
+    }
+    EXPECT_EQ(ports.size(), 10u);
+    EXPECT_EQ(allocator.getPortsInUse(), 10u);
+
+    int port = -1;
+    EXPECT_LT(allocator.acquire(port), 0);
+    EXPECT_EQ(allocator.getExhaustedCount(), 1u);
+
+    allocator.release(leases[3].first, leases[3].second);
+    EXPECT_EQ(allocator.getPortsInUse(), 9u);
+    int sock = allocator.acquire(port);
+    ASSERT_GE(sock, 0);
+    EXPECT_EQ(port, leases[3].first);
+    leases[3].second = sock;
+
+    for (const auto& lease : leases) {
+        allocator.release(lease.first, lease.second);
+    }
+    EXPECT_EQ(allocator.getPortsInUse(), 0u);
+}
+
+TEST_F(PassivePortAllocatorTest, HandsOutPreBoundSocketsAndRefillsOnRelease) {
+    PassivePortAllocator allocator(logger_, 31110, 31139, 4);
+    allocator.start();
+    EXPECT_EQ(allocator.getPooledCount(), 4u);
+    EXPECT_EQ(allocator.getPortsInUse(), 4u);
+
+    int port = -1;
+    int sock = allocator.acquire(port);
+    ASSERT_GE(sock, 0);
+    EXPECT_EQ(allocator.getPoolHits(), 1u);
+    EXPECT_EQ(allocator.getPooledCount(), 3u);
+    EXPECT_EQ(boundPort(sock), port);
+
+    allocator.release(port, sock);
+    EXPECT_EQ(allocator.getPooledCount(), 4u);
+
+    allocator.stop();
+    EXPECT_EQ(allocator.getPooledCount(), 0u);
+    EXPECT_EQ(allocator.getPortsInUse(), 0u);
+}
+
+TEST_F(PassivePortAllocatorTest, SkipsPortsHeldOutsideTheServer) {
+    int holder = socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_GE(holder, 0);
+    struct sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(31140);
+    ASSERT_EQ(bind(holder, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)), 0);
+    ASSERT_EQ(listen(holder, 1), 0);
+
+    PassivePortAllocator allocator(logger_, 31140, 31141);
+    int port = -1;
+    for (int i = 0; i < 4; ++i) {
+        int sock = allocator.acquire(port);
+        ASSERT_GE(sock, 0);
+        EXPECT_EQ(port, 31141);
+        allocator.release(port, sock);
+    }
+    close(holder);
+}
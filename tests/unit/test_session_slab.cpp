@@ -0,0 +1,114 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/core/session_slab.hpp"
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace simple_sftpd;
+
+namespace {
+
+struct Session {
+    explicit Session(int value) : value(value) {}
+    int value;
+    char payload[200];
+};
+
+} // namespace
+
+TEST(SessionSlabTest, ReusesFreedBlocks) {
+    auto slab = std::make_shared<SessionSlab>();
+    void* first = nullptr;
+    {
+        auto session = std::allocate_shared<Session>(SlabAllocator<Session>(slab), 1);
+        first = session.get();
+        EXPECT_EQ(slab->getInUse(), 1u);
+        EXPECT_EQ(slab->getCapacity(), SessionSlab::BLOCKS_PER_SLAB);
+    }
+    EXPECT_EQ(slab->getInUse(), 0u);
+
+    // The next session lands in the block the last one left
+    auto next = std::allocate_shared<Session>(SlabAllocator<Session>(slab), 2);
+    EXPECT_EQ(static_cast<void*>(next.get()), first);
+    EXPECT_EQ(next->value, 2);
+    EXPECT_EQ(slab->getCapacity(), SessionSlab::BLOCKS_PER_SLAB);
+}
+
+TEST(SessionSlabTest, GrowsBySlabAndKeepsBlocksDistinct) {
+    auto slab = std::make_shared<SessionSlab>();
+    std::vector<std::shared_ptr<Session>> sessions;
+    std::set<Session*> seen;
+    const size_t count = SessionSlab::BLOCKS_PER_SLAB * 2 + 1;
+    for (size_t i = 0; i < count; ++i) {
+        sessions.push_back(std::allocate_shared<Session>(SlabAllocator<Session>(slab), static_cast<int>(i)));
+        EXPECT_EQ(reinterpret_cast<uintptr_t>(sessions.back().get()) % alignof(std::max_align_t), 0u);
+        seen.insert(sessions.back().get());
+    }
+    EXPECT_EQ(seen.size(), count);
+    EXPECT_EQ(slab->getCapacity(), SessionSlab::BLOCKS_PER_SLAB * 3);
+    for (size_t i = 0; i < count; ++i) {
+        EXPECT_EQ(sessions[i]->value, static_cast<int>(i));
+    }
+}
+
+TEST(SessionSlabTest, OtherSizesBypassTheSlab) {
+    auto slab = std::make_shared<SessionSlab>();
+    auto session = std::allocate_shared<Session>(SlabAllocator<Session>(slab), 1);
+    auto other = std::allocate_shared<int>(SlabAllocator<int>(slab), 7);
+    EXPECT_EQ(*other, 7);
+    EXPECT_EQ(slab->getInUse(), 1u);
+    other.reset();
+    EXPECT_EQ(slab->getInUse(), 1u);
+}
+
+TEST(SessionSlabTest, OutlivesTheServerThatCreatedIt) {
+    auto slab = std::make_shared<SessionSlab>();
+    auto session = std::allocate_shared<Session>(SlabAllocator<Session>(slab), 1);
+    std::weak_ptr<SessionSlab> watch = slab;
+    slab.reset();
+
+    // A session still running after shutdown keeps its slab alive
+    EXPECT_FALSE(watch.expired());
+    session.reset();
+    EXPECT_TRUE(watch.expired());
+}
+
+TEST(SessionSlabTest, ConcurrentCreateAndDestroy) {
+    auto slab = std::make_shared<SessionSlab>();
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([slab, t] {
+            std::vector<std::shared_ptr<Session>> held;
+            for (int i = 0; i < 2000; ++i) {
+                held.push_back(std::allocate_shared<Session>(SlabAllocator<Session>(slab), t));
+                if (held.size() > 16) {
+                    held.erase(held.begin());
+                }
+            }
+            for (const auto& session : held) {
+                EXPECT_EQ(session->value, t);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(slab->getInUse(), 0u);
+    EXPECT_LE(slab->getCapacity(), SessionSlab::BLOCKS_PER_SLAB * 2);
+}
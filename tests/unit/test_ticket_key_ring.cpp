@@ -0,0 +1,96 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/security/ticket_key_ring.hpp"
+#include <sys/mman.h>
+#include <unistd.h>
+#include <cstring>
+#include <thread>
+
+using namespace simple_sftpd;
+
+namespace {
+
+bool sameKey(const TicketKeyRing::Key& a, const TicketKeyRing::Key& b) {
+    return std::memcmp(&a, &b, sizeof(TicketKeyRing::Key)) == 0;
+}
+
+} // namespace
+
+TEST(TicketKeyRingTest, RetiredKeysStillDecrypt) {
+    TicketKeyRing ring(nullptr, "", std::chrono::seconds(0));
+    TicketKeyRing::Key first = ring.encryptionKey();
+    EXPECT_TRUE(sameKey(ring.encryptionKey(), first));
+
+    ring.rotate();
+    TicketKeyRing::Key second = ring.encryptionKey();
+    EXPECT_FALSE(sameKey(second, first));
+
+    TicketKeyRing::Key found;
+    bool current = true;
+    ASSERT_TRUE(ring.find(first.name, found, current));
+    EXPECT_TRUE(sameKey(found, first));
+    EXPECT_FALSE(current);
+    ASSERT_TRUE(ring.find(second.name, found, current));
+    EXPECT_TRUE(current);
+
+    // Past SLOTS rotations the first key is gone
+    for (size_t i = 1; i < TicketKeyRing::SLOTS; ++i) {
+        ring.rotate();
+    }
+    EXPECT_FALSE(ring.find(first.name, found, current));
+
+    TicketKeyRing::Stats stats = ring.getStats();
+    EXPECT_EQ(stats.rotations, TicketKeyRing::SLOTS);
+    EXPECT_EQ(stats.hits, 2u);
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_FALSE(stats.shared);
+}
+
+TEST(TicketKeyRingTest, RotatesOnceTheIntervalPasses) {
+    TicketKeyRing ring(nullptr, "", std::chrono::seconds(3600));
+    TicketKeyRing::Key first = ring.encryptionKey();
+    EXPECT_TRUE(sameKey(ring.encryptionKey(), first));
+
+    ring.setRotationInterval(std::chrono::seconds(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(1100));
+    EXPECT_FALSE(sameKey(ring.encryptionKey(), first));
+    EXPECT_EQ(ring.getStats().rotations, 1u);
+}
+
+TEST(TicketKeyRingTest, NamedRingsShareKeys) {
+    std::string name = "/simple-sftpd-test-" + std::to_string(getpid());
+    shm_unlink(name.c_str());
+    {
+        TicketKeyRing first(nullptr, name, std::chrono::seconds(0));
+        TicketKeyRing second(nullptr, name, std::chrono::seconds(0));
+        EXPECT_TRUE(first.getStats().shared);
+        EXPECT_TRUE(sameKey(first.encryptionKey(), second.encryptionKey()));
+
+        // A rotation by one is seen by the other
+        first.rotate();
+        TicketKeyRing::Key key = second.encryptionKey();
+        EXPECT_TRUE(sameKey(key, first.encryptionKey()));
+        EXPECT_EQ(second.getStats().rotations, 1u);
+    }
+    {
+        // The segment outlives the rings that used it
+        TicketKeyRing later(nullptr, name, std::chrono::seconds(0));
+        EXPECT_EQ(later.getStats().rotations, 1u);
+    }
+    shm_unlink(name.c_str());
+}
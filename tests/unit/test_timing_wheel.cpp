@@ -0,0 +1,155 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/core/timing_wheel.hpp"
+#include <random>
+#include <vector>
+
+using namespace simple_sftpd;
+using std::chrono::hours;
+using std::chrono::milliseconds;
+using std::chrono::seconds;
+
+class TimingWheelTest : public ::testing::Test {
+protected:
+    TimingWheel::Clock::time_point at(TimingWheel::Clock::duration offset) const { return start_ + offset; }
+
+    const TimingWheel::Clock::time_point start_ = TimingWheel::Clock::now();
+};
+
+TEST_F(TimingWheelTest, FiresInDeadlineOrderAcrossLevels) {
+    TimingWheel wheel(milliseconds(10), start_);
+    std::vector<int> fired;
+    // Deadlines that land in every level, plus one past the top level's reach
+    wheel.schedule(at(hours(100)), [&] { fired.push_back(6); });
+    wheel.schedule(at(seconds(50)), [&] { fired.push_back(4); });
+    wheel.schedule(at(milliseconds(5)), [&] { fired.push_back(1); });
+    wheel.schedule(at(hours(3)), [&] { fired.push_back(5); });
+    wheel.schedule(at(milliseconds(700)), [&] { fired.push_back(2); });
+    wheel.schedule(at(milliseconds(701)), [&] { fired.push_back(3); });
+    EXPECT_EQ(wheel.size(), 6u);
+
+    EXPECT_EQ(wheel.advance(at(milliseconds(9))), 0u);
+    EXPECT_EQ(wheel.advance(at(milliseconds(10))), 1u);
+    EXPECT_EQ(wheel.advance(at(milliseconds(699))), 0u);
+    EXPECT_EQ(wheel.advance(at(milliseconds(700))), 1u);
+    EXPECT_EQ(wheel.advance(at(milliseconds(710))), 1u);
+    EXPECT_EQ(wheel.advance(at(seconds(49))), 0u);
+    EXPECT_EQ(wheel.advance(at(seconds(50))), 1u);
+    EXPECT_EQ(wheel.advance(at(hours(3) - milliseconds(10))), 0u);
+    EXPECT_EQ(wheel.advance(at(hours(3))), 1u);
+    EXPECT_EQ(wheel.advance(at(hours(99))), 0u);
+    EXPECT_EQ(wheel.advance(at(hours(100))), 1u);
+
+    EXPECT_EQ(fired, (std::vector<int>{1, 2, 3, 4, 5, 6}));
+    EXPECT_TRUE(wheel.empty());
+    EXPECT_EQ(wheel.nextDeadline(), TimingWheel::Clock::time_point::max());
+}
+
+TEST_F(TimingWheelTest, RescheduleAndCancelAreHonoured) {
+    TimingWheel wheel(milliseconds(10), start_);
+    int idle_fired = 0;
+    int login_fired = 0;
+    TimingWheel::TimerId idle = wheel.schedule(at(seconds(1)), [&] { ++idle_fired; });
+    TimingWheel::TimerId login = wheel.schedule(at(seconds(2)), [&] { ++login_fired; });
+    EXPECT_NE(idle, 0u);
+
+    // Activity pushes the idle deadline out
+    EXPECT_TRUE(wheel.reschedule(idle, at(seconds(5))));
+    wheel.cancel(login);
+    EXPECT_GT(wheel.nextDeadline(), at(seconds(2)));
+    EXPECT_LE(wheel.nextDeadline(), at(seconds(5)));
+    EXPECT_EQ(wheel.advance(at(seconds(4))), 0u);
+    EXPECT_EQ(wheel.advance(at(seconds(5))), 1u);
+    EXPECT_EQ(idle_fired, 1);
+    EXPECT_EQ(login_fired, 0);
+
+    // Ids of fired or cancelled timers stay dead even once their node is reused
+    TimingWheel::TimerId reused = wheel.schedule(at(seconds(6)), [] {});
+    EXPECT_FALSE(wheel.reschedule(idle, at(seconds(7))));
+    EXPECT_FALSE(wheel.reschedule(login, at(seconds(7))));
+    wheel.cancel(idle);
+    EXPECT_EQ(wheel.size(), 1u);
+    wheel.cancel(reused);
+    EXPECT_TRUE(wheel.empty());
+}
+
+TEST_F(TimingWheelTest, CallbacksCanArmAndCancelTimers) {
+    TimingWheel wheel(milliseconds(10), start_);
+    std::vector<int> fired;
+    TimingWheel::TimerId victim = 0;
+    wheel.schedule(at(milliseconds(100)), [&] {
+        fired.push_back(1);
+        wheel.cancel(victim);
+        wheel.schedule(at(milliseconds(150)), [&] { fired.push_back(3); });
+    });
+    victim = wheel.schedule(at(milliseconds(120)), [&] { fired.push_back(2); });
+
+    EXPECT_EQ(wheel.advance(at(seconds(1))), 2u);
+    EXPECT_EQ(fired, (std::vector<int>{1, 3}));
+}
+
+TEST_F(TimingWheelTest, NextDeadlineBoundsTheWait) {
+    TimingWheel wheel(milliseconds(10), start_);
+    EXPECT_EQ(wheel.nextDeadline(), TimingWheel::Clock::time_point::max());
+
+    wheel.schedule(at(milliseconds(300)), [] {});
+    EXPECT_EQ(wheel.nextDeadline(), at(milliseconds(300)));
+
+    // Far timers report when their slot moves down, never later than the deadline
+    TimingWheel far(milliseconds(10), start_);
+    far.schedule(at(seconds(100)), [] {});
+    EXPECT_LE(far.nextDeadline(), at(seconds(100)));
+    EXPECT_GT(far.nextDeadline(), at(seconds(50)));
+}
+
+TEST_F(TimingWheelTest, HundredThousandTimersFireOnTime) {
+    const size_t count = 100000;
+    TimingWheel wheel(milliseconds(10), start_);
+    std::minstd_rand generator(42);
+    std::uniform_int_distribution<int> delay_ms(1, 20 * 60 * 1000);
+
+    std::vector<milliseconds> deadlines(count);
+    std::vector<TimingWheel::TimerId> ids(count);
+    std::vector<int64_t> fired_at(count, -1);
+    int64_t now_ms = 0;
+    for (size_t i = 0; i < count; ++i) {
+        deadlines[i] = milliseconds(delay_ms(generator));
+        ids[i] = wheel.schedule(at(deadlines[i]), [&fired_at, &now_ms, i] { fired_at[i] = now_ms; });
+    }
+    for (size_t i = 0; i < count; i += 2) {
+        wheel.cancel(ids[i]);
+    }
+    EXPECT_EQ(wheel.size(), count / 2);
+
+    // Irregular steps, like a loop woken by I/O as well as by timers
+    size_t fired = 0;
+    while (!wheel.empty()) {
+        now_ms += 1 + static_cast<int64_t>(generator() % 700);
+        fired += wheel.advance(at(milliseconds(now_ms)));
+    }
+    EXPECT_EQ(fired, count / 2);
+
+    for (size_t i = 0; i < count; ++i) {
+        if (i % 2 == 0) {
+            EXPECT_EQ(fired_at[i], -1);
+            continue;
+        }
+        ASSERT_GE(fired_at[i], deadlines[i].count()) << "timer " << i << " fired early";
+        ASSERT_LT(fired_at[i], deadlines[i].count() + 710) << "timer " << i << " fired late";
+    }
+}
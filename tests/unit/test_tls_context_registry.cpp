@@ -0,0 +1,58 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/security/tls_context_registry.hpp"
+#include "simple-sftpd/security/ssl_context.hpp"
+#include "simple-sftpd/utils/logger.hpp"
+
+using namespace simple_sftpd;
+
+namespace {
+
+std::shared_ptr<SSLContext> makeContext() {
+    return std::make_shared<SSLContext>(std::make_shared<Logger>("", LogLevel::ERROR, false, false));
+}
+
+} // namespace
+
+TEST(TlsContextRegistryTest, FindsExactNamesIgnoringCase) {
+    TlsContextRegistry registry;
+    auto tenant = makeContext();
+    auto other = makeContext();
+    registry.add("Tenant.Example", tenant);
+    registry.add("other.example", other);
+
+    EXPECT_EQ(registry.size(), 2u);
+    EXPECT_EQ(registry.find("tenant.example"), tenant);
+    EXPECT_EQ(registry.find("TENANT.EXAMPLE"), tenant);
+    EXPECT_EQ(registry.find("other.example"), other);
+    EXPECT_EQ(registry.find("unknown.example"), nullptr);
+    EXPECT_EQ(registry.find(""), nullptr);
+}
+
+TEST(TlsContextRegistryTest, WildcardsCoverOneLabel) {
+    TlsContextRegistry registry;
+    auto wildcard = makeContext();
+    auto exact = makeContext();
+    registry.add("*.example.com", wildcard);
+    registry.add("ftp.example.com", exact);
+
+    EXPECT_EQ(registry.find("ftp.example.com"), exact);
+    EXPECT_EQ(registry.find("files.example.com"), wildcard);
+    EXPECT_EQ(registry.find("a.b.example.com"), nullptr);
+    EXPECT_EQ(registry.find("example.com"), nullptr);
+}
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2024 SimpleDaemons
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include "simple-sftpd/security/tls_session_cache.hpp"
+#include <functional>
+#include <vector>
+
+using namespace simple_sftpd;
+
+namespace {
+
+// IDs that land in the same shard, so one shard's LRU order can be checked
+std::vector<std::string> sameShardIds(size_t count) {
+    std::vector<std::string> ids;
+    size_t shard = std::hash<std::string_view>()("id-0") % TlsSessionCache::SHARDS;
+    for (int i = 0; ids.size() < count; ++i) {
+        std::string id = "id-" + std::to_string(i);
+        if (std::hash<std::string_view>()(id) % TlsSessionCache::SHARDS == shard) {
+            ids.push_back(id);
+        }
+    }
+    return ids;
+}
+
+} // namespace
+
+TEST(TlsSessionCacheTest, StoresAndFindsSessions) {
+    TlsSessionCache cache(100, std::chrono::seconds(60));
+    cache.store("abc", "session-a");
+    cache.store("def", "session-d");
+    cache.store("abc", "session-a2");
+
+    std::string session;
+    EXPECT_TRUE(cache.lookup("abc", session));
+    EXPECT_EQ(session, "session-a2");
+    EXPECT_FALSE(cache.lookup("xyz", session));
+
+    cache.remove("def");
+    EXPECT_FALSE(cache.lookup("def", session));
+
+    TlsSessionCache::Stats stats = cache.getStats();
+    EXPECT_EQ(stats.hits, 1u);
+    EXPECT_EQ(stats.misses, 2u);
+    EXPECT_EQ(stats.stores, 3u);
+    EXPECT_EQ(stats.entries, 1u);
+}
+
+TEST(TlsSessionCacheTest, EvictsLeastRecentlyUsedPerShard) {
+    // Two sessions per shard
+    TlsSessionCache cache(2 * TlsSessionCache::SHARDS, std::chrono::seconds(60));
+    std::vector<std::string> ids = sameShardIds(3);
+    cache.store(ids[0], "0");
+    cache.store(ids[1], "1");
+
+    std::string session;
+    ASSERT_TRUE(cache.lookup(ids[0], session));
+    cache.store(ids[2], "2");
+
+    EXPECT_TRUE(cache.lookup(ids[0], session));
+    EXPECT_FALSE(cache.lookup(ids[1], session));
+    EXPECT_TRUE(cache.lookup(ids[2], session));
+    EXPECT_EQ(cache.getStats().evictions, 1u);
+}
+
+TEST(TlsSessionCacheTest, BoundsEntriesByCapacity) {
+    TlsSessionCache cache(64, std::chrono::seconds(60));
+    for (int i = 0; i < 1000; ++i) {
+        cache.store("session-" + std::to_string(i), "x");
+    }
+    TlsSessionCache::Stats stats = cache.getStats();
+    EXPECT_LE(stats.entries, 64u);
+    EXPECT_EQ(stats.entries + stats.evictions, 1000u);
+
+    cache.setLimits(0, std::chrono::seconds(60));
+    cache.store("late", "x");
+    std::string session;
+    EXPECT_FALSE(cache.lookup("late", session));
+}
+
+TEST(TlsSessionCacheTest, ExpiredSessionsMiss) {
+    TlsSessionCache cache(100, std::chrono::seconds(0));
+    cache.store("abc", "session");
+
+    std::string session;
+    EXPECT_FALSE(cache.lookup("abc", session));
+    TlsSessionCache::Stats stats = cache.getStats();
+    EXPECT_EQ(stats.misses, 1u);
+    EXPECT_EQ(stats.entries, 0u);
+}